@@ -0,0 +1,479 @@
+// Load generator for the server: several threads, each driving its share of the connections
+// from its own epoll loop, report throughput and latency percentiles per scenario.
+// Build with 'cmake --build build --target bench'; run ./build/loadgen --help for options.
+
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <array>
+#include <arpa/inet.h>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+
+namespace {
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 4221;
+    int threads = 4;
+    int connections = 64;       // Across all threads.
+    int seconds = 5;            // Per scenario.
+    int pipeline = 16;          // Requests in flight per connection in the pipeline scenario.
+    int file_mb = 8;            // Body size of the files scenario.
+    std::string scenario = "all";
+};
+
+/**
+ * @struct Scenario
+ * @brief What every connection sends over and over.
+ */
+struct Scenario {
+    std::string name;
+    std::string path;
+    bool keep_alive = true;     // Otherwise every request opens a new connection.
+    int depth = 1;              // Requests written before waiting for their responses.
+};
+
+/**
+ * @struct Results
+ * @brief One thread's tally; the report adds them up.
+ */
+struct Results {
+    uint64_t responses = 0;
+    uint64_t bytes = 0;         // Response bytes, head and body.
+    uint64_t errors = 0;        // Non-2xx, failed connects, dropped and unanswered requests.
+    Clock::time_point last;     // When the last response was complete.
+    LatencyHistogram latency;   // From writing a request (or connecting) to its last byte.
+};
+
+// One client connection's progress through its batch of requests.
+struct Client {
+    int fd = -1;
+    std::string out;            // Requests not yet written.
+    size_t out_sent = 0;
+    std::deque<Clock::time_point> started;  // Per request in flight, oldest first.
+    std::string head;           // Response head being received.
+    uint64_t body_left = 0;     // Body bytes of the current response still to come.
+    bool in_body = false;
+    bool closing = false;       // The server said 'Connection: close'.
+    unsigned generation = 0;    // Bumped by every reconnect; the fd number may well be reused.
+};
+
+bool parseNumber(std::string_view text, int& value) {
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc() && end == text.data() + text.size() && value > 0;
+}
+
+bool containsIgnoreCase(std::string_view text, std::string_view needle) {
+    auto it = std::search(text.begin(), text.end(), needle.begin(), needle.end(),
+                          [](char a, char b) { return std::tolower(a) == std::tolower(b); });
+    return it != text.end();
+}
+
+// Value of a header in a response head, found case-insensitively; empty if absent.
+std::string_view headerValue(std::string_view head, std::string_view name) {
+    size_t pos = 0;
+    while ((pos = head.find("\r\n", pos)) != std::string_view::npos) {
+        pos += 2;
+        std::string_view line = head.substr(pos, head.find("\r\n", pos) - pos);
+        if (line.size() > name.size() && line[name.size()] == ':' &&
+            containsIgnoreCase(line.substr(0, name.size()), name)) {
+            std::string_view value = line.substr(name.size() + 1);
+            while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+            return value;
+        }
+    }
+    return {};
+}
+
+sockaddr_in serverAddress(const Options& options) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.host.c_str(), &address.sin_addr) != 1) {
+        std::cerr << "Invalid IPv4 address '" << options.host << "'\n";
+        exit(1);
+    }
+    return address;
+}
+
+/**
+ * @class Worker
+ * @brief Drives a set of connections on one thread until the scenario's time is up.
+ */
+class Worker {
+public:
+    Worker(const Options& options, const Scenario& scenario, int connections)
+        : scenario(scenario), address(serverAddress(options)), clients(connections) {
+        request = "GET " + scenario.path + " HTTP/1.1\r\nHost: " + options.host + "\r\n";
+        request += scenario.keep_alive ? "\r\n" : "Connection: close\r\n\r\n";
+    }
+
+    void run(Clock::time_point until) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        for (Client& client : clients) open(client);
+
+        std::vector<char> buffer(256 * 1024);
+        epoll_event events[64];
+        // Requests still in flight at the deadline get a moment to finish.
+        Clock::time_point hard_stop = until + std::chrono::seconds(2);
+        while (true) {
+            Clock::time_point now = Clock::now();
+            if (now >= until) {
+                stopping = true;
+                if (inFlight() == 0) break;
+                if (now >= hard_stop) {
+                    results.errors += inFlight();
+                    break;
+                }
+            }
+            int n = epoll_wait(epoll_fd, events, 64, 50);
+            for (int i = 0; i < n; ++i) {
+                Client& client = clients[events[i].data.u32];
+                if (client.fd < 0) continue;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) receive(client, buffer);
+                if (client.fd >= 0 && (events[i].events & EPOLLOUT)) send(client);
+            }
+        }
+        for (Client& client : clients) {
+            if (client.fd >= 0) close(client.fd);
+        }
+        close(epoll_fd);
+    }
+
+    Results results;
+
+private:
+    const Scenario& scenario;
+    sockaddr_in address;
+    std::string request;
+    std::vector<Client> clients;
+    int epoll_fd = -1;
+    bool stopping = false;
+
+    size_t inFlight() const {
+        size_t total = 0;
+        for (const Client& client : clients) total += client.started.size();
+        return total;
+    }
+
+    // Connects (without waiting) and queues the client's first batch.
+    void open(Client& client) {
+        client.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        setsockopt(client.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        Clock::time_point now = Clock::now();
+        if (connect(client.fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 &&
+            errno != EINPROGRESS) {
+            ++results.errors;
+            close(client.fd);
+            client.fd = -1;
+            return;
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        ev.data.u32 = &client - clients.data();
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client.fd, &ev);
+        client.head.clear();
+        client.in_body = false;
+        client.closing = false;
+        // A new connection per request: its latency includes the handshake.
+        queueBatch(client, scenario.keep_alive ? std::nullopt : std::optional(now));
+    }
+
+    void reopen(Client& client) {
+        ++client.generation;
+        close(client.fd);
+        client.fd = -1;
+        client.started.clear();
+        client.out.clear();
+        client.out_sent = 0;
+        if (!stopping) open(client);
+    }
+
+    void queueBatch(Client& client, std::optional<Clock::time_point> since = std::nullopt) {
+        if (stopping) return;
+        Clock::time_point now = since.value_or(Clock::now());
+        for (int i = 0; i < scenario.depth; ++i) {
+            client.out += request;
+            client.started.push_back(now);
+        }
+        send(client);
+    }
+
+    void send(Client& client) {
+        while (client.out_sent < client.out.size()) {
+            ssize_t n = ::send(client.fd, client.out.data() + client.out_sent,
+                               client.out.size() - client.out_sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            if (n <= 0) {
+                results.errors += client.started.size();
+                reopen(client);
+                return;
+            }
+            client.out_sent += n;
+        }
+        client.out.clear();
+        client.out_sent = 0;
+    }
+
+    void receive(Client& client, std::vector<char>& buffer) {
+        unsigned generation = client.generation;
+        while (client.generation == generation) {
+            ssize_t n = recv(client.fd, buffer.data(), buffer.size(), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            if (n <= 0) {
+                // The server hung up. Fine after 'Connection: close'; otherwise requests were lost.
+                if (!client.closing) results.errors += client.started.size();
+                reopen(client);
+                return;
+            }
+            results.bytes += n;
+            consume(client, std::string_view(buffer.data(), n));
+        }
+    }
+
+    void consume(Client& client, std::string_view data) {
+        unsigned generation = client.generation;
+        // Whatever follows a response that made us reconnect belonged to the old connection.
+        while (!data.empty() && client.generation == generation) {
+            if (client.in_body) {
+                size_t take = std::min<uint64_t>(client.body_left, data.size());
+                client.body_left -= take;
+                data.remove_prefix(take);
+                if (client.body_left == 0) finishResponse(client);
+                continue;
+            }
+            size_t old_size = client.head.size();
+            client.head.append(data);
+            size_t end = client.head.find("\r\n\r\n", old_size >= 3 ? old_size - 3 : 0);
+            if (end == std::string::npos) return;
+            end += 4;
+            data.remove_prefix(end - old_size);
+            client.head.resize(end);
+            startBody(client);
+        }
+    }
+
+    void startBody(Client& client) {
+        std::string_view head = client.head;
+        int status = 0;
+        if (head.size() > 12) std::from_chars(head.data() + 9, head.data() + 12, status);
+        if (status < 200 || status >= 300) ++results.errors;
+        std::string_view length = headerValue(head, "content-length");
+        client.body_left = 0;
+        std::from_chars(length.data(), length.data() + length.size(), client.body_left);
+        client.closing = containsIgnoreCase(headerValue(head, "connection"), "close");
+        client.head.clear();
+        client.in_body = true;
+        if (client.body_left == 0) finishResponse(client);
+    }
+
+    void finishResponse(Client& client) {
+        client.in_body = false;
+        if (client.started.empty()) return;     // An unsolicited response, e.g. a 408.
+        results.last = Clock::now();
+        results.latency.record(results.last - client.started.front());
+        client.started.pop_front();
+        ++results.responses;
+        if (client.closing) {
+            // Pipelined requests behind this one will not be answered; start over.
+            client.started.clear();
+            reopen(client);
+        } else if (client.started.empty()) {
+            queueBatch(client);
+        }
+    }
+};
+
+// Blocking request used to set up a scenario; returns the response's status.
+int sendOnce(const Options& options, const std::string& request) {
+    sockaddr_in address = serverAddress(options);
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+        close(fd);
+        return 0;
+    }
+    std::string_view rest = request;
+    while (!rest.empty()) {
+        ssize_t n = ::send(fd, rest.data(), rest.size(), MSG_NOSIGNAL);
+        if (n <= 0) break;
+        rest.remove_prefix(n);
+    }
+    char reply[512];
+    ssize_t n = recv(fd, reply, sizeof(reply), 0);
+    close(fd);
+    int status = 0;
+    if (n > 12) std::from_chars(reply + 9, reply + 12, status);
+    return status;
+}
+
+double quantileUs(const std::array<uint64_t, LatencyHistogram::BUCKETS>& buckets, uint64_t count,
+                  double q) {
+    if (count == 0) return 0;
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * count + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            uint64_t low = LatencyHistogram::lowerBound(i);
+            uint64_t high = LatencyHistogram::lowerBound(i + 1);
+            return (low + (high - low) / 2.0) / 1e3;
+        }
+    }
+    return LatencyHistogram::lowerBound(LatencyHistogram::BUCKETS) / 1e3;
+}
+
+void runScenario(const Options& options, const Scenario& scenario) {
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int i = 0; i < options.threads; ++i) {
+        // Spread the connections as evenly as they go.
+        int share = options.connections / options.threads + (i < options.connections % options.threads);
+        if (share > 0) workers.push_back(std::make_unique<Worker>(options, scenario, share));
+    }
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point until = start + std::chrono::seconds(options.seconds);
+    std::vector<std::thread> threads;
+    for (auto& worker : workers) threads.emplace_back([&worker, until] { worker->run(until); });
+    for (auto& thread : threads) thread.join();
+
+    // Up to the last response, not the end of the grace period given to stragglers.
+    Clock::time_point last = start;
+    uint64_t responses = 0, bytes = 0, errors = 0;
+    std::array<uint64_t, LatencyHistogram::BUCKETS> buckets{};
+    for (const auto& worker : workers) {
+        responses += worker->results.responses;
+        bytes += worker->results.bytes;
+        errors += worker->results.errors;
+        last = std::max(last, worker->results.last);
+        for (size_t i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+            buckets[i] += worker->results.latency.buckets[i].get();
+        }
+    }
+
+    double elapsed = std::max(std::chrono::duration<double>(last - start).count(), 1e-9);
+    std::printf("%-10s %10llu %12.0f %10.1f %10.1f %10.1f %10.1f %8llu\n", scenario.name.c_str(),
+                static_cast<unsigned long long>(responses), responses / elapsed,
+                bytes / elapsed / (1 << 20), quantileUs(buckets, responses, 0.5),
+                quantileUs(buckets, responses, 0.99), quantileUs(buckets, responses, 0.999),
+                static_cast<unsigned long long>(errors));
+    std::fflush(stdout);
+}
+
+void usage() {
+    std::cout <<
+        "Usage: loadgen [options]\n"
+        "  --host <ipv4>          server address (default 127.0.0.1)\n"
+        "  --port <n>             server port (default 4221)\n"
+        "  --threads <n>          client threads, one epoll loop each (default 4)\n"
+        "  --connections <n>      connections across all threads (default 64)\n"
+        "  --duration <s>         seconds per scenario (default 5)\n"
+        "  --pipeline <n>         requests in flight per connection when pipelining (default 16)\n"
+        "  --file-mb <n>          body size for the files scenario (default 8)\n"
+        "  --scenario <name>      keepalive, close, pipeline, files or all (default all)\n"
+        "\n"
+        "The files scenario first uploads its file with POST /files/, so the server's\n"
+        "--directory must be writable. Latencies are from writing a request (or, without\n"
+        "keep-alive, from connecting) until its response has been read completely.\n";
+}
+
+}
+
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            usage();
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return 1;
+        }
+        std::string_view value = argv[++i];
+        bool ok = true;
+        if (arg == "--host") {
+            options.host = value;
+        } else if (arg == "--scenario") {
+            options.scenario = value;
+        } else if (arg == "--port") {
+            ok = parseNumber(value, options.port);
+        } else if (arg == "--threads") {
+            ok = parseNumber(value, options.threads);
+        } else if (arg == "--connections") {
+            ok = parseNumber(value, options.connections);
+        } else if (arg == "--duration") {
+            ok = parseNumber(value, options.seconds);
+        } else if (arg == "--pipeline") {
+            ok = parseNumber(value, options.pipeline);
+        } else if (arg == "--file-mb") {
+            ok = parseNumber(value, options.file_mb);
+        } else {
+            std::cerr << "Unknown option " << arg << " (see --help)\n";
+            return 1;
+        }
+        if (!ok) {
+            std::cerr << arg << " expects a positive integer, got '" << value << "'\n";
+            return 1;
+        }
+    }
+
+    std::string file_name = "loadgen-" + std::to_string(options.file_mb) + "mb.bin";
+    std::vector<Scenario> scenarios = {
+        {"keepalive", "/echo/loadgen", true, 1},
+        {"close", "/echo/loadgen", false, 1},
+        {"pipeline", "/echo/loadgen", true, options.pipeline},
+        {"files", "/files/" + file_name, true, 1},
+    };
+
+    std::printf("%-10s %10s %12s %10s %10s %10s %10s %8s\n", "scenario", "responses", "req/s",
+                "MB/s", "p50 us", "p99 us", "p99.9 us", "errors");
+    bool matched = false;
+    for (const Scenario& scenario : scenarios) {
+        if (options.scenario != "all" && options.scenario != scenario.name) continue;
+        matched = true;
+        if (scenario.name == "files") {
+            std::string body(static_cast<size_t>(options.file_mb) << 20, '\0');
+            for (size_t i = 0; i < body.size(); ++i) body[i] = static_cast<char>(i * 131 + (i >> 12));
+            std::string upload = "POST /files/" + file_name + " HTTP/1.1\r\nHost: " + options.host +
+                                 "\r\nContent-Length: " + std::to_string(body.size()) +
+                                 "\r\nConnection: close\r\n\r\n" + body;
+            int status = sendOnce(options, upload);
+            if (status != 201) {
+                std::cerr << "Uploading " << file_name << " failed (status " << status << ")\n";
+                return 1;
+            }
+        }
+        runScenario(options, scenario);
+    }
+    if (!matched) {
+        std::cerr << "Unknown scenario '" << options.scenario << "' (see --help)\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,260 @@
+// Microbenchmarks of the per-request hot path: parsing, formatting responses and routing.
+// Build with 'cmake --build build --target bench' and run ./build/microbench.
+
+#include "http-server.hpp"
+#include "request-parser.hpp"
+#include "simd-scan.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <random>
+#include <string>
+
+
+namespace {
+
+constexpr std::string_view SMALL_REQUEST =
+    "GET /echo/hello HTTP/1.1\r\n"
+    "Host: localhost:4221\r\n"
+    "\r\n";
+
+// What a browser sends: a dozen headers, about 500 bytes.
+constexpr std::string_view BROWSER_REQUEST =
+    "GET /files/index.html HTTP/1.1\r\n"
+    "Host: localhost:4221\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Connection: keep-alive\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Priority: u=0, i\r\n"
+    "If-None-Match: \"1f2a-400-17a29c\"\r\n"
+    "\r\n";
+
+constexpr std::string_view POST_REQUEST =
+    "POST /files/upload.txt HTTP/1.1\r\n"
+    "Host: localhost:4221\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Content-Length: 32\r\n"
+    "\r\n"
+    "0123456789abcdef0123456789abcdef";
+
+// The parser lowercases header names in place, so every iteration parses a fresh copy.
+void parseRequest(benchmark::State& state, std::string_view text) {
+    std::string buffer(text);
+    std::string pristine(text);
+    RequestParser parser;
+    HttpRequest request;
+    for (auto _ : state) {
+        std::copy(pristine.begin(), pristine.end(), buffer.begin());
+        RequestParser::Result result = parser.parse(buffer.data(), buffer.size(), request);
+        benchmark::DoNotOptimize(result);
+        benchmark::DoNotOptimize(request);
+        parser.reset();
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+
+void BM_ParseSmall(benchmark::State& state) { parseRequest(state, SMALL_REQUEST); }
+void BM_ParseBrowser(benchmark::State& state) { parseRequest(state, BROWSER_REQUEST); }
+void BM_ParsePost(benchmark::State& state) { parseRequest(state, POST_REQUEST); }
+
+// A request split over several reads resumes where the previous parse() stopped.
+void BM_ParseSplit(benchmark::State& state) {
+    const size_t pieces = state.range(0);
+    std::string buffer(BROWSER_REQUEST);
+    std::string pristine(BROWSER_REQUEST);
+    RequestParser parser;
+    HttpRequest request;
+    for (auto _ : state) {
+        std::copy(pristine.begin(), pristine.end(), buffer.begin());
+        for (size_t i = 1; i <= pieces; ++i) {
+            size_t length = buffer.size() * i / pieces;
+            benchmark::DoNotOptimize(parser.parse(buffer.data(), length, request));
+        }
+        parser.reset();
+    }
+    state.SetBytesProcessed(state.iterations() * BROWSER_REQUEST.size());
+}
+
+void BM_SendResponse(benchmark::State& state) {
+    std::string body(state.range(0), 'x');
+    OutputQueue out;
+    for (auto _ : state) {
+        HttpResponse response(out);
+        response.keepAlive(15, 999);
+        response.sendResponse("200 OK", "text/plain", body);
+        out.clear();
+    }
+}
+
+void BM_SendStatus(benchmark::State& state) {
+    OutputQueue out;
+    for (auto _ : state) {
+        HttpResponse response(out);
+        response.sendStatus(404);
+        out.clear();
+    }
+}
+
+// Dispatch through the route table, plus the handler itself for the cheap routes.
+void handleRequest(benchmark::State& state, std::string_view text) {
+    ServerConfig config;
+    config.file_cache_bytes = 0;
+    RequestHandler handler(config);
+    std::string buffer(text);
+    RequestParser parser;
+    HttpRequest request;
+    if (parser.parse(buffer.data(), buffer.size(), request) != RequestParser::Result::Complete) {
+        state.SkipWithError("request did not parse");
+        return;
+    }
+    OutputQueue out;
+    for (auto _ : state) {
+        HttpResponse response(out);
+        Task<void> finished = handler.handle(request, response);
+        benchmark::DoNotOptimize(finished);
+        out.clear();
+    }
+}
+
+void BM_HandleRoot(benchmark::State& state) {
+    handleRequest(state, "GET / HTTP/1.1\r\n\r\n");
+}
+void BM_HandleEcho(benchmark::State& state) {
+    handleRequest(state, SMALL_REQUEST);
+}
+void BM_HandleUserAgent(benchmark::State& state) {
+    handleRequest(state, "GET /user-agent HTTP/1.1\r\nUser-Agent: bench/1.0\r\n\r\n");
+}
+void BM_HandleNotFound(benchmark::State& state) {
+    handleRequest(state, "GET /no/such/route HTTP/1.1\r\n\r\n");
+}
+
+// The scan kernels on a head with one long header, such as a cookie jar, where they dominate.
+std::string largeHead() {
+    std::string head = "GET / HTTP/1.1\r\nHost: localhost:4221\r\nCookie: ";
+    for (int i = 0; head.size() < 4000; ++i) head += "session" + std::to_string(i) + "=0123456789abcdef; ";
+    return head + "\r\nAccept: */*\r\n\r\n";
+}
+
+void BM_ScanHeaderEnd(benchmark::State& state, ScanKernel kernel) {
+    std::string head = state.range(0) ? largeHead() : std::string(BROWSER_REQUEST);
+    ScanKernel previous = activeScanKernel();
+    selectScanKernel(kernel);
+    for (auto _ : state) benchmark::DoNotOptimize(findHeaderEnd(head.data(), 0, head.size()));
+    selectScanKernel(previous);
+    state.SetBytesProcessed(state.iterations() * head.size());
+}
+
+void BM_ScanFindEither(benchmark::State& state, ScanKernel kernel) {
+    std::string head = largeHead();
+    ScanKernel previous = activeScanKernel();
+    selectScanKernel(kernel);
+    for (auto _ : state) {
+        // Walk the head line by line, as the header loop does.
+        const char* end = head.data() + head.size();
+        for (const char* p = head.data(); p < end; ++p) {
+            p = findEither(p, end, ':', '\n');
+            benchmark::DoNotOptimize(p);
+        }
+    }
+    selectScanKernel(previous);
+    state.SetBytesProcessed(state.iterations() * head.size());
+}
+
+void BM_ScanLowercase(benchmark::State& state, ScanKernel kernel) {
+    std::string name(state.range(0), 'X');
+    ScanKernel previous = activeScanKernel();
+    selectScanKernel(kernel);
+    for (auto _ : state) {
+        lowercaseInPlace(name.data(), name.size());
+        benchmark::DoNotOptimize(name.data());
+        name[0] = 'X';
+    }
+    selectScanKernel(previous);
+    state.SetBytesProcessed(state.iterations() * name.size());
+}
+
+void BM_ParseLargeHead(benchmark::State& state, ScanKernel kernel) {
+    ScanKernel previous = activeScanKernel();
+    selectScanKernel(kernel);
+    parseRequest(state, largeHead());
+    selectScanKernel(previous);
+}
+
+// Every kernel must agree with the scalar one. Random buffers drawn from a small alphabet put
+// delimiters at every offset and alignment, including across the vector-step boundaries.
+bool kernelsAgree(ScanKernel kernel) {
+    constexpr char ALPHABET[] = "\r\n:aZ \x80\xff@[`{";
+    std::mt19937 random(21);
+    for (int round = 0; round < 20000; ++round) {
+        std::string text(random() % 200, ' ');
+        for (char& c : text) c = ALPHABET[random() % (sizeof(ALPHABET) - 1)];
+        size_t from = text.empty() ? 0 : random() % (text.size() + 1);
+        const char* first = text.data() + from;
+        const char* end = text.data() + text.size();
+        std::string lowered = text;
+
+        selectScanKernel(ScanKernel::Scalar);
+        size_t header_end = findHeaderEnd(text.data(), from, text.size());
+        const char* either = findEither(first, end, ':', '\n');
+        lowercaseInPlace(lowered.data(), lowered.size());
+
+        selectScanKernel(kernel);
+        std::string check = text;
+        lowercaseInPlace(check.data(), check.size());
+        if (findHeaderEnd(text.data(), from, text.size()) != header_end ||
+            findEither(first, end, ':', '\n') != either || check != lowered) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void registerScanBenchmarks() {
+    ScanKernel best = bestScanKernel();
+    for (ScanKernel kernel : {ScanKernel::Scalar, ScanKernel::Sse42, ScanKernel::Avx2}) {
+        if (!selectScanKernel(kernel)) continue;
+        if (!kernelsAgree(kernel)) {
+            std::fprintf(stderr, "The %s scan kernel disagrees with the scalar one\n",
+                         scanKernelName(kernel).data());
+            exit(1);
+        }
+        std::string suffix = "/" + std::string(scanKernelName(kernel));
+        benchmark::RegisterBenchmark(("BM_ScanHeaderEnd" + suffix).c_str(), BM_ScanHeaderEnd, kernel)
+            ->ArgName("large")->Arg(0)->Arg(1);
+        benchmark::RegisterBenchmark(("BM_ScanFindEither" + suffix).c_str(), BM_ScanFindEither, kernel);
+        benchmark::RegisterBenchmark(("BM_ScanLowercase" + suffix).c_str(), BM_ScanLowercase, kernel)
+            ->Arg(16)->Arg(256);
+        benchmark::RegisterBenchmark(("BM_ParseLargeHead" + suffix).c_str(), BM_ParseLargeHead, kernel);
+    }
+    selectScanKernel(best);
+}
+
+}
+
+BENCHMARK(BM_ParseSmall);
+BENCHMARK(BM_ParseBrowser);
+BENCHMARK(BM_ParsePost);
+BENCHMARK(BM_ParseSplit)->Arg(2)->Arg(8);
+BENCHMARK(BM_SendResponse)->Arg(16)->Arg(4096);
+BENCHMARK(BM_SendStatus);
+BENCHMARK(BM_HandleRoot);
+BENCHMARK(BM_HandleEcho);
+BENCHMARK(BM_HandleUserAgent);
+BENCHMARK(BM_HandleNotFound);
+
+int main(int argc, char** argv) {
+    registerScanBenchmarks();
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+}
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/pack-bundle.dir/tools/pack-bundle.cpp.o"
+  "CMakeFiles/pack-bundle.dir/tools/pack-bundle.cpp.o.d"
+  "pack-bundle"
+  "pack-bundle.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/pack-bundle.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,46 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/access-log.cpp" "CMakeFiles/server-core.dir/src/access-log.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/access-log.cpp.o.d"
+  "/root/repo/src/admission.cpp" "CMakeFiles/server-core.dir/src/admission.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/admission.cpp.o.d"
+  "/root/repo/src/arena.cpp" "CMakeFiles/server-core.dir/src/arena.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/arena.cpp.o.d"
+  "/root/repo/src/async-io.cpp" "CMakeFiles/server-core.dir/src/async-io.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/async-io.cpp.o.d"
+  "/root/repo/src/buffer-pool.cpp" "CMakeFiles/server-core.dir/src/buffer-pool.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/buffer-pool.cpp.o.d"
+  "/root/repo/src/bundle.cpp" "CMakeFiles/server-core.dir/src/bundle.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/bundle.cpp.o.d"
+  "/root/repo/src/chunked.cpp" "CMakeFiles/server-core.dir/src/chunked.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/chunked.cpp.o.d"
+  "/root/repo/src/compression.cpp" "CMakeFiles/server-core.dir/src/compression.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/compression.cpp.o.d"
+  "/root/repo/src/conditional.cpp" "CMakeFiles/server-core.dir/src/conditional.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/conditional.cpp.o.d"
+  "/root/repo/src/event-loop.cpp" "CMakeFiles/server-core.dir/src/event-loop.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/event-loop.cpp.o.d"
+  "/root/repo/src/file-cache.cpp" "CMakeFiles/server-core.dir/src/file-cache.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/file-cache.cpp.o.d"
+  "/root/repo/src/file-reader.cpp" "CMakeFiles/server-core.dir/src/file-reader.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/file-reader.cpp.o.d"
+  "/root/repo/src/handoff.cpp" "CMakeFiles/server-core.dir/src/handoff.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/handoff.cpp.o.d"
+  "/root/repo/src/hpack.cpp" "CMakeFiles/server-core.dir/src/hpack.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/hpack.cpp.o.d"
+  "/root/repo/src/http-server.cpp" "CMakeFiles/server-core.dir/src/http-server.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/http-server.cpp.o.d"
+  "/root/repo/src/http2.cpp" "CMakeFiles/server-core.dir/src/http2.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/http2.cpp.o.d"
+  "/root/repo/src/metrics.cpp" "CMakeFiles/server-core.dir/src/metrics.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/metrics.cpp.o.d"
+  "/root/repo/src/output-queue.cpp" "CMakeFiles/server-core.dir/src/output-queue.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/output-queue.cpp.o.d"
+  "/root/repo/src/placement.cpp" "CMakeFiles/server-core.dir/src/placement.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/placement.cpp.o.d"
+  "/root/repo/src/read-buffer.cpp" "CMakeFiles/server-core.dir/src/read-buffer.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/read-buffer.cpp.o.d"
+  "/root/repo/src/request-body.cpp" "CMakeFiles/server-core.dir/src/request-body.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/request-body.cpp.o.d"
+  "/root/repo/src/request-parser.cpp" "CMakeFiles/server-core.dir/src/request-parser.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/request-parser.cpp.o.d"
+  "/root/repo/src/router.cpp" "CMakeFiles/server-core.dir/src/router.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/router.cpp.o.d"
+  "/root/repo/src/simd-scan.cpp" "CMakeFiles/server-core.dir/src/simd-scan.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/simd-scan.cpp.o.d"
+  "/root/repo/src/socket-options.cpp" "CMakeFiles/server-core.dir/src/socket-options.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/socket-options.cpp.o.d"
+  "/root/repo/src/thread-pool.cpp" "CMakeFiles/server-core.dir/src/thread-pool.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/thread-pool.cpp.o.d"
+  "/root/repo/src/timer-wheel.cpp" "CMakeFiles/server-core.dir/src/timer-wheel.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/timer-wheel.cpp.o.d"
+  "/root/repo/src/tls.cpp" "CMakeFiles/server-core.dir/src/tls.cpp.o" "gcc" "CMakeFiles/server-core.dir/src/tls.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
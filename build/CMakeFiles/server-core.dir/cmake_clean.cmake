@@ -0,0 +1,65 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/server-core.dir/src/access-log.cpp.o"
+  "CMakeFiles/server-core.dir/src/access-log.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/admission.cpp.o"
+  "CMakeFiles/server-core.dir/src/admission.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/arena.cpp.o"
+  "CMakeFiles/server-core.dir/src/arena.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/async-io.cpp.o"
+  "CMakeFiles/server-core.dir/src/async-io.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/buffer-pool.cpp.o"
+  "CMakeFiles/server-core.dir/src/buffer-pool.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/bundle.cpp.o"
+  "CMakeFiles/server-core.dir/src/bundle.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/chunked.cpp.o"
+  "CMakeFiles/server-core.dir/src/chunked.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/compression.cpp.o"
+  "CMakeFiles/server-core.dir/src/compression.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/conditional.cpp.o"
+  "CMakeFiles/server-core.dir/src/conditional.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/event-loop.cpp.o"
+  "CMakeFiles/server-core.dir/src/event-loop.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/file-cache.cpp.o"
+  "CMakeFiles/server-core.dir/src/file-cache.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/file-reader.cpp.o"
+  "CMakeFiles/server-core.dir/src/file-reader.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/handoff.cpp.o"
+  "CMakeFiles/server-core.dir/src/handoff.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/hpack.cpp.o"
+  "CMakeFiles/server-core.dir/src/hpack.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/http-server.cpp.o"
+  "CMakeFiles/server-core.dir/src/http-server.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/http2.cpp.o"
+  "CMakeFiles/server-core.dir/src/http2.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/metrics.cpp.o"
+  "CMakeFiles/server-core.dir/src/metrics.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/output-queue.cpp.o"
+  "CMakeFiles/server-core.dir/src/output-queue.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/placement.cpp.o"
+  "CMakeFiles/server-core.dir/src/placement.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/read-buffer.cpp.o"
+  "CMakeFiles/server-core.dir/src/read-buffer.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/request-body.cpp.o"
+  "CMakeFiles/server-core.dir/src/request-body.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/request-parser.cpp.o"
+  "CMakeFiles/server-core.dir/src/request-parser.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/router.cpp.o"
+  "CMakeFiles/server-core.dir/src/router.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/simd-scan.cpp.o"
+  "CMakeFiles/server-core.dir/src/simd-scan.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/socket-options.cpp.o"
+  "CMakeFiles/server-core.dir/src/socket-options.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/thread-pool.cpp.o"
+  "CMakeFiles/server-core.dir/src/thread-pool.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/timer-wheel.cpp.o"
+  "CMakeFiles/server-core.dir/src/timer-wheel.cpp.o.d"
+  "CMakeFiles/server-core.dir/src/tls.cpp.o"
+  "CMakeFiles/server-core.dir/src/tls.cpp.o.d"
+  "libserver-core.a"
+  "libserver-core.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/server-core.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -4,6 +4,7 @@ Complete HTTP Server Test Suite
 Tests ALL functionality including file operations, concurrency, and persistence
 """
 
+import gzip
 import socket
 import subprocess
 import time
@@ -112,6 +113,91 @@ class HttpClient:
         
         return self.send_raw_request(request, verbose)
 
+class Http2Client:
+    """Just enough HTTP/2 to drive the server: raw frames, and HPACK without Huffman coding"""
+    PREFACE = b"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+    DATA, HEADERS, SETTINGS, PING, GOAWAY, WINDOW_UPDATE = 0x0, 0x1, 0x4, 0x6, 0x7, 0x8
+    END_STREAM, ACK, END_HEADERS = 0x1, 0x1, 0x4
+    COMPRESSION_ERROR = 0x9
+    # The responses our tests expect, as indexed static-table entries (RFC 7541 Appendix A).
+    STATIC_STATUS = {8: 200, 9: 204, 10: 206, 11: 304, 12: 400, 13: 404, 14: 500}
+
+    def __init__(self, sock: socket.socket):
+        self.sock = sock
+        self.buffer = b""
+
+    @classmethod
+    def connect(cls, host='localhost', port=4221):
+        sock = socket.create_connection((host, port), timeout=5)
+        client = cls(sock)
+        sock.sendall(cls.PREFACE + client.frame(cls.SETTINGS, 0, 0, b""))
+        return client
+
+    @staticmethod
+    def frame(kind: int, flags: int, stream: int, payload: bytes) -> bytes:
+        return len(payload).to_bytes(3, 'big') + bytes([kind, flags]) + stream.to_bytes(4, 'big') + payload
+
+    @staticmethod
+    def literal(text: str) -> bytes:
+        data = text.encode()
+        return bytes([len(data)]) + data     # Short strings only: one-byte length, no Huffman.
+
+    @classmethod
+    def request_block(cls, path: str, extra: bytes = b"") -> bytes:
+        # :method GET and :scheme http indexed; :path and :authority literal without indexing.
+        return b"\x82\x86\x04" + cls.literal(path) + b"\x01" + cls.literal("localhost") + extra
+
+    def send(self, kind: int, flags: int, stream: int, payload: bytes):
+        self.sock.sendall(self.frame(kind, flags, stream, payload))
+
+    def get(self, stream: int, path: str, extra: bytes = b""):
+        self.send(self.HEADERS, self.END_STREAM | self.END_HEADERS, stream,
+                  self.request_block(path, extra))
+
+    def read_frame(self, timeout: float = 5):
+        """The next frame as (type, flags, stream, payload); None on timeout or close"""
+        self.sock.settimeout(timeout)
+        try:
+            while len(self.buffer) < 9 or len(self.buffer) < 9 + int.from_bytes(self.buffer[:3], 'big'):
+                chunk = self.sock.recv(65536)
+                if not chunk:
+                    return None
+                self.buffer += chunk
+        except socket.timeout:
+            return None
+        length = int.from_bytes(self.buffer[:3], 'big')
+        kind, flags = self.buffer[3], self.buffer[4]
+        stream = int.from_bytes(self.buffer[5:9], 'big') & 0x7fffffff
+        payload = self.buffer[9:9 + length]
+        self.buffer = self.buffer[9 + length:]
+        return kind, flags, stream, payload
+
+    def response(self, stream: int, update_windows: bool = True, timeout: float = 5):
+        """Reads until 'stream' ends; returns (status, body, ended)"""
+        status, body = 0, b""
+        while True:
+            frame = self.read_frame(timeout)
+            if frame is None:
+                return status, body, False
+            kind, flags, on_stream, payload = frame
+            if kind == self.SETTINGS and not flags & self.ACK:
+                self.send(self.SETTINGS, self.ACK, 0, b"")
+            if on_stream != stream:
+                continue
+            if kind == self.HEADERS and payload and payload[0] & 0x80:
+                status = self.STATIC_STATUS.get(payload[0] & 0x7f, 0)
+            elif kind == self.DATA:
+                body += payload
+                if update_windows and payload:
+                    increment = len(payload).to_bytes(4, 'big')
+                    self.send(self.WINDOW_UPDATE, 0, 0, increment)
+                    self.send(self.WINDOW_UPDATE, 0, stream, increment)
+            if kind in (self.HEADERS, self.DATA) and flags & self.END_STREAM:
+                return status, body, True
+
+    def close(self):
+        self.sock.close()
+
 class ServerTester:
     def __init__(self):
         self.server_process = None
@@ -141,6 +227,8 @@ class ServerTester:
     def start_server(self, with_directory: bool = False) -> bool:
         """Start the HTTP server"""
         cmd = ["./build/server"]
+        # Extra server flags, e.g. SERVER_FLAGS="--mode reactor" to run the suite against the epoll loop
+        cmd.extend(os.environ.get("SERVER_FLAGS", "").split())
         if with_directory:
             cmd.extend(["--directory", self.test_dir])
         
@@ -292,6 +380,43 @@ class ServerTester:
         
         return success
     
+    def test_gzip_echo(self) -> bool:
+        """Test a large /echo/ body is gzip-compressed when the client accepts it"""
+        client = HttpClient()
+        if not client.connect():
+            return False
+
+        try:
+            text = "compressible" * 200
+            request = (f"GET /echo/{text} HTTP/1.1\r\nHost: localhost\r\n"
+                       "Accept-Encoding: deflate, gzip\r\n\r\n")
+            client.sock.sendall(request.encode())
+
+            data = b""
+            while b"\r\n\r\n" not in data:
+                chunk = client.sock.recv(4096)
+                if not chunk:
+                    break
+                data += chunk
+            head, body = data.split(b"\r\n\r\n", 1)
+            headers = {}
+            for line in head.decode().split("\r\n")[1:]:
+                key, value = line.split(":", 1)
+                headers[key.strip().lower()] = value.strip()
+            length = int(headers.get("content-length", "0"))
+            while len(body) < length:
+                chunk = client.sock.recv(4096)
+                if not chunk:
+                    break
+                body += chunk
+            client.close()
+
+            return (headers.get("content-encoding") == "gzip" and length < len(text) and
+                    gzip.decompress(body).decode() == text)
+        except Exception:
+            client.close()
+            return False
+
     def test_user_agent_endpoint(self) -> bool:
         """Test /user-agent endpoint returns User-Agent header"""
         print(f"{Colors.TESTER}Connected to localhost port 4221{Colors.RESET}")
@@ -357,6 +482,29 @@ class ServerTester:
         
         return success
     
+    def test_file_change_visible(self) -> bool:
+        """Test a file rewritten on disk is served with its new contents"""
+        filename = "changing_file"
+        filepath = os.path.join(self.test_dir, filename)
+        bodies = []
+        for content in ["first version", "second, longer version"]:
+            with open(filepath, 'w') as f:
+                f.write(content)
+            time.sleep(0.2)  # Give the change notification time to arrive.
+
+            client = HttpClient()
+            if not client.connect():
+                return False
+            response = client.send_request("GET", f"/files/{filename}")
+            client.close()
+            status, headers, body = self.parse_response(response)
+            if status != 200 or 'etag' not in headers:
+                return False
+            bodies.append((body, headers['etag']))
+
+        return (bodies[0][0] == "first version" and bodies[1][0] == "second, longer version" and
+                bodies[0][1] != bodies[1][1])
+
     def test_file_not_found(self) -> bool:
         """Test 404 for non-existent files"""
         print(f"{Colors.TESTER}Testing non existent file returns 404{Colors.RESET}")
@@ -377,6 +525,33 @@ class ServerTester:
         
         return status == 404
     
+    def test_path_traversal_rejected(self) -> bool:
+        """Test names leading outside the directory are neither served nor written"""
+        parent = os.path.dirname(self.test_dir)
+        secret = os.path.basename(self.test_dir) + "_secret"
+        secret_path = os.path.join(parent, secret)
+        upload_path = os.path.join(parent, os.path.basename(self.test_dir) + "_upload")
+        with open(secret_path, 'w') as f:
+            f.write("outside the served directory")
+
+        try:
+            statuses = []
+            for method, name, body in [("GET", secret, ""),
+                                       ("POST", os.path.basename(upload_path), "not written")]:
+                client = HttpClient()
+                if not client.connect():
+                    return False
+                response = client.send_request(method, f"/files/../{name}", body=body,
+                                               verbose=self.verbose)
+                client.close()
+                status, _, _ = self.parse_response(response, verbose=self.verbose)
+                statuses.append(status)
+            return statuses == [404, 404] and not os.path.exists(upload_path)
+        finally:
+            os.remove(secret_path)
+            if os.path.exists(upload_path):
+                os.remove(upload_path)
+
     def test_file_creation(self) -> bool:
         """Test creating files via POST"""
         print(f"{Colors.TESTER}Connected to localhost port 4221{Colors.RESET}")
@@ -542,6 +717,32 @@ class ServerTester:
         
         return success
     
+    def test_pipelined_requests(self) -> bool:
+        """Test several requests sent back-to-back in one segment"""
+        client = HttpClient()
+        if not client.connect():
+            return False
+
+        try:
+            paths = ["/echo/one", "/echo/two", "/echo/three"]
+            request = "".join(f"GET {path} HTTP/1.1\r\nHost: localhost\r\n\r\n" for path in paths)
+            client.sock.sendall(request.encode())
+
+            # Responses may arrive in any number of reads; collect until all three are in.
+            data = b""
+            while data.count(b"HTTP/1.1 200 OK") < len(paths) or not data.endswith(b"three"):
+                chunk = client.sock.recv(4096)
+                if not chunk:
+                    break
+                data += chunk
+            client.close()
+
+            bodies = [part.split(b"\r\n\r\n", 1)[1] for part in data.split(b"HTTP/1.1 ")[1:]]
+            return [b.decode() for b in bodies] == ["one", "two", "three"]
+        except Exception:
+            client.close()
+            return False
+
     # ==================== EDGE CASE TESTS ====================
     
     def test_large_request_body(self) -> bool:
@@ -570,6 +771,36 @@ class ServerTester:
         
         return file_content == large_content
     
+    def test_oversized_body_rejected(self) -> bool:
+        """Test a body too large to buffer is refused before it is sent"""
+        client = HttpClient()
+        if not client.connect():
+            return False
+
+        # /echo/ does not stream bodies, so 8 MB is more than it will buffer.
+        response = client.send_raw_request(
+            "POST /echo/big HTTP/1.1\r\nHost: localhost\r\nContent-Length: 8000000\r\n\r\n")
+        client.close()
+
+        status, _, _ = self.parse_response(response)
+        return status == 413
+
+    def test_chunked_upload(self) -> bool:
+        """Test POST with a chunked body, then read the file back"""
+        client = HttpClient()
+        if not client.connect():
+            return False
+        pieces = ["mango ", "pineapple ", "x" * 300]
+        body = "".join(f"{len(piece):x}\r\n{piece}\r\n" for piece in pieces) + "0\r\n\r\n"
+        response = client.send_raw_request(
+            "POST /files/chunked.txt HTTP/1.1\r\nHost: localhost\r\n"
+            "Transfer-Encoding: chunked\r\n\r\n" + body)
+        status, _, _ = self.parse_response(response)
+        response = client.send_request("GET", "/files/chunked.txt")
+        client.close()
+        _, _, contents = self.parse_response(response)
+        return status == 201 and contents == "".join(pieces)
+
     def test_empty_request_body(self) -> bool:
         """Test POST with empty body"""
         client = HttpClient()
@@ -610,6 +841,208 @@ class ServerTester:
         
         return True
     
+    def test_transfer_encoding_framing(self) -> bool:
+        """Test bodies framed ambiguously by Transfer-Encoding are refused, not served"""
+        chunked_body = "5\r\nhello\r\n0\r\n\r\n"
+        cases = [
+            # Joined, the lines read "chunked, gzip": chunked is not the final coding.
+            ("HTTP/1.1", "Transfer-Encoding: chunked\r\nTransfer-Encoding: gzip\r\n", 400),
+            ("HTTP/1.1", "Transfer-Encoding: chunked\r\nContent-Length: 22\r\n", 400),
+            ("HTTP/1.0", "Transfer-Encoding: chunked\r\n", 400),
+            ("HTTP/1.1", "Transfer-Encoding: chunked, chunked\r\n", 400),
+            ("HTTP/1.1", "Transfer-Encoding: gzip, chunked\r\n", 501),
+        ]
+        for version, fields, expected in cases:
+            client = HttpClient()
+            if not client.connect():
+                return False
+            # A request smuggled after the body must never be answered.
+            client.sock.sendall((f"POST /echo/framing {version}\r\nHost: localhost\r\n{fields}\r\n"
+                                 f"{chunked_body}GET /echo/smuggled HTTP/1.1\r\n"
+                                 "Host: localhost\r\n\r\n").encode())
+            data = b""
+            try:
+                while True:
+                    chunk = client.sock.recv(4096)
+                    if not chunk:
+                        break
+                    data += chunk
+            except socket.timeout:
+                pass
+            client.close()
+            status, _, _ = self.parse_response(data.decode())
+            if status != expected or b"smuggled" in data:
+                return False
+        return True
+
+    def test_conflicting_content_length(self) -> bool:
+        """Test repeated Content-Length headers must agree"""
+        statuses = []
+        for lengths in [("5", "5"), ("5", "6"), ("5, 6",)]:
+            client = HttpClient()
+            if not client.connect():
+                return False
+            fields = "".join(f"Content-Length: {length}\r\n" for length in lengths)
+            response = client.send_raw_request(
+                f"GET /echo/abc HTTP/1.1\r\nHost: localhost\r\n{fields}\r\nhello")
+            client.close()
+            status, _, _ = self.parse_response(response)
+            statuses.append(status)
+        return statuses == [200, 400, 400]
+
+    # ==================== RANGE AND CONDITIONAL TESTS ====================
+
+    def fetch(self, path: str, headers: Dict[str, str] = None):
+        """GET on a fresh connection, reading the whole body; returns (status, headers, body)"""
+        request = f"GET {path} HTTP/1.1\r\nHost: localhost\r\n"
+        request += "".join(f"{key}: {value}\r\n" for key, value in (headers or {}).items())
+        sock = socket.create_connection(('localhost', 4221), timeout=5)
+        sock.sendall((request + "Connection: close\r\n\r\n").encode())
+        data = b""
+        while True:
+            chunk = sock.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+        sock.close()
+        head, _, body = data.partition(b"\r\n\r\n")
+        lines = head.decode().split("\r\n")
+        fields = {}
+        for line in lines[1:]:
+            key, _, value = line.partition(":")
+            fields[key.strip().lower()] = value.strip()
+        return int(lines[0].split(" ")[1]), fields, body
+
+    def test_ranges(self) -> bool:
+        """Test single, suffix, merged and multipart ranges, and 416 past the end"""
+        content = bytes(ord('a') + i % 26 for i in range(400))
+        with open(os.path.join(self.test_dir, "ranges.txt"), 'wb') as f:
+            f.write(content)
+        path = "/files/ranges.txt"
+
+        status, headers, body = self.fetch(path, {"Range": "bytes=10-19"})
+        if (status, headers.get("content-range"), body) != (206, "bytes 10-19/400", content[10:20]):
+            return False
+        status, headers, body = self.fetch(path, {"Range": "bytes=-5"})
+        if (status, headers.get("content-range"), body) != (206, "bytes 395-399/400", content[-5:]):
+            return False
+        # Overlapping ranges come back as one part.
+        status, headers, body = self.fetch(path, {"Range": "bytes=0-9,5-14"})
+        if (status, headers.get("content-range"), body) != (206, "bytes 0-14/400", content[:15]):
+            return False
+        # Ranges far apart are sent as multipart/byteranges, each part with its Content-Range.
+        status, headers, body = self.fetch(path, {"Range": "bytes=0-9,300-309"})
+        content_type = headers.get("content-type", "")
+        if status != 206 or not content_type.startswith("multipart/byteranges; boundary="):
+            return False
+        boundary = content_type.split("boundary=", 1)[1].encode()
+        parts = body.split(b"--" + boundary)
+        if (len(parts) != 4 or b"Content-Range: bytes 0-9/400\r\n\r\n" + content[:10] not in parts[1] or
+                b"Content-Range: bytes 300-309/400\r\n\r\n" + content[300:310] not in parts[2]):
+            return False
+        status, headers, _ = self.fetch(path, {"Range": "bytes=1000-2000"})
+        return status == 416 and headers.get("content-range") == "bytes */400"
+
+    def test_conditional_requests(self) -> bool:
+        """Test If-None-Match gives 304, and a stale If-Range the whole file"""
+        content = b"conditional request body " * 10
+        with open(os.path.join(self.test_dir, "conditional.txt"), 'wb') as f:
+            f.write(content)
+        path = "/files/conditional.txt"
+
+        status, headers, _ = self.fetch(path)
+        etag = headers.get("etag")
+        if status != 200 or not etag:
+            return False
+        status, headers, body = self.fetch(path, {"If-None-Match": etag})
+        if status != 304 or body or headers.get("etag") != etag:
+            return False
+        status, _, body = self.fetch(path, {"Range": "bytes=0-4", "If-Range": '"not-the-etag"'})
+        if status != 200 or body != content:
+            return False
+        status, _, body = self.fetch(path, {"Range": "bytes=0-4", "If-Range": etag})
+        return status == 206 and body == content[:5]
+
+    # ==================== HTTP/2 TESTS ====================
+
+    def test_http2_prior_knowledge(self) -> bool:
+        """Test a GET on a connection that opens with the HTTP/2 preface"""
+        client = Http2Client.connect()
+        client.get(1, "/echo/prior-knowledge")
+        status, body, ended = client.response(1)
+        client.close()
+        return status == 200 and body == b"prior-knowledge" and ended
+
+    def test_http2_upgrade(self) -> bool:
+        """Test 'Upgrade: h2c': 101, then the response to the first request on stream 1"""
+        sock = socket.create_connection(('localhost', 4221), timeout=5)
+        sock.sendall(b"GET /echo/upgraded HTTP/1.1\r\nHost: localhost\r\n"
+                     b"Connection: Upgrade, HTTP2-Settings\r\nUpgrade: h2c\r\n"
+                     b"HTTP2-Settings: AAMAAABk\r\n\r\n")
+        head = b""
+        while b"\r\n\r\n" not in head:
+            chunk = sock.recv(4096)
+            if not chunk:
+                sock.close()
+                return False
+            head += chunk
+        head, rest = head.split(b"\r\n\r\n", 1)
+        if not head.startswith(b"HTTP/1.1 101"):
+            sock.close()
+            return False
+        client = Http2Client(sock)
+        client.buffer = rest
+        sock.sendall(Http2Client.PREFACE + Http2Client.frame(Http2Client.SETTINGS, 0, 0, b""))
+        status, body, ended = client.response(1)
+        client.close()
+        return status == 200 and body == b"upgraded" and ended
+
+    def test_http2_flow_control(self) -> bool:
+        """Test a body past the 64 KiB initial window waits for WINDOW_UPDATE"""
+        content = os.urandom(200 * 1024)
+        with open(os.path.join(self.test_dir, "h2_large.bin"), 'wb') as f:
+            f.write(content)
+        client = Http2Client.connect()
+        client.get(1, "/files/h2_large.bin")
+        # Without window updates the server must stop at the initial 65535 bytes.
+        status, first, ended = client.response(1, update_windows=False, timeout=1)
+        if ended or len(first) != 65535:
+            client.close()
+            return False
+        increment = (1 << 20).to_bytes(4, 'big')
+        client.send(Http2Client.WINDOW_UPDATE, 0, 0, increment)
+        client.send(Http2Client.WINDOW_UPDATE, 0, 1, increment)
+        _, rest, ended = client.response(1)
+        client.close()
+        return status == 200 and ended and first + rest == content
+
+    def test_http2_dynamic_table(self) -> bool:
+        """Test a header indexed in one request is referenced from the dynamic table in the next"""
+        client = Http2Client.connect()
+        # user-agent (static name 58) with incremental indexing: it becomes dynamic entry 62.
+        client.get(1, "/user-agent", b"\x7a" + Http2Client.literal("h2-test-agent"))
+        first = client.response(1)
+        client.get(3, "/user-agent", b"\xbe")
+        second = client.response(3)
+        client.close()
+        return first == second == (200, b"h2-test-agent", True)
+
+    def test_http2_compression_error(self) -> bool:
+        """Test an undecodable header block ends the connection with GOAWAY(COMPRESSION_ERROR)"""
+        client = Http2Client.connect()
+        # Index 0 is never valid (RFC 7541 6.1).
+        client.send(Http2Client.HEADERS, Http2Client.END_STREAM | Http2Client.END_HEADERS, 1,
+                    b"\x80")
+        while True:
+            frame = client.read_frame()
+            if frame is None:
+                client.close()
+                return False
+            kind, _, _, payload = frame
+            if kind == Http2Client.GOAWAY:
+                client.close()
+                return int.from_bytes(payload[4:8], 'big') == Http2Client.COMPRESSION_ERROR
+
     # ==================== MAIN TEST RUNNER ====================
     
     def run_all_tests(self):
@@ -643,6 +1076,9 @@ class ServerTester:
             
             print(f"{Colors.TESTER}[tester::#ROOT] Testing user-agent endpoint{Colors.RESET}")
             self.add_result("User-Agent Endpoint", self.test_user_agent_endpoint())
+
+            print(f"{Colors.TESTER}[tester::#ROOT] Testing gzip compression{Colors.RESET}")
+            self.add_result("Gzip Echo", self.test_gzip_echo())
             
             print(f"{Colors.TESTER}[tester::#ROOT] Terminating program{Colors.RESET}")
             print(f"{Colors.TESTER}[tester::#ROOT] Program terminated successfully{Colors.RESET}")
@@ -660,15 +1096,33 @@ class ServerTester:
             print(f"{Colors.TESTER}[tester::#FILE] Testing file serving{Colors.RESET}")
             self.add_result("File Serving", self.test_file_serving())
             
+            print(f"{Colors.TESTER}[tester::#FILE] Testing changed file is re-read{Colors.RESET}")
+            self.add_result("File Change Visible", self.test_file_change_visible())
+
             print(f"{Colors.TESTER}[tester::#FILE] Testing file not found{Colors.RESET}")
             self.add_result("File Not Found", self.test_file_not_found())
             
+            print(f"{Colors.TESTER}[tester::#FILE] Testing names outside the directory{Colors.RESET}")
+            self.add_result("Path Traversal Rejected", self.test_path_traversal_rejected())
+
             print(f"{Colors.TESTER}[tester::#FILE] Testing file creation{Colors.RESET}")
             self.add_result("File Creation", self.test_file_creation())
             
             print(f"{Colors.TESTER}[tester::#FILE] Testing large request body{Colors.RESET}")
             self.add_result("Large Request Body", self.test_large_request_body())
             
+            print(f"{Colors.TESTER}[tester::#FILE] Testing oversized request body{Colors.RESET}")
+            self.add_result("Oversized Body Rejected", self.test_oversized_body_rejected())
+
+            print(f"{Colors.TESTER}[tester::#FILE] Testing byte ranges{Colors.RESET}")
+            self.add_result("Byte Ranges", self.test_ranges())
+
+            print(f"{Colors.TESTER}[tester::#FILE] Testing conditional requests{Colors.RESET}")
+            self.add_result("Conditional Requests", self.test_conditional_requests())
+
+            print(f"{Colors.TESTER}[tester::#FILE] Testing chunked upload{Colors.RESET}")
+            self.add_result("Chunked Upload", self.test_chunked_upload())
+
             print(f"{Colors.TESTER}[tester::#FILE] Testing empty request body{Colors.RESET}")
             self.add_result("Empty Request Body", self.test_empty_request_body())
             
@@ -709,11 +1163,39 @@ class ServerTester:
             
             print(f"{Colors.TESTER}[tester::#PERSIST] Testing connection close{Colors.RESET}")
             self.add_result("Connection Close", self.test_connection_close())
+
+            print(f"{Colors.TESTER}[tester::#PERSIST] Testing pipelined requests{Colors.RESET}")
+            self.add_result("Pipelined Requests", self.test_pipelined_requests())
             
             print(f"{Colors.TESTER}[tester::#PERSIST] Terminating program{Colors.RESET}")
             print(f"{Colors.TESTER}[tester::#PERSIST] Program terminated successfully{Colors.RESET}")
             self.stop_server()
             
+            # HTTP/2 tests
+            print(f"\n{Colors.TESTER_BOLD}[tester::#H2] Running tests for HTTP/2{Colors.RESET}")
+            print(f"{Colors.TESTER}[tester::#H2] Running program{Colors.RESET}")
+            print(f"{Colors.TESTER}[tester::#H2] $ ./build/server --directory {self.test_dir}{Colors.RESET}")
+
+            self.start_server(with_directory=True)
+
+            print(f"{Colors.TESTER}[tester::#H2] Testing prior-knowledge HTTP/2{Colors.RESET}")
+            self.add_result("HTTP/2 Prior Knowledge", self.test_http2_prior_knowledge())
+
+            print(f"{Colors.TESTER}[tester::#H2] Testing h2c upgrade{Colors.RESET}")
+            self.add_result("HTTP/2 Upgrade", self.test_http2_upgrade())
+
+            print(f"{Colors.TESTER}[tester::#H2] Testing flow control{Colors.RESET}")
+            self.add_result("HTTP/2 Flow Control", self.test_http2_flow_control())
+
+            print(f"{Colors.TESTER}[tester::#H2] Testing the HPACK dynamic table{Colors.RESET}")
+            self.add_result("HTTP/2 Dynamic Table", self.test_http2_dynamic_table())
+
+            print(f"{Colors.TESTER}[tester::#H2] Testing a malformed header block{Colors.RESET}")
+            self.add_result("HTTP/2 Compression Error", self.test_http2_compression_error())
+
+            print(f"{Colors.TESTER}[tester::#H2] Terminating program{Colors.RESET}")
+            self.stop_server()
+
             # Edge case tests
             print(f"\n{Colors.TESTER_BOLD}[tester::#EDGE] Running tests for Edge Cases{Colors.RESET}")
             print(f"{Colors.TESTER}[tester::#EDGE] Running program{Colors.RESET}")
@@ -725,6 +1207,12 @@ class ServerTester:
             
             print(f"{Colors.TESTER}[tester::#EDGE] Testing special characters in path{Colors.RESET}")
             self.add_result("Special Characters in Path", self.test_special_characters_in_path())
+
+            print(f"{Colors.TESTER}[tester::#EDGE] Testing Transfer-Encoding framing{Colors.RESET}")
+            self.add_result("Transfer-Encoding Framing", self.test_transfer_encoding_framing())
+
+            print(f"{Colors.TESTER}[tester::#EDGE] Testing conflicting Content-Length headers{Colors.RESET}")
+            self.add_result("Conflicting Content-Length", self.test_conflicting_content_length())
             
             print(f"{Colors.TESTER}[tester::#EDGE] Terminating program{Colors.RESET}")
             print(f"{Colors.TESTER}[tester::#EDGE] Program terminated successfully{Colors.RESET}")
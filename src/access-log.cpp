@@ -0,0 +1,279 @@
+#include "access-log.hpp"
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+// How long the writer sleeps between drains: briefly while requests keep arriving, longer
+// once the rings were empty. A ring holds RECORDS requests, which covers the busy interval at
+// several hundred thousand requests per second per worker; sample beyond that.
+constexpr std::chrono::milliseconds BUSY_INTERVAL{10};
+constexpr std::chrono::milliseconds IDLE_INTERVAL{100};
+
+constexpr std::string_view MONTHS[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                       "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+
+/**
+ * @struct AccessLog::Ring
+ * @brief One thread's queue of records: the thread pushes, the writer pops.
+ *
+ * 'head' and 'tail' sit on separate cache lines so the two sides do not share one, and the
+ * producer re-reads 'tail' only when its cached copy says the ring is full.
+ */
+struct AccessLog::Ring {
+    static constexpr size_t RECORDS = 2048;     // 256 KB; a power of two.
+
+    alignas(64) std::atomic<uint64_t> head{0};  // Next slot to fill; written by the producer.
+    uint64_t cached_tail = 0;                   // Producer's last view of 'tail'.
+    uint64_t seen = 0;                          // Producer: successes counted for sampling.
+    alignas(64) std::atomic<uint64_t> tail{0};  // Next slot to drain; written by the writer.
+    std::array<AccessRecord, RECORDS> records;
+
+    bool push(const AccessRecord& record) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if (h - cached_tail == RECORDS) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h - cached_tail == RECORDS) return false;
+        }
+        records[h & (RECORDS - 1)] = record;
+        head.store(h + 1, std::memory_order_release);   // Publishes the record.
+        return true;
+    }
+};
+
+
+// "HTTP/1.1" as 11, "HTTP/2" as 20; 0 for anything else.
+static uint8_t versionCode(std::string_view version) {
+    auto digit = [](char c) { return c >= '0' && c <= '9'; };
+    if (!version.starts_with("HTTP/") || version.size() < 6 || !digit(version[5])) return 0;
+    uint8_t major = version[5] - '0';
+    if (version.size() == 6) return major * 10;
+    if (version.size() == 8 && version[6] == '.' && digit(version[7])) {
+        return major * 10 + (version[7] - '0');
+    }
+    return 0;
+}
+
+void AccessEntry::begin(std::string_view method, std::string_view path,
+                        std::string_view version) {
+    if (!log) return;
+    record.start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    size_t method_length = std::min(method.size(), AccessRecord::METHOD_BYTES);
+    std::memcpy(record.method, method.data(), method_length);
+    if (method_length < AccessRecord::METHOD_BYTES) record.method[method_length] = '\0';
+    record.path_length = std::min(path.size(), AccessRecord::PATH_BYTES);
+    record.truncated = path.size() > AccessRecord::PATH_BYTES;
+    std::memcpy(record.path, path.data(), record.path_length);
+    record.version = versionCode(version);
+}
+
+void AccessEntry::finish(int status, uint64_t bytes) {
+    if (!log) return;
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    record.status = status;
+    record.bytes = bytes;
+    record.duration_us = std::min<int64_t>((now - record.start_ns) / 1000, UINT32_MAX);
+    log->submit(record);
+}
+
+
+AccessLog::AccessLog(const AccessLogOptions& options) : options(options) {
+    if (!openFile()) exit(1);
+    writer = std::thread([this] { writeLoop(); });
+}
+
+AccessLog::~AccessLog() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+    if (fd > STDERR_FILENO) close(fd);
+}
+
+bool AccessLog::openFile() {
+    if (options.path == "-") {
+        fd = STDOUT_FILENO;
+        return true;
+    }
+    fd = open(options.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to open access log '" << options.path << "': " << strerror(errno) << "\n";
+        return false;
+    }
+    off_t size = lseek(fd, 0, SEEK_END);
+    file_bytes = size > 0 ? size : 0;
+    return true;
+}
+
+AccessLog::Ring& AccessLog::localRing() {
+    thread_local Ring* ring = nullptr;
+    thread_local const AccessLog* owner = nullptr;
+    if (owner != this) {
+        auto fresh = std::make_unique<Ring>();
+        ring = fresh.get();
+        owner = this;
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        rings.push_back(std::move(fresh));
+    }
+    return *ring;
+}
+
+void AccessLog::submit(const AccessRecord& record) {
+    Ring& ring = localRing();
+    if (record.status < 400 && options.sample > 1 && ring.seen++ % options.sample != 0) return;
+    if (!ring.push(record)) localMetrics().access_log_dropped.add();
+}
+
+void AccessLog::writeLoop() {
+    std::string batch;
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    while (true) {
+        bool stop = stopping;
+        lock.unlock();
+        size_t drained = drain(batch);
+        if (!batch.empty()) writeBatch(batch);
+        batch.clear();
+        lock.lock();
+        if (stop) return;   // The drain above took everything queued before ~AccessLog().
+        wake.wait_for(lock, drained ? BUSY_INTERVAL : IDLE_INTERVAL, [this] { return stopping; });
+    }
+}
+
+namespace {
+
+void appendNumber(std::string& out, uint64_t value) {
+    char digits[20];
+    out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+// Request lines can hold any byte but space; keep the log one line per request and unambiguous.
+void appendEscaped(std::string& out, std::string_view text) {
+    for (unsigned char c : text) {
+        if (c < 0x20 || c >= 0x7f || c == '"' || c == '\\') {
+            constexpr char HEX[] = "0123456789abcdef";
+            out += "\\x";
+            out += HEX[c >> 4];
+            out += HEX[c & 15];
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+}
+
+}
+
+size_t AccessLog::drain(std::string& batch) {
+    // Records carry steady-clock times; one offset per drain turns them into wall-clock times.
+    auto wall = std::chrono::system_clock::now().time_since_epoch();
+    auto steady = std::chrono::steady_clock::now().time_since_epoch();
+    int64_t offset_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wall - steady).count();
+
+    // The "[10/Oct/2026:13:55:36 +0000]" field only changes once a second.
+    time_t stamped = -1;
+    char stamp[48];
+    size_t stamp_length = 0;
+
+    size_t drained = 0;
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    for (const std::unique_ptr<Ring>& ring : rings) {
+        uint64_t t = ring->tail.load(std::memory_order_relaxed);
+        uint64_t h = ring->head.load(std::memory_order_acquire);
+        for (; t != h; ++t) {
+            const AccessRecord& record = ring->records[t & (Ring::RECORDS - 1)];
+
+            char address[INET_ADDRSTRLEN] = "-";
+            if (record.peer_addr) inet_ntop(AF_INET, &record.peer_addr, address, sizeof(address));
+            batch += address;
+
+            time_t seconds = (record.start_ns + offset_ns) / 1'000'000'000;
+            if (seconds != stamped) {
+                tm utc{};
+                gmtime_r(&seconds, &utc);
+                stamped = seconds;
+                stamp_length = std::snprintf(stamp, sizeof(stamp),
+                                             " - - [%02d/%s/%04d:%02d:%02d:%02d +0000] \"",
+                                             utc.tm_mday, MONTHS[utc.tm_mon].data(),
+                                             utc.tm_year + 1900, utc.tm_hour, utc.tm_min, utc.tm_sec);
+            }
+            batch.append(stamp, stamp_length);
+
+            std::string_view method(record.method, strnlen(record.method, AccessRecord::METHOD_BYTES));
+            if (method.empty() && record.path_length == 0) {
+                batch += '-';   // No request was parsed (e.g. a malformed one).
+            } else {
+                appendEscaped(batch, method);
+                batch += ' ';
+                appendEscaped(batch, std::string_view(record.path, record.path_length));
+                if (record.truncated) batch += "...";
+                // The whole request line, as %r has it: "GET /path HTTP/1.1".
+                if (record.version) {
+                    batch += " HTTP/";
+                    batch += static_cast<char>('0' + record.version / 10);
+                    batch += '.';
+                    batch += static_cast<char>('0' + record.version % 10);
+                }
+            }
+            batch += "\" ";
+            appendNumber(batch, record.status);
+            batch += ' ';
+            if (record.bytes == 0 || record.bytes == UINT64_MAX) {
+                batch += '-';
+            } else {
+                appendNumber(batch, record.bytes);
+            }
+            batch += ' ';
+            appendNumber(batch, record.duration_us);
+            batch += '\n';
+        }
+        drained += t - ring->tail.load(std::memory_order_relaxed);
+        ring->tail.store(t, std::memory_order_release);  // Only now may the slots be reused.
+    }
+    return drained;
+}
+
+void AccessLog::writeBatch(std::string_view batch) {
+    if (fd < 0 && !openFile()) return;  // Rotation could not reopen it; keep trying.
+    if (options.max_bytes && fd != STDOUT_FILENO && file_bytes > 0 &&
+        file_bytes + batch.size() > options.max_bytes) {
+        rotate();
+    }
+    while (!batch.empty()) {
+        ssize_t n = write(fd, batch.data(), batch.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            // A full disk must not stop the server; the lines are lost, as when a ring is full.
+            std::cerr << "Failed to write access log: " << strerror(errno) << "\n";
+            return;
+        }
+        batch.remove_prefix(n);
+        file_bytes += n;
+    }
+}
+
+void AccessLog::rotate() {
+    close(fd);
+    // log.4 -> log.5, ..., log -> log.1; the oldest is overwritten.
+    for (int i = KEPT_FILES - 1; i >= 0; --i) {
+        std::string from = i == 0 ? options.path : options.path + "." + std::to_string(i);
+        std::string to = options.path + "." + std::to_string(i + 1);
+        rename(from.c_str(), to.c_str());   // Fails harmlessly for files not there yet.
+    }
+    file_bytes = 0;
+    openFile();
+}
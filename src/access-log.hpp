@@ -0,0 +1,132 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+/**
+ * @struct AccessLogOptions
+ * @brief Where and how much to log, filled in from the command line.
+ */
+struct AccessLogOptions {
+    std::string path;               // Log file; "-" for standard output, empty to disable.
+    size_t max_bytes = 100 << 20;   // Size at which the file is rotated (0: never).
+    unsigned sample = 1;            // Log one in this many successful requests; errors always.
+};
+
+
+/**
+ * @struct AccessRecord
+ * @brief One request as it is queued for the log: fixed-size and binary, never allocating.
+ *
+ * Workers only copy these; the writer thread does all the formatting.
+ */
+struct AccessRecord {
+    static constexpr size_t METHOD_BYTES = 8;
+    static constexpr size_t PATH_BYTES = 91;
+
+    int64_t start_ns = 0;           // Steady clock when the request was parsed.
+    uint64_t bytes = 0;             // Body length; UINT64_MAX when chunked.
+    uint32_t duration_us = 0;       // Until the response head was queued.
+    uint32_t peer_addr = 0;         // Client IPv4 address, network byte order.
+    uint16_t status = 0;
+    char method[METHOD_BYTES];      // Not NUL-terminated when it fills the array.
+    uint8_t path_length = 0;
+    bool truncated = false;         // The path was longer than PATH_BYTES.
+    uint8_t version = 0;            // 10 * major + minor, e.g. 11 for HTTP/1.1; 0 if unknown.
+    char path[PATH_BYTES];
+};
+static_assert(sizeof(AccessRecord) == 128, "a record fills exactly two cache lines");
+
+
+class AccessLog;
+
+/**
+ * @struct AccessEntry
+ * @brief A connection's record for the request being answered.
+ *
+ * The connection loop calls begin() when a request (or a reply to no request, such as a
+ * 400) starts and hands the entry to its HttpResponse, which calls finish() as the head is
+ * queued. Both do nothing when logging is off.
+ */
+struct AccessEntry {
+    AccessLog* log = nullptr;       // Null when logging is off.
+    AccessRecord record;
+
+    /**
+     * @brief Records the client's address; kept for every request on the connection.
+     */
+    void setPeer(uint32_t addr) { record.peer_addr = addr; }
+
+    /**
+     * @brief Starts the record of a request; method, path and version are empty when unparsed.
+     * @param version As on the request line, e.g. "HTTP/1.1", or "HTTP/2".
+     */
+    void begin(std::string_view method, std::string_view path, std::string_view version = {});
+
+    /**
+     * @brief Completes the record and queues it on the calling thread's ring.
+     */
+    void finish(int status, uint64_t bytes);
+};
+
+
+/**
+ * @class AccessLog
+ * @brief Asynchronous access log: workers queue binary records, a background thread writes.
+ *
+ * Every thread that submits gets its own single-producer, single-consumer ring of records,
+ * so a worker never takes a lock or makes a system call to log. The writer thread drains
+ * all rings every few milliseconds, formats the records in Common Log Format followed by the
+ * time taken in microseconds, and appends the batch with one write(). When the file passes
+ * max_bytes it is renamed to <path>.1 (shifting older files up to <path>.5) and reopened.
+ *
+ * A full ring drops the record instead of waiting, counted in the metrics as
+ * http_access_log_dropped_total. Only one AccessLog may exist at a time.
+ */
+class AccessLog {
+public:
+    /**
+     * @brief Opens the file and starts the writer thread; exits the process on failure.
+     */
+    explicit AccessLog(const AccessLogOptions& options);
+    ~AccessLog();   // Writes whatever is still queued.
+    AccessLog(const AccessLog&) = delete;
+    AccessLog& operator=(const AccessLog&) = delete;
+
+    /**
+     * @brief Queues a finished record, unless sampling skips it or the ring is full.
+     */
+    void submit(const AccessRecord& record);
+
+private:
+    struct Ring;
+
+    static constexpr int KEPT_FILES = 5;    // Rotated files beside the current one.
+
+    AccessLogOptions options;
+    int fd = -1;
+    size_t file_bytes = 0;      // Size of the current file.
+
+    std::mutex rings_mutex;     // Guards 'rings'; taken once per thread, and by the writer.
+    std::vector<std::unique_ptr<Ring>> rings;
+
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread writer;
+
+    Ring& localRing();
+    void writeLoop();
+    size_t drain(std::string& batch);   // Formats every queued record; returns how many.
+    void writeBatch(std::string_view batch);
+    bool openFile();            // Reports a failure to std::cerr.
+    void rotate();
+};
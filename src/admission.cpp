@@ -0,0 +1,121 @@
+#include "admission.hpp"
+
+#include "static-responses.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// What an over-rate client gets: the prebuilt 503, with a hint to come back in a second.
+constexpr std::string_view OVERLOADED =
+    "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n"
+    "Retry-After: 1\r\nConnection: close\r\n\r\n";
+static_assert(OVERLOADED.starts_with(statusEntry(503).head));
+
+// Enough to take in any request line and headers a client sent before it was refused.
+constexpr size_t DISCARD_BYTES = 4096;
+
+
+RateLimiter::RateLimiter(unsigned rate, unsigned burst, size_t slots)
+    : rate(rate), capacity(std::min(burst, MAX_BURST) * TOKEN), epoch(Clock::now()) {
+    size_t shard_count = std::bit_ceil(std::max(slots / SHARD_SLOTS, size_t{1}));
+    shards = std::make_unique<Shard[]>(shard_count);
+    shard_shift = 64 - std::countr_zero(shard_count);
+}
+
+uint64_t RateLimiter::nowMs() const {
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - epoch);
+    uint64_t now = static_cast<uint64_t>(elapsed.count()) & (~uint64_t{0} >> TOKEN_BITS);
+    return now ? now : 1;
+}
+
+RateLimiter::Slot& RateLimiter::slotFor(uint32_t address, uint64_t now) {
+    // Fibonacci hashing: addresses from one subnet differ in their low bits, which the
+    // multiplication spreads across the high bits the shard is picked by.
+    uint64_t hash = address * 0x9E3779B97F4A7C15ull;
+    Shard& shard = shards[shard_shift == 64 ? 0 : hash >> shard_shift];
+
+    Slot* stalest = nullptr;
+    uint64_t stalest_age = 0;
+    for (Slot& slot : shard.slots) {
+        uint32_t held = slot.address.load(std::memory_order_acquire);
+        if (held == 0 &&
+            slot.address.compare_exchange_strong(held, address, std::memory_order_acq_rel)) {
+            return slot;
+        }
+        // A failed claim leaves 'held' with whoever took the slot first, perhaps this address.
+        if (held == address) return slot;
+        uint64_t seen = slot.bucket.load(std::memory_order_relaxed) >> TOKEN_BITS;
+        uint64_t age = (now - seen) & (~uint64_t{0} >> TOKEN_BITS);
+        if (!stalest || age > stalest_age) {
+            stalest = &slot;
+            stalest_age = age;
+        }
+    }
+
+    // The shard is full: evict. Two threads doing so at once may briefly share the slot,
+    // which at worst lets one of their clients in on the other's tokens.
+    stalest->bucket.store(0, std::memory_order_relaxed);
+    stalest->address.store(address, std::memory_order_release);
+    return *stalest;
+}
+
+bool RateLimiter::admit(uint32_t address) {
+    uint64_t now = nowMs();
+    Slot& slot = slotFor(address, now);
+
+    uint64_t bucket = slot.bucket.load(std::memory_order_relaxed);
+    while (true) {
+        uint64_t then = bucket >> TOKEN_BITS;
+        uint64_t tokens = capacity;
+        if (then != 0) {
+            uint64_t elapsed = (now - then) & (~uint64_t{0} >> TOKEN_BITS);
+            tokens = bucket & TOKEN_MASK;
+            // Compared first, so a long-idle bucket can't overflow the multiplication.
+            tokens = elapsed >= capacity ? capacity
+                                         : std::min(capacity, tokens + elapsed * rate);
+        }
+        bool admitted = tokens >= TOKEN;
+        if (admitted) tokens -= TOKEN;
+        // Refused clients are counted as seen too, so eviction prefers idle addresses to
+        // an abusive one.
+        uint64_t updated = (now << TOKEN_BITS) | tokens;
+        if (updated == bucket ||
+            slot.bucket.compare_exchange_weak(bucket, updated, std::memory_order_relaxed)) {
+            return admitted;
+        }
+    }
+}
+
+
+Admission::Admission(const AdmissionOptions& options)
+    : max_connections(options.max_connections) {
+    if (options.rate) {
+        limiter = std::make_unique<RateLimiter>(options.rate,
+                                                options.burst ? options.burst : options.rate);
+    }
+}
+
+bool Admission::reserve() {
+    if (!max_connections) return true;
+    if (open_connections.fetch_add(1, std::memory_order_relaxed) < max_connections) return true;
+    open_connections.fetch_sub(1, std::memory_order_relaxed);
+    return false;
+}
+
+void Admission::reject(int fd, bool respond) {
+    if (respond) {
+        // The socket buffer of a new connection always has room for this much.
+        ssize_t ignored = send(fd, OVERLOADED.data(), OVERLOADED.size(),
+                               MSG_DONTWAIT | MSG_NOSIGNAL);
+        (void)ignored;
+        shutdown(fd, SHUT_WR);
+        // Closing with unread input makes the kernel send a reset, after which the client
+        // may never read the response; so what has arrived of the request is read first.
+        char discard[DISCARD_BYTES];
+        ignored = recv(fd, discard, sizeof(discard), MSG_DONTWAIT);
+    }
+    close(fd);
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+
+/**
+ * @struct AdmissionOptions
+ * @brief Limits on the connections the server takes, filled in from the command line.
+ */
+struct AdmissionOptions {
+    size_t max_connections = 0;     // Open at once, across every worker (0: no limit).
+    unsigned rate = 0;              // New connections per second per client address (0: no limit).
+    unsigned burst = 0;             // Connections a client may open at once (0: a second's worth).
+};
+
+
+/**
+ * @class RateLimiter
+ * @brief Per-address token buckets, in a fixed-size table shared by every thread without locks.
+ *
+ * Each client address has a bucket holding up to 'burst' tokens, refilled at 'rate' per
+ * second; a connection takes one. A bucket is one 64-bit word (tokens and the time they were
+ * counted), updated with compare-and-swap, so threads accepting at the same time never wait
+ * on each other.
+ *
+ * The table is split into shards of four slots, one cache line each, and an address only
+ * ever lives in the shard it hashes to: a lookup touches a single line, and threads contend
+ * only over addresses that share one. When all four slots are taken, the one seen least
+ * recently is given to the new address. Its bucket starts full, so under churn the limiter
+ * errs towards admitting: a client can lose its debt, never its allowance. Nothing is
+ * allocated after construction, whatever the number of addresses.
+ */
+class RateLimiter {
+public:
+    static constexpr size_t DEFAULT_SLOTS = 1 << 16;    // 1 MiB of buckets.
+
+    /**
+     * @param rate Tokens added per second; must be positive.
+     * @param burst Bucket size, at most MAX_BURST.
+     * @param slots Table size, rounded up to a power of two.
+     */
+    RateLimiter(unsigned rate, unsigned burst, size_t slots = DEFAULT_SLOTS);
+
+    static constexpr unsigned MAX_BURST = (1u << 28) / 1000 - 1;
+
+    /**
+     * @brief Takes a token from the address's bucket.
+     * @param address IPv4 address, in network byte order; never 0.
+     * @return false if the bucket is empty: the client is over its rate.
+     */
+    bool admit(uint32_t address);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // A bucket: tokens in thousandths, so that a millisecond at 'rate' adds exactly 'rate',
+    // in the low bits; above them, the millisecond they were counted at. Time 0 marks a
+    // bucket nobody has drawn from yet, which is full.
+    static constexpr unsigned TOKEN_BITS = 28;
+    static constexpr uint64_t TOKEN_MASK = (uint64_t{1} << TOKEN_BITS) - 1;
+    static constexpr uint64_t TOKEN = 1000;
+
+    struct Slot {
+        std::atomic<uint32_t> address{0};   // 0 while free.
+        std::atomic<uint64_t> bucket{0};
+    };
+    static constexpr size_t SHARD_SLOTS = 4;
+    struct alignas(64) Shard {
+        Slot slots[SHARD_SLOTS];
+    };
+
+    uint64_t rate;              // Thousandths of a token per millisecond.
+    uint64_t capacity;          // Thousandths of a token.
+    std::unique_ptr<Shard[]> shards;
+    unsigned shard_shift;       // Turns a 64-bit hash into a shard index.
+    Clock::time_point epoch;
+
+    Slot& slotFor(uint32_t address, uint64_t now);
+    // Milliseconds since construction, wrapped to the bits a bucket has for them; never 0.
+    uint64_t nowMs() const;
+};
+
+
+/**
+ * @class Admission
+ * @brief Decides, at accept time, which connections the server takes.
+ *
+ * Two independent limits, both off by default. A global cap on open connections puts
+ * pressure back on the accept queue: while it is reached, connection loops stop calling
+ * accept(), so new clients wait in the kernel's listen backlog (and, once that is full, have
+ * their SYNs retried) instead of costing the server memory. And a per-address rate limit
+ * turns away clients opening connections faster than allowed: they get OVERLOADED, written
+ * straight from read-only memory before the connection is registered anywhere, so an abusive
+ * client costs an accept() and a send() and never reaches a worker's queue or event loop.
+ *
+ * Shared by every worker; reserve() and admit() are a few atomic operations each.
+ */
+class Admission {
+public:
+    // How often a loop stopped at the connection limit checks whether a slot has freed up.
+    static constexpr int RETRY_MS = 10;
+
+    explicit Admission(const AdmissionOptions& options);
+
+    /**
+     * @brief Takes a connection slot before accepting.
+     * @return false, taking nothing, while max_connections are open: stop accepting.
+     */
+    bool reserve();
+
+    /**
+     * @brief Gives back a slot: the connection closed, or none was accepted with it.
+     */
+    void release() {
+        if (max_connections) open_connections.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Whether a connection just accepted from this address is within its rate.
+     * @param address IPv4 address, in network byte order.
+     */
+    bool admit(uint32_t address) { return !limiter || limiter->admit(address); }
+
+    /**
+     * @brief Closes a connection admit() refused, answering OVERLOADED first unless the
+     * client expects a TLS handshake, which would cost more than the connection it refuses.
+     */
+    static void reject(int fd, bool respond);
+
+private:
+    size_t max_connections;
+    std::atomic<size_t> open_connections{0};
+    std::unique_ptr<RateLimiter> limiter;   // Null without a rate limit.
+};
@@ -0,0 +1,105 @@
+#include "arena.hpp"
+
+#include <cstdint>
+#include <new>
+
+
+namespace {
+
+// Blocks a thread keeps for reuse; beyond this reset() returns them to malloc.
+constexpr size_t MAX_SPARE_BLOCKS = 64;
+
+struct SpareBlocks {
+    void* head = nullptr;   // Each spare block's first word links to the next.
+    size_t count = 0;
+
+    ~SpareBlocks() {
+        while (head) {
+            void* next = *static_cast<void**>(head);
+            ::operator delete(head);
+            head = next;
+        }
+    }
+};
+
+thread_local SpareBlocks spare_blocks;
+thread_local Arena* current_arena = nullptr;
+
+}
+
+
+Arena::~Arena() {
+    reset();
+}
+
+void Arena::reset() {
+    while (blocks) {
+        Block* next = blocks->next;
+        if (blocks->size == BLOCK_BYTES && spare_blocks.count < MAX_SPARE_BLOCKS) {
+            *reinterpret_cast<void**>(blocks) = spare_blocks.head;
+            spare_blocks.head = blocks;
+            ++spare_blocks.count;
+        } else {
+            ::operator delete(blocks);
+        }
+        blocks = next;
+    }
+    cursor = limit = nullptr;
+}
+
+void* Arena::do_allocate(size_t bytes, size_t alignment) {
+    uintptr_t start = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(alignment - 1);
+    if (cursor && start + bytes <= reinterpret_cast<uintptr_t>(limit)) {
+        cursor = reinterpret_cast<char*>(start + bytes);
+        return reinterpret_cast<void*>(start);
+    }
+
+    // Block headers keep block data aligned for anything operator new would return.
+    constexpr size_t HEADER = (sizeof(Block) + alignof(std::max_align_t) - 1)
+                              & ~(alignof(std::max_align_t) - 1);
+    size_t needed = HEADER + bytes + (alignment > alignof(std::max_align_t) ? alignment : 0);
+
+    void* memory;
+    size_t size = BLOCK_BYTES;
+    if (needed > BLOCK_BYTES) {
+        size = needed;
+        memory = ::operator new(size);
+    } else if (spare_blocks.head) {
+        memory = spare_blocks.head;
+        spare_blocks.head = *static_cast<void**>(memory);
+        --spare_blocks.count;
+    } else {
+        memory = ::operator new(size);
+    }
+
+    Block* block = static_cast<Block*>(memory);
+    block->size = size;
+    char* data = static_cast<char*>(memory) + HEADER;
+    start = (reinterpret_cast<uintptr_t>(data) + alignment - 1) & ~(alignment - 1);
+    char* end = reinterpret_cast<char*>(start + bytes);
+
+    if (size == BLOCK_BYTES || !blocks) {
+        // Make it the block we bump from; what was left of the previous one is abandoned.
+        block->next = blocks;
+        blocks = block;
+        cursor = end;
+        limit = static_cast<char*>(memory) + size;
+    } else {
+        // Keep bumping from the current block; the oversized one only needs to be freed.
+        block->next = blocks->next;
+        blocks->next = block;
+    }
+    return reinterpret_cast<void*>(start);
+}
+
+Arena* Arena::current() {
+    return current_arena;
+}
+
+Arena::Scope::Scope(Arena& arena) : previous(current_arena) {
+    current_arena = &arena;
+}
+
+Arena::Scope::~Scope() {
+    current_arena = previous;
+}
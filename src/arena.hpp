@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+
+/**
+ * @class Arena
+ * @brief A monotonic allocator for memory that lives exactly as long as one request.
+ *
+ * Each connection owns one. Handlers take request-scoped scratch memory from it (paths,
+ * header lines, the frames of coroutine handlers) via HttpResponse::arena(), and the
+ * connection resets it once the request is answered, which releases everything at once.
+ * Allocation is a pointer bump; deallocation does nothing.
+ *
+ * Memory comes in fixed-size blocks taken from a spare list belonging to the calling thread,
+ * and reset() puts them back there, so in steady state no request calls malloc and threads
+ * never contend on the allocator. An idle connection holds no blocks at all.
+ * Requests larger than a block get a dedicated allocation that is freed by reset().
+ *
+ * An arena must only be used, reset and destroyed on one thread, and nothing allocated from
+ * it may be queued for output: the queue outlives the request.
+ */
+class Arena : public std::pmr::memory_resource {
+public:
+    // Size of a block, including its header.
+    static constexpr size_t BLOCK_BYTES = 4096;
+
+    Arena() = default;
+    ~Arena() override;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /**
+     * @brief Releases everything allocated since the last reset.
+     */
+    void reset();
+
+    /**
+     * @brief The arena coroutine frames are placed in on this thread, or null.
+     *
+     * Task's frames are allocated by the compiler, not by the handler, so dispatch code
+     * names the request's arena with a Scope around the call that creates them.
+     */
+    static Arena* current();
+
+    /**
+     * @class Scope
+     * @brief Makes an arena current() for the lifetime of the object.
+     */
+    class Scope {
+    public:
+        explicit Scope(Arena& arena);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Arena* previous;
+    };
+
+private:
+    struct Block {
+        Block* next;
+        size_t size;    // Bytes including this header; BLOCK_BYTES unless oversized.
+    };
+
+    Block* blocks = nullptr;    // Newest first.
+    char* cursor = nullptr;     // Free space in the newest block.
+    char* limit = nullptr;
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
@@ -0,0 +1,314 @@
+#include "async-io.hpp"
+#include "thread-pool.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Submission queue entries of each loop's ring; the completion queue gets twice as many.
+constexpr unsigned RING_ENTRIES = 256;
+
+// Threads of the fallback backend, per loop. A read keeps one busy only while it waits for
+// the disk, so a few are enough to overlap the reads of many connections.
+constexpr size_t FALLBACK_THREADS = 4;
+constexpr size_t FALLBACK_QUEUE = 4096;
+
+// Operation codes the io_uring_probe buffer has room for.
+constexpr unsigned PROBE_OPS = 256;
+
+
+void AsyncIo::read(int fd, char* buffer, size_t length, off_t offset, Completion done) {
+    pending.push_back(Request{fd, buffer, length, offset, std::move(done)});
+}
+
+
+static void signalEventFd(int fd) {
+    uint64_t one = 1;
+    ssize_t ignored = write(fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+static void clearEventFd(int fd) {
+    uint64_t count;
+    ssize_t ignored = ::read(fd, &count, sizeof(count));
+    (void)ignored;
+}
+
+
+/**
+ * @class IoUring
+ * @brief AsyncIo on an io_uring instance, driven through the raw system calls.
+ *
+ * Queued reads become IORING_OP_READ entries in the shared submission ring and go to the
+ * kernel with a single io_uring_enter() per submit(). The kernel signals an eventfd registered
+ * with the ring whenever it posts a completion, which is what the loop's epoll waits on.
+ */
+class IoUring : public AsyncIo {
+private:
+    int ring_fd = -1;
+    int event_fd = -1;
+
+    // The two rings, shared with the kernel.
+    void* sq_ring = MAP_FAILED;
+    void* cq_ring = MAP_FAILED;
+    size_t sq_ring_bytes = 0;
+    size_t cq_ring_bytes = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqes_bytes = 0;
+
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned sq_mask = 0;
+    unsigned sq_entries = 0;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    unsigned cq_mask = 0;
+    unsigned cq_entries = 0;
+
+    // Reads in the kernel's hands. Kept below cq_entries so completions can never overflow.
+    unsigned in_flight = 0;
+
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                                        flags, nullptr, 0));
+    }
+
+    bool supportsRead();
+
+public:
+    IoUring() = default;
+    ~IoUring() override;
+
+    /**
+     * @brief Sets up the ring.
+     * @return 0, or the errno that made it unusable.
+     */
+    int open();
+
+    void submit() override;
+    int notifyFd() const override { return event_fd; }
+    void reap() override;
+    const char* name() const override { return "io_uring"; }
+};
+
+int IoUring::open() {
+    io_uring_params params{};
+    ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+    if (ring_fd < 0) return errno;
+
+    // IORING_OP_READ (plain read at an offset) arrived in 5.6; older rings only have READV.
+    if (!supportsRead()) return EOPNOTSUPP;
+
+    sq_ring_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_bytes = cq_ring_bytes = std::max(sq_ring_bytes, cq_ring_bytes);
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) return errno;
+    if (single_mmap) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = mmap(nullptr, cq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) return errno;
+    }
+    sqes_bytes = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_bytes, PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED) return errno;
+
+    char* sq = static_cast<char*>(sq_ring);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries = params.sq_entries;
+
+    char* cq = static_cast<char*>(cq_ring);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cq_entries = params.cq_entries;
+
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd < 0) return errno;
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_EVENTFD, &event_fd, 1) < 0) {
+        return errno;
+    }
+    return 0;
+}
+
+bool IoUring::supportsRead() {
+    size_t bytes = sizeof(io_uring_probe) + PROBE_OPS * sizeof(io_uring_probe_op);
+    std::unique_ptr<char[]> storage(new char[bytes]());
+    auto* probe = reinterpret_cast<io_uring_probe*>(storage.get());
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, PROBE_OPS) < 0) {
+        return false;   // No probing (before 5.6) means no IORING_OP_READ either.
+    }
+    return probe->last_op >= IORING_OP_READ &&
+           (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+}
+
+IoUring::~IoUring() {
+    // The kernel may still write into the buffers of reads in flight; wait for them. Their
+    // completions are dropped: whoever queued them is being torn down too.
+    while (in_flight > 0) {
+        if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) break;
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head, --in_flight) {
+            delete reinterpret_cast<Completion*>(cqes[head & cq_mask].user_data);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    if (sqes != MAP_FAILED) munmap(sqes, sqes_bytes);
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring) munmap(cq_ring, cq_ring_bytes);
+    if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_bytes);
+    if (event_fd >= 0) close(event_fd);
+    if (ring_fd >= 0) close(ring_fd);
+}
+
+void IoUring::submit() {
+    if (pending.empty()) return;
+
+    // Only this thread produces entries, so the tail needs no atomic read; the head is
+    // advanced by the kernel as it consumes them.
+    unsigned tail = *sq_tail;
+    size_t queued = 0;
+    while (queued < pending.size() && in_flight < cq_entries &&
+           tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) < sq_entries) {
+        Request& request = pending[queued++];
+        unsigned index = tail & sq_mask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = request.fd;
+        sqe.addr = reinterpret_cast<uint64_t>(request.buffer);
+        sqe.len = static_cast<uint32_t>(request.length);
+        sqe.off = static_cast<uint64_t>(request.offset);
+        sqe.user_data = reinterpret_cast<uint64_t>(new Completion(std::move(request.done)));
+        sq_array[index] = index;
+        ++tail;
+        ++in_flight;
+    }
+    // Publish the entries before the kernel is told about them.
+    __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+    pending.erase(pending.begin(), pending.begin() + queued);
+
+    unsigned unconsumed = tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    while (unconsumed > 0 && enter(unconsumed, 0, 0) < 0 && errno == EINTR) {}
+    // Anything left over (a full ring, EAGAIN) goes out with the next submit(), which
+    // follows the reap() of the completions that make room for it.
+}
+
+void IoUring::reap() {
+    // Reset the eventfd first: a completion posted after this point signals it again.
+    clearEventFd(event_fd);
+
+    unsigned head = *cq_head;
+    while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+        const io_uring_cqe& cqe = cqes[head & cq_mask];
+        std::unique_ptr<Completion> done(reinterpret_cast<Completion*>(cqe.user_data));
+        ssize_t result = cqe.res;
+        // Hand the slot back before running the completion, which may queue the next read.
+        __atomic_store_n(cq_head, ++head, __ATOMIC_RELEASE);
+        --in_flight;
+        (*done)(result);
+    }
+}
+
+
+/**
+ * @class ThreadedIo
+ * @brief AsyncIo on a small thread pool, for kernels without (a usable) io_uring.
+ *
+ * Each read runs as a blocking pread() on a pool thread; finished reads are collected under
+ * a lock and the loop is woken through an eventfd to run their completions.
+ */
+class ThreadedIo : public AsyncIo {
+private:
+    int event_fd;
+    std::mutex mutex;
+    std::vector<std::pair<Completion, ssize_t>> finished;  // Guarded by mutex.
+    std::unique_ptr<ThreadPool> pool;
+
+public:
+    ThreadedIo()
+        : event_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+          pool(std::make_unique<ThreadPool>(FALLBACK_THREADS, FALLBACK_QUEUE)) {
+        if (event_fd < 0) {
+            std::cerr << "eventfd failed\n";
+            exit(1);
+        }
+    }
+
+    ~ThreadedIo() override {
+        // Every read must be done with its buffer before the eventfd and the list go away.
+        pool.reset();
+        close(event_fd);
+    }
+
+    void submit() override {
+        for (Request& request : pending) {
+            pool->submit([this, request = std::move(request)]() mutable {
+                ssize_t n;
+                do {
+                    n = pread(request.fd, request.buffer, request.length, request.offset);
+                } while (n < 0 && errno == EINTR);
+                if (n < 0) n = -errno;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    finished.emplace_back(std::move(request.done), n);
+                }
+                signalEventFd(event_fd);
+            });
+        }
+        pending.clear();
+    }
+
+    int notifyFd() const override { return event_fd; }
+
+    void reap() override {
+        clearEventFd(event_fd);
+        std::vector<std::pair<Completion, ssize_t>> batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batch.swap(finished);
+        }
+        for (auto& [done, result] : batch) done(result);
+    }
+
+    const char* name() const override { return "threads"; }
+};
+
+
+std::unique_ptr<AsyncIo> makeAsyncIo(bool use_io_uring) {
+    if (use_io_uring) {
+        auto ring = std::make_unique<IoUring>();
+        int error = ring->open();
+        if (error == 0) return ring;
+
+        // Old kernels, seccomp filters and io_uring_disabled all land here; say so once.
+        static std::once_flag warned;
+        std::call_once(warned, [error] {
+            std::cerr << "io_uring unavailable (" << std::strerror(error)
+                      << "); reading files on a thread pool instead\n";
+        });
+    }
+    return std::make_unique<ThreadedIo>();
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <sys/types.h>
+#include <vector>
+
+
+/**
+ * @class AsyncIo
+ * @brief Asynchronous file reads for one event loop.
+ *
+ * An event loop must never wait for the disk: one cold read would stall every connection on
+ * it. Reads are queued with read(), handed to the kernel together by submit() once per loop
+ * iteration, and finished by reap() when notifyFd() becomes readable. Completions always run
+ * on the loop's own thread, from reap(), so they may touch connection state freely.
+ *
+ * makeAsyncIo() picks the backend: io_uring where the kernel has it, otherwise a small pool
+ * of threads doing blocking pread() calls.
+ */
+class AsyncIo {
+public:
+    /**
+     * @brief Called with the number of bytes read, or -errno.
+     */
+    using Completion = std::function<void(ssize_t result)>;
+
+    virtual ~AsyncIo() = default;
+
+    /**
+     * @brief Queues a pread() of up to 'length' bytes at 'offset' into buffer.
+     *
+     * Nothing reaches the kernel before the next submit(). The fd and the buffer must stay
+     * valid until 'done' has run.
+     */
+    void read(int fd, char* buffer, size_t length, off_t offset, Completion done);
+
+    /**
+     * @brief Hands every read queued since the last call to the kernel (or the pool).
+     */
+    virtual void submit() = 0;
+
+    /**
+     * @brief An eventfd that becomes readable when completions are waiting for reap().
+     */
+    virtual int notifyFd() const = 0;
+
+    /**
+     * @brief Runs the completion of every finished read.
+     */
+    virtual void reap() = 0;
+
+    virtual const char* name() const = 0;
+
+protected:
+    // A read waiting for submit().
+    struct Request {
+        int fd;
+        char* buffer;
+        size_t length;
+        off_t offset;
+        Completion done;
+    };
+
+    std::vector<Request> pending;
+};
+
+
+/**
+ * @brief Creates the reads backend for an event loop.
+ * @param use_io_uring false forces the thread-pool backend.
+ */
+std::unique_ptr<AsyncIo> makeAsyncIo(bool use_io_uring);
+
+
+/**
+ * @struct AsyncContext
+ * @brief What a handler needs to read files for a connection without blocking its loop.
+ *
+ * Event loops give every HttpResponse one; blocking connections have none.
+ */
+struct AsyncContext {
+    AsyncIo* io = nullptr;
+    std::function<void()> resume;   // Retries the connection's output; harmless once it closed.
+};
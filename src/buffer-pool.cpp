@@ -0,0 +1,38 @@
+#include "buffer-pool.hpp"
+
+
+BufferPool::BufferPool(size_t limit_bytes) : limit(limit_bytes) {}
+
+BufferPool::~BufferPool() {
+    for (char* buffer : spare) delete[] buffer;
+}
+
+bool BufferPool::fits(size_t size) const {
+    return limit == 0 || in_use + spare.size() * BLOCK_BYTES + size <= limit;
+}
+
+char* BufferPool::acquire(size_t size) {
+    if (size == BLOCK_BYTES && !spare.empty()) {
+        char* buffer = spare.back();
+        spare.pop_back();
+        in_use += size;
+        return buffer;
+    }
+    // Spares are given up before a new buffer is refused.
+    while (!fits(size) && !spare.empty()) {
+        delete[] spare.back();
+        spare.pop_back();
+    }
+    if (!fits(size)) return nullptr;
+    in_use += size;
+    return new char[size];
+}
+
+void BufferPool::release(char* buffer, size_t size) {
+    in_use -= size;
+    if (size == BLOCK_BYTES && spare.size() < MAX_SPARE) {
+        spare.push_back(buffer);
+    } else {
+        delete[] buffer;
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+/**
+ * @class BufferPool
+ * @brief Storage for one worker's read buffers, recycled between connections and capped.
+ *
+ * Buffers of the initial size are kept for reuse when released, so connections that come
+ * and go do not allocate while the pool has spares. Every byte handed out counts against
+ * the pool's limit, and acquire() refuses a buffer that would exceed it: memory use of a
+ * worker with 100k connections stays predictable, and a connection that cannot get a
+ * buffer is answered with 503 instead. A pool belongs to one thread.
+ */
+class BufferPool {
+public:
+    // Size of the buffers kept for reuse; larger ones are freed when released.
+    static constexpr size_t BLOCK_BYTES = 4096;
+
+    /**
+     * @param limit_bytes Most bytes handed out at once, spares included; 0 for no limit.
+     */
+    explicit BufferPool(size_t limit_bytes = 0);
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    /**
+     * @brief Returns a buffer of the given size, or null if over the limit.
+     */
+    char* acquire(size_t size);
+
+    /**
+     * @brief Takes back a buffer from acquire(), of the size it was acquired with.
+     */
+    void release(char* buffer, size_t size);
+
+    size_t bytesInUse() const { return in_use; }
+
+private:
+    // Spares kept at most, whatever the limit allows.
+    static constexpr size_t MAX_SPARE = 1024;
+
+    size_t limit;
+    size_t in_use = 0;          // Bytes handed out and not yet released.
+    std::vector<char*> spare;   // Released BLOCK_BYTES buffers.
+
+    bool fits(size_t size) const;
+};
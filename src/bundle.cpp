@@ -0,0 +1,226 @@
+#include "bundle.hpp"
+#include "compression.hpp"
+#include "conditional.hpp"
+#include "file-cache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <openssl/evp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+[[noreturn]] static void failOpen(const std::string& path, std::string_view reason) {
+    std::cerr << "Cannot use bundle '" << path << "': " << reason << "\n";
+    exit(1);
+}
+
+// Whether a span lies within a bundle of 'size' bytes; written so no sum can overflow.
+static bool inBounds(const BundleSpan& span, uint64_t size) {
+    return span.offset <= size && span.length <= size - span.offset;
+}
+
+static bool inBounds(const BundleEntry::Variant& variant, uint64_t size) {
+    return inBounds(variant.head, size) && inBounds(variant.body, size) &&
+           inBounds(variant.etag, size);
+}
+
+AssetBundle::AssetBundle(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) failOpen(path, strerror(errno));
+    struct stat st{};
+    if (fstat(fd, &st) != 0) failOpen(path, strerror(errno));
+    uint64_t size = st.st_size;
+    if (size < sizeof(BundleHeader)) failOpen(path, "too short to be a bundle");
+
+    void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) failOpen(path, strerror(errno));
+    mapping = std::shared_ptr<const void>(address, [size](const void* p) {
+        munmap(const_cast<void*>(p), size);
+    });
+    base = static_cast<const char*>(address);
+
+    const BundleHeader& header = *reinterpret_cast<const BundleHeader*>(base);
+    if (std::memcmp(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0) {
+        failOpen(path, "not a bundle");
+    }
+    if (header.version != BUNDLE_VERSION) {
+        failOpen(path, "made by another version of pack-bundle");
+    }
+    if (header.size != size) failOpen(path, "truncated or appended to");
+    count = header.count;
+    if (count > (size - sizeof(BundleHeader)) / sizeof(BundleEntry)) {
+        failOpen(path, "index runs past the end");
+    }
+    entries = reinterpret_cast<const BundleEntry*>(base + sizeof(BundleHeader));
+
+    for (size_t i = 0; i < count; ++i) {
+        const BundleEntry& entry = entries[i];
+        if (!inBounds(entry.name, size) || !inBounds(entry.last_modified, size) ||
+            !inBounds(entry.identity, size) || !inBounds(entry.gzip, size)) {
+            failOpen(path, "entry " + std::to_string(i) + " points past the end");
+        }
+        if (i > 0 && text(entries[i - 1].name) >= text(entry.name)) {
+            failOpen(path, "names are not sorted");
+        }
+    }
+
+    // Start reading the contents in now, without waiting for it: the first requests for
+    // each file then rarely fault on the disk in a worker.
+    madvise(address, size, MADV_WILLNEED);
+}
+
+std::optional<BundledFile> AssetBundle::find(std::string_view name) const {
+    const BundleEntry* end = entries + count;
+    const BundleEntry* entry = std::lower_bound(entries, end, name,
+        [this](const BundleEntry& e, std::string_view key) { return text(e.name) < key; });
+    if (entry == end || text(entry->name) != name) return std::nullopt;
+
+    auto variant = [this](const BundleEntry::Variant& v) {
+        return BundledFile::Variant{text(v.head), text(v.body), text(v.etag)};
+    };
+    return BundledFile{variant(entry->identity), variant(entry->gzip), text(entry->last_modified),
+                       static_cast<time_t>(entry->modified),
+                       (entry->flags & BUNDLE_COMPRESSIBLE) != 0};
+}
+
+
+// Everything after the index, built up as the entries are.
+class BundleData {
+private:
+    uint64_t start;     // Offset of the first byte of 'data' in the bundle.
+    std::string data;
+
+public:
+    explicit BundleData(uint64_t start) : start(start) {}
+
+    BundleSpan append(std::string_view piece) {
+        BundleSpan span{start + data.size(), piece.size()};
+        data += piece;
+        return span;
+    }
+
+    // A span for 'part', which must lie within the piece 'whole' was returned for.
+    static BundleSpan within(const BundleSpan& whole, std::string_view piece,
+                             std::string_view part) {
+        return {whole.offset + (part.data() - piece.data()), part.size()};
+    }
+
+    const std::string& bytes() const { return data; }
+};
+
+// One representation of a file: its head and body stored, and the spans recorded.
+static BundleEntry::Variant packVariant(BundleData& data, const std::string& head,
+                                        std::string_view body, std::string_view etag) {
+    BundleEntry::Variant variant{};
+    variant.head = data.append(head);
+    std::string_view head_view = head;
+    variant.etag = BundleData::within(variant.head, head_view,
+                                      head_view.substr(head_view.find(etag), etag.size()));
+    variant.body = data.append(body);
+    return variant;
+}
+
+static std::string hexDigits(const uint8_t* bytes, size_t length) {
+    constexpr char DIGITS[] = "0123456789abcdef";
+    std::string hex;
+    for (size_t i = 0; i < length; ++i) {
+        hex += DIGITS[bytes[i] >> 4];
+        hex += DIGITS[bytes[i] & 0xf];
+    }
+    return hex;
+}
+
+bool writeBundle(std::vector<BundleInput> files, const std::string& path, size_t gzip_min_bytes) {
+    std::sort(files.begin(), files.end(), [](const BundleInput& a, const BundleInput& b) {
+        return a.name < b.name;
+    });
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!isPlainName(files[i].name)) {
+            std::cerr << "Cannot pack '" << files[i].name << "': not a plain relative name\n";
+            return false;
+        }
+        if (i > 0 && files[i - 1].name == files[i].name) {
+            std::cerr << "Cannot pack '" << files[i].name << "' twice\n";
+            return false;
+        }
+    }
+
+    std::vector<BundleEntry> entries(files.size());
+    BundleData data(sizeof(BundleHeader) + files.size() * sizeof(BundleEntry));
+    for (size_t i = 0; i < files.size(); ++i) {
+        const BundleInput& file = files[i];
+        BundleEntry& entry = entries[i];
+        entry.name = data.append(file.name);
+        entry.modified = file.modified;
+
+        uint8_t digest[EVP_MAX_MD_SIZE];
+        unsigned digest_length = 0;
+        if (EVP_Digest(file.contents.data(), file.contents.size(), digest, &digest_length,
+                       EVP_sha256(), nullptr) != 1) {
+            std::cerr << "Cannot hash '" << file.name << "'\n";
+            return false;
+        }
+        std::memcpy(entry.hash, digest, BUNDLE_HASH_BYTES);
+        std::string tag = hexDigits(digest, BUNDLE_HASH_BYTES);
+
+        char last_modified[HTTP_DATE_BYTES];
+        formatHttpDate(file.modified, last_modified);
+        std::string_view date(last_modified, HTTP_DATE_BYTES);
+        bool compressible = file.contents.size() >= gzip_min_bytes;
+        if (compressible) entry.flags |= BUNDLE_COMPRESSIBLE;
+
+        std::string etag = '"' + tag + '"';
+        std::string head = makeFileHead(file.contents.size(), etag, date,
+                                        compressible ? "Vary: Accept-Encoding\r\n" : "");
+        entry.identity = packVariant(data, head, file.contents, etag);
+        std::string_view head_view = head;
+        std::string_view date_in_head = head_view.substr(head_view.find(date), date.size());
+        entry.last_modified = BundleData::within(entry.identity.head, head_view, date_in_head);
+
+        std::string compressed;
+        // Keep the gzip variant only if it is actually smaller, as FileCache does.
+        if (compressible && acquireCompressor()->compress(file.contents, true, compressed) &&
+            compressed.size() < file.contents.size()) {
+            std::string gzip_etag = '"' + tag + "-gz\"";
+            std::string gzip_head = makeFileHead(compressed.size(), gzip_etag, date,
+                                                 "Content-Encoding: gzip\r\n"
+                                                 "Vary: Accept-Encoding\r\n");
+            entry.gzip = packVariant(data, gzip_head, compressed, gzip_etag);
+        }
+    }
+
+    BundleHeader header{};
+    std::memcpy(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+    header.version = BUNDLE_VERSION;
+    header.count = static_cast<uint32_t>(entries.size());
+    header.size = sizeof(BundleHeader) + entries.size() * sizeof(BundleEntry) + data.bytes().size();
+
+    // Written beside the target and renamed over it, so a server starting meanwhile maps
+    // either the old bundle or the new one, whole.
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(entries.data()),
+                  entries.size() * sizeof(BundleEntry));
+        out.write(data.bytes().data(), data.bytes().size());
+        if (!out.flush()) {
+            std::cerr << "Cannot write '" << temporary << "'\n";
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::cerr << "Cannot replace '" << path << "': " << strerror(errno) << "\n";
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
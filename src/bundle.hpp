@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+/**
+ * A bundle is a read-only archive of the files served by GET /files/, laid out so the server
+ * can answer from it without copying or parsing anything: pack-bundle builds it offline, and
+ * AssetBundle maps it.
+ *
+ * The layout, in host byte order:
+ *
+ *     BundleHeader
+ *     BundleEntry[count]        sorted by name, bytewise
+ *     names, heads, bodies      referred to by the entries' BundleSpans
+ *
+ * Each entry carries ready-made response heads and, where it pays off, a gzip-compressed body
+ * next to the identity one, so a hit costs the same as a FileCache hit. Entity tags are taken
+ * from a SHA-256 of the contents rather than inode and mtime, so they survive repacking and
+ * are the same on every machine serving the bundle.
+ */
+
+constexpr char BUNDLE_MAGIC[8] = {'H', 'T', 'T', 'P', 'B', 'N', 'D', 'L'};
+constexpr uint32_t BUNDLE_VERSION = 1;
+
+// Bytes of the SHA-256 digest kept per entry and shown in entity tags.
+constexpr size_t BUNDLE_HASH_BYTES = 16;
+
+struct BundleSpan {
+    uint64_t offset;    // From the start of the bundle.
+    uint64_t length;
+};
+
+struct BundleHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;     // Entries following the header.
+    uint64_t size;      // Of the whole bundle, to catch truncated copies.
+};
+
+struct BundleEntry {
+    // One representation of the file, like CachedFile::Variant.
+    struct Variant {
+        BundleSpan head;    // Status line and headers up to, not including, 'Connection:'.
+        BundleSpan body;
+        BundleSpan etag;    // Within 'head'.
+    };
+
+    BundleSpan name;        // Relative to the packed directory, e.g. "css/site.css".
+    uint8_t hash[BUNDLE_HASH_BYTES];
+    int64_t modified;       // The file's mtime when it was packed.
+    BundleSpan last_modified;   // 'modified' as an HTTP date, within the heads.
+    uint32_t flags;         // BUNDLE_COMPRESSIBLE.
+    uint32_t reserved;
+    Variant identity;
+    Variant gzip;           // Empty body when compression would not pay off.
+};
+
+// The file was long enough to compress, so every response varies on Accept-Encoding.
+constexpr uint32_t BUNDLE_COMPRESSIBLE = 1;
+
+
+/**
+ * @struct BundledFile
+ * @brief A file in an open AssetBundle: views into the mapping, valid while it is open.
+ */
+struct BundledFile {
+    struct Variant {
+        std::string_view head;
+        std::string_view body;
+        std::string_view etag;
+    };
+
+    Variant identity;
+    Variant gzip;
+    std::string_view last_modified;
+    time_t modified;
+    bool compressible;
+};
+
+
+/**
+ * @class AssetBundle
+ * @brief A bundle mapped read-only into memory, looked up by binary search over its names.
+ *
+ * Opening costs one mmap() and a pass over the index, however large the bundle: the contents
+ * are left to the page cache and faulted in as they are first sent (read ahead in the
+ * background from open on), and every worker shares the same pages. The index is checked
+ * when the bundle is opened, so a damaged or truncated file is refused then rather than read
+ * out of bounds later.
+ */
+class AssetBundle {
+private:
+    std::shared_ptr<const void> mapping;    // Unmaps the bundle with the last response using it.
+    const char* base = nullptr;
+    const BundleEntry* entries = nullptr;
+    size_t count = 0;
+
+    std::string_view text(const BundleSpan& span) const {
+        return std::string_view(base + span.offset, span.length);
+    }
+
+public:
+    /**
+     * @brief Maps and checks the bundle at 'path'; exits with a message if it is unusable.
+     */
+    explicit AssetBundle(const std::string& path);
+
+    /**
+     * @brief The file stored under 'name', if there is one.
+     */
+    std::optional<BundledFile> find(std::string_view name) const;
+
+    /**
+     * @brief What responses queue by reference hold on to, so the mapping outlives them.
+     */
+    const std::shared_ptr<const void>& owner() const { return mapping; }
+
+    size_t size() const { return count; }
+};
+
+
+/**
+ * @struct BundleInput
+ * @brief One file to pack: its name within the bundle, contents and modification time.
+ */
+struct BundleInput {
+    std::string name;
+    std::string contents;
+    time_t modified;
+};
+
+/**
+ * @brief Writes a bundle holding 'files' to 'path', replacing any file there atomically.
+ *
+ * Names must be plain relative paths ("a.txt", "sub/a.txt") and unique; they are sorted here.
+ * @param gzip_min_bytes Files at least this long get a gzip variant, if it is smaller.
+ * @return false, with a message, if a name is unusable or the bundle can't be written.
+ */
+bool writeBundle(std::vector<BundleInput> files, const std::string& path, size_t gzip_min_bytes);
@@ -0,0 +1,121 @@
+#include "chunked.hpp"
+
+#include <algorithm>
+#include <charconv>
+
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    char lower = static_cast<char>(c | 0x20);
+    if (lower >= 'a' && lower <= 'f') return lower - 'a' + 10;
+    return -1;
+}
+
+
+ChunkedDecoder::Result ChunkedDecoder::next(std::string_view& input, std::string_view& data) {
+    // Framing is walked a byte at a time; it is a few bytes per chunk, and the data between
+    // is handed out in one piece.
+    while (state != State::Done) {
+        if (input.empty()) return Result::Incomplete;
+        if (state == State::Data) {
+            size_t take = static_cast<size_t>(std::min<uint64_t>(chunk_left, input.size()));
+            data = input.substr(0, take);
+            input.remove_prefix(take);
+            skip(take);
+            return Result::Data;
+        }
+
+        char c = input.front();
+        input.remove_prefix(1);
+        switch (state) {
+        case State::Size:
+            if (int digit = hexValue(c); digit >= 0) {
+                if (chunk_size > (UINT64_MAX >> 4)) return Result::Malformed;
+                chunk_size = chunk_size << 4 | digit;
+                has_digits = true;
+            } else if (!has_digits) {
+                return Result::Malformed;
+            } else if (c == '\r') {
+                state = State::SizeLf;
+            } else if (c == ';' || c == ' ' || c == '\t') {
+                state = State::Extension;
+            } else {
+                return Result::Malformed;
+            }
+            if (++line_bytes > MAX_SIZE_LINE) return Result::Malformed;
+            break;
+        case State::Extension:
+            if (c == '\n' || ++line_bytes > MAX_SIZE_LINE) return Result::Malformed;
+            if (c == '\r') state = State::SizeLf;
+            break;
+        case State::SizeLf:
+            if (c != '\n') return Result::Malformed;
+            line_bytes = 0;
+            if (chunk_size == 0) {
+                state = State::TrailerStart;    // The last-chunk.
+                break;
+            }
+            if (chunk_size > max_bytes - decoded) return Result::TooLarge;
+            decoded += chunk_size;
+            chunk_left = chunk_size;
+            state = State::Data;
+            break;
+        case State::DataCr:
+            if (c != '\r') return Result::Malformed;
+            state = State::DataLf;
+            break;
+        case State::DataLf:
+            if (c != '\n') return Result::Malformed;
+            chunk_size = 0;
+            has_digits = false;
+            state = State::Size;
+            break;
+        case State::TrailerStart:
+        case State::Trailer:
+            if (++line_bytes > MAX_TRAILER_BYTES) return Result::Malformed;
+            if (state == State::TrailerStart && c == '\r') {
+                state = State::EndLf;
+            } else if (c == '\n') {
+                // A bare LF where the final CRLF belongs.
+                if (state == State::TrailerStart) return Result::Malformed;
+                state = State::TrailerStart;
+            } else {
+                state = State::Trailer;
+            }
+            break;
+        case State::EndLf:
+            if (c != '\n') return Result::Malformed;
+            state = State::Done;
+            break;
+        case State::Data:
+        case State::Done:
+            break;
+        }
+    }
+    return Result::Done;
+}
+
+void ChunkedDecoder::skip(uint64_t length) {
+    chunk_left -= length;
+    if (chunk_left == 0) state = State::DataCr;
+}
+
+
+StreamSource::Status ChunkedSource::produce(std::string& out) {
+    Status status = inner->produce(piece);
+    out.clear();
+    if (status == Status::Pending || status == Status::Error) return status;
+
+    // An empty chunk would end the body, so empty pieces are simply not sent.
+    if (!piece.empty()) {
+        char digits[16];
+        char* end = std::to_chars(digits, digits + sizeof(digits), piece.size(), 16).ptr;
+        out.reserve((end - digits) + piece.size() + 9);
+        out.append(digits, end);
+        out += "\r\n";
+        out += piece;
+        out += "\r\n";
+    }
+    if (status == Status::Done) out += "0\r\n\r\n";
+    return status;
+}
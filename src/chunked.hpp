@@ -0,0 +1,102 @@
+#pragma once
+
+#include "output-queue.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+
+/**
+ * @class ChunkedDecoder
+ * @brief An incremental decoder for the chunked transfer coding of request bodies (RFC 9112 7.1).
+ *
+ * It is fed the encoded body in whatever pieces it arrives, strips the framing and hands the
+ * chunk data back as views into the input, so nothing is copied. Chunk extensions and trailer
+ * fields are skipped. The framing must use CRLF throughout: a decoder that is laxer than the
+ * proxy in front of it is how requests get smuggled past that proxy.
+ */
+class ChunkedDecoder {
+public:
+    enum class Result {
+        Data,           // 'data' holds body bytes taken from the front of the input.
+        Incomplete,     // The input is used up and the body has not ended.
+        Done,           // The body has ended; the input now starts with whatever follows it.
+        Malformed,      // Not valid chunked framing.
+        TooLarge        // The chunk sizes add up to more than the limit.
+    };
+
+    /**
+     * @param max_body_bytes Longest decoded body to accept.
+     */
+    explicit ChunkedDecoder(uint64_t max_body_bytes = UINT64_MAX) : max_bytes(max_body_bytes) {}
+
+    /**
+     * @brief Takes framing, and then the next run of chunk data, from the front of input.
+     *
+     * Call repeatedly while it returns Data. Malformed and TooLarge are final.
+     */
+    Result next(std::string_view& input, std::string_view& data);
+
+    /**
+     * @brief Bytes of the current chunk's data still to come; 0 while framing is expected.
+     *
+     * That many bytes of the input are plain body data, which the caller may move by other
+     * means (e.g. splice(2)) and then account for with skip().
+     */
+    uint64_t dataAhead() const { return state == State::Data ? chunk_left : 0; }
+
+    /**
+     * @brief Accounts for 'length' (at most dataAhead()) bytes of data taken past next().
+     */
+    void skip(uint64_t length);
+
+    bool done() const { return state == State::Done; }
+
+private:
+    enum class State {
+        Size,           // The chunk-size's hex digits.
+        Extension,      // The rest of the size line, up to its CR.
+        SizeLf,
+        Data,
+        DataCr,         // The CRLF after a chunk's data.
+        DataLf,
+        TrailerStart,   // The start of a trailer line, or the CR of the final blank line.
+        Trailer,        // The rest of a trailer line.
+        EndLf,
+        Done
+    };
+
+    static constexpr size_t MAX_SIZE_LINE = 4096;       // Chunk size and extensions.
+    static constexpr size_t MAX_TRAILER_BYTES = 64 * 1024;
+
+    uint64_t max_bytes;
+    State state = State::Size;
+    uint64_t chunk_size = 0;    // Parsed so far from the current size line.
+    uint64_t chunk_left = 0;    // Data bytes of the current chunk not yet taken.
+    uint64_t decoded = 0;       // Sum of the chunk sizes so far.
+    size_t line_bytes = 0;      // Of the current size line, or of the trailers.
+    bool has_digits = false;
+};
+
+
+/**
+ * @class ChunkedSource
+ * @brief Frames the pieces of another StreamSource as HTTP/1.1 chunks.
+ *
+ * For response bodies whose length is not known when the head is sent: each piece the inner
+ * source produces goes out as one chunk as soon as it exists, and the last-chunk follows the
+ * final one. HTTP/2 frames bodies itself and takes the inner source directly.
+ */
+class ChunkedSource : public StreamSource {
+private:
+    std::unique_ptr<StreamSource> inner;
+    std::string piece;          // Reused buffer for the inner source's output.
+
+public:
+    explicit ChunkedSource(std::unique_ptr<StreamSource> inner) : inner(std::move(inner)) {}
+
+    Status produce(std::string& out) override;
+};
@@ -0,0 +1,141 @@
+#include "compression.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+// gzip framing for deflateInit2(): 15 window bits plus 16.
+constexpr int GZIP_WINDOW_BITS = 15 + 16;
+
+// Compressors kept per thread once returned; more than this are freed.
+constexpr size_t MAX_RETAINED_COMPRESSORS = 4;
+
+static std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](char x, char y) {
+        return (x | 0x20) == (y | 0x20);
+    });
+}
+
+// A q-value of zero ("0", "0.", "0.000") means "not acceptable"; anything else accepts.
+static bool isZeroWeight(std::string_view params) {
+    size_t q = params.find("q=");
+    if (q == std::string_view::npos) return false;
+    std::string_view value = trim(params.substr(q + 2));
+    value = value.substr(0, value.find(';'));
+    return !value.empty() && value.find_first_not_of("0.") == std::string_view::npos;
+}
+
+bool acceptsGzip(std::string_view accept_encoding) {
+    std::optional<bool> gzip, any;
+    while (!accept_encoding.empty()) {
+        size_t comma = accept_encoding.find(',');
+        std::string_view item = accept_encoding.substr(0, comma);
+        accept_encoding.remove_prefix(comma == std::string_view::npos ? accept_encoding.size() : comma + 1);
+
+        size_t semi = item.find(';');
+        std::string_view coding = trim(item.substr(0, semi));
+        bool accepted = semi == std::string_view::npos || !isZeroWeight(item.substr(semi + 1));
+        if (equalsIgnoreCase(coding, "gzip") || equalsIgnoreCase(coding, "x-gzip")) {
+            gzip = accepted;
+        } else if (coding == "*") {
+            any = accepted;
+        }
+    }
+    // An explicit entry for gzip wins over the wildcard.
+    return gzip.value_or(any.value_or(false));
+}
+
+
+GzipCompressor::GzipCompressor() {
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, GZIP_WINDOW_BITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        std::cerr << "Failed to initialize zlib deflate stream\n";
+        exit(1);
+    }
+}
+
+GzipCompressor::~GzipCompressor() {
+    deflateEnd(&stream);
+}
+
+void GzipCompressor::reset() {
+    deflateReset(&stream);
+}
+
+bool GzipCompressor::compress(std::string_view input, bool finish, std::string& out) {
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    int flush = finish ? Z_FINISH : Z_NO_FLUSH;
+
+    // The first pass is sized by deflateBound(), so a whole body usually takes one call.
+    size_t room = std::max<size_t>(deflateBound(&stream, stream.avail_in), 4096);
+    while (true) {
+        size_t used = out.size();
+        out.resize(used + room);
+        stream.next_out = reinterpret_cast<Bytef*>(out.data() + used);
+        stream.avail_out = static_cast<uInt>(room);
+        int rc = deflate(&stream, flush);
+        out.resize(used + room - stream.avail_out);
+
+        if (rc == Z_STREAM_ERROR) return false;
+        if (finish ? rc == Z_STREAM_END : stream.avail_in == 0 && stream.avail_out != 0) return true;
+        // Output space ran out (or Z_BUF_ERROR): go round with more.
+        room *= 2;
+    }
+}
+
+
+// Idle compressors of the calling thread. Every worker thread (pool thread or event loop)
+// gets its own list, so handing them out needs no locking.
+static thread_local std::vector<std::unique_ptr<GzipCompressor>> idle_compressors;
+
+void CompressorRelease::operator()(GzipCompressor* compressor) const {
+    if (idle_compressors.size() >= MAX_RETAINED_COMPRESSORS) {
+        delete compressor;
+        return;
+    }
+    compressor->reset();
+    idle_compressors.emplace_back(compressor);
+}
+
+CompressorHandle acquireCompressor() {
+    if (idle_compressors.empty()) return CompressorHandle(new GzipCompressor());
+    CompressorHandle handle(idle_compressors.back().release());
+    idle_compressors.pop_back();
+    return handle;
+}
+
+
+GzipFileSource::GzipFileSource(std::unique_ptr<FileReader> reader)
+    : reader(std::move(reader)), compressor(acquireCompressor()) {}
+
+StreamSource::Status GzipFileSource::produce(std::string& out) {
+    out.clear();
+
+    // deflate may swallow a block without emitting anything, so read until it does.
+    bool finished = false;
+    while (out.empty() && !finished) {
+        FileReader::Result result = reader->next(block);
+        if (result == FileReader::Result::Pending) {
+            return Status::Pending;     // deflate keeps what it was given so far.
+        }
+        if (result == FileReader::Result::Error) return Status::Error;
+        if (result == FileReader::Result::End) block.clear();
+
+        finished = reader->atEnd();
+        if (!compressor->compress(block, finished, out)) {
+            return Status::Error;
+        }
+    }
+
+    if (!finished) return Status::More;
+    compressor.reset();     // Back to the free list as soon as the body is complete.
+    return Status::Done;
+}
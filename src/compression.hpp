@@ -0,0 +1,82 @@
+#pragma once
+
+#include "file-reader.hpp"
+#include "output-queue.hpp"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <zlib.h>
+
+
+/**
+ * @brief Whether an Accept-Encoding header value allows a gzip-coded response.
+ *
+ * Honors "gzip", "x-gzip" and "*", including q-values ("gzip;q=0" refuses it).
+ */
+bool acceptsGzip(std::string_view accept_encoding);
+
+
+/**
+ * @class GzipCompressor
+ * @brief A reusable zlib deflate stream producing gzip-framed output.
+ *
+ * deflateInit2() allocates a few hundred KB of state, so compressors are not made per
+ * request: acquireCompressor() hands out one from a small per-thread free list, and it is
+ * reset (not reinitialized) when it is returned.
+ */
+class GzipCompressor {
+private:
+    z_stream stream{};
+
+public:
+    GzipCompressor();
+    ~GzipCompressor();
+    GzipCompressor(const GzipCompressor&) = delete;
+    GzipCompressor& operator=(const GzipCompressor&) = delete;
+
+    /**
+     * @brief Starts a new gzip member, discarding any unfinished one.
+     */
+    void reset();
+
+    /**
+     * @brief Compresses input and appends whatever output deflate produces to out.
+     * @param finish Also flush everything buffered and write the gzip trailer.
+     * @return false if zlib reported an error.
+     */
+    bool compress(std::string_view input, bool finish, std::string& out);
+};
+
+// Returns a compressor to its thread's free list when the handle is destroyed.
+struct CompressorRelease {
+    void operator()(GzipCompressor* compressor) const;
+};
+
+using CompressorHandle = std::unique_ptr<GzipCompressor, CompressorRelease>;
+
+/**
+ * @brief Takes a reset compressor from the calling thread's free list, creating one if empty.
+ */
+CompressorHandle acquireCompressor();
+
+
+/**
+ * @class GzipFileSource
+ * @brief Streams a file as a gzip-coded response body.
+ *
+ * The file is read (see FileReader) and compressed one block at a time as the socket drains,
+ * so neither the file nor its compressed form is ever held in memory whole. Its compressed
+ * length is not known up front, so the body goes out through HttpResponse::sendStream().
+ */
+class GzipFileSource : public StreamSource {
+private:
+    std::unique_ptr<FileReader> reader;
+    CompressorHandle compressor;
+    std::string block;          // Reused read buffer.
+
+public:
+    explicit GzipFileSource(std::unique_ptr<FileReader> reader);
+
+    Status produce(std::string& out) override;
+};
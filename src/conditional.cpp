@@ -0,0 +1,223 @@
+#include "conditional.hpp"
+#include "http-server.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+
+namespace {
+
+// Ranges closer than this are sent as one: a multipart part header costs about as much.
+constexpr uint64_t MERGE_GAP = 80;
+
+bool isOws(char c) {
+    return c == ' ' || c == '\t';
+}
+
+// Parses a run of digits, all of 'text'.
+bool parseNumber(std::string_view text, uint64_t& value) {
+    if (text.empty()) return false;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc() && end == text.data() + text.size();
+}
+
+bool parseNumber(std::string_view text, int& value) {
+    uint64_t wide;
+    if (!parseNumber(text, wide) || wide > 1000000) return false;
+    value = static_cast<int>(wide);
+    return true;
+}
+
+// "hh:mm:ss"
+bool parseTime(std::string_view text, tm& parts) {
+    return text.size() == 8 && text[2] == ':' && text[5] == ':' &&
+           parseNumber(text.substr(0, 2), parts.tm_hour) &&
+           parseNumber(text.substr(3, 2), parts.tm_min) &&
+           parseNumber(text.substr(6, 2), parts.tm_sec);
+}
+
+// The opaque part of an entity tag, without W/ and quotes; false if it is not one.
+bool opaqueTag(std::string_view& text, std::string_view& tag, bool& weak) {
+    weak = text.starts_with("W/");
+    if (weak) text.remove_prefix(2);
+    if (text.empty() || text.front() != '"') return false;
+    size_t close = text.find('"', 1);
+    if (close == std::string_view::npos) return false;
+    tag = text.substr(1, close - 1);
+    text.remove_prefix(close + 1);
+    return true;
+}
+
+// Whether an If-None-Match list matches 'etag' under the weak comparison (RFC 9110 8.8.3.2).
+bool anyTagMatches(std::string_view list, std::string_view etag) {
+    std::string_view ours;
+    bool ours_weak;
+    if (!opaqueTag(etag, ours, ours_weak)) return false;
+    while (true) {
+        while (!list.empty() && (isOws(list.front()) || list.front() == ',')) list.remove_prefix(1);
+        if (list.empty()) return false;
+        if (list.front() == '*') return true;
+        std::string_view tag;
+        bool weak;
+        if (!opaqueTag(list, tag, weak)) return false;
+        if (tag == ours) return true;
+    }
+}
+
+// If-Range holds only for the exact representation: a strong tag, or the very same date.
+bool ifRangeHolds(std::string_view condition, std::string_view etag, time_t modified) {
+    if (condition.starts_with("W/")) return false;
+    if (condition.starts_with('"')) return condition == etag;
+    time_t date;
+    return parseHttpDate(condition, date) && date == modified;
+}
+
+}
+
+
+void formatHttpDate(time_t t, char* out) {
+    static constexpr char DAYS[] = "SunMonTueWedThuFriSat";
+    static constexpr char MONTHS[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    tm parts{};
+    gmtime_r(&t, &parts);
+    auto two = [](char* p, int value) {
+        p[0] = static_cast<char>('0' + value / 10);
+        p[1] = static_cast<char>('0' + value % 10);
+    };
+    std::memcpy(out, DAYS + 3 * parts.tm_wday, 3);
+    std::memcpy(out + 3, ", ", 2);
+    two(out + 5, parts.tm_mday);
+    out[7] = ' ';
+    std::memcpy(out + 8, MONTHS + 3 * parts.tm_mon, 3);
+    out[11] = ' ';
+    int year = parts.tm_year + 1900;
+    two(out + 12, year / 100 % 100);
+    two(out + 14, year % 100);
+    out[16] = ' ';
+    two(out + 17, parts.tm_hour);
+    out[19] = ':';
+    two(out + 20, parts.tm_min);
+    out[22] = ':';
+    two(out + 23, parts.tm_sec);
+    std::memcpy(out + 25, " GMT", 4);
+}
+
+bool parseHttpDate(std::string_view text, time_t& t) {
+    static constexpr std::string_view MONTHS = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    // IMF-fixdate "Sun, 06 Nov 1994 08:49:37 GMT", RFC 850 "Sunday, 06-Nov-94 08:49:37 GMT" and
+    // asctime "Sun Nov  6 08:49:37 1994" have the same fields, with the day before the year
+    // in each: tell them apart by shape rather than position.
+    tm parts{};
+    parts.tm_mday = parts.tm_mon = parts.tm_year = parts.tm_hour = -1;
+    size_t year_digits = 0;
+    while (!text.empty()) {
+        size_t end = 0;
+        while (end < text.size() && text[end] != ' ' && text[end] != ',' && text[end] != '-') ++end;
+        std::string_view token = text.substr(0, end);
+        text.remove_prefix(std::min(end + 1, text.size()));
+        if (token.empty()) continue;
+
+        if (token.find(':') != std::string_view::npos) {
+            if (parts.tm_hour >= 0 || !parseTime(token, parts)) return false;
+        } else if (token.front() >= '0' && token.front() <= '9') {
+            int& field = parts.tm_mday < 0 ? parts.tm_mday : parts.tm_year;
+            if (field >= 0 || !parseNumber(token, field)) return false;
+            if (&field == &parts.tm_year) year_digits = token.size();
+        } else if (size_t month = MONTHS.find(token);
+                   token.size() == 3 && month != std::string_view::npos && month % 3 == 0) {
+            parts.tm_mon = static_cast<int>(month / 3);
+        }
+        // Anything else is the weekday or "GMT".
+    }
+    if (parts.tm_mday < 1 || parts.tm_mday > 31 || parts.tm_mon < 0 || parts.tm_year < 0 ||
+        parts.tm_hour < 0 || parts.tm_hour > 23 || parts.tm_min > 59 || parts.tm_sec > 60) {
+        return false;
+    }
+    if (year_digits == 2) parts.tm_year += parts.tm_year < 70 ? 2000 : 1900;
+    parts.tm_year -= 1900;
+    t = timegm(&parts);
+    return t != -1;
+}
+
+bool notModified(const HttpRequest& request, std::string_view etag, time_t modified) {
+    if (std::optional<std::string_view> tags = request.headers.get("if-none-match")) {
+        return anyTagMatches(*tags, etag);
+    }
+    if (std::optional<std::string_view> since = request.headers.get("if-modified-since")) {
+        time_t date;
+        return parseHttpDate(*since, date) && modified <= date;
+    }
+    return false;
+}
+
+
+ByteRanges::Result ByteRanges::select(const HttpRequest& request, std::string_view etag,
+                                      time_t modified, uint64_t size) {
+    count = 0;
+    std::optional<std::string_view> range = request.headers.get("range");
+    if (!range) return Result::Whole;
+    std::optional<std::string_view> condition = request.headers.get("if-range");
+    if (condition && !ifRangeHolds(*condition, etag, modified)) return Result::Whole;
+    return parse(*range, size);
+}
+
+ByteRanges::Result ByteRanges::parse(std::string_view header, uint64_t size) {
+    constexpr std::string_view UNIT = "bytes=";
+    if (header.size() < UNIT.size() ||
+        !std::equal(UNIT.begin(), UNIT.end(), header.begin(),
+                    [](char a, char b) { return a == (b | 0x20); })) {
+        return Result::Whole;   // Other units are not ours to serve.
+    }
+    header.remove_prefix(UNIT.size());
+
+    // A syntax error anywhere voids the whole header; ranges past the end are just dropped.
+    size_t specs = 0;
+    while (!header.empty()) {
+        size_t comma = header.find(',');
+        std::string_view spec = header.substr(0, comma);
+        header.remove_prefix(comma == std::string_view::npos ? header.size() : comma + 1);
+        while (!spec.empty() && isOws(spec.front())) spec.remove_prefix(1);
+        while (!spec.empty() && isOws(spec.back())) spec.remove_suffix(1);
+        if (spec.empty()) continue;
+        if (++specs > MAX_RANGES) return Result::Whole;
+
+        size_t dash = spec.find('-');
+        if (dash == std::string_view::npos) return Result::Whole;
+        std::string_view from = spec.substr(0, dash);
+        std::string_view to = spec.substr(dash + 1);
+        uint64_t first;
+        uint64_t last = size - 1;
+        if (from.empty()) {
+            // "-n": the final n bytes.
+            uint64_t suffix;
+            if (!parseNumber(to, suffix)) return Result::Whole;
+            if (suffix == 0 || size == 0) continue;
+            first = size - std::min(suffix, size);
+        } else {
+            if (!parseNumber(from, first)) return Result::Whole;
+            if (!to.empty()) {
+                if (!parseNumber(to, last) || last < first) return Result::Whole;
+                last = std::min(last, size - 1);
+            }
+            if (first >= size) continue;
+        }
+        ranges[count++] = ByteRange{first, last - first + 1};
+    }
+    if (specs == 0) return Result::Whole;
+    if (count == 0) return Result::Unsatisfiable;
+
+    std::sort(ranges.begin(), ranges.begin() + count,
+              [](const ByteRange& a, const ByteRange& b) { return a.first < b.first; });
+    size_t merged = 0;
+    for (size_t i = 1; i < count; ++i) {
+        ByteRange& into = ranges[merged];
+        if (ranges[i].first <= into.last() + 1 + MERGE_GAP) {
+            into.length = std::max(into.last(), ranges[i].last()) - into.first + 1;
+        } else {
+            ranges[++merged] = ranges[i];
+        }
+    }
+    count = merged + 1;
+    return Result::Partial;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string_view>
+
+class HttpRequest;
+
+
+// Length of an IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+constexpr size_t HTTP_DATE_BYTES = 29;
+
+/**
+ * @brief Writes t as an IMF-fixdate (RFC 9110 5.6.7), the form Last-Modified is sent in.
+ * @param out Room for HTTP_DATE_BYTES characters; no terminator is written.
+ */
+void formatHttpDate(time_t t, char* out);
+
+/**
+ * @brief Parses an HTTP date in any of the three formats recipients must accept.
+ * @return false if text is none of them.
+ */
+bool parseHttpDate(std::string_view text, time_t& t);
+
+/**
+ * @brief Whether a GET can be answered with 304 Not Modified (RFC 9110 13.1.2, 13.1.3).
+ *
+ * If-None-Match is compared with 'etag' using the weak comparison; If-Modified-Since is
+ * only looked at when there is no If-None-Match.
+ * @param etag The quoted entity tag of the representation that would be sent.
+ * @param modified Its modification time.
+ */
+bool notModified(const HttpRequest& request, std::string_view etag, time_t modified);
+
+
+/**
+ * @struct ByteRange
+ * @brief A satisfiable range of a representation: 'length' bytes from offset 'first'.
+ */
+struct ByteRange {
+    uint64_t first;
+    uint64_t length;
+
+    uint64_t last() const { return first + length - 1; }
+};
+
+/**
+ * @class ByteRanges
+ * @brief The parts of a representation a request's Range header selects (RFC 9110 14).
+ *
+ * Ranges are sorted, and overlapping or nearly adjacent ones merged, so a client cannot make
+ * the server send a byte more than once, or pay a part header for every few bytes. A header
+ * asking for more than MAX_RANGES pieces is ignored, as RFC 9110 allows.
+ */
+class ByteRanges {
+public:
+    enum class Result {
+        Whole,          // No usable Range (or If-Range failed): send the whole representation.
+        Partial,        // Send the ranges with 206.
+        Unsatisfiable   // No range overlaps the representation: answer 416.
+    };
+
+    static constexpr size_t MAX_RANGES = 16;
+
+    /**
+     * @brief Evaluates Range and If-Range for a representation of 'size' bytes.
+     * @param etag, modified The representation's validators, for If-Range.
+     */
+    Result select(const HttpRequest& request, std::string_view etag, time_t modified, uint64_t size);
+
+    size_t size() const { return count; }
+    const ByteRange* begin() const { return ranges.data(); }
+    const ByteRange* end() const { return ranges.data() + count; }
+    const ByteRange& operator[](size_t i) const { return ranges[i]; }
+
+private:
+    std::array<ByteRange, MAX_RANGES> ranges;
+    size_t count = 0;
+
+    Result parse(std::string_view header, uint64_t size);
+};
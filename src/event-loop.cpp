@@ -0,0 +1,651 @@
+#include "event-loop.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+
+// Size of the shared receive buffer and the number of events handled per epoll_wait().
+constexpr size_t SCRATCH_BYTES = 64 * 1024;
+constexpr int MAX_EVENTS = 128;
+
+
+bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return false;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Closed connections kept for reuse per loop.
+constexpr size_t MAX_SPARE_CONNECTIONS = 1024;
+
+
+void Connection::clear() {
+    h2.reset();         // Its streams' handlers may still be reading from 'async'.
+    tls.reset();
+    task = {};          // Before the arena its frame lives in.
+    arena.reset();
+    body = BodyStream();
+    out.clear();        // Before 'in', which output may borrow from.
+    in.clear();
+    parser.reset();
+    state = State::Reading;
+    peer_closed = false;
+    read_paused = false;
+    deadline = Deadline::None;
+    served = 0;
+}
+
+EventLoop::EventLoop(int listen_fd, const RequestHandler& handler, std::unique_ptr<AsyncIo> io,
+                     size_t buffer_limit, unsigned accept_batch)
+    : listen_fd(listen_fd), handler(handler), io(std::move(io)), buffers(buffer_limit),
+      scratch(SCRATCH_BYTES), metrics(localMetrics()), accept_batch(accept_batch) {
+    // The listening socket must not block: with edge-triggered epoll we accept until EAGAIN.
+    if (!setNonBlocking(listen_fd)) {
+        std::cerr << "Failed to make listening socket non-blocking\n";
+        exit(1);
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        std::cerr << "epoll_create1 failed\n";
+        exit(1);
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = listen_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+        std::cerr << "epoll_ctl failed for listening socket\n";
+        exit(1);
+    }
+
+    // Completed file reads are announced through an eventfd, so they wake the same epoll_wait().
+    ev.data.fd = this->io->notifyFd();
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0) {
+        std::cerr << "epoll_ctl failed for file I/O completions\n";
+        exit(1);
+    }
+
+    // So does the start of draining; being edge-triggered, it wakes each loop once.
+    ev.data.fd = handler.drainFd();
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0) {
+        std::cerr << "epoll_ctl failed for the drain signal\n";
+        exit(1);
+    }
+}
+
+EventLoop::~EventLoop() {
+    for (auto& [fd, conn] : connections) {
+        close(fd);
+    }
+    close(epoll_fd);
+}
+
+// Waits for readiness events and dispatches them until the loop has drained.
+void EventLoop::run() {
+    epoll_event events[MAX_EVENTS];
+    while (!draining || !connections.empty()) {
+        // An accept that stopped early gets no more edges for the connections it left
+        // waiting: after a batch it resumes as soon as this loop's events are handled; at
+        // the limit, whose slots may free up on other loops, on a short timer.
+        int timeout = accept_more ? 0 : timers.nextTimeoutMs();
+        if (accept_paused && (timeout < 0 || timeout > Admission::RETRY_MS)) {
+            timeout = Admission::RETRY_MS;
+        }
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "epoll_wait failed\n";
+            return;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            uint32_t flags = events[i].events;
+
+            if (fd == listen_fd) {
+                acceptNew();
+                continue;
+            }
+            if (fd == io->notifyFd()) {
+                io->reap();     // Resumes the streams and handlers whose reads completed.
+                finishTasks();
+                continue;
+            }
+            if (fd == handler.drainFd()) {
+                if (!draining) drain();
+                continue;
+            }
+
+            // Look the connection up by fd: an earlier event in this batch may have closed it.
+            auto it = connections.find(fd);
+            if (it == connections.end()) continue;
+            Connection& conn = *it->second;
+
+            if (flags & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(conn);
+                continue;
+            }
+            if ((flags & (EPOLLIN | EPOLLRDHUP)) && !onReadable(conn)) {
+                continue;   // The connection was closed while reading.
+            }
+            if (flags & EPOLLOUT) {
+                onWritable(conn);
+            }
+        }
+
+        timers.advance([this](TimerWheel::Timer& timer) { expire(timer.id); });
+        if ((accept_paused || accept_more) && !draining) acceptNew();
+
+        // Every read queued while handling this batch goes to the kernel in one call.
+        io->submit();
+    }
+}
+
+void EventLoop::acceptNew() {
+    Admission& admission = handler.admission();
+    accept_more = false;
+    for (unsigned accepted = 0;; ++accepted) {
+        // A burst of new clients must not keep the loop from the connections it has.
+        if (accepted == accept_batch) {
+            accept_more = true;
+            return;
+        }
+        if (!admission.reserve()) {
+            if (!accept_paused) metrics.accept_pauses.add();
+            accept_paused = true;
+            return;
+        }
+        accept_paused = false;
+
+        sockaddr_in client_addr{};
+        socklen_t client_len = sizeof(client_addr);
+        // accept4() hands back a socket that is already non-blocking, saving an fcntl() pair.
+        int client_fd = accept4(listen_fd, (struct sockaddr *)&client_addr, &client_len,
+                                SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            admission.release();
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "Failed to accept connection.\n";
+            }
+            return;     // Backlog drained (or a transient error); wait for the next edge.
+        }
+        if (!admission.admit(client_addr.sin_addr.s_addr)) {
+            // Refused before it costs an epoll registration or a Connection.
+            admission.release();
+            Admission::reject(client_fd, !handler.tls());
+            metrics.connections_rejected.add();
+            continue;
+        }
+
+        // Register for both directions once. With EPOLLET we are only told about transitions,
+        // so there is no need to toggle EPOLLOUT on and off as output is queued.
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = client_fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+            std::cerr << "epoll_ctl failed for client socket\n";
+            close(client_fd);
+            admission.release();
+            continue;
+        }
+        std::unique_ptr<Connection> conn;
+        if (spare_connections.empty()) {
+            conn = std::make_unique<Connection>(client_fd, next_serial++, handler.maxBodyBytes(),
+                                                &buffers);
+        } else {
+            conn = std::move(spare_connections.back());
+            spare_connections.pop_back();
+            conn->fd = client_fd;
+            conn->serial = next_serial++;
+        }
+        conn->async.io = io.get();
+        conn->async.resume = [this, token = resumeToken(*conn)] { resume(token); };
+        conn->timer.id = resumeToken(*conn);
+        conn->access.log = handler.accessLog();
+        conn->access.setPeer(client_addr.sin_addr.s_addr);
+        if (const TlsContext* context = handler.tls()) {
+            conn->tls = std::make_unique<TlsSession>(*context, client_fd);
+        }
+        updateDeadline(*conn);
+        metrics.connections_opened.add();
+        connections.emplace(client_fd, std::move(conn));
+    }
+}
+
+bool EventLoop::onReadable(Connection& conn) {
+    if (conn.tls && !conn.tls->established()) {
+        if (!handshake(conn)) return false;
+        if (!conn.tls->established()) return true;
+    }
+
+    // Pipelined requests left over from a paused read are answered before reading more.
+    if (conn.read_paused) {
+        conn.read_paused = false;
+        if (!conn.in.empty() && !processBuffered(conn)) return false;
+    }
+
+    // Edge-triggered: keep reading until the kernel says there is nothing left.
+    while (conn.state != Connection::State::Closing) {
+        if (conn.task) {
+            // A handler is waiting for I/O; finishTasks() resumes reading once it is done.
+            conn.read_paused = true;
+            break;
+        }
+        if (conn.out.bufferedBytes() >= OutputQueue::HIGH_WATER_MARK) {
+            // The client isn't reading its responses. Stop here; onWritable() resumes reading
+            // once the queue drains (the unread bytes produce no new edge, so it must).
+            conn.read_paused = true;
+            break;
+        }
+
+        ssize_t n;
+        if (conn.body.active() && conn.in.empty() && conn.body.expectsData() && !conn.tls) {
+            // Mid-upload: move the body from the socket to its sink, spliced where possible.
+            // Chunk framing is read below instead, as it may be followed by the next request;
+            // so is anything that must be decrypted first.
+            n = conn.body.spliceFrom(conn.fd);
+            if (n > 0) {
+                metrics.bytes_in.add(n);
+                if (conn.body.complete()) {
+                    finishBody(conn);
+                    if (!settleOutput(conn)) return false;
+                }
+                continue;
+            }
+        } else if (conn.in.empty()) {
+            // Common case: the whole request arrives in one read, so parse it in place in the
+            // shared buffer and only keep the tail if it is an incomplete request.
+            n = receiveFrom(conn.fd, conn.tls.get(), scratch.data(), scratch.size());
+            if (n > 0) {
+                metrics.bytes_in.add(n);
+                size_t consumed = processInput(conn, scratch.data(), n);
+                // Responses may borrow from scratch, which the next recv() overwrites.
+                if (!settleOutput(conn)) return false;
+                if (consumed < static_cast<size_t>(n) && conn.state != Connection::State::Closing &&
+                    !conn.in.append(scratch.data() + consumed, n - consumed)) {
+                    return rejectForMemory(conn);
+                }
+                continue;
+            }
+        } else {
+            // A partial request is pending: read straight onto the end of it.
+            if (!conn.in.reserve(ReadBuffer::MIN_READ)) return rejectForMemory(conn);
+            n = receiveFrom(conn.fd, conn.tls.get(), conn.in.tail(), conn.in.freeSpace());
+            if (n > 0) {
+                metrics.bytes_in.add(n);
+                conn.in.commit(n);
+                if (!processBuffered(conn)) return false;
+                continue;
+            }
+        }
+        if (n == 0) {
+            conn.peer_closed = true;
+            break;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        closeConnection(conn);
+        return false;
+    }
+
+    return flush(conn);
+}
+
+void EventLoop::onWritable(Connection& conn) {
+    if (conn.tls && !conn.tls->established()) {
+        onReadable(conn);   // The handshake may have been waiting to write.
+        return;
+    }
+    // An HTTP/2 session may have body data to frame even with nothing queued, and a TLS
+    // session a record it has taken from the queue.
+    bool pending = !conn.out.empty() || conn.h2 || (conn.tls && conn.tls->hasUnsent());
+    if (pending && !flush(conn)) return;
+    if (conn.read_paused && conn.out.bufferedBytes() < OutputQueue::HIGH_WATER_MARK) {
+        onReadable(conn);
+    }
+}
+
+void EventLoop::finishTasks() {
+    // Tasks only end while reap() runs, so nothing below adds to the list.
+    for (uint64_t token : finished_tasks) {
+        auto it = connections.find(static_cast<int>(token & 0xffffffff));
+        if (it == connections.end() || resumeToken(*it->second) != token) continue;
+        Connection& conn = *it->second;
+        if (conn.h2) {
+            conn.h2->reapTasks();   // Any of its streams; the token may be listed more than once.
+        } else {
+            metrics.handle.record(std::chrono::steady_clock::now() - conn.handle_started);
+            conn.task = {};
+            conn.arena.reset();
+        }
+        // Flush even if nothing is queued: a 'Connection: close' request closes here.
+        if (!flush(conn)) continue;
+        if (conn.read_paused && conn.out.bufferedBytes() < OutputQueue::HIGH_WATER_MARK) {
+            onReadable(conn);
+        }
+    }
+    finished_tasks.clear();
+}
+
+void EventLoop::updateDeadline(Connection& conn) {
+    const Timeouts& timeouts = handler.timeouts();
+    Connection::Deadline deadline = Connection::Deadline::Idle;
+    unsigned seconds = timeouts.idle;
+    if (conn.task) {
+        deadline = Connection::Deadline::None;  // Waiting on the server, not the client.
+        seconds = 0;
+    } else if (!conn.out.empty()) {
+        // Sending: every flush that gets further re-arms, so only a stalled client hits this.
+    } else if (conn.h2) {
+        // Frames dribbling in are not timed like an HTTP/1.1 head; open streams are bodies.
+        if (conn.h2->busy()) {
+            deadline = Connection::Deadline::None;
+            seconds = 0;
+        } else if (conn.h2->hasStreams()) {
+            deadline = Connection::Deadline::Body;
+            seconds = timeouts.body;
+        }
+    } else if (conn.body.active()) {
+        deadline = Connection::Deadline::Body;
+        seconds = timeouts.body;
+    } else if (!conn.in.empty()) {
+        // Counted from the head's first byte: later bytes do not extend it.
+        if (conn.deadline == Connection::Deadline::Header && conn.timer.armed()) return;
+        deadline = Connection::Deadline::Header;
+        seconds = timeouts.header;
+    }
+
+    if (seconds == 0) {
+        conn.deadline = Connection::Deadline::None;
+        timers.cancel(conn.timer);
+        return;
+    }
+    conn.deadline = deadline;
+    timers.schedule(conn.timer, std::chrono::seconds(seconds));
+}
+
+void EventLoop::expire(uint64_t token) {
+    auto it = connections.find(static_cast<int>(token & 0xffffffff));
+    if (it == connections.end() || resumeToken(*it->second) != token) return;
+    Connection& conn = *it->second;
+    if (conn.h2) {
+        // GOAWAY, so the client knows not to retry on this connection.
+        conn.h2->shutdown();
+        conn.state = Connection::State::Closing;
+        flush(conn);
+        return;
+    }
+    if (conn.deadline == Connection::Deadline::Header || conn.deadline == Connection::Deadline::Body) {
+        // Answered requests have all been sent (or the deadline would be Idle), so this is next.
+        conn.state = Connection::State::Closing;
+        // A body that stopped arriving is logged under its request; a head had none yet.
+        if (conn.deadline == Connection::Deadline::Header) conn.access.begin({}, {});
+        HttpResponse response(conn.out, true);
+        response.logTo(&conn.access);
+        response.sendError(408);
+        flush(conn);
+        return;
+    }
+    closeConnection(conn);
+}
+
+void EventLoop::resume(uint64_t token) {
+    // The connection may have closed, and its fd been reused, while the read was in flight.
+    auto it = connections.find(static_cast<int>(token & 0xffffffff));
+    if (it == connections.end() || resumeToken(*it->second) != token) return;
+    onWritable(*it->second);
+}
+
+size_t EventLoop::processInput(Connection& conn, char* data, size_t length) {
+    if (conn.h2) return conn.h2->receive(data, length);
+    if (conn.served == 0 && handler.http2() && Http2Session::startsWithPreface(data, length)) {
+        startHttp2(conn);
+        return conn.h2->receive(data, length);
+    }
+
+    size_t consumed = 0;
+    while (conn.state != Connection::State::Closing && !conn.task &&
+           conn.out.bufferedBytes() < OutputQueue::HIGH_WATER_MARK) {
+        if (conn.body.active()) {
+            consumed += conn.body.feed(data + consumed, length - consumed);
+            if (!conn.body.complete()) break;   // Everything went to the body.
+            finishBody(conn);
+            continue;
+        }
+
+        auto parse_started = std::chrono::steady_clock::now();
+        RequestParser::Result result = conn.parser.parse(data + consumed, length - consumed, request);
+        if (result == RequestParser::Result::Incomplete) break;   // Wait for the rest.
+
+        if (result == RequestParser::Result::Error) {
+            metrics.parse_errors.add();
+            conn.access.begin({}, {});
+            HttpResponse response(conn.out, true);
+            response.logTo(&conn.access);
+            response.sendError(conn.parser.errorStatus());
+            conn.state = Connection::State::Closing;
+            break;
+        }
+
+        metrics.parse.record(std::chrono::steady_clock::now() - parse_started);
+
+        if (result == RequestParser::Result::Headers) {
+            // The body is still on its way: stream it if the route takes it piecewise.
+            conn.access.begin(request.method, request.path, request.version);
+            if (std::unique_ptr<BodySink> sink = handler.openBody(request)) {
+                ++conn.served;
+                conn.deadline = Connection::Deadline::None;     // The head is in.
+                bool should_close = request.wantsClose() || handler.lastRequest(conn.served);
+                if (conn.parser.chunked()) {
+                    conn.body.startChunked(std::move(sink), handler.maxBodyBytes(), should_close);
+                } else {
+                    conn.body.start(std::move(sink), conn.parser.bodyLength(), should_close);
+                }
+                consumed += conn.parser.headLength();
+                conn.parser.reset();
+            } else if (conn.parser.bodyLength() > RequestParser::MAX_BUFFERED_BODY) {
+                HttpResponse response(conn.out, true);
+                response.logTo(&conn.access);
+                response.sendError(413);
+                conn.state = Connection::State::Closing;
+                break;
+            }
+            // Otherwise keep buffering; parse() reports Incomplete until the body is in.
+            continue;
+        }
+
+        // Over TLS, HTTP/2 is only ever chosen with ALPN.
+        if (conn.served == 0 && handler.http2() && !conn.tls &&
+            Http2Session::wantsUpgrade(request)) {
+            HttpResponse(conn.out).sendRaw(Http2Session::SWITCHING_PROTOCOLS);
+            startHttp2(conn);
+            conn.h2->upgrade(request);
+            consumed += conn.parser.consumed();
+            conn.parser.reset();
+            return consumed + conn.h2->receive(data + consumed, length - consumed);
+        }
+
+        ++conn.served;
+        conn.deadline = Connection::Deadline::None;     // The next request gets its own.
+        bool should_close = request.wantsClose() || handler.lastRequest(conn.served);
+        conn.access.begin(request.method, request.path, request.version);
+        HttpResponse response(conn.out, should_close, &conn.async, &conn.arena);
+        response.logTo(&conn.access);
+        handler.advertiseKeepAlive(response, conn.served);
+        conn.handle_started = std::chrono::steady_clock::now();
+        {
+            Arena::Scope scope(conn.arena);
+            conn.task = handler.handle(request, response);
+        }
+        if (conn.task) {
+            // Suspended on I/O; finishTasks() records the handler's time once it is done.
+            conn.task.onDone([this, token = resumeToken(conn)] { finished_tasks.push_back(token); });
+        } else {
+            metrics.handle.record(std::chrono::steady_clock::now() - conn.handle_started);
+            conn.arena.reset();
+        }
+
+        consumed += conn.parser.consumed();
+        conn.parser.reset();
+        if (should_close) {
+            conn.state = Connection::State::Closing;
+        }
+    }
+    return consumed;
+}
+
+void EventLoop::finishBody(Connection& conn) {
+    bool should_close = conn.body.shouldClose();
+    HttpResponse response(conn.out, should_close, &conn.async);
+    response.logTo(&conn.access);   // Begun with the request's head.
+    handler.advertiseKeepAlive(response, conn.served);
+    conn.body.finish(response);
+    if (should_close) {
+        conn.state = Connection::State::Closing;
+    }
+}
+
+void EventLoop::startHttp2(Connection& conn) {
+    conn.deadline = Connection::Deadline::None;
+    conn.h2 = std::make_unique<Http2Session>(
+        handler, conn.out, &conn.async,
+        [this, token = resumeToken(conn)] { finished_tasks.push_back(token); }, conn.access);
+}
+
+bool EventLoop::processBuffered(Connection& conn) {
+    size_t consumed = processInput(conn, conn.in.data(), conn.in.size());
+    // Settle before consuming: responses may borrow from 'in', and release() frees it.
+    if (!settleOutput(conn)) return false;
+    conn.in.consume(consumed);
+    if (conn.in.empty()) conn.in.release();
+    return true;
+}
+
+bool EventLoop::settleOutput(Connection& conn) {
+    if (!flush(conn)) return false;
+    conn.out.retainBorrowed();  // Copies only what the kernel did not take.
+    return true;
+}
+
+bool EventLoop::flush(Connection& conn) {
+    // An HTTP/2 session frames more of its response bodies each time the queue drains.
+    bool pumped = conn.h2 && conn.h2->pump();
+    OutputQueue::FlushResult result = flushTo(conn.fd, conn.tls.get(), conn.out);
+    while (pumped && result == OutputQueue::FlushResult::Done) {
+        pumped = conn.h2->pump();
+        result = flushTo(conn.fd, conn.tls.get(), conn.out);
+    }
+
+    switch (result) {
+        case OutputQueue::FlushResult::WouldBlock:
+            // Kernel buffer is full; EPOLLOUT will tell us when to resume.
+            if (conn.state == Connection::State::Reading) {
+                conn.state = Connection::State::Writing;
+            }
+            updateDeadline(conn);
+            return true;
+        case OutputQueue::FlushResult::Error:
+            closeConnection(conn);
+            return false;
+        case OutputQueue::FlushResult::Done:
+            break;
+    }
+
+    // A suspended handler has more to send; finishTasks() flushes again when it is done.
+    if (conn.task) {
+        updateDeadline(conn);
+        return true;
+    }
+
+    // Also close once a client that hung up has been sent everything it asked for, whether
+    // that happens right away or after EPOLLOUT or a file read resumed the connection.
+    bool answered = true;
+    if (conn.h2) {
+        if (conn.h2->finished()) conn.state = Connection::State::Closing;
+        answered = !conn.h2->hasStreams();
+    }
+    if (conn.state == Connection::State::Closing || (conn.peer_closed && answered) ||
+        (draining && betweenRequests(conn))) {
+        closeConnection(conn);
+        return false;
+    }
+    conn.state = Connection::State::Reading;
+    updateDeadline(conn);
+    return true;
+}
+
+void EventLoop::closeConnection(Connection& conn) {
+    int fd = conn.fd;
+    if (conn.tls) conn.tls->shutdown();
+    // Closing the fd also removes it from the epoll interest list.
+    close(fd);
+    // Callers must not touch conn afterwards: it is cleared, or destroyed if enough are spare.
+    auto it = connections.find(fd);
+    std::unique_ptr<Connection> closed = std::move(it->second);
+    connections.erase(it);
+    timers.cancel(closed->timer);
+    metrics.connections_closed.add();
+    handler.admission().release();
+    closed->clear();
+    if (spare_connections.size() < MAX_SPARE_CONNECTIONS) {
+        spare_connections.push_back(std::move(closed));
+    }
+}
+
+bool EventLoop::handshake(Connection& conn) {
+    // Waiting either way is fine: both directions are registered, so the next edge of
+    // whichever it is brings us back.
+    if (conn.tls->handshake() != TlsSession::Handshake::Failed) return true;
+    closeConnection(conn);
+    return false;
+}
+
+bool EventLoop::betweenRequests(const Connection& conn) {
+    // A first request may still be on its way.
+    return conn.served > 0 && !conn.h2 && !conn.task && !conn.body.active() && conn.in.empty() &&
+           conn.out.empty() && !(conn.tls && conn.tls->hasUnsent());
+}
+
+void EventLoop::drain() {
+    draining = true;
+    accept_paused = accept_more = false;
+    // The process taking over may share this socket, so closing our descriptor alone would
+    // leave it in the interest list.
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, listen_fd, nullptr);
+    close(listen_fd);
+    listen_fd = -1;
+
+    // Closing erases from 'connections', so pick the connections out first.
+    std::vector<int> fds;
+    for (auto& [fd, conn] : connections) fds.push_back(fd);
+    for (int fd : fds) {
+        auto it = connections.find(fd);
+        if (it == connections.end()) continue;
+        Connection& conn = *it->second;
+        if (conn.h2) {
+            conn.h2->shutdown();
+            flush(conn);    // Closes the connection if no streams are open.
+        } else if (betweenRequests(conn)) {
+            closeConnection(conn);
+        }
+        // The rest close after their response: lastRequest() now says so.
+    }
+}
+
+bool EventLoop::rejectForMemory(Connection& conn) {
+    if (conn.task || conn.h2) {
+        // The suspended handler's response is still being written; a 503 can't go after it.
+        // Nor does HTTP/2 have a way to answer a frame too large to buffer.
+        closeConnection(conn);
+        return false;
+    }
+    // Responses to the requests before it still go out first.
+    conn.state = Connection::State::Closing;
+    conn.access.begin({}, {});
+    HttpResponse response(conn.out, true);
+    response.logTo(&conn.access);
+    response.sendError(503);
+    return flush(conn);
+}
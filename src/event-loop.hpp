@@ -0,0 +1,222 @@
+#pragma once
+
+#include "async-io.hpp"
+#include "buffer-pool.hpp"
+#include "http-server.hpp"
+#include "http2.hpp"
+#include "metrics.hpp"
+#include "read-buffer.hpp"
+#include "request-parser.hpp"
+#include "task.hpp"
+#include "timer-wheel.hpp"
+#include "tls.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <sys/epoll.h>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+ * @struct Connection
+ * @brief Per-connection state for the epoll reactor.
+ *
+ * Instead of a thread blocked in recv(), every client is a small state machine. Bytes are
+ * read into the loop's shared scratch buffer; only a partially received request is copied
+ * into 'in' (whose storage is released again once it empties), and only a response the
+ * kernel could not accept yet is kept in 'out'. An idle keep-alive connection therefore
+ * holds nothing but this struct, and a closed one is cleared and kept for the next accept.
+ */
+struct Connection {
+    enum class State {
+        Reading,    // Waiting for (more of) a request.
+        Writing,    // A response is queued and the socket was not writable.
+        Closing     // Flush what is queued, then close.
+    };
+
+    // What 'timer' is timing.
+    enum class Deadline {
+        None,       // Nothing: the server is busy with the connection, or timeouts are off.
+        Idle,       // No request in progress and nothing to send; or a send that is stuck.
+        Header,     // The head of a request, since its first byte arrived.
+        Body        // The next bytes of a streamed request body.
+    };
+
+    int fd;                     // The client socket, set to non-blocking.
+    uint32_t serial;            // Tells this connection apart from later ones on the same fd.
+    State state = State::Reading;
+    ReadBuffer in;              // Received bytes that do not yet form a complete request.
+    RequestParser parser;       // Progress through the request at the head of 'in'.
+    BodyStream body;            // An upload being streamed to its route, between head and response.
+    OutputQueue out;            // Response data not yet accepted by the kernel.
+    bool peer_closed = false;   // The client shut down its side of the connection.
+    bool read_paused = false;   // Stopped reading: 'out' passed its high-water mark, or 'task' runs.
+    AsyncContext async;         // Lets file bodies be read without blocking the loop.
+    Arena arena;                // Scratch memory of the current request; outlives 'task'.
+    Task<void> task;            // A handler suspended mid-request; later requests wait for it.
+    TimerWheel::Timer timer;    // Enforces the current Deadline; its id is the resumeToken().
+    Deadline deadline = Deadline::None;
+    unsigned served = 0;        // Requests taken on this connection.
+    std::chrono::steady_clock::time_point handle_started;  // Of the handler in 'task'.
+    AccessEntry access;         // Access log record of the request being answered.
+    std::unique_ptr<Http2Session> h2;   // Set once the client speaks HTTP/2; then 'in' holds frames.
+    std::unique_ptr<TlsSession> tls;    // Set on HTTPS connections; everything passes through it.
+
+    Connection(int fd, uint32_t serial, size_t max_body_bytes, BufferPool* buffers)
+        : fd(fd), serial(serial), in(buffers), parser(max_body_bytes) {}
+
+    /**
+     * @brief Drops everything about the client, ready for reuse by the next one.
+     *
+     * The timer must have been cancelled.
+     */
+    void clear();
+};
+
+
+/**
+ * @class EventLoop
+ * @brief A single-threaded, edge-triggered epoll reactor.
+ *
+ * The loop owns the listening socket's readiness and every accepted connection. Each wake-up
+ * drains the socket until EAGAIN (as edge-triggered epoll requires), parses every complete
+ * request, runs it through RequestHandler, and writes as much of the response as the kernel
+ * accepts. Whatever is left waits for the next EPOLLOUT.
+ *
+ * File bodies are read through the loop's AsyncIo rather than with blocking calls. The reads
+ * queued while handling one batch of events are submitted together at the end of it, and a
+ * connection whose body was waiting for the disk is resumed when its read completes.
+ * Coroutine handlers (see Task) suspend on those same reads: the loop keeps the suspended
+ * Task in its connection, handles nothing else from that client meanwhile, and carries on
+ * with the client's next request once the Task has finished.
+ *
+ * Every connection has one timer on the loop's TimerWheel, set for whichever of the idle,
+ * header or body timeouts applies to what it is waiting for; epoll_wait() returns in time
+ * for the nearest one.
+ *
+ * Read buffers come from the loop's BufferPool, which caps what all of its connections may
+ * hold together; a request that would need more is refused with 503.
+ *
+ * A connection that opens with the HTTP/2 preface, or upgrades with 'Upgrade: h2c', is handed
+ * to an Http2Session: its streams are handled concurrently, each suspending on its own, and
+ * every flush first lets the session frame more of their bodies.
+ *
+ * With TLS, a connection's TlsSession shakes hands before anything else is read, driven by
+ * whichever readiness event it waits on, and then stands between the socket and the buffers:
+ * reads return plaintext, and flushes write the queue through it (see TlsSession::flush()).
+ *
+ * When the server drains (RequestHandler::startDraining()), the loop stops accepting, closes
+ * keep-alive connections between requests, lets the others finish the response they owe
+ * (marked as the connection's last) and sends HTTP/2 clients GOAWAY; run() returns once the
+ * last connection has closed.
+ */
+class EventLoop {
+private:
+    int epoll_fd;       // The epoll instance.
+    int listen_fd;      // The listening socket, switched to non-blocking.
+    const RequestHandler& handler;  // Route table shared by every loop.
+    std::unique_ptr<AsyncIo> io;    // File reads; outlives the connections that use it.
+    uint32_t next_serial = 0;
+    BufferPool buffers;         // Storage for the connections' read buffers.
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;  // Live connections by fd.
+    std::vector<std::unique_ptr<Connection>> spare_connections;  // Closed ones, kept for reuse.
+    std::vector<char> scratch;  // Shared receive buffer, reused for every read on this loop.
+    std::vector<uint64_t> finished_tasks;   // resumeToken()s of connections whose Task ended.
+    TimerWheel timers;          // Every connection's current timeout.
+    WorkerMetrics& metrics;     // This loop's thread's counters; the loop is built on its thread.
+    HttpRequest request;        // Parsed request being handled; reused to avoid re-initializing it.
+    bool draining = false;      // Stopped accepting; closing connections as they go quiet.
+    bool accept_paused = false; // Left connections in the backlog at the connection limit.
+    bool accept_more = false;   // Left connections in the backlog at the end of a batch.
+    unsigned accept_batch;      // Connections accepted per iteration, at most.
+
+    // Accepts every pending connection on listen_fd that Admission lets in.
+    void acceptNew();
+    bool onReadable(Connection& conn);      // Drains the socket and processes requests; false if closed.
+    void onWritable(Connection& conn);      // Flushes queued output.
+
+    // Flushes a connection whose streamed body was waiting for a read; token from resumeToken().
+    void resume(uint64_t token);
+
+    // Drops the finished Tasks noted in finished_tasks and continues their connections.
+    void finishTasks();
+
+    // Arms conn.timer for what the connection now waits on; called whenever that may change.
+    void updateDeadline(Connection& conn);
+
+    // Closes a connection whose timer fired, answering 408 if a request was under way.
+    void expire(uint64_t token);
+    static uint64_t resumeToken(const Connection& conn) {
+        return static_cast<uint64_t>(conn.serial) << 32 | static_cast<uint32_t>(conn.fd);
+    }
+
+    /**
+     * @brief Parses and handles every complete request in data.
+     * @return The number of bytes consumed; the rest is an incomplete request.
+     */
+    size_t processInput(Connection& conn, char* data, size_t length);
+
+    /**
+     * @brief Handles the complete requests in conn.in, then consumes them.
+     * @return false if the connection was closed.
+     */
+    bool processBuffered(Connection& conn);
+
+    // Sends the response of a completely received streamed body.
+    void finishBody(Connection& conn);
+
+    // Switches the connection to HTTP/2; the caller passes it the bytes that follow.
+    void startHttp2(Connection& conn);
+
+    /**
+     * @brief Flushes, then copies whatever output still borrows from the read buffers.
+     *
+     * Must run after handling requests and before the bytes they were parsed from are
+     * overwritten or freed. In the common case the flush sends everything and nothing is copied.
+     * @return false if the connection was closed.
+     */
+    bool settleOutput(Connection& conn);
+
+    /**
+     * @brief Writes queued output until it is drained or the socket would block.
+     * @return false if the connection hit an error and was closed.
+     */
+    bool flush(Connection& conn);
+    void closeConnection(Connection& conn);
+
+    // Advances a TLS connection's handshake; false if it failed and the connection was closed.
+    bool handshake(Connection& conn);
+
+    // Stops accepting and closes or winds down every connection, as described above.
+    void drain();
+
+    // Whether a connection is kept open only for a next request that has not begun.
+    static bool betweenRequests(const Connection& conn);
+
+    // Answers a request that could not be buffered within the memory limit with 503 and
+    // closes the connection once it is sent; false if it is closed already.
+    bool rejectForMemory(Connection& conn);
+
+public:
+    /**
+     * @param buffer_limit Most bytes of read buffers this loop's connections may hold (0: no limit).
+     * @param accept_batch Most connections accepted per iteration of the loop.
+     */
+    EventLoop(int listen_fd, const RequestHandler& handler, std::unique_ptr<AsyncIo> io,
+              size_t buffer_limit = 0, unsigned accept_batch = 64);
+    ~EventLoop();
+
+    /**
+     * @brief Runs the reactor until it has drained.
+     */
+    void run();
+};
+
+
+/**
+ * @brief Puts a file descriptor into non-blocking mode.
+ * @return false if fcntl() failed.
+ */
+bool setNonBlocking(int fd);
@@ -0,0 +1,290 @@
+#include "file-cache.hpp"
+#include "compression.hpp"
+#include "conditional.hpp"
+
+#include <cerrno>
+#include <charconv>
+#include <iostream>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// Directory events after which a cached file below it may be stale.
+constexpr uint32_t WATCH_MASK = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                                IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF |
+                                IN_ONLYDIR;
+
+constexpr std::string_view CONTENT_TYPE = "application/octet-stream";
+
+
+size_t CachedFile::bytes() const {
+    return sizeof(CachedFile) + identity.head.size() + identity.body.size() +
+           gzip.head.size() + gzip.body.size();
+}
+
+bool isPlainName(std::string_view name) {
+    if (name.empty()) return false;
+    while (true) {
+        size_t slash = name.find('/');
+        std::string_view segment = name.substr(0, slash);
+        if (segment.empty() || segment == "." || segment == "..") return false;
+        if (slash == std::string_view::npos) return true;
+        name.remove_prefix(slash + 1);
+    }
+}
+
+template <typename String>
+static void appendHex(String& out, uint64_t value) {
+    char digits[16];
+    char* end = std::to_chars(digits, digits + sizeof(digits), value, 16).ptr;
+    out.append(digits, end);
+}
+
+// A strong validator derived from the inode, size and modification time; cheap to compute
+// and it changes whenever the file does.
+template <typename String>
+static void appendETagTo(String& out, const struct stat& st, std::string_view suffix) {
+    out += '"';
+    appendHex(out, st.st_ino);
+    out += '-';
+    appendHex(out, st.st_size);
+    out += '-';
+    appendHex(out, static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec);
+    out += suffix;
+    out += '"';
+}
+
+std::string makeETag(const struct stat& st, std::string_view suffix) {
+    std::string etag;
+    appendETagTo(etag, st, suffix);
+    return etag;
+}
+
+void appendETag(std::pmr::string& out, const struct stat& st, std::string_view suffix) {
+    appendETagTo(out, st, suffix);
+}
+
+std::string makeFileHead(size_t length, std::string_view etag, std::string_view last_modified,
+                         std::string_view extra) {
+    char digits[20];
+    char* end = std::to_chars(digits, digits + sizeof(digits), length).ptr;
+    std::string head = "HTTP/1.1 200 OK\r\nContent-Type: ";
+    head += CONTENT_TYPE;
+    head += "\r\nContent-Length: ";
+    head.append(digits, end);
+    head += "\r\nETag: ";
+    head += etag;
+    head += "\r\nLast-Modified: ";
+    head += last_modified;
+    head += "\r\n";
+    head += extra;
+    return head;
+}
+
+
+void FileCache::Shard::erase(std::list<Entry>::iterator it) {
+    bytes -= it->second->bytes();
+    index.erase(it->first);
+    lru.erase(it);
+}
+
+FileCache::FileCache(const std::string& base_dir, size_t capacity_bytes, size_t gzip_min_bytes)
+    : base_dir(base_dir), shard_capacity(capacity_bytes / SHARDS),
+      max_entry_bytes(shard_capacity / 4), gzip_min_bytes(gzip_min_bytes) {
+    if (capacity_bytes == 0) return;
+
+    inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd >= 0) {
+        stop_fd = eventfd(0, EFD_CLOEXEC);
+        if (stop_fd < 0) {
+            close(inotify_fd);
+            inotify_fd = -1;
+        }
+    }
+    if (inotify_fd < 0) {
+        std::cerr << "[FileCache] inotify unavailable; revalidating cached files with stat()\n";
+        return;
+    }
+    watcher = std::thread([this] { watchLoop(); });
+}
+
+FileCache::~FileCache() {
+    if (watcher.joinable()) {
+        uint64_t one = 1;
+        ssize_t ignored = write(stop_fd, &one, sizeof(one));
+        (void)ignored;
+        watcher.join();
+    }
+    if (stop_fd >= 0) close(stop_fd);
+    if (inotify_fd >= 0) close(inotify_fd);
+}
+
+FileCache::Shard& FileCache::shardFor(std::string_view name) {
+    return shards[KeyHash{}(name) % SHARDS];
+}
+
+FileCache::Lookup FileCache::find(std::string_view name) {
+    if (shard_capacity == 0 || !isPlainName(name)) return {};
+
+    Shard& shard = shardFor(name);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(name);
+        if (it != shard.index.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            std::shared_ptr<const CachedFile> file = it->second->second;
+            if (inotify_fd >= 0 || isCurrent(name, *file)) return {std::move(file)};
+            shard.erase(it->second);
+        }
+    }
+
+    // A miss. The directory must be watched before the caller opens the file, so a change
+    // made while it is being read still bumps the generation and the load is not kept.
+    if (inotify_fd >= 0 && !watch(name)) return {};
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return {nullptr, shard.generation};
+}
+
+std::shared_ptr<const CachedFile> FileCache::store(std::string_view name, const struct stat& st,
+                                                   std::string contents, uint64_t generation) {
+    size_t size = contents.size();
+    if (!accepts(size)) return nullptr;
+
+    auto file = std::make_shared<CachedFile>();
+    file->st = st;
+    std::string& body = file->identity.body;
+    body = std::move(contents);
+
+    bool compressible = size >= gzip_min_bytes;
+    file->last_modified.resize(HTTP_DATE_BYTES);
+    formatHttpDate(st.st_mtime, file->last_modified.data());
+    file->identity.etag = makeETag(st, "");
+    file->identity.head = makeFileHead(size, file->identity.etag, file->last_modified,
+                                       compressible ? "Vary: Accept-Encoding\r\n" : "");
+    if (compressible) {
+        std::string compressed;
+        CompressorHandle compressor = acquireCompressor();
+        // Keep the gzip variant only if it is actually smaller.
+        if (compressor->compress(body, true, compressed) && compressed.size() < size) {
+            file->gzip.body = std::move(compressed);
+            file->gzip.etag = makeETag(st, "-gz");
+            file->gzip.head = makeFileHead(file->gzip.body.size(), file->gzip.etag,
+                                           file->last_modified,
+                                           "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n");
+        }
+    }
+
+    if (!isPlainName(name)) return file;
+    Shard& shard = shardFor(name);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.generation != generation) return file;    // Changed while we were reading it.
+
+    auto existing = shard.index.find(name);
+    if (existing != shard.index.end()) shard.erase(existing->second);
+    shard.lru.emplace_front(std::string(name), file);
+    shard.index.emplace(shard.lru.front().first, shard.lru.begin());
+    shard.bytes += file->bytes();
+    while (shard.bytes > shard_capacity && shard.lru.size() > 1) {
+        shard.erase(std::prev(shard.lru.end()));
+    }
+    return file;
+}
+
+void FileCache::invalidate(std::string_view name) {
+    if (shard_capacity == 0) return;
+    Shard& shard = shardFor(name);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    ++shard.generation;
+    auto it = shard.index.find(name);
+    if (it != shard.index.end()) shard.erase(it->second);
+}
+
+void FileCache::invalidateAll() {
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        ++shard.generation;
+        shard.lru.clear();
+        shard.index.clear();
+        shard.bytes = 0;
+    }
+}
+
+bool FileCache::isCurrent(std::string_view name, const CachedFile& file) const {
+    std::string path = base_dir + "/" + std::string(name);
+    struct stat now{};
+    return stat(path.c_str(), &now) == 0 && now.st_ino == file.st.st_ino &&
+           now.st_size == file.st.st_size && now.st_mtim.tv_sec == file.st.st_mtim.tv_sec &&
+           now.st_mtim.tv_nsec == file.st.st_mtim.tv_nsec;
+}
+
+bool FileCache::watch(std::string_view name) {
+    size_t slash = name.rfind('/');
+    std::string_view prefix = slash == std::string_view::npos ? "" : name.substr(0, slash + 1);
+
+    std::lock_guard<std::mutex> lock(watch_mutex);
+    if (watched_prefixes.find(prefix) != watched_prefixes.end()) return true;
+
+    std::string dir = base_dir;
+    if (!prefix.empty()) {
+        dir += '/';
+        dir += prefix.substr(0, prefix.size() - 1);
+    }
+    int wd = inotify_add_watch(inotify_fd, dir.c_str(), WATCH_MASK);
+    if (wd < 0) return false;
+    // The same directory reached under another name (a symlink): its events would be
+    // reported under the first name only, so don't cache through this one.
+    if (watches.find(wd) != watches.end()) return false;
+
+    watches.emplace(wd, std::string(prefix));
+    watched_prefixes.emplace(std::string(prefix), wd);
+    return true;
+}
+
+// Runs on the watcher thread: turns directory events into invalidations.
+void FileCache::watchLoop() {
+    alignas(inotify_event) char events[4096];
+    pollfd fds[2] = {{inotify_fd, POLLIN, 0}, {stop_fd, POLLIN, 0}};
+
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+
+        ssize_t n = read(inotify_fd, events, sizeof(events));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+
+        for (char* p = events; p < events + n;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            // Lost events: anything may have changed.
+            if (event->mask & IN_Q_OVERFLOW) {
+                invalidateAll();
+                continue;
+            }
+
+            std::string prefix;
+            {
+                std::lock_guard<std::mutex> lock(watch_mutex);
+                auto it = watches.find(event->wd);
+                if (it == watches.end()) continue;
+                prefix = it->second;
+                if (event->mask & IN_IGNORED) {
+                    watched_prefixes.erase(prefix);
+                    watches.erase(it);
+                }
+            }
+
+            // The directory itself went away or moved; its names now mean something else.
+            if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                invalidateAll();
+            } else if (event->len > 0) {
+                invalidate(prefix + event->name);
+            }
+        }
+    }
+}
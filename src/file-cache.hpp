@@ -0,0 +1,171 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <thread>
+#include <unordered_map>
+
+
+/**
+ * @struct CachedFile
+ * @brief A file's bytes together with ready-made response heads, as held by FileCache.
+ *
+ * Entries are immutable and shared: a response keeps its entry alive until the bytes have
+ * been written, even if the cache evicts or invalidates it in the meantime.
+ */
+struct CachedFile {
+    // One representation of the file.
+    struct Variant {
+        std::string head;   // Status line and headers up to, not including, 'Connection:'.
+        std::string body;
+        std::string etag;   // Quoted entity tag, also present in 'head'.
+    };
+
+    Variant identity;
+    Variant gzip;           // Empty body when compression would not pay off.
+    struct stat st{};       // What the file looked like when it was read.
+    std::string last_modified;  // st_mtime as an HTTP date, also present in the heads.
+
+    size_t bytes() const;   // Memory charged against the cache budget.
+};
+
+
+/**
+ * @brief The entity tag of a file's contents as described by st, e.g. "\"1f2a-400-17a...\"".
+ *
+ * Built from inode, size and modification time, so it changes whenever the file does.
+ * @param suffix Appended inside the quotes to tell representations apart ("-gz").
+ */
+std::string makeETag(const struct stat& st, std::string_view suffix = {});
+
+/**
+ * @brief Appends makeETag(st, suffix) to out, e.g. a header line in a request's Arena.
+ */
+void appendETag(std::pmr::string& out, const struct stat& st, std::string_view suffix = {});
+
+/**
+ * @brief A 200 response head for a file body of 'length' bytes, up to 'Connection:'.
+ * @param extra Header lines appended after Last-Modified, e.g. Content-Encoding and Vary.
+ */
+std::string makeFileHead(size_t length, std::string_view etag, std::string_view last_modified,
+                         std::string_view extra);
+
+/**
+ * @brief Whether 'name' is a plain relative path ("a.txt", "sub/a.txt"): no empty, "." or
+ * ".." segments.
+ *
+ * Only such names are cached, since they match the names inotify reports one to one, where
+ * "./a.txt" or "sub//a.txt" could never be invalidated; and only they are packed in bundles.
+ */
+bool isPlainName(std::string_view name);
+
+
+/**
+ * @class FileCache
+ * @brief A sharded, size-bounded LRU cache of the files served by GET /files/.
+ *
+ * Each entry holds the file's contents, its gzip-compressed form and precomputed response
+ * heads (Content-Length, ETag, Last-Modified), so a hit is answered by queueing pointers: no
+ * open(), stat() or read(), just the socket write. Keys are spread over independently locked shards, each
+ * with its own LRU list and a share of the byte budget, so workers rarely contend.
+ *
+ * Entries are invalidated when the file changes on disk: an inotify watch on each directory
+ * holding a cached file is read by a background thread. If inotify is unavailable, every hit
+ * is revalidated with stat() against the cached size, mtime and inode instead. The server's
+ * own writes call invalidate() directly.
+ */
+class FileCache {
+public:
+    /**
+     * @brief Result of find(): either an entry, or the generation to pass to store().
+     */
+    struct Lookup {
+        std::shared_ptr<const CachedFile> file;
+        uint64_t generation = UINT64_MAX;   // UINT64_MAX: the name can't be cached right now.
+    };
+
+    /**
+     * @param base_dir Directory the cached names are relative to.
+     * @param capacity_bytes Total budget; 0 disables the cache.
+     * @param gzip_min_bytes Files smaller than this get no gzip variant.
+     */
+    FileCache(const std::string& base_dir, size_t capacity_bytes, size_t gzip_min_bytes);
+    ~FileCache();
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
+
+    /**
+     * @brief Looks up a file by its name below base_dir, marking it most recently used.
+     */
+    Lookup find(std::string_view name);
+
+    /**
+     * @brief Builds an entry from a file's contents and caches it.
+     *
+     * 'generation' comes from the find() that missed. If the name was invalidated since then,
+     * the entry is still returned (it reflects the file as it was read) but not kept.
+     * @param st The file's metadata from before it was read.
+     * @return The entry, or null if the file is too large to cache.
+     */
+    std::shared_ptr<const CachedFile> store(std::string_view name, const struct stat& st,
+                                            std::string contents, uint64_t generation);
+
+    /**
+     * @brief Whether a file of this size would be kept by store().
+     */
+    bool accepts(size_t size) const { return shard_capacity > 0 && size <= max_entry_bytes; }
+
+    /**
+     * @brief Drops the entry for a name, e.g. after the server wrote that file.
+     */
+    void invalidate(std::string_view name);
+
+private:
+    static constexpr size_t SHARDS = 16;
+
+    // Lets the maps be searched with a string_view without building a std::string.
+    struct KeyHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key); }
+    };
+
+    struct Shard {
+        using Entry = std::pair<std::string, std::shared_ptr<const CachedFile>>;
+
+        std::mutex mutex;
+        std::list<Entry> lru;   // Most recently used first.
+        std::unordered_map<std::string, std::list<Entry>::iterator, KeyHash, std::equal_to<>> index;
+        size_t bytes = 0;
+        uint64_t generation = 0;    // Bumped by every invalidation, so stale loads are not kept.
+
+        void erase(std::list<Entry>::iterator it);
+    };
+
+    std::string base_dir;
+    size_t shard_capacity;      // Byte budget of each shard.
+    size_t max_entry_bytes;     // Larger files are streamed from disk instead.
+    size_t gzip_min_bytes;
+    std::array<Shard, SHARDS> shards;
+
+    // Change notification. 'watches' maps a watch descriptor to the name prefix of its
+    // directory ("" for base_dir itself, "sub/" for base_dir/sub).
+    int inotify_fd = -1;
+    int stop_fd = -1;           // eventfd that tells the watcher thread to exit.
+    std::mutex watch_mutex;
+    std::unordered_map<int, std::string> watches;
+    std::unordered_map<std::string, int, KeyHash, std::equal_to<>> watched_prefixes;
+    std::thread watcher;
+
+    Shard& shardFor(std::string_view name);
+    bool watch(std::string_view name);  // Ensures the name's directory is watched.
+    void watchLoop();
+    void invalidateAll();
+    bool isCurrent(std::string_view name, const CachedFile& file) const;  // stat() fallback.
+};
@@ -0,0 +1,154 @@
+#include "file-reader.hpp"
+#include "async-io.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+#include <utility>
+
+
+FileReader::Shared::~Shared() {
+    close(fd);
+}
+
+FileReader::FileReader(int file_fd, size_t length, const AsyncContext* context, off_t start)
+    : shared(std::make_shared<Shared>()), async(context && context->io ? context : nullptr),
+      total(length), start(start) {
+    shared->fd = file_fd;
+    if (async) {
+        shared->resume = async->resume;
+        if (total > 0) startRead();
+    }
+}
+
+FileReader::~FileReader() {
+    // A read still in flight keeps 'shared' alive; it must not wake a connection that is gone.
+    shared->resume = nullptr;
+}
+
+void FileReader::startRead() {
+    size_t want = std::min(total - offset, BLOCK_BYTES);
+    shared->filling.resize(want);
+    shared->in_flight = true;
+    async->io->read(shared->fd, shared->filling.data(), want, start + offset, [state = shared](ssize_t result) {
+        state->in_flight = false;
+        state->result = result;
+        if (state->waiting && state->resume) {
+            state->waiting = false;
+            // Call a copy: resuming may destroy the reader, which clears state->resume.
+            std::function<void()> resume = state->resume;
+            resume();
+        }
+    });
+}
+
+FileReader::Result FileReader::next(std::string& block) {
+    if (offset == total) return Result::End;
+    if (!async) return readBlocking(block);
+
+    if (shared->in_flight) {
+        shared->waiting = true;
+        return Result::Pending;
+    }
+    // 0 bytes before the end means the file shrank under us.
+    if (shared->result <= 0) return Result::Error;
+
+    // Hand over the finished buffer and read the next block into the one handed back.
+    block.swap(shared->filling);
+    block.resize(shared->result);
+    offset += block.size();
+    if (offset < total) startRead();
+    return Result::Ready;
+}
+
+FileReader::Result FileReader::readBlocking(std::string& block) {
+    size_t want = std::min(total - offset, BLOCK_BYTES);
+    block.resize(want);
+    ssize_t n;
+    do {
+        n = pread(shared->fd, block.data(), want, start + offset);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return Result::Error;
+    block.resize(n);
+    offset += n;
+    return Result::Ready;
+}
+
+
+StreamSource::Status FileStreamSource::produce(std::string& out) {
+    switch (reader->next(out)) {
+        case FileReader::Result::Ready:
+            return reader->atEnd() ? Status::Done : Status::More;
+        case FileReader::Result::Pending:
+            return Status::Pending;
+        case FileReader::Result::End:
+            out.clear();
+            return Status::Done;
+        case FileReader::Result::Error:
+            break;
+    }
+    return Status::Error;
+}
+
+
+ReadFile::State::~State() {
+    close(fd);
+}
+
+ReadFile::ReadFile(const AsyncContext* async, int file_fd, size_t length)
+    : state(std::make_shared<State>()) {
+    state->io = async ? async->io : nullptr;
+    state->fd = file_fd;
+    state->data.resize(length);
+}
+
+ReadFile::~ReadFile() {
+    // Only reached with a read in flight if the awaiting coroutine was destroyed.
+    state->waiter = {};
+}
+
+bool ReadFile::await_ready() {
+    if (state->data.empty()) {
+        state->ok = true;
+        return true;
+    }
+    if (state->io) return false;
+
+    while (state->done < state->data.size()) {
+        ssize_t n = pread(state->fd, state->data.data() + state->done,
+                          state->data.size() - state->done, state->done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return true;    // Read error, or the file shrank while we read it.
+        state->done += n;
+    }
+    state->ok = true;
+    return true;
+}
+
+void ReadFile::await_suspend(std::coroutine_handle<> waiter) {
+    state->waiter = waiter;
+    readMore(state);
+}
+
+FileContents ReadFile::await_resume() {
+    FileContents contents;
+    contents.ok = state->ok;
+    if (state->ok) contents.data = std::move(state->data);
+    return contents;
+}
+
+// Queues a read of the rest of the file; short reads queue another one from the completion.
+void ReadFile::readMore(const std::shared_ptr<State>& state) {
+    state->io->read(state->fd, state->data.data() + state->done, state->data.size() - state->done,
+                    state->done, [state](ssize_t result) {
+        if (result > 0) {
+            state->done += result;
+            if (state->done < state->data.size()) {
+                readMore(state);
+                return;
+            }
+            state->ok = true;
+        }
+        if (std::coroutine_handle<> waiter = std::exchange(state->waiter, {})) waiter.resume();
+    });
+}
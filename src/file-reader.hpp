@@ -0,0 +1,145 @@
+#pragma once
+
+#include "output-queue.hpp"
+
+#include <coroutine>
+#include <functional>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+
+class AsyncIo;
+struct AsyncContext;
+
+
+/**
+ * @class FileReader
+ * @brief Reads a range of an open file, one block at a time, for a streamed body.
+ *
+ * Without an AsyncContext every block is a blocking pread(), which is what a thread serving
+ * one connection wants. With one, blocks are read through the event loop's AsyncIo, one block
+ * ahead of the consumer: next() hands over a finished block and immediately queues the read
+ * of the following one, so the disk and the socket work in parallel and the loop never waits.
+ */
+class FileReader {
+public:
+    enum class Result {
+        Ready,      // 'block' holds the next bytes of the file.
+        Pending,    // The next block is still being read; the context's resume() will be called.
+        End,        // The whole range has been read.
+        Error       // A read failed, or the file shrank under us.
+    };
+
+    // Bytes read per block.
+    static constexpr size_t BLOCK_BYTES = 64 * 1024;
+
+    /**
+     * @param file_fd An open file; the reader takes ownership of it.
+     * @param length Bytes to read, starting at offset 'start'.
+     * @param async Read without blocking through this context, or block if null.
+     */
+    FileReader(int file_fd, size_t length, const AsyncContext* async = nullptr, off_t start = 0);
+    ~FileReader();
+    FileReader(const FileReader&) = delete;
+    FileReader& operator=(const FileReader&) = delete;
+
+    /**
+     * @brief Replaces the contents of block with the next bytes of the file.
+     */
+    Result next(std::string& block);
+
+    size_t length() const { return total; }
+    bool atEnd() const { return offset == total; }
+
+private:
+    // Everything a read in flight may touch. It is shared with the read's completion, so it
+    // outlives the reader if the connection goes away first, and closes the file last.
+    struct Shared {
+        int fd;
+        std::string filling;        // Buffer the next block is being read into.
+        bool in_flight = false;
+        ssize_t result = 0;         // Outcome of the last finished read.
+        bool waiting = false;       // next() said Pending; call resume() when the read is done.
+        std::function<void()> resume;   // Cleared when the reader is destroyed.
+
+        ~Shared();
+    };
+
+    std::shared_ptr<Shared> shared;
+    const AsyncContext* async;
+    size_t total;
+    off_t start;                    // File offset of the range's first byte.
+    size_t offset = 0;              // Bytes handed out by next().
+
+    void startRead();               // Queues the read of the block at 'offset'.
+    Result readBlocking(std::string& block);
+};
+
+
+/**
+ * @class FileStreamSource
+ * @brief Sends a file as a plain (Content-Length framed) body, block by block.
+ *
+ * Used by event loops instead of sendfile(2), which would block the loop whenever the file is
+ * not in the page cache.
+ */
+class FileStreamSource : public StreamSource {
+private:
+    std::unique_ptr<FileReader> reader;
+
+public:
+    explicit FileStreamSource(std::unique_ptr<FileReader> reader) : reader(std::move(reader)) {}
+
+    Status produce(std::string& out) override;
+};
+
+
+/**
+ * @struct FileContents
+ * @brief What awaiting a ReadFile produces.
+ */
+struct FileContents {
+    bool ok = false;    // false if a read failed or the file was shorter than expected.
+    std::string data;
+};
+
+/**
+ * @class ReadFile
+ * @brief Awaitable that reads a whole file into memory: 'co_await ReadFile(async, fd, size)'.
+ *
+ * With an AsyncContext the read goes through the loop's AsyncIo and the awaiting coroutine is
+ * resumed from its completion. Without one the file is read with blocking pread() calls and
+ * the coroutine never suspends. The file and the buffer belong to state shared with the read
+ * in flight, so a coroutine destroyed while it waits leaves the kernel nothing dangling.
+ */
+class ReadFile {
+public:
+    /**
+     * @param file_fd An open file, read from offset 0; ReadFile takes ownership of it.
+     * @param length Bytes to read.
+     */
+    ReadFile(const AsyncContext* async, int file_fd, size_t length);
+    ~ReadFile();
+    ReadFile(const ReadFile&) = delete;
+    ReadFile& operator=(const ReadFile&) = delete;
+
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> waiter);
+    FileContents await_resume();
+
+private:
+    struct State {
+        AsyncIo* io = nullptr;
+        int fd;
+        std::string data;
+        size_t done = 0;            // Bytes read so far.
+        bool ok = false;
+        std::coroutine_handle<> waiter;     // Cleared if the awaiting coroutine is destroyed.
+
+        ~State();
+    };
+
+    std::shared_ptr<State> state;
+
+    static void readMore(const std::shared_ptr<State>& state);
+};
@@ -0,0 +1,165 @@
+#include "handoff.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+// Names the successor's end of the channel; set only in the successor's environment.
+constexpr char HANDOFF_ENV[] = "HTTP_SERVER_HANDOFF_FD";
+
+// More listeners than any --workers value that makes sense.
+constexpr size_t MAX_LISTENERS = 256;
+
+// Sent back by the successor once it is ready to serve.
+constexpr char READY = 'R';
+
+
+Takeover receiveListeners() {
+    Takeover takeover;
+    const char* value = getenv(HANDOFF_ENV);
+    if (!value) return takeover;
+    int channel = atoi(value);
+    unsetenv(HANDOFF_ENV);     // Not for this process's own successors.
+    fcntl(channel, F_SETFD, FD_CLOEXEC);
+
+    char count;
+    iovec data{&count, 1};
+    alignas(cmsghdr) char control[CMSG_SPACE(MAX_LISTENERS * sizeof(int))];
+    msghdr message{};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t n;
+    do {
+        n = recvmsg(channel, &message, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+
+    cmsghdr* header = n == 1 ? CMSG_FIRSTHDR(&message) : nullptr;
+    if (!header || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS ||
+        (message.msg_flags & MSG_CTRUNC)) {
+        std::cerr << "Failed to receive the listening sockets from the previous process\n";
+        exit(1);
+    }
+    size_t listeners = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    takeover.listeners.resize(listeners);
+    std::memcpy(takeover.listeners.data(), CMSG_DATA(header), listeners * sizeof(int));
+    takeover.channel = channel;
+    return takeover;
+}
+
+void confirmTakeover(Takeover& takeover) {
+    if (takeover.channel < 0) return;
+    // If the predecessor is gone already, there is no one left to tell.
+    ssize_t ignored = write(takeover.channel, &READY, 1);
+    (void)ignored;
+    close(takeover.channel);
+    takeover.channel = -1;
+}
+
+// This process's argv, as the kernel recorded it at exec.
+static std::vector<std::string> commandLine() {
+    std::ifstream file("/proc/self/cmdline", std::ios::binary);
+    std::string all((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::vector<std::string> args;
+    for (size_t start = 0; start < all.size();) {
+        size_t end = all.find('\0', start);
+        if (end == std::string::npos) end = all.size();
+        args.push_back(all.substr(start, end - start));
+        start = end + 1;
+    }
+    return args;
+}
+
+// Waits up to timeout_s for the successor's READY; false if it closed the channel first.
+static bool awaitReady(int channel, unsigned timeout_s) {
+    pollfd entry{channel, POLLIN, 0};
+    int n;
+    do {
+        n = poll(&entry, 1, static_cast<int>(timeout_s * 1000));
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return false;
+    char reply = 0;
+    return read(channel, &reply, 1) == 1 && reply == READY;
+}
+
+bool startSuccessor(const std::vector<int>& listeners, unsigned timeout_s) {
+    if (listeners.empty() || listeners.size() > MAX_LISTENERS) return false;
+    std::vector<std::string> args = commandLine();
+    if (args.empty()) {
+        std::cerr << "Restart failed: cannot read this process's command line\n";
+        return false;
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+        std::cerr << "Restart failed: socketpair: " << strerror(errno) << "\n";
+        return false;
+    }
+
+    // Everything the child needs is built before fork(): in a threaded process, the child
+    // may only make async-signal-safe calls until it execs.
+    std::vector<char*> argv;
+    for (std::string& arg : args) argv.push_back(arg.data());
+    argv.push_back(nullptr);
+    std::string channel_var = std::string(HANDOFF_ENV) + "=" + std::to_string(fds[1]);
+    std::vector<char*> envp;
+    for (char** var = environ; *var; ++var) {
+        if (strncmp(*var, HANDOFF_ENV, sizeof(HANDOFF_ENV) - 1) != 0) envp.push_back(*var);
+    }
+    envp.push_back(channel_var.data());
+    envp.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // The signals the parent handles stay blocked across exec, so one that arrives
+        // before the successor is set up waits for it instead of killing it.
+        fcntl(fds[1], F_SETFD, 0);  // The one descriptor meant to survive exec.
+        execvpe(argv[0], argv.data(), envp.data());
+        _exit(127);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        std::cerr << "Restart failed: fork: " << strerror(errno) << "\n";
+        close(fds[0]);
+        return false;
+    }
+
+    char count = static_cast<char>(listeners.size());
+    iovec data{&count, 1};
+    std::vector<char> control(CMSG_SPACE(listeners.size() * sizeof(int)));
+    msghdr message{};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(listeners.size() * sizeof(int));
+    std::memcpy(CMSG_DATA(header), listeners.data(), listeners.size() * sizeof(int));
+
+    bool ready = sendmsg(fds[0], &message, MSG_NOSIGNAL) == 1 && awaitReady(fds[0], timeout_s);
+    close(fds[0]);
+    if (!ready) {
+        // Whatever state it is in, it must not end up serving next to us half set up.
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        std::cerr << "Restart failed: the new process exited or did not take over within "
+                  << timeout_s << "s\n";
+        return false;
+    }
+    std::cout << "[HttpServer] Process " << pid << " took over the listening sockets\n";
+    return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+
+
+/**
+ * Zero-downtime restarts: a running server hands its listening sockets to a new copy of
+ * itself, which starts accepting on them, before the old one stops.
+ *
+ * The sockets, not copies of them, change hands over a Unix socket (SCM_RIGHTS), so nothing
+ * is ever unbound: connections that arrive during the switch queue in the same accept
+ * backlog and are picked up by whichever process accepts first. The old process only starts
+ * draining once the new one has confirmed it is ready, so a successor that fails to start
+ * (a bad binary, an unloadable certificate) leaves the old one serving.
+ */
+
+/**
+ * @struct Takeover
+ * @brief What a process started by startSuccessor() received from its predecessor.
+ */
+struct Takeover {
+    std::vector<int> listeners;     // Listening sockets, in the order the predecessor had them.
+    int channel = -1;               // Where to confirmTakeover(); -1 if not started that way.
+};
+
+/**
+ * @brief Receives the predecessor's listening sockets, if this process was started to take
+ * over from one; otherwise returns an empty Takeover. Exits if the handoff is broken.
+ */
+Takeover receiveListeners();
+
+/**
+ * @brief Tells the predecessor that this process serves on its sockets now, so it can drain.
+ */
+void confirmTakeover(Takeover& takeover);
+
+/**
+ * @brief Starts a new process from this one's command line and hands it the listeners.
+ * @param timeout_s Seconds the successor has to confirmTakeover().
+ * @return true once the successor has confirmed; false (with a message) if it could not be
+ *         started, exited or timed out, in which case it has been stopped.
+ */
+bool startSuccessor(const std::vector<int>& listeners, unsigned timeout_s);
@@ -0,0 +1,359 @@
+#include "hpack.hpp"
+
+#include <array>
+#include <charconv>
+
+
+namespace {
+
+struct StaticEntry {
+    std::string_view name;
+    std::string_view value;
+};
+
+// RFC 7541 Appendix A; index 1 is STATIC_TABLE[0].
+constexpr StaticEntry STATIC_TABLE[] = {
+    {":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"},
+    {":path", "/index.html"}, {":scheme", "http"}, {":scheme", "https"}, {":status", "200"},
+    {":status", "204"}, {":status", "206"}, {":status", "304"}, {":status", "400"},
+    {":status", "404"}, {":status", "500"}, {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"}, {"accept-language", ""}, {"accept-ranges", ""},
+    {"accept", ""}, {"access-control-allow-origin", ""}, {"age", ""}, {"allow", ""},
+    {"authorization", ""}, {"cache-control", ""}, {"content-disposition", ""},
+    {"content-encoding", ""}, {"content-language", ""}, {"content-length", ""},
+    {"content-location", ""}, {"content-range", ""}, {"content-type", ""}, {"cookie", ""},
+    {"date", ""}, {"etag", ""}, {"expect", ""}, {"expires", ""}, {"from", ""}, {"host", ""},
+    {"if-match", ""}, {"if-modified-since", ""}, {"if-none-match", ""}, {"if-range", ""},
+    {"if-unmodified-since", ""}, {"last-modified", ""}, {"link", ""}, {"location", ""},
+    {"max-forwards", ""}, {"proxy-authenticate", ""}, {"proxy-authorization", ""},
+    {"range", ""}, {"referer", ""}, {"refresh", ""}, {"retry-after", ""}, {"server", ""},
+    {"set-cookie", ""}, {"strict-transport-security", ""}, {"transfer-encoding", ""},
+    {"user-agent", ""}, {"vary", ""}, {"via", ""}, {"www-authenticate", ""},
+};
+constexpr size_t STATIC_COUNT = std::size(STATIC_TABLE);
+
+// Every dynamic-table entry is charged its name and value plus this much (RFC 7541 4.1).
+constexpr size_t ENTRY_OVERHEAD = 32;
+
+struct HuffmanCode {
+    uint32_t code;      // Right-aligned.
+    uint8_t bits;
+};
+
+// RFC 7541 Appendix B, indexed by symbol; 256 is end-of-string.
+constexpr HuffmanCode HUFFMAN_CODES[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30},
+};
+
+// The code as a binary tree, for decoding a bit at a time.
+struct HuffmanTree {
+    struct Node {
+        int16_t child[2] = {-1, -1};
+        int16_t symbol = -1;    // Leaves only.
+    };
+    std::array<Node, 2 * 257> nodes;
+    size_t used = 1;            // nodes[0] is the root.
+
+    HuffmanTree() {
+        for (int symbol = 0; symbol < 257; ++symbol) {
+            const HuffmanCode& code = HUFFMAN_CODES[symbol];
+            size_t node = 0;
+            for (int bit = code.bits - 1; bit >= 0; --bit) {
+                int branch = (code.code >> bit) & 1;
+                if (nodes[node].child[branch] < 0) nodes[node].child[branch] = used++;
+                node = nodes[node].child[branch];
+            }
+            nodes[node].symbol = symbol;
+        }
+    }
+};
+
+const HuffmanTree& huffmanTree() {
+    static const HuffmanTree tree;
+    return tree;
+}
+
+// Appends the Huffman-coded bytes to out; false if they are not a valid encoding.
+bool huffmanDecode(std::string_view coded, std::string& out) {
+    const HuffmanTree& tree = huffmanTree();
+    size_t node = 0;
+    int pending_bits = 0;       // Bits read since the last complete symbol.
+    bool all_ones = true;       // Whether those were all 1s, as padding must be.
+    for (unsigned char byte : coded) {
+        for (int bit = 7; bit >= 0; --bit) {
+            int branch = (byte >> bit) & 1;
+            int16_t next = tree.nodes[node].child[branch];
+            if (next < 0) return false;
+            node = next;
+            ++pending_bits;
+            all_ones = all_ones && branch;
+            int16_t symbol = tree.nodes[node].symbol;
+            if (symbol < 0) continue;
+            if (symbol == 256) return false;    // EOS must not appear in a string.
+            out += static_cast<char>(symbol);
+            node = 0;
+            pending_bits = 0;
+            all_ones = true;
+        }
+    }
+    // Padding is a prefix of EOS (all 1s) shorter than a byte.
+    return pending_bits < 8 && all_ones;
+}
+
+size_t huffmanLength(std::string_view text) {
+    size_t bits = 0;
+    for (unsigned char c : text) bits += HUFFMAN_CODES[c].bits;
+    return (bits + 7) / 8;
+}
+
+void huffmanEncode(std::string& out, std::string_view text) {
+    uint64_t pending = 0;
+    int pending_bits = 0;
+    for (unsigned char c : text) {
+        const HuffmanCode& code = HUFFMAN_CODES[c];
+        pending = pending << code.bits | code.code;
+        pending_bits += code.bits;
+        while (pending_bits >= 8) {
+            pending_bits -= 8;
+            out += static_cast<char>(pending >> pending_bits);
+        }
+    }
+    if (pending_bits > 0) {
+        // Pad with the most significant bits of EOS, which are all 1s.
+        out += static_cast<char>(pending << (8 - pending_bits) | (0xff >> pending_bits));
+    }
+}
+
+// An integer with an N-bit prefix (RFC 7541 5.1); 'flags' fills the bits above the prefix.
+void writeInteger(std::string& out, uint64_t value, int prefix_bits, uint8_t flags) {
+    uint8_t limit = (1 << prefix_bits) - 1;
+    if (value < limit) {
+        out += static_cast<char>(flags | value);
+        return;
+    }
+    out += static_cast<char>(flags | limit);
+    value -= limit;
+    while (value >= 0x80) {
+        out += static_cast<char>(0x80 | (value & 0x7f));
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+bool readInteger(const uint8_t*& p, const uint8_t* end, int prefix_bits, uint64_t& value) {
+    uint8_t limit = (1 << prefix_bits) - 1;
+    value = *p++ & limit;
+    if (value < limit) return true;
+    for (int shift = 0; p < end && shift <= 28; shift += 7) {
+        uint8_t byte = *p++;
+        value += static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;   // Truncated, or longer than any length or index we accept.
+}
+
+void writeString(std::string& out, std::string_view text) {
+    size_t coded = huffmanLength(text);
+    if (coded < text.size()) {
+        writeInteger(out, coded, 7, 0x80);
+        huffmanEncode(out, text);
+    } else {
+        writeInteger(out, text.size(), 7, 0);
+        out += text;
+    }
+}
+
+bool readString(const uint8_t*& p, const uint8_t* end, std::string& out) {
+    if (p == end) return false;
+    bool huffman = *p & 0x80;
+    uint64_t length;
+    if (!readInteger(p, end, 7, length) || length > static_cast<uint64_t>(end - p)) return false;
+    std::string_view bytes(reinterpret_cast<const char*>(p), length);
+    p += length;
+    if (huffman) return huffmanDecode(bytes, out);
+    out += bytes;
+    return true;
+}
+
+}
+
+
+void HpackDecoder::insert(std::string_view name, std::string_view value) {
+    size_t bytes = name.size() + value.size() + ENTRY_OVERHEAD;
+    // An entry larger than the table empties it and is not added (RFC 7541 4.4).
+    evictTo(bytes > table_limit ? 0 : table_limit - bytes);
+    if (bytes > table_limit) return;
+    table.push_front(Entry{std::string(name), std::string(value)});
+    table_bytes += bytes;
+}
+
+void HpackDecoder::evictTo(size_t limit) {
+    while (table_bytes > limit) {
+        const Entry& oldest = table.back();
+        table_bytes -= oldest.name.size() + oldest.value.size() + ENTRY_OVERHEAD;
+        table.pop_back();
+    }
+}
+
+bool HpackDecoder::lookup(uint64_t index, std::string_view& name, std::string_view& value) const {
+    if (index == 0) return false;
+    if (index <= STATIC_COUNT) {
+        name = STATIC_TABLE[index - 1].name;
+        value = STATIC_TABLE[index - 1].value;
+        return true;
+    }
+    index -= STATIC_COUNT + 1;
+    if (index >= table.size()) return false;
+    name = table[index].name;
+    value = table[index].value;
+    return true;
+}
+
+HpackDecoder::Result HpackDecoder::decode(std::string_view block, std::string& text,
+                                          std::vector<HpackField>& fields, size_t max_list_bytes) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(block.data());
+    const uint8_t* end = p + block.size();
+    size_t stored = 0;
+    bool too_large = false;
+
+    while (p < end) {
+        uint8_t first = *p;
+        size_t field_start = text.size();
+        uint64_t index;
+
+        if (first & 0x20 && !(first & 0xc0)) {
+            // Dynamic table size update: 001xxxxx.
+            if (!readInteger(p, end, 5, index) || index > max_table_bytes) return Result::Error;
+            table_limit = index;
+            evictTo(table_limit);
+            continue;
+        }
+
+        if (first & 0x80) {
+            // Indexed field: 1xxxxxxx.
+            std::string_view name, value;
+            if (!readInteger(p, end, 7, index) || !lookup(index, name, value)) return Result::Error;
+            text += name;
+            text += value;
+            HpackField field{static_cast<uint32_t>(field_start), static_cast<uint32_t>(name.size()),
+                             static_cast<uint32_t>(field_start + name.size()),
+                             static_cast<uint32_t>(value.size())};
+            fields.push_back(field);
+        } else {
+            // Literal: 01xxxxxx adds it to the table; 0000xxxx and 0001xxxx (never indexed) don't.
+            bool indexing = first & 0x40;
+            if (!readInteger(p, end, indexing ? 6 : 4, index)) return Result::Error;
+            if (index) {
+                std::string_view name, unused;
+                if (!lookup(index, name, unused)) return Result::Error;
+                text += name;
+            } else if (!readString(p, end, text)) {
+                return Result::Error;
+            }
+            size_t value_start = text.size();
+            if (!readString(p, end, text)) return Result::Error;
+            HpackField field{static_cast<uint32_t>(field_start),
+                             static_cast<uint32_t>(value_start - field_start),
+                             static_cast<uint32_t>(value_start),
+                             static_cast<uint32_t>(text.size() - value_start)};
+            if (indexing) insert(field.nameIn(text), field.valueIn(text));
+            fields.push_back(field);
+        }
+
+        // Past the limit, keep decoding (the table must stay in step) but drop the field.
+        stored += text.size() - field_start;
+        if (too_large || stored > max_list_bytes) {
+            too_large = true;
+            text.resize(field_start);
+            fields.pop_back();
+        }
+    }
+    return too_large ? Result::TooLarge : Result::Ok;
+}
+
+
+void hpackEncode(std::string& out, std::string_view name, std::string_view value) {
+    size_t name_index = 0;
+    for (size_t i = 0; i < STATIC_COUNT; ++i) {
+        if (STATIC_TABLE[i].name != name) continue;
+        if (STATIC_TABLE[i].value == value && !value.empty()) {
+            writeInteger(out, i + 1, 7, 0x80);
+            return;
+        }
+        if (!name_index) name_index = i + 1;
+    }
+    // Literal without indexing: 0000 and a 4-bit name index, 0 for a literal name.
+    writeInteger(out, name_index, 4, 0);
+    if (!name_index) writeString(out, name);
+    writeString(out, value);
+}
+
+void hpackEncodeStatus(std::string& out, int status) {
+    char digits[3];
+    std::to_chars(digits, digits + sizeof(digits), status);
+    hpackEncode(out, ":status", std::string_view(digits, sizeof(digits)));
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+/**
+ * @struct HpackField
+ * @brief One decoded header field, as offsets into the text it was decoded into.
+ *
+ * Offsets rather than views, so the text may grow (and move) while a block is decoded.
+ */
+struct HpackField {
+    uint32_t name;
+    uint32_t name_length;
+    uint32_t value;
+    uint32_t value_length;
+
+    std::string_view nameIn(std::string_view text) const { return text.substr(name, name_length); }
+    std::string_view valueIn(std::string_view text) const { return text.substr(value, value_length); }
+};
+
+
+/**
+ * @class HpackDecoder
+ * @brief Decodes HTTP/2 header blocks (RFC 7541), keeping one connection's dynamic table.
+ *
+ * Every header block a connection receives must go through its decoder in order, including
+ * blocks of requests that are then refused, or the two dynamic tables fall out of step.
+ */
+class HpackDecoder {
+public:
+    enum class Result {
+        Ok,
+        TooLarge,   // Decoded in full, but the fields stored were cut off at max_list_bytes.
+        Error       // Malformed; the connection must be closed with COMPRESSION_ERROR.
+    };
+
+    /**
+     * @param max_table_bytes The SETTINGS_HEADER_TABLE_SIZE this side advertised.
+     */
+    explicit HpackDecoder(size_t max_table_bytes = 4096) : max_table_bytes(max_table_bytes),
+                                                           table_limit(max_table_bytes) {}
+
+    /**
+     * @brief Decodes a complete header block, appending its fields to 'fields' and their
+     * bytes to 'text'.
+     * @param max_list_bytes Most name and value bytes to store; the rest is decoded and dropped.
+     */
+    Result decode(std::string_view block, std::string& text, std::vector<HpackField>& fields,
+                  size_t max_list_bytes);
+
+private:
+    struct Entry {
+        std::string name;
+        std::string value;
+    };
+
+    size_t max_table_bytes;         // What the peer may grow the table to.
+    size_t table_limit;             // Current size limit, set by the peer's size updates.
+    size_t table_bytes = 0;         // Per RFC 7541 4.1: name + value + 32 per entry.
+    std::deque<Entry> table;        // Newest first.
+
+    void insert(std::string_view name, std::string_view value);
+    void evictTo(size_t limit);
+
+    // Looks up an index over the static and dynamic tables; false if it is out of range.
+    bool lookup(uint64_t index, std::string_view& name, std::string_view& value) const;
+};
+
+
+/**
+ * @brief Appends an HPACK header field to 'out'.
+ *
+ * Nothing is added to the peer's dynamic table: fields the static table holds in full are
+ * sent as an index, the rest as literals without indexing, with the name as a static index
+ * where there is one. Strings are Huffman-coded when that makes them shorter.
+ * @param name The field name, already lowercase.
+ */
+void hpackEncode(std::string& out, std::string_view name, std::string_view value);
+
+/**
+ * @brief Appends the ':status' pseudo-header for 'status' to 'out'.
+ */
+void hpackEncodeStatus(std::string& out, int status);
@@ -1,5 +1,27 @@
 #include "http-server.hpp"
-std::string base_dir = "."; // default directory
+#include "chunked.hpp"
+#include "compression.hpp"
+#include "event-loop.hpp"
+#include "handoff.hpp"
+#include "http2.hpp"
+#include "metrics.hpp"
+#include "read-buffer.hpp"
+#include "request-parser.hpp"
+#include "static-responses.hpp"
+#include "thread-pool.hpp"
+
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <vector>
 
 /*
 GET
@@ -24,258 +46,1296 @@ Accept: /\r\n
   // by some network gear, older CPUs) The standard byte order for data
   // transmitted over the network is big-endian.
 
-HttpServer::HttpServer(const std::string& directory, int port)
-    : base_dir(directory), port(port), server_fd(-1) {}
+HttpServer::HttpServer(const ServerConfig& config)
+    : server_fd(-1), config(config) {}
+
+// Seconds a new process has to start up and take over the listeners on a restart.
+constexpr unsigned TAKEOVER_TIMEOUT = 10;
 
 void HttpServer::start() {
-    setupSocket();
-    acceptConnections();
+    // First, so that every thread started from here on inherits it.
+    if (!config.cpus.empty()) restrictToCpus(config.cpus);
+
+    // Only superviseSignals() takes these. They are blocked before any thread starts, so
+    // that every thread inherits the mask and none of them is interrupted instead.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    // Routes are registered once here and shared by every worker for the server's lifetime.
+    RequestHandler handler(config);
+    Takeover takeover = receiveListeners();
+    openListeners(std::move(takeover.listeners));
+    if (config.mode == ServerMode::Reactor) {
+        std::cout << "[HttpServer] Listening on port " << config.port
+                  << " with " << listeners.size() << " reactor worker(s)" << std::endl;
+    } else {
+        std::cout << "[HttpServer] Listening on port " << config.port << std::endl;
+    }
+    // Everything that could fail at startup has been done: the previous process may drain.
+    confirmTakeover(takeover);
+
+    std::promise<void> finished;
+    std::future<void> stopped = finished.get_future();
+    std::thread serving([this, &handler, &finished] {
+        if (config.mode == ServerMode::Reactor) {
+            runReactors(handler);
+        } else {
+            server_fd = listeners.front();
+            acceptConnections(handler);
+        }
+        finished.set_value();
+    });
+    superviseSignals(handler, signals, stopped);
+    serving.join();
+}
+
+void HttpServer::openListeners(std::vector<int> inherited) {
+    size_t wanted = config.mode == ServerMode::Reactor ? std::max(1, config.workers) : 1;
+    bool reuse_port = wanted > 1;
+    for (size_t i = 0; i < wanted; ++i) {
+        if (inherited.empty()) {
+            listeners.push_back(createListener(reuse_port));
+        } else if (i < inherited.size()) {
+            // Tuned as this process's configuration says, not as the predecessor's did.
+            applySocketOptions(inherited[i], config.sockets);
+            listeners.push_back(inherited[i]);
+        } else {
+            // A new socket could only join the inherited ones' SO_REUSEPORT group if they all
+            // had the option; sharing them works whatever they were opened with.
+            listeners.push_back(dup(inherited[i % inherited.size()]));
+        }
+    }
+    // Connections already queued on these are lost, as they would be on any close.
+    for (size_t i = wanted; i < inherited.size(); ++i) {
+        close(inherited[i]);
+    }
+}
+
+void HttpServer::superviseSignals(RequestHandler& handler, const sigset_t& signals,
+                                  std::future<void>& stopped) {
+    while (true) {
+        int signal = 0;
+        if (sigwait(&signals, &signal) != 0) continue;
+        if (signal == SIGTERM) break;
+        // SIGHUP or SIGUSR2: restart from the binary and command line, as they are now.
+        std::cout << "[HttpServer] Restarting: starting a new process" << std::endl;
+        if (startSuccessor(listeners, TAKEOVER_TIMEOUT)) break;
+        std::cout << "[HttpServer] Still serving" << std::endl;
+    }
+
+    std::cout << "[HttpServer] Draining connections" << std::endl;
+    handler.startDraining();
+    if (config.drain_timeout == 0) {
+        stopped.wait();
+    } else if (stopped.wait_for(std::chrono::seconds(config.drain_timeout)) ==
+               std::future_status::timeout) {
+        // Workers can't be stopped mid-request; the connections close with the process.
+        std::cout << "[HttpServer] Drain timed out after " << config.drain_timeout
+                  << "s; exiting with connections still open" << std::endl;
+        _exit(0);
+    }
+    std::cout << "[HttpServer] Drained" << std::endl;
 }
 
 // create a socket, bind it to an IP/port, and listen for connections
-void HttpServer::setupSocket() {
+int HttpServer::createListener(bool reuse_port) {
     
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    // Close-on-exec: a process started for a restart gets the listeners handed to it instead.
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     // AF_INET -> IPv4
     // SOCK_STREAM -> TCP
     // 0 -> IP protocol
 
-    if (server_fd < 0) {
+    if (fd < 0) {
         std::cerr << "Failed to create server socket\n";
         exit(1); // non-zero status to indicate failure
     }
 
     // Since the tester restarts program quite often, setting SO_REUSEADDR ensures that we don't run into 'Address already in use' errors
     int reuse = 1;
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
         std::cerr << "setsockopt failed\n";
         exit(1);
     }
 
+    // SO_REUSEPORT lets every worker bind its own socket to the same port; the kernel then
+    // hashes each incoming connection to one of them, so no single thread accepts for all.
+    if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+        std::cerr << "setsockopt(SO_REUSEPORT) failed\n";
+        exit(1);
+    }
+
     sockaddr_in server_addr{};  // structure for IPV4 addresses, holds info IP address, port, and protocol family
     server_addr.sin_family = AF_INET;  
     // address family AF_INET -> IPV4
     server_addr.sin_addr.s_addr = INADDR_ANY;  
     // INADDR_ANY = 0.0.0.0 tells the OS to bind to all available network interfaces
-    server_addr.sin_port = htons(port);  
+    server_addr.sin_port = htons(config.port);  
     // sets the port number
     // htons() = Host To Network Short Byte Order, Little Endian to Big Endian
 
-    if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) != 0) {
-        std::cerr << "Failed to bind to port " << port << "\    n";
+    if (bind(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) != 0) {
+        std::cerr << "Failed to bind to port " << config.port << "\n";
         exit(1);
     }
 
-    int backlog = 5;
+    applySocketOptions(fd, config.sockets);
+
     // max number of pending connections that the OS can queue up before refusing new ones
-    if (listen(server_fd, backlog) != 0) {
+    // (the kernel silently caps this at net.core.somaxconn)
+    if (listen(fd, config.backlog) != 0) {
         std::cerr << "listen failed\n";
         exit(1);
     }
 
-    std::cout << "[HttpServer] Listening on port " << port << std::endl;
+    return fd;
+}
+
+void HttpServer::runReactors(const RequestHandler& handler) {
+    std::vector<int> allowed = allowedCpus();
+    std::vector<int> worker_cpus;
+    for (size_t i = 0; i < listeners.size() && !allowed.empty(); ++i) {
+        worker_cpus.push_back(allowed[i % allowed.size()]);
+    }
+    if (listeners.size() > 1) {
+        // The group's i-th socket is listeners[i]: opened in this order, or handed over in
+        // the order the previous process had them.
+        if (!config.steer_connections) {
+            stopSteering(listeners.front());
+        } else if (listeners.size() > allowed.size()) {
+            std::cerr << "Not steering connections: there are more workers than CPUs\n";
+        } else {
+            steerByCpu(listeners.front(), worker_cpus);
+        }
+    }
+
+    // Every listener was opened up front, so the port is fully bound before any worker starts.
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < listeners.size(); ++i) {
+        threads.emplace_back([this, &handler, i, fd = listeners[i], &worker_cpus] {
+            // Before the loop is built, so its memory is allocated on this CPU's node.
+            if (i < worker_cpus.size()) pinThread({worker_cpus[i]});
+            EventLoop loop(fd, handler, makeAsyncIo(config.io_uring), config.buffer_memory_bytes,
+                           config.sockets.accept_batch);
+            loop.run();
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
 }
 
 // This method contains the main server loop for accepting new client connections.
-void HttpServer::acceptConnections() {
-    while (true) {
+void HttpServer::acceptConnections(const RequestHandler& handler) {
+    // Connections are served by a fixed set of workers instead of a fresh thread each. When
+    // every worker is busy and the queue is full, submit() blocks and we stop accepting, so
+    // a spike waits in the kernel's listen backlog rather than exhausting memory.
+    size_t threads = config.pool_threads;
+    if (threads == 0) {
+        threads = std::max(16u, 4 * std::thread::hardware_concurrency());
+    }
+    std::vector<std::vector<int>> nodes = cpusByNode(allowedCpus());
+    std::function<void(size_t)> on_start;
+    if (nodes.size() > 1) {
+        // Each worker stays on one node, where the buffers it reuses for every connection
+        // are first touched; the scheduler still balances it across that node's CPUs.
+        on_start = [&nodes](size_t worker) { pinThread(nodes[worker % nodes.size()]); };
+    }
+    ThreadPool pool(threads, config.max_queued, on_start);
+
+    // Waiting in poll() rather than accept() lets draining interrupt the wait. The socket is
+    // non-blocking because during a restart another process accepts from it too, and may
+    // take the connection poll() announced.
+    setNonBlocking(server_fd);
+    pollfd waits[2] = {{handler.drainFd(), POLLIN, 0}, {server_fd, POLLIN, 0}};
+    Admission& admission = handler.admission();
+    WorkerMetrics& metrics = localMetrics();
+    bool paused = false;    // At the connection limit.
+
+    // Accepts a connection with the slot reserved for it; false, having given the slot
+    // back, once the backlog is empty.
+    auto acceptOne = [&] {
         sockaddr_in client_addr{};
         // holds client's address and port after connection
 
         socklen_t client_len = sizeof(client_addr);
-        std::cout << "Waiting for a client to connect...\n";
-
-        // The accept() call is blocking; it waits until a client connects.
-        int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &client_len);
         // Takes the listening server_fd.
         // Fills client_addr with the client’s IP and port.
-        // Returns a new socket file descriptor client_fd for this particular client.
+        // Returns a new socket file descriptor client_fd for this particular client, which
+        // is blocking (it does not inherit O_NONBLOCK) and is not inherited across exec.
+        int client_fd = accept4(server_fd, (struct sockaddr *)&client_addr, &client_len,
+                                SOCK_CLOEXEC);
 
         if (client_fd < 0) {
-            std::cerr << "Failed to accept connection.\n";
-            continue;   // Continue to the next iteration to wait for another client.
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "Failed to accept connection.\n";
+            }
+            admission.release();
+            return false;   // Wait for another client.
+        }
+        if (!admission.admit(client_addr.sin_addr.s_addr)) {
+            // Refused here, before it takes a place in the pool's queue.
+            admission.release();
+            Admission::reject(client_fd, !handler.tls());
+            metrics.connections_rejected.add();
+            return true;
         }
 
-        // Create a new thread to handle the client's requests concurrently.
+        // Hand the client to the pool so it is handled concurrently.
         // This allows the server to accept other connections while handling the current one.
-        std::thread client_thread(handleClient, client_fd, base_dir);
-        // Detach the thread to let it run independently. The main thread will not wait for it to finish.
-        client_thread.detach();
+        pool.submit([client_fd, &handler] {
+            handleClient(client_fd, handler);
+            handler.admission().release();
+        });
+        return true;
+    };
+
+    while (true) {
+        // At the limit, new clients wait in the listen backlog; we look again every
+        // Admission::RETRY_MS, since the connections that free a slot close on other threads.
+        bool full = !admission.reserve();
+        if (full && !paused) metrics.accept_pauses.add();
+        paused = full;
+        if (poll(waits, full ? 1 : 2, full ? Admission::RETRY_MS : -1) < 0) {
+            if (!full) admission.release();
+            continue;   // EINTR
+        }
+        if (waits[0].revents) {                 // Draining: stop accepting.
+            if (!full) admission.release();
+            break;
+        }
+        if (full) continue;
+
+        // One wakeup takes a batch: what a burst of connections left in the backlog is
+        // accepted without a poll() for each.
+        for (unsigned accepted = 0; accepted < config.sockets.accept_batch; ++accepted) {
+            if (accepted > 0 && !admission.reserve()) break;    // At the limit.
+            if (!acceptOne()) break;
+        }
     }
+    close(server_fd);
+    // The pool's destructor waits for the connections still open to finish.
+}
+
+bool HttpHeaders::add(std::string_view name, std::string_view value) {
+    if (count == MAX_HEADERS) return false;
+    entries[count++] = HttpHeader{name, value};
+    return true;
+}
+
+std::optional<std::string_view> HttpHeaders::get(std::string_view name) const {
+    for (size_t i = 0; i < count; ++i) {
+        if (entries[i].name == name) return entries[i].value;
+    }
+    return std::nullopt;
+}
+
+void HttpRequest::reset() {
+    method = path = version = body = {};
+    headers.clear();
+}
+
+// Case-insensitive comparison for ASCII header values such as "close" or "keep-alive".
+static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+           });
+}
+
+bool HttpRequest::wantsClose() const {
+    auto connection = headers.get("connection");
+    if (connection && equalsIgnoreCase(*connection, "close")) return true;
+    // HTTP/1.0 connections are closed unless keep-alive is asked for explicitly.
+    if (version == "HTTP/1.0") return !(connection && equalsIgnoreCase(*connection, "keep-alive"));
+    return false;
 }
 
-// This static method parses the raw HTTP request from the buffer.
-HttpRequest HttpRequest::parse(int client_fd, char* buffer, int bytes_read) {
-    HttpRequest request;
 
-    buffer[bytes_read] = '\0'; // Null-terminate the buffer to treat it as a C-string
-    std::string raw_request(buffer);
+HttpResponse::HttpResponse(OutputQueue& out, bool should_close, const AsyncContext* async_context,
+                           Arena* request_arena)
+    : out(out), should_close(should_close), async_context(async_context),
+      request_arena(request_arena) {}
+
+HttpResponse::HttpResponse(Http2Stream& stream, const AsyncContext* async_context,
+                           Arena* request_arena)
+    : out(stream.body), stream(&stream), should_close(false), async_context(async_context),
+      request_arena(request_arena) {}
+
+// Writes the head without iostreams: fixed pieces are memcpy'd and the length is formatted
+// with std::to_chars, which is locale-free and never allocates.
+void HttpResponse::queueHead(std::string_view status, std::string_view content_type,
+                             std::optional<size_t> content_length, std::string_view extra_headers) {
+    int code = 0;
+    std::from_chars(status.data(), status.data() + std::min<size_t>(status.size(), 3), code);
+    if (stream) {
+        stream->respond(code, content_type, content_length, extra_headers);
+        recordStatus(code, content_length);
+        return;
+    }
+
+    constexpr std::string_view version = "HTTP/1.1 ";
+    constexpr std::string_view type_name = "Content-Type: ";
+    constexpr std::string_view length_name = "Content-Length: ";
+    constexpr std::string_view chunked = "Transfer-Encoding: chunked\r\n";
+    constexpr size_t max_digits = 20;   // Enough for any 64-bit length.
+
+    size_t max_length = version.size() + status.size() + 2 +
+                        type_name.size() + content_type.size() + 2 +
+                        std::max(length_name.size() + max_digits + 2, chunked.size()) +
+                        extra_headers.size() + MAX_CONNECTION_HEADERS;
+    char* begin = out.prepareHead(max_length);
+    char* p = begin;
+    auto put = [&p](std::string_view piece) {
+        if (piece.empty()) return;  // A defaulted view has a null data(), which memcpy rejects.
+        std::memcpy(p, piece.data(), piece.size());
+        p += piece.size();
+    };
 
-    // Find the split point between headers and body
-    size_t header_end = raw_request.find("\r\n\r\n");
-    if (header_end == std::string::npos) return request;    // Return empty request if invalid.
+    put(version);
+    put(status);
+    put("\r\n");
+    if (!content_type.empty()) {
+        put(type_name);
+        put(content_type);
+        put("\r\n");
+    }
+    if (content_length) {
+        put(length_name);
+        p = std::to_chars(p, p + max_digits, *content_length).ptr;
+        put("\r\n");
+    } else {
+        put(chunked);
+    }
+    put(extra_headers);
+    p = writeConnection(p);
 
-    std::string header_section = raw_request.substr(0, header_end);
-    std::istringstream header_stream(header_section);
+    out.commitHead(p - begin);
+    recordStatus(code, content_length);
+}
 
-    // Parse request line
-    std::string request_line;
-    std::getline(header_stream, request_line);
-    std::istringstream rl_stream(request_line);
-    rl_stream >> request.method >> request.path >> request.version;
+void HttpResponse::recordStatus(int status, std::optional<size_t> body_bytes) {
+    localMetrics().response(route_id, status);
+    if (access_entry) {
+        access_entry->finish(status, body_bytes.value_or(UINT64_MAX));
+        access_entry = nullptr;
+    }
+}
 
-    // Parse headers
-    std::map<std::string, std::string> headers;
-    std::string line;
-    while (std::getline(header_stream, line)) {
-        if (line.back() == '\r') line.pop_back(); // Remove trailing '\r'
-        size_t pos = line.find(": ");
-        if (pos != std::string::npos) {
-            std::string key = line.substr(0, pos);
-            std::string value = line.substr(pos + 2);
-            // Normalize header keys to lowercase for case-insensitive matching.
-            std::transform(key.begin(), key.end(), key.begin(), ::tolower);
-            headers[key] = value;
+char* HttpResponse::writeConnection(char* p) const {
+    auto put = [&p](std::string_view piece) {
+        std::memcpy(p, piece.data(), piece.size());
+        p += piece.size();
+    };
+    if (should_close) {
+        put("Connection: close\r\n\r\n");
+        return p;
+    }
+    put("Connection: keep-alive\r\n");
+    if (keep_alive_timeout || keep_alive_max) {
+        put("Keep-Alive: ");
+        if (keep_alive_timeout) {
+            put("timeout=");
+            p = std::to_chars(p, p + 10, keep_alive_timeout).ptr;
         }
+        if (keep_alive_max) {
+            put(keep_alive_timeout ? ", max=" : "max=");
+            p = std::to_chars(p, p + 10, keep_alive_max).ptr;
+        }
+        put("\r\n");
     }
-    request.headers = headers;
+    put("\r\n");
+    return p;
+}
+
+// Constructs and sends a complete HTTP response.
+void HttpResponse::sendResponse(std::string_view status, std::string_view content_type,
+                                std::string_view body, std::string_view extra_headers) {
+    queueHead(status, content_type, body.size(), extra_headers);
+    // Queue the body by reference; it is gathered with the head into one write.
+    out.appendBorrowed(body);
+}
+
+void HttpResponse::sendResponse(std::string_view status, std::string_view content_type,
+                                std::string&& body) {
+    queueHead(status, content_type, body.size());
+    out.append(std::move(body));
+}
 
-    // Determine the length of the body from the 'Content-Length' header.
-    int content_length = 0;
-    if (headers.find("content-length") != headers.end()) {
-        content_length = std::stoi(headers["content-length"]);
+// Sends a raw, pre-formatted string to the client.
+void HttpResponse::sendRaw(std::string_view raw) {
+    char* p = out.prepareHead(raw.size());
+    std::memcpy(p, raw.data(), raw.size());
+    out.commitHead(raw.size());
+}
+
+void HttpResponse::sendStatus(int status) {
+    recordStatus(status, 0);
+    if (stream) {
+        stream->respond(status, {}, 0, {});
+        return;
+    }
+    const StatusEntry& entry = statusEntry(status);
+    if (should_close || !(keep_alive_timeout || keep_alive_max)) {
+        out.appendStatic(should_close ? entry.close : entry.keep_alive);
+        return;
     }
+    out.appendStatic(entry.head);
+    char* begin = out.prepareHead(MAX_CONNECTION_HEADERS);
+    out.commitHead(writeConnection(begin) - begin);
+}
 
-    // Extract the body from the initial buffer.
-    request.body = raw_request.substr(header_end + 4);
-    int already_read = request.body.size();
+void HttpResponse::sendError(int status) {
+    should_close = true;
+    sendStatus(status);
+}
 
-    // Read more if Content-Length not satisfied
-    while (already_read < content_length) {
-        char more[4096];
-        int n = recv(client_fd, more, sizeof(more), 0);  // number of bytes read from socket and copied to 'more'
-        // recv -> receive data from a connected socket
-        if (n <= 0) break;
-        request.body.append(more, n);
-        already_read += n;
+// Queues the headers and then the file itself; the file bytes never enter userspace.
+void HttpResponse::sendFile(std::string_view status, std::string_view content_type,
+                            int file_fd, size_t length, std::string_view extra_headers) {
+    queueHead(status, content_type, length, extra_headers);
+    out.appendFile(file_fd, 0, length);
+}
+
+void HttpResponse::sendFile(std::string_view status, std::string_view content_type,
+                            std::unique_ptr<FileReader> reader, std::string_view extra_headers) {
+    queueHead(status, content_type, reader->length(), extra_headers);
+    if (reader->length() > 0) out.appendStream(std::make_unique<FileStreamSource>(std::move(reader)));
+}
+
+// Caches must keep the identity and gzip variants of a response apart.
+constexpr std::string_view GZIP_HEADERS = "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n";
+
+void HttpResponse::sendGzip(std::string_view status, std::string_view content_type,
+                            std::string_view body) {
+    std::string compressed;
+    CompressorHandle compressor = acquireCompressor();
+    if (!compressor->compress(body, true, compressed)) {
+        sendResponse(status, content_type, body, "Vary: Accept-Encoding\r\n");
+        return;
+    }
+    queueHead(status, content_type, compressed.size(), GZIP_HEADERS);
+    out.append(std::move(compressed));
+}
+
+void HttpResponse::sendCached(std::shared_ptr<const CachedFile> file, bool gzip) {
+    const CachedFile::Variant& variant =
+        gzip && !file->gzip.body.empty() ? file->gzip : file->identity;
+    sendPrepared(std::move(file), variant.head, variant.body);
+}
+
+void HttpResponse::sendPrepared(std::shared_ptr<const void> owner, std::string_view head,
+                                std::string_view body) {
+    recordStatus(200, body.size());
+    if (stream) {
+        // The header lines follow the status line, Content-Length among them.
+        std::string_view lines = head;
+        lines.remove_prefix(lines.find("\r\n") + 2);
+        stream->respond(200, {}, std::nullopt, lines);
+        out.appendShared(std::move(owner), body);
+        return;
     }
+    out.appendShared(owner, head);
+    char* begin = out.prepareHead(MAX_CONNECTION_HEADERS);
+    out.commitHead(writeConnection(begin) - begin);
+    out.appendShared(std::move(owner), body);
+}
 
-    return request;
+void HttpResponse::sendNotModified(std::string_view headers) {
+    recordStatus(304, 0);
+    if (stream) {
+        stream->respond(304, {}, std::nullopt, headers);
+        return;
+    }
+    // No Content-Length: it would describe the body a 200 carries (RFC 9110 8.6).
+    constexpr std::string_view status_line = "HTTP/1.1 304 Not Modified\r\n";
+    char* begin = out.prepareHead(status_line.size() + headers.size() + MAX_CONNECTION_HEADERS);
+    char* p = begin;
+    std::memcpy(p, status_line.data(), status_line.size());
+    p += status_line.size();
+    if (!headers.empty()) std::memcpy(p, headers.data(), headers.size());
+    p = writeConnection(p + headers.size());
+    out.commitHead(p - begin);
 }
 
+// "bytes first-last/size", as Content-Range has it.
+static char* writeContentRange(char* p, const ByteRange& range, uint64_t size) {
+    std::memcpy(p, "bytes ", 6);
+    p = std::to_chars(p + 6, p + 26, range.first).ptr;
+    *p++ = '-';
+    p = std::to_chars(p, p + 20, range.last()).ptr;
+    *p++ = '/';
+    return std::to_chars(p, p + 20, size).ptr;
+}
 
-HttpResponse::HttpResponse(int client_fd, bool should_close) : client_fd(client_fd), should_close(should_close) {}
+// Longest writeContentRange() output.
+constexpr size_t MAX_CONTENT_RANGE = 6 + 3 * 20 + 2;
 
-// Constructs and sends a complete HTTP response.
-void HttpResponse::sendResponse(const std::string& status, const std::string& content_type,
-                                const std::string& body) {
-    std::ostringstream oss;
-    oss << "HTTP/1.1 " << status << "\r\n"
-        << "Content-Type: " << content_type << "\r\n"
-        << "Content-Length: " << body.size() << "\r\n";
-    if(should_close){
-        oss << "Connection: close\r\n";
+template <typename AppendPart>
+void HttpResponse::queueRanges(std::string_view content_type, uint64_t size, const ByteRanges& ranges,
+                               std::string_view extra_headers, AppendPart append_part) {
+    char range_text[MAX_CONTENT_RANGE];
+    if (ranges.size() == 1) {
+        std::pmr::string headers("Content-Range: ", arena());
+        headers.append(range_text, writeContentRange(range_text, ranges[0], size));
+        headers += "\r\n";
+        headers += extra_headers;
+        queueHead("206 Partial Content", content_type, ranges[0].length, headers);
+        append_part(ranges[0]);
+        return;
     }
-    else{
-        oss << "Connection: keep-alive\r\n";
+
+    // The boundary must not occur in the parts; a fresh random one per response makes that
+    // as good as certain.
+    static thread_local uint64_t seed = std::chrono::steady_clock::now().time_since_epoch().count() | 1;
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    char boundary[16];
+    std::memset(boundary, '0', sizeof(boundary));
+    char* digits_end = std::to_chars(boundary, boundary + sizeof(boundary), seed, 16).ptr;
+    std::rotate(boundary, digits_end, boundary + sizeof(boundary));
+    std::string_view tag(boundary, sizeof(boundary));
+
+    // Each part's header, back to back, so the total length is known before the head goes out.
+    std::pmr::string framing(arena());
+    std::array<size_t, ByteRanges::MAX_RANGES + 1> ends{};
+    uint64_t length = 0;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        framing += "\r\n--";
+        framing += tag;
+        framing += "\r\nContent-Type: ";
+        framing += content_type;
+        framing += "\r\nContent-Range: ";
+        framing.append(range_text, writeContentRange(range_text, ranges[i], size));
+        framing += "\r\n\r\n";
+        ends[i + 1] = framing.size();
+        length += ranges[i].length;
     }
-    oss << "\r\n"
-        << body;
+    framing += "\r\n--";
+    framing += tag;
+    framing += "--\r\n";
+    length += framing.size();
 
-    std::string response = oss.str();
-    // Send the formatted response string to the client.
-    send(client_fd, response.c_str(), response.size(), 0);
+    std::pmr::string multipart("multipart/byteranges; boundary=", arena());
+    multipart += tag;
+    queueHead("206 Partial Content", multipart, length, extra_headers);
+    auto copy = [this](std::string_view piece) {
+        std::memcpy(out.prepareHead(piece.size()), piece.data(), piece.size());
+        out.commitHead(piece.size());
+    };
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        copy(std::string_view(framing).substr(ends[i], ends[i + 1] - ends[i]));
+        append_part(ranges[i]);
+    }
+    copy(std::string_view(framing).substr(ends[ranges.size()]));
 }
 
-// Sends a raw, pre-formatted string to the client.
-void HttpResponse::sendRaw(const std::string& raw) {
-    send(client_fd, raw.c_str(), raw.size(), 0);
+void HttpResponse::sendFileRanges(std::string_view content_type, int file_fd, uint64_t size,
+                                  const ByteRanges& ranges, std::string_view extra_headers) {
+    size_t parts = 0;
+    queueRanges(content_type, size, ranges, extra_headers, [&](const ByteRange& range) {
+        // Every part closes its descriptor when done; the last one gets the original.
+        int fd = ++parts == ranges.size() ? file_fd : fcntl(file_fd, F_DUPFD_CLOEXEC, 0);
+        if (async_context) {
+            out.appendStream(std::make_unique<FileStreamSource>(
+                std::make_unique<FileReader>(fd, range.length, async_context, range.first)));
+        } else {
+            out.appendFile(fd, range.first, range.length);
+        }
+    });
 }
 
+void HttpResponse::sendCachedRanges(std::shared_ptr<const CachedFile> file,
+                                    std::string_view content_type, const ByteRanges& ranges,
+                                    std::string_view extra_headers) {
+    std::string_view body = file->identity.body;
+    sendSharedRanges(std::move(file), body, content_type, ranges, extra_headers);
+}
 
-RequestHandler::RequestHandler(const std::string& dir) : base_dir(dir) {}
+void HttpResponse::sendSharedRanges(std::shared_ptr<const void> owner, std::string_view body,
+                                    std::string_view content_type, const ByteRanges& ranges,
+                                    std::string_view extra_headers) {
+    queueRanges(content_type, body.size(), ranges, extra_headers, [&](const ByteRange& range) {
+        out.appendShared(owner, body.substr(range.first, range.length));
+    });
+}
 
-// This method acts as a router, directing the request to the correct handling logic.
-void RequestHandler::handle(const HttpRequest& request, HttpResponse& response) {
-    const std::string& method = request.method;
-    const std::string& path = request.path;
+void HttpResponse::sendGzipFile(std::string_view status, std::string_view content_type,
+                                int file_fd, size_t length, std::string_view extra_headers) {
+    sendGzipFile(status, content_type, std::make_unique<FileReader>(file_fd, length), extra_headers);
+}
+
+void HttpResponse::sendGzipFile(std::string_view status, std::string_view content_type,
+                                std::unique_ptr<FileReader> reader, std::string_view extra_headers) {
+    std::string headers(GZIP_HEADERS);
+    headers += extra_headers;
+    sendStream(status, content_type, std::make_unique<GzipFileSource>(std::move(reader)), headers);
+}
 
-    if (method == "GET" && path == "/") {
-        response.sendRaw("HTTP/1.1 200 OK\r\n\r\n");
+void HttpResponse::sendStream(std::string_view status, std::string_view content_type,
+                              std::unique_ptr<StreamSource> body, std::string_view extra_headers) {
+    queueHead(status, content_type, std::nullopt, extra_headers);
+    // HTTP/2 cuts the body into DATA frames itself; HTTP/1.1 needs every piece sized.
+    if (stream) {
+        out.appendStream(std::move(body));
+    } else {
+        out.appendStream(std::make_unique<ChunkedSource>(std::move(body)));
     }
-    else if (method == "GET" && path.rfind("/echo/", 0) == 0) {
-        std::string echo_str = path.substr(std::string("/echo/").length());
-        response.sendResponse("200 OK", "text/plain", echo_str);
+}
+
+
+RequestHandler::RequestHandler(const ServerConfig& config)
+    : base_dir(config.base_dir), gzip_min_bytes(config.gzip_min_bytes),
+      max_body_bytes(config.max_body_bytes), limits(config.timeouts),
+      max_requests(config.keepalive_requests), accept_http2(config.http2),
+      file_cache(config.base_dir, config.file_cache_bytes, config.gzip_min_bytes),
+      admission_control(config.admission), drain_fd(eventfd(0, EFD_CLOEXEC)) {
+    if (drain_fd < 0) {
+        std::cerr << "eventfd failed\n";
+        exit(1);
+    }
+    if (!config.access_log.path.empty()) access_log = std::make_unique<AccessLog>(config.access_log);
+    if (!config.tls.cert_path.empty()) {
+        tls_context = std::make_unique<TlsContext>(config.tls, config.http2);
+    }
+    if (!config.bundle_path.empty()) bundle = std::make_unique<AssetBundle>(config.bundle_path);
+    router.exact(HttpMethod::Get, "/", [this](const HttpRequest&, HttpResponse& response,
+                                             std::string_view) {
+        serveRoot(response);
+    });
+    router.prefix(HttpMethod::Get, "/echo/", [this](const HttpRequest& request,
+                                                   HttpResponse& response, std::string_view text) {
+        serveEcho(request, response, text);
+    });
+    router.exact(HttpMethod::Get, "/user-agent", [this](const HttpRequest& request,
+                                                       HttpResponse& response, std::string_view) {
+        serveUserAgent(request, response);
+    });
+    router.prefixTask(HttpMethod::Get, "/files/", [this](const HttpRequest& request,
+                                                        HttpResponse response, std::string_view name) {
+        return serveFile(request, response, name);
+    });
+    router.prefixBody(HttpMethod::Post, "/files/", [this](const HttpRequest&, std::string_view name) {
+        return storeFile(name);
+    });
+    router.exact(HttpMethod::Get, "/metrics", [this](const HttpRequest&, HttpResponse& response,
+                                                    std::string_view) {
+        serveMetrics(response);
+    });
+}
+
+RequestHandler::~RequestHandler() {
+    close(drain_fd);
+}
+
+void RequestHandler::startDraining() {
+    stopping.store(true, std::memory_order_relaxed);
+    uint64_t one = 1;
+    ssize_t ignored = write(drain_fd, &one, sizeof(one));   // Never read, so it stays readable.
+    (void)ignored;
+}
+
+// Dispatches through the route table; anything without a route is a 404.
+Task<void> RequestHandler::handle(const HttpRequest& request, HttpResponse& response) const {
+    Task<void> suspended;
+    if (!router.dispatch(request, response, suspended)) {
+        response.sendStatus(404);
+    }
+    return suspended;
+}
+
+std::unique_ptr<BodySink> RequestHandler::openBody(const HttpRequest& request) const {
+    return router.openBody(request);
+}
+
+bool RequestHandler::wantsGzip(const HttpRequest& request, size_t length) const {
+    if (length < gzip_min_bytes) return false;
+    std::optional<std::string_view> accept = request.headers.get("accept-encoding");
+    return accept && acceptsGzip(*accept);
+}
+
+// Sent on identity responses that could have been compressed, so caches key on the header.
+constexpr std::string_view VARY_HEADER = "Vary: Accept-Encoding\r\n";
+
+void RequestHandler::serveRoot(HttpResponse& response) const {
+    response.sendStatus(200);
+}
+
+void RequestHandler::serveEcho(const HttpRequest& request, HttpResponse& response,
+                               std::string_view text) const {
+    if (wantsGzip(request, text.size())) {
+        response.sendGzip("200 OK", "text/plain", text);
+    } else {
+        response.sendResponse("200 OK", "text/plain", text,
+                              text.size() >= gzip_min_bytes ? VARY_HEADER : "");
     }
-    else if (method == "GET" && path == "/user-agent") {
-        auto it = request.headers.find("user-agent");
-        std::string user_agent = (it != request.headers.end()) ? it->second : "Unknown";
-        response.sendResponse("200 OK", "text/plain", user_agent);
+}
+
+void RequestHandler::serveMetrics(HttpResponse& response) const {
+    response.sendResponse("200 OK", "text/plain; version=0.0.4", renderMetrics(router.labels()));
+}
+
+void RequestHandler::serveUserAgent(const HttpRequest& request, HttpResponse& response) const {
+    std::string_view user_agent = request.headers.get("user-agent").value_or("Unknown");
+    response.sendResponse("200 OK", "text/plain", user_agent);
+}
+
+// Answers a Range no part of which lies within the file.
+static void sendUnsatisfiable(HttpResponse& response, uint64_t size) {
+    std::pmr::string header("Content-Range: bytes */", response.arena());
+    char digits[20];
+    header.append(digits, std::to_chars(digits, digits + sizeof(digits), size).ptr);
+    header += "\r\n";
+    response.sendResponse("416 Range Not Satisfiable", {}, std::string_view(), header);
+}
+
+// Like a FileCache hit, with the gzip variant and Vary as the packer chose them.
+void RequestHandler::serveBundled(const HttpRequest& request, HttpResponse& response,
+                                  const BundledFile& file) const {
+    std::optional<std::string_view> accept = request.headers.get("accept-encoding");
+    bool gzip = !file.gzip.body.empty() && request.version != "HTTP/1.0" &&
+                !request.headers.get("range") && accept && acceptsGzip(*accept);
+    const BundledFile::Variant& variant = gzip ? file.gzip : file.identity;
+    std::pmr::string headers("ETag: ", response.arena());
+    headers += variant.etag;
+    headers += "\r\nLast-Modified: ";
+    headers += file.last_modified;
+    headers += "\r\n";
+    if (file.compressible) headers += VARY_HEADER;
+
+    if (notModified(request, variant.etag, file.modified)) {
+        response.sendNotModified(headers);
+        return;
     }
-    else if (method == "GET" && path.rfind("/files/", 0) == 0) {
-        std::string filename = base_dir + "/" + path.substr(std::string("/files/").length());
-        std::ifstream file(filename, std::ios::binary);
-        if (!file.is_open()) {
-            response.sendRaw("HTTP/1.1 404 Not Found\r\n\r\n");
+    size_t size = file.identity.body.size();
+    ByteRanges ranges;
+    switch (ranges.select(request, file.identity.etag, file.modified, size)) {
+        case ByteRanges::Result::Partial:
+            response.sendSharedRanges(bundle->owner(), file.identity.body,
+                                      "application/octet-stream", ranges, headers);
+            return;
+        case ByteRanges::Result::Unsatisfiable:
+            sendUnsatisfiable(response, size);
+            return;
+        case ByteRanges::Result::Whole:
+            break;
+    }
+    response.sendPrepared(bundle->owner(), variant.head, variant.body);
+}
+
+Task<void> RequestHandler::serveFile(const HttpRequest& request, HttpResponse response,
+                                     std::string_view name) const {
+    // Only plain names are joined to base_dir: "../secret" must not reach outside it.
+    if (!isPlainName(name)) {
+        response.sendStatus(404);
+        co_return;
+    }
+    if (bundle) {
+        if (std::optional<BundledFile> file = bundle->find(name)) {
+            serveBundled(request, response, *file);
+            co_return;
+        }
+    }
+
+    // 'request' and 'name' are only valid until the first co_await.
+    bool http10 = request.version == "HTTP/1.0";
+    // Ranges are served from the identity body: offsets into a compressed one would only
+    // hold for as long as zlib's output does not change.
+    bool ranged = request.headers.get("range").has_value();
+    ByteRanges ranges;
+    FileCache::Lookup cached = file_cache.find(name);
+    if (cached.file) {
+        const CachedFile& file = *cached.file;
+        bool gzip = !http10 && !ranged && wantsGzip(request, file.st.st_size);
+        const CachedFile::Variant& variant =
+            gzip && !file.gzip.body.empty() ? file.gzip : file.identity;
+        std::pmr::string headers("ETag: ", response.arena());
+        headers += variant.etag;
+        headers += "\r\nLast-Modified: ";
+        headers += file.last_modified;
+        headers += "\r\n";
+        if (static_cast<size_t>(file.st.st_size) >= gzip_min_bytes) headers += VARY_HEADER;
+
+        if (notModified(request, variant.etag, file.st.st_mtime)) {
+            response.sendNotModified(headers);
+            co_return;
+        }
+        switch (ranges.select(request, file.identity.etag, file.st.st_mtime, file.st.st_size)) {
+            case ByteRanges::Result::Partial:
+                response.sendCachedRanges(std::move(cached.file), "application/octet-stream", ranges,
+                                          headers);
+                co_return;
+            case ByteRanges::Result::Unsatisfiable:
+                sendUnsatisfiable(response, file.st.st_size);
+                co_return;
+            case ByteRanges::Result::Whole:
+                break;
+        }
+        response.sendCached(std::move(cached.file), gzip);
+        co_return;
+    }
+
+    std::pmr::string filename(response.arena());
+    filename.reserve(base_dir.size() + 1 + name.size());
+    filename += base_dir;
+    filename += '/';
+    filename += name;
+    int file_fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st{};
+    if (file_fd < 0 || fstat(file_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (file_fd >= 0) close(file_fd);
+        response.sendStatus(404);
+        co_return;
+    }
+
+    size_t length = st.st_size;
+    bool gzip = !http10 && !ranged && wantsGzip(request, length);
+    bool compressible = length >= gzip_min_bytes;
+    const AsyncContext* async = response.async();
+
+    // Streamed bodies carry the same validators as cached ones, and the metadata is all it
+    // takes to settle a conditional request: the contents are never read for a 304.
+    std::pmr::string etag(response.arena());
+    appendETag(etag, st, gzip ? "-gz" : "");
+    char last_modified[HTTP_DATE_BYTES];
+    formatHttpDate(st.st_mtime, last_modified);
+    std::pmr::string headers("ETag: ", response.arena());
+    headers += etag;
+    headers += "\r\nLast-Modified: ";
+    headers.append(last_modified, HTTP_DATE_BYTES);
+    headers += "\r\n";
+    if (compressible && !gzip) headers += VARY_HEADER;     // Gzip responses add their own.
+
+    if (notModified(request, etag, st.st_mtime)) {
+        close(file_fd);
+        if (gzip) headers += VARY_HEADER;
+        response.sendNotModified(headers);
+        co_return;
+    }
+    switch (ranges.select(request, etag, st.st_mtime, length)) {
+        case ByteRanges::Result::Partial:
+            response.sendFileRanges("application/octet-stream", file_fd, length, ranges, headers);
+            co_return;
+        case ByteRanges::Result::Unsatisfiable:
+            close(file_fd);
+            sendUnsatisfiable(response, length);
+            co_return;
+        case ByteRanges::Result::Whole:
+            break;
+    }
+
+    // Small files are read once into the cache and answered from memory from then on.
+    if (file_cache.accepts(length)) {
+        std::pmr::string key(name, response.arena());
+        FileContents contents = co_await ReadFile(async, file_fd, length);
+        auto file = contents.ok ? file_cache.store(key, st, std::move(contents.data), cached.generation)
+                                : nullptr;
+        if (file) {
+            response.sendCached(std::move(file), gzip);
         } else {
-            std::ostringstream oss;
-            oss << file.rdbuf();
-            std::string content = oss.str();
-            response.sendResponse("200 OK", "application/octet-stream", content);
+            response.sendStatus(500);   // The read failed, or the file shrank while we read it.
         }
+        co_return;
     }
-    else if (method == "POST" && path.rfind("/files/", 0) == 0) {
-        std::string filename = path.substr(std::string("/files/").length());
-        std::string full_path = base_dir + "/" + filename;
 
-        std::ofstream out_file(full_path, std::ios::binary);
-        if (!out_file.is_open()) {  
-            response.sendRaw("HTTP/1.1 500 Internal Server Error\r\n\r\n");
+    if (async) {
+        // On an event loop, read through AsyncIo a block ahead of the socket, never blocking.
+        auto reader = std::make_unique<FileReader>(file_fd, length, async);
+        if (gzip) {
+            response.sendGzipFile("200 OK", "application/octet-stream", std::move(reader), headers);
         } else {
-            out_file.write(request.body.c_str(), request.body.size());
-            // std::cout << request.body << std::endl;  // test log
-            out_file.close();
-            response.sendRaw("HTTP/1.1 201 Created\r\n\r\n");
+            response.sendFile("200 OK", "application/octet-stream", std::move(reader), headers);
         }
+    } else if (gzip) {
+        // A compressed body's length is unknown up front, so it needs chunked framing.
+        response.sendGzipFile("200 OK", "application/octet-stream", file_fd, length, headers);
+    } else {
+        // Only the size is needed up front; sendfile() streams the contents later.
+        response.sendFile("200 OK", "application/octet-stream", file_fd, length, headers);
     }
-    else {
-        response.sendRaw("HTTP/1.1 404 Not Found\r\n\r\n");
+}
+
+/**
+ * @class FileUploadSink
+ * @brief Streams a POST /files/ body to disk.
+ *
+ * The body goes into a temporary file beside the target, renamed over it once complete, so
+ * neither readers nor the file cache ever see a half-written file and an aborted upload
+ * leaves nothing behind.
+ */
+class FileUploadSink : public BodySink {
+private:
+    std::string path;       // Final location.
+    std::string temp_path;  // Where the body is written until it is complete.
+    std::string name;       // Cache key of the file.
+    FileCache& cache;
+    int fd;
+    bool failed;
+
+public:
+    FileUploadSink(std::string target, std::string file_name, FileCache& file_cache)
+        : path(std::move(target)), temp_path(path + ".upload-XXXXXX"),
+          name(std::move(file_name)), cache(file_cache) {
+        fd = mkostemp(temp_path.data(), O_CLOEXEC);
+        failed = fd < 0;
+        if (fd >= 0) fchmod(fd, 0644);  // mkostemp() creates it 0600.
+    }
+
+    ~FileUploadSink() override {
+        if (fd >= 0) {
+            close(fd);
+            unlink(temp_path.c_str());
+        }
+    }
+
+    void write(std::string_view chunk) override {
+        while (!failed && !chunk.empty()) {
+            ssize_t n = ::write(fd, chunk.data(), chunk.size());
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) failed = true;
+            else chunk.remove_prefix(n);
+        }
+    }
+
+    int spliceFd() const override { return failed ? -1 : fd; }
+
+    void finish(HttpResponse& response) override {
+        bool created = fd >= 0;
+        bool ok = !failed;
+        if (created && close(fd) != 0) ok = false;     // Delayed write errors surface here.
+        fd = -1;
+        if (ok && rename(temp_path.c_str(), path.c_str()) != 0) ok = false;
+        if (!ok) {
+            if (created) unlink(temp_path.c_str());
+            response.sendStatus(500);
+            return;
+        }
+        // Don't wait for inotify: the next GET on this connection must see the new contents.
+        cache.invalidate(name);
+        response.sendStatus(201);
+    }
+};
+
+/**
+ * @class RefusedUploadSink
+ * @brief Takes the body of a POST /files/ whose name is not a plain relative one, and
+ * answers 404 as GET would: nothing is created, and the connection stays in sync.
+ */
+class RefusedUploadSink : public BodySink {
+public:
+    void write(std::string_view) override {}
+
+    void finish(HttpResponse& response) override { response.sendStatus(404); }
+};
+
+std::unique_ptr<BodySink> RequestHandler::storeFile(std::string_view name) const {
+    // As for GET, a name such as "../x" must not lead outside base_dir.
+    if (!isPlainName(name)) return std::make_unique<RefusedUploadSink>();
+    return std::make_unique<FileUploadSink>(base_dir + "/" + std::string(name), std::string(name),
+                                            file_cache);
+}
+
+// Waits until fd is readable, or until deadline if there is one; false if it passed first,
+// or if wake_fd (when not -1) became readable first.
+static bool waitReadable(int fd, std::optional<std::chrono::steady_clock::time_point> deadline,
+                         int wake_fd = -1) {
+    pollfd entries[2] = {{fd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+    while (true) {
+        int timeout_ms = -1;
+        if (deadline) {
+            auto left = std::chrono::ceil<std::chrono::milliseconds>(
+                *deadline - std::chrono::steady_clock::now());
+            timeout_ms = static_cast<int>(std::max<decltype(left.count())>(0, left.count()));
+        }
+        int n = poll(entries, wake_fd < 0 ? 1 : 2, timeout_ms);
+        if (n < 0 && errno == EINTR) continue;
+        if (n > 0 && entries[1].revents && !entries[0].revents) return false;
+        return n != 0;  // Errors are left for the read to report.
+    }
+}
+
+// Serves a connection that switched to HTTP/2 until it closes; 'buffer' holds the bytes
+// received after the switch. Streams are answered one after another as their requests
+// complete, but their bodies still go out interleaved. An idle session is sent GOAWAY once
+// drain_fd is readable.
+static void serveHttp2(int fd, TlsSession* tls, Http2Session& session, ReadBuffer& buffer,
+                       OutputQueue& out, const Timeouts& timeouts, int drain_fd) {
+    WorkerMetrics& metrics = localMetrics();
+    while (true) {
+        buffer.consume(session.receive(buffer.data(), buffer.size()));
+        bool pumped;
+        do {
+            pumped = session.pump();
+            if (flushTo(fd, tls, out) != OutputQueue::FlushResult::Done) return;
+        } while (pumped);
+        if (session.finished() || !buffer.reserve(ReadBuffer::MIN_READ)) return;
+
+        // Open streams wait on request bodies or window updates; otherwise the client is idle.
+        unsigned seconds = session.hasStreams() ? timeouts.body : timeouts.idle;
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+        if (seconds) deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+        int wake_fd = session.hasStreams() ? -1 : drain_fd;
+        if (!(tls && tls->hasBuffered()) && !waitReadable(fd, deadline, wake_fd)) {
+            session.shutdown();
+            flushTo(fd, tls, out);
+            return;
+        }
+        ssize_t bytes_read = receiveFrom(fd, tls, buffer.tail(), buffer.freeSpace());
+        if (bytes_read <= 0) return;
+        metrics.bytes_in.add(bytes_read);
+        buffer.commit(bytes_read);
     }
 }
 
 // This is the main function for each client-handling thread.
-void handleClient(int client_fd, const std::string& base_dir) {
-    char buffer[4096];
-    // Loop to handle multiple requests on the same connection (keep-alive).
+void handleClient(int client_fd, const RequestHandler& handler) {
+    // Each worker serves one connection at a time, so its buffers need no limit; the pool
+    // just lets the next connection reuse them.
+    static thread_local BufferPool buffers;
+    ReadBuffer buffer(&buffers);    // Grows as needed, so a request is not limited to one read.
+    OutputQueue out;
+    RequestParser parser(handler.maxBodyBytes());
+    HttpRequest request;    // Reused for every request on this connection.
+    BodyStream body;        // An upload being streamed to its route, between head and response.
+    Arena arena;            // Scratch memory of the request being handled.
+    unsigned served = 0;    // Requests taken on this connection.
+    WorkerMetrics& metrics = localMetrics();
+    metrics.connections_opened.add();
+    AccessEntry access;     // Record of the request being answered.
+    access.log = handler.accessLog();
+    if (access.log) {
+        sockaddr_in peer{};
+        socklen_t peer_length = sizeof(peer);
+        if (getpeername(client_fd, reinterpret_cast<sockaddr*>(&peer), &peer_length) == 0) {
+            access.setPeer(peer.sin_addr.s_addr);
+        }
+    }
+
+    using Clock = std::chrono::steady_clock;
+    const Timeouts& timeouts = handler.timeouts();
+    auto after = [](unsigned seconds) -> std::optional<Clock::time_point> {
+        if (seconds == 0) return std::nullopt;
+        return Clock::now() + std::chrono::seconds(seconds);
+    };
+    std::optional<Clock::time_point> head_deadline;     // Set once a request's head has begun.
+    bool head_started = false;
+
+    if (timeouts.idle) {
+        // A client that stops reading its responses fails the send instead of pinning us.
+        timeval send_timeout{static_cast<time_t>(timeouts.idle), 0};
+        setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+    }
+
+    std::unique_ptr<TlsSession> tls;
+    if (const TlsContext* context = handler.tls()) {
+        // SSL_read() waits for a whole record, so a client trickling one in must not pin the
+        // worker either. This bounds the handshake as well.
+        if (timeouts.idle) {
+            timeval receive_timeout{static_cast<time_t>(timeouts.idle), 0};
+            setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &receive_timeout,
+                       sizeof(receive_timeout));
+        }
+        tls = std::make_unique<TlsSession>(*context, client_fd);
+        if (tls->handshake() != TlsSession::Handshake::Done) {
+            close(client_fd);
+            metrics.connections_closed.add();
+            return;
+        }
+    }
+    // Decrypted bytes already inside OpenSSL never make the socket readable.
+    auto readable = [&](std::optional<Clock::time_point> deadline, int wake_fd = -1) {
+        return (tls && tls->hasBuffered()) || waitReadable(client_fd, deadline, wake_fd);
+    };
+
+    // Loop to handle multiple requests on the same connection (keep-alive). Every complete
+    // request already in the buffer is answered before anything is written, so a pipelined
+    // batch goes out in one flush rather than one send() per request.
     while (true) {
-        int bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-        if (bytes_read <= 0) {
-            break;  // client closed connection or error occurred
+        if (body.active()) {
+            if (!buffer.empty()) {
+                // Body bytes that arrived with the head (or with an earlier read) go first.
+                buffer.consume(body.feed(buffer.data(), buffer.size()));
+            } else {
+                if (!out.empty() &&
+                    flushTo(client_fd, tls.get(), out) != OutputQueue::FlushResult::Done) {
+                    break;
+                }
+                out.retainBorrowed();
+                if (!readable(after(timeouts.body))) {
+                    HttpResponse response(out, true);
+                    response.logTo(&access);    // Begun with the request's head.
+                    response.sendError(408);
+                    flushTo(client_fd, tls.get(), out);
+                    break;
+                }
+                ssize_t moved;
+                if (body.expectsData() && !tls) {
+                    // The rest goes from the socket straight to the sink, spliced where possible.
+                    moved = body.spliceFrom(client_fd);
+                } else {
+                    // Chunk framing, possibly followed by the next request, or bytes that must
+                    // be decrypted first: keep it buffered.
+                    if (!buffer.reserve(ReadBuffer::MIN_READ)) break;
+                    moved = receiveFrom(client_fd, tls.get(), buffer.tail(), buffer.freeSpace());
+                    if (moved > 0) buffer.commit(moved);
+                }
+                if (moved < 0 && errno == EINTR) continue;
+                if (moved <= 0) break;
+                metrics.bytes_in.add(moved);
+            }
+            if (!body.complete()) continue;
+
+            bool should_close = body.shouldClose();
+            HttpResponse response(out, should_close);
+            response.logTo(&access);
+            handler.advertiseKeepAlive(response, served);
+            body.finish(response);
+            if (should_close) {
+                flushTo(client_fd, tls.get(), out);
+                break;
+            }
+            continue;
+        }
+
+        if (served == 0 && handler.http2() &&
+            Http2Session::startsWithPreface(buffer.data(), buffer.size())) {
+            Http2Session session(handler, out, nullptr, {}, access);
+            serveHttp2(client_fd, tls.get(), session, buffer, out, timeouts,
+                       handler.drainFd());
+            break;
+        }
+
+        auto parse_started = Clock::now();
+        RequestParser::Result result = parser.parse(buffer.data(), buffer.size(), request);
+        if (result == RequestParser::Result::Complete || result == RequestParser::Result::Headers) {
+            metrics.parse.record(Clock::now() - parse_started);
         }
 
-        HttpRequest request = HttpRequest::parse(client_fd, buffer, bytes_read);
-        // HttpResponse response(client_fd);
+        if (result == RequestParser::Result::Incomplete) {
+            // Nothing more to answer until more bytes arrive: write the batch, then wait.
+            if (!out.empty() &&
+                flushTo(client_fd, tls.get(), out) != OutputQueue::FlushResult::Done) {
+                break;
+            }
+            // Responses may borrow from the buffer, which reserve() and recv() may overwrite.
+            out.retainBorrowed();
+            if (!buffer.reserve(ReadBuffer::MIN_READ)) break;
+            if (!buffer.empty() && !head_started) {
+                head_started = true;
+                head_deadline = after(timeouts.header);
+            }
+            // Between requests, draining closes the connection as the idle timeout would. A
+            // new connection's first request is still waited for: it may be on its way.
+            bool between = !head_started && served > 0;
+            if (!readable(head_started ? head_deadline : after(timeouts.idle),
+                          between ? handler.drainFd() : -1)) {
+                if (head_started) {
+                    access.begin({}, {});
+                    HttpResponse response(out, true);
+                    response.logTo(&access);
+                    response.sendError(408);
+                    flushTo(client_fd, tls.get(), out);
+                }
+                break;  // An idle connection just closes.
+            }
+            ssize_t bytes_read = receiveFrom(client_fd, tls.get(), buffer.tail(),
+                                             buffer.freeSpace());
+            if (bytes_read <= 0) {
+                break;  // client closed connection or error occurred
+            }
+            metrics.bytes_in.add(bytes_read);
+            buffer.commit(bytes_read);
+            continue;
+        }
+
+        if (result == RequestParser::Result::Error) {
+            // The stream can't be resynchronized after a malformed request; reply and hang up.
+            metrics.parse_errors.add();
+            access.begin({}, {});
+            HttpResponse response(out, true);
+            response.logTo(&access);
+            response.sendError(parser.errorStatus());
+            flushTo(client_fd, tls.get(), out);
+            break;
+        }
+
+        if (result == RequestParser::Result::Headers) {
+            // The body is still on its way: stream it if the route takes it piecewise.
+            access.begin(request.method, request.path, request.version);
+            if (std::unique_ptr<BodySink> sink = handler.openBody(request)) {
+                ++served;
+                head_started = false;
+                bool should_close = request.wantsClose() || handler.lastRequest(served);
+                if (parser.chunked()) {
+                    body.startChunked(std::move(sink), handler.maxBodyBytes(), should_close);
+                } else {
+                    body.start(std::move(sink), parser.bodyLength(), should_close);
+                }
+                buffer.consume(parser.headLength());
+                parser.reset();
+            } else if (parser.bodyLength() > RequestParser::MAX_BUFFERED_BODY) {
+                HttpResponse response(out, true);
+                response.logTo(&access);
+                response.sendError(413);
+                flushTo(client_fd, tls.get(), out);
+                break;
+            }
+            // Otherwise keep buffering; parse() reports Incomplete until the body is in.
+            continue;
+        }
+
+        // Over TLS, HTTP/2 is only ever chosen with ALPN.
+        if (served == 0 && handler.http2() && !tls && Http2Session::wantsUpgrade(request)) {
+            HttpResponse(out).sendRaw(Http2Session::SWITCHING_PROTOCOLS);
+            Http2Session session(handler, out, nullptr, {}, access);
+            session.upgrade(request);   // Copies the request out of the buffer.
+            buffer.consume(parser.consumed());
+            serveHttp2(client_fd, tls.get(), session, buffer, out, timeouts,
+                       handler.drainFd());
+            break;
+        }
 
         // Check the 'Connection' header to see if the connection should be closed after this response.
-        auto conn_it = request.headers.find("connection");
-        bool should_close = (conn_it != request.headers.end() && conn_it->second == "close");
+        ++served;
+        head_started = false;
+        bool should_close = request.wantsClose() || handler.lastRequest(served);
+
+        access.begin(request.method, request.path, request.version);
+        HttpResponse response(out, should_close, nullptr, &arena);
+        response.logTo(&access);
+        handler.advertiseKeepAlive(response, served);
+        {
+            // No AsyncContext here: coroutine handlers block instead of suspending, so they
+            // are finished by the time handle() returns.
+            Arena::Scope scope(arena);
+            auto handle_started = Clock::now();
+            Task<void> finished = handler.handle(request, response);
+            metrics.handle.record(Clock::now() - handle_started);
+        }
+        arena.reset();
 
-        HttpResponse response(client_fd, should_close);
-        RequestHandler handler(base_dir);
-        handler.handle(request, response);
+        // Drop the handled request; any pipelined bytes after it stay for the next parse.
+        buffer.consume(parser.consumed());
+        parser.reset();
 
         if(should_close){
+            flushTo(client_fd, tls.get(), out);
             break;
         }
 
-        // Clear buffer for next request
-        memset(buffer, 0, sizeof(buffer));
+        // Don't let a client that pipelines without reading make us queue unbounded output.
+        if (out.bufferedBytes() >= OutputQueue::HIGH_WATER_MARK &&
+            flushTo(client_fd, tls.get(), out) != OutputQueue::FlushResult::Done) {
+            break;
+        }
     }
 
+    if (tls) tls->shutdown();
     close(client_fd);
+    metrics.connections_closed.add();
 }
-
-
-
-
-  
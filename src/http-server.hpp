@@ -1,17 +1,97 @@
+#pragma once
+
+#include "access-log.hpp"
+#include "admission.hpp"
+#include "arena.hpp"
+#include "async-io.hpp"
+#include "bundle.hpp"
+#include "conditional.hpp"
+#include "file-cache.hpp"
+#include "file-reader.hpp"
+#include "output-queue.hpp"
+#include "placement.hpp"
+#include "request-body.hpp"
+#include "router.hpp"
+#include "socket-options.hpp"
+#include "tls.hpp"
+
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <arpa/inet.h>
 // #include <cstdlib>
+#include <csignal>
 #include <cstring>
 #include <fstream>
+#include <future>
 #include <iostream>
-#include <map>
 #include <netdb.h>
-#include <sstream>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <thread>
 #include <unistd.h>
+#include <vector>
+
+
+/**
+ * Selects how accepted connections are serviced.
+ *
+ * Threads  - blocking I/O; each connection is served by a worker from a fixed-size pool.
+ * Reactor  - non-blocking, edge-triggered epoll event loops that multiplex every connection
+ *            through a small per-connection state machine. With more than one worker, each
+ *            loop owns its own SO_REUSEPORT listening socket and the kernel spreads
+ *            incoming connections across them.
+ */
+enum class ServerMode { Threads, Reactor };
+
+
+/**
+ * @struct Timeouts
+ * @brief How long a connection may wait on its client, in seconds; 0 disables a timeout.
+ *
+ * Both connection loops enforce them. The header timeout runs from a request's first byte
+ * and is not extended by later ones, so a client dripping its head slowly is cut off all
+ * the same; header and body timeouts are answered with 408 before closing.
+ */
+struct Timeouts {
+    unsigned idle = 15;     // Between requests, and for a send that makes no progress.
+    unsigned header = 10;   // From a request's first byte until its head is complete.
+    unsigned body = 30;     // Without receiving any more of a request body.
+};
+
+
+/**
+ * @struct ServerConfig
+ * @brief Startup options for HttpServer, filled in from the command line by main().
+ */
+struct ServerConfig {
+    std::string base_dir = ".";     // The root directory for serving files.
+    std::string bundle_path;        // Bundle consulted before base_dir for GET /files/ (if any).
+    int port = 4221;                // The port number the server will listen on.
+    ServerMode mode = ServerMode::Threads;
+    int workers = 1;                // Number of reactor threads, each with its own listener.
+    int backlog = SOMAXCONN;        // Pending-connection queue length passed to listen().
+    size_t pool_threads = 0;        // Threads mode: worker pool size (0 picks a default from the core count).
+    size_t max_queued = 1024;       // Threads mode: accepted connections waiting for a free worker.
+    size_t gzip_min_bytes = 1024;   // Smallest body worth gzip-compressing for clients that accept it.
+    size_t file_cache_bytes = 64 << 20;     // Memory for cached /files/ contents (0 disables).
+    size_t max_body_bytes = 1 << 30;        // Longest request body accepted; larger ones get 413.
+    bool io_uring = true;           // Reactor mode: read files through io_uring, not a thread pool.
+    size_t buffer_memory_bytes = 256 << 20; // Reactor mode: read buffer memory per worker (0: no limit).
+    Timeouts timeouts;
+    unsigned keepalive_requests = 1000;     // Requests served per connection before closing it (0: no limit).
+    bool http2 = true;              // Accept h2c, by prior knowledge or 'Upgrade: h2c'.
+    AccessLogOptions access_log;    // No access log unless a path is given.
+    TlsOptions tls;                 // Plain TCP unless a certificate is given.
+    unsigned drain_timeout = 30;    // Seconds to wait for connections when stopping (0: no limit).
+    AdmissionOptions admission;     // Connection cap and per-client rate limit; none by default.
+    SocketOptions sockets;          // TCP tuning of the listeners and accepted connections.
+    std::vector<int> cpus;          // CPUs to run on (empty: those the process started with).
+    bool steer_connections = false; // Reactor mode: accept on the worker of the receiving CPU.
+};
 
 
 /**
@@ -20,51 +100,142 @@
  * This class encapsulates the core server functionality. It initializes the listening socket,
  * binds it to a specific port, and enters a loop to accept and handle incoming client connections.
  */
+class RequestHandler;
+class Http2Stream;
+
 class HttpServer {
 private:
-    int server_fd;  // File descriptor for the listening server socket.
-    std::string base_dir;   // The root directory for serving files.
-    int port;   // The port number the server will listen on.
+    int server_fd;  // File descriptor for the listening server socket (threads mode).
+    ServerConfig config;    // Directory, port, mode, worker count and backlog.
+    std::vector<int> listeners;     // Every listening socket, in the order the workers use them.
 
 
-    void setupSocket();     // Creates, configures (with SO_REUSEADDR), binds, and sets the socket to listen for incoming connections.
-    
+    /**
+     * Opens the listening sockets the mode needs: one, or one per reactor worker.
+     *
+     * Sockets handed over by a previous process (see receiveListeners()) are used first, and
+     * shared with dup() if there are fewer; any left over are closed.
+     */
+    void openListeners(std::vector<int> inherited);
+
+    /**
+     * Creates, configures (with SO_REUSEADDR), binds, and sets a socket to listen for incoming connections.
+     *
+     * @param reuse_port Also set SO_REUSEPORT so several sockets can bind the same port.
+     * @return The listening file descriptor; exits the process on failure.
+     */
+    int createListener(bool reuse_port);
 
     /**
      * Enters an infinite loop to accept new client connections.
      *
-     * For each new connection, it spawns a new thread to handle the client's requests.
+     * Each new connection is queued on a bounded, work-stealing ThreadPool whose workers
+     * run handleClient(); accepting pauses while the queue is full. On a NUMA machine, the
+     * pool's workers are spread over the nodes, each free to run on any CPU of its own.
+     * @param handler The route table shared by every worker.
+     */
+    void acceptConnections(const RequestHandler& handler);
+
+    /**
+     * Opens one SO_REUSEPORT listener per worker and runs an EventLoop on each, every worker
+     * on its own thread pinned to its own CPU (the i-th allowed one for worker i), and steers
+     * connections to them if asked. Blocks for as long as the workers run.
+     * @param handler The route table shared by every worker.
+     */
+    void runReactors(const RequestHandler& handler);
+
+    /**
+     * Waits for the signals that stop the server: SIGTERM, or SIGHUP / SIGUSR2 to restart it
+     * by handing the listeners to a new process first (see startSuccessor()). Then drains,
+     * returning once every connection has closed, or exiting at the drain timeout.
+     * @param stopped Ready once the workers have finished.
      */
-    void acceptConnections();
+    void superviseSignals(RequestHandler& handler, const sigset_t& signals,
+                          std::future<void>& stopped);
 public:
-    HttpServer(const std::string& directory, int port = 4221);
+    HttpServer(const ServerConfig& config);
 
     /**
      * Starts the server's execution.
      *
-     * Calls setupSocket() and then acceptConnections() to begin listening for clients.
+     * Opens the listeners (or takes them over from the process being replaced), then serves
+     * on another thread: acceptConnections() in threads mode, or the configured number of
+     * event-loop workers in reactor mode. Returns once the server has been stopped and
+     * drained (see superviseSignals()).
      */
     void start();
 };
 
 
+/**
+ * @struct HttpHeader
+ * @brief One request header. Both fields point into the connection's read buffer.
+ */
+struct HttpHeader {
+    std::string_view name;      // Lowercased in place by the parser.
+    std::string_view value;     // Leading and trailing whitespace removed.
+};
+
+
+/**
+ * @class HttpHeaders
+ * @brief A small, fixed-capacity, flat list of request headers.
+ *
+ * Requests carry a handful of headers, so a linear scan over a contiguous array beats a
+ * std::map and never allocates. The array lives as long as its HttpRequest; connections keep
+ * one HttpRequest around and reset() it between requests.
+ */
+class HttpHeaders {
+public:
+    static constexpr size_t MAX_HEADERS = 64;
+
+    /**
+     * @brief Appends a header.
+     * @return false if the list is already full.
+     */
+    bool add(std::string_view name, std::string_view value);
+
+    /**
+     * @brief Looks up a header by name.
+     * @param name The header name in lowercase (e.g. "content-length").
+     * @return The value of the first matching header, or std::nullopt.
+     */
+    std::optional<std::string_view> get(std::string_view name) const;
+
+    size_t size() const { return count; }
+    const HttpHeader* begin() const { return entries.data(); }
+    const HttpHeader* end() const { return entries.data() + count; }
+    void clear() { count = 0; }
+
+private:
+    std::array<HttpHeader, MAX_HEADERS> entries;
+    size_t count = 0;
+};
+
+
 /**
  * @class HttpRequest
  * @brief Represents a parsed HTTP request.
  *
  * This class provides a structured representation of an incoming HTTP request,
- * breaking it down into its method, path, version, headers, and body.
+ * breaking it down into its method, path, version, headers, and body. Every field is a
+ * view into the connection's read buffer (see RequestParser), so a request is only valid
+ * until that buffer is consumed.
  */
 class HttpRequest {
     
 public:
-    std::string method;
-    std::string path;
-    std::string version;
-    std::map<std::string, std::string> headers;
-    std::string body;
+    std::string_view method;
+    std::string_view path;
+    std::string_view version;
+    HttpHeaders headers;
+    std::string_view body;
+
+    // Clears the fields so the object can be reused for the next request on a connection.
+    void reset();
 
-    static HttpRequest parse(int client_fd, char* buffer, int bytes_read);
+    // True when the client asked for the connection to be closed after this request.
+    bool wantsClose() const;
 };
 
 /**
@@ -72,24 +243,116 @@ public:
  * @brief Handles the creation and sending of HTTP responses.
  *
  * This class simplifies sending responses back to the client, handling the formatting
- * of status lines, headers, and the response body.
+ * of status lines, headers, and the response body. Output is appended to the connection's
+ * OutputQueue, which the connection's owner (handleClient or the EventLoop) flushes.
+ * Headers are formatted with std::to_chars straight into the queue's reusable header arena,
+ * and a body passed as a view is queued by reference, so headers and body go out together
+ * in one gathered write without the body being copied.
  */
 class HttpResponse {
 private:
-    int client_fd;      // File descriptor for the client socket to write the response to.
+    OutputQueue& out;       // The connection's pending output.
+    Http2Stream* stream = nullptr;      // Set for HTTP/2: the head goes out as HEADERS instead.
     bool should_close;     // Flag to determine if the 'Connection: close' header should be sent.
+    const AsyncContext* async_context;  // Set by event loops, which must not block on files.
+    Arena* request_arena;               // The connection's scratch memory for this request.
+    unsigned keep_alive_timeout = 0;    // Advertised in 'Keep-Alive' when the connection stays open;
+    unsigned keep_alive_max = 0;        // 0 omits the parameter.
+    size_t route_id = SIZE_MAX;         // Router id of the route answering; counted in metrics.
+    AccessEntry* access_entry = nullptr;    // Completed once the status is known; see logTo().
+
+    // Most bytes writeConnection() produces.
+    static constexpr size_t MAX_CONNECTION_HEADERS = 80;
+
+    // Writes the 'Connection' (and 'Keep-Alive') headers and the blank line ending the head.
+    char* writeConnection(char* p) const;
+
+    // Formats the status line and the common headers, up to and including the blank line,
+    // into the output queue. An empty content_type omits the Content-Type header; no
+    // content_length means a chunked body. extra_headers are complete, CRLF-terminated lines.
+    void queueHead(std::string_view status, std::string_view content_type,
+                   std::optional<size_t> content_length, std::string_view extra_headers = {});
+
+    // Counts the response in the metrics and the access log as its head is queued; no
+    // body_bytes means a chunked body.
+    void recordStatus(int status, std::optional<size_t> body_bytes);
+
+    // Queues a 206 head for 'ranges' of a 'size'-byte body, and for several ranges the
+    // multipart framing around each part; append_part(range) queues a part's bytes.
+    template <typename AppendPart>
+    void queueRanges(std::string_view content_type, uint64_t size, const ByteRanges& ranges,
+                     std::string_view extra_headers, AppendPart append_part);
 
 public:
-    HttpResponse(int client_fd, bool should_close = false);
+    HttpResponse(OutputQueue& out, bool should_close = false,
+                 const AsyncContext* async_context = nullptr, Arena* request_arena = nullptr);
+
+    /**
+     * @brief A response on an HTTP/2 stream.
+     *
+     * The send functions work as over HTTP/1.1: the head is translated into a HEADERS frame
+     * (see Http2Stream::respond()) and the body queued on the stream. Connection headers
+     * have no meaning there, and sendRaw() must not be used.
+     */
+    explicit HttpResponse(Http2Stream& stream, const AsyncContext* async_context = nullptr,
+                          Arena* request_arena = nullptr);
+
+    /**
+     * @brief How file bodies can be read without blocking, or null if blocking is fine.
+     */
+    const AsyncContext* async() const { return async_context; }
+
+    /**
+     * @brief Memory for values that die with the request, such as paths and header lines.
+     *
+     * It is released all at once when the connection's next request starts, so nothing
+     * allocated from it may be passed to the send functions as a borrowed body.
+     */
+    std::pmr::memory_resource* arena() const {
+        return request_arena ? request_arena : std::pmr::get_default_resource();
+    }
+
+    /**
+     * @brief Advertises, with 'Keep-Alive: timeout=..., max=...', how long the connection is
+     * kept open while idle and how many more requests it takes. Zero omits a parameter.
+     */
+    void keepAlive(unsigned timeout_seconds, unsigned max_requests) {
+        keep_alive_timeout = timeout_seconds;
+        keep_alive_max = max_requests;
+    }
+
+    /**
+     * @brief Counts what this response sends under the given route (see Router::labels()).
+     */
+    void setRoute(size_t id) { route_id = id; }
+
+    /**
+     * @brief Finishes entry (see AccessEntry::begin()) with this response's status and length.
+     *
+     * The entry must outlive the response; only the first response sent is logged.
+     */
+    void logTo(AccessEntry* entry) { access_entry = entry; }
 
     /**
      * @brief Sends a fully formatted HTTP response with a body.
+     *
+     * The body is not copied: it must stay valid until the connection flushes or retains
+     * its output (views into the request, such as the path or a header, always do).
      * @param status The HTTP status string (e.g., "200 OK").
      * @param content_type The MIME type of the body (e.g., "text/plain").
      * @param body The content to send in the response body.
+     * @param extra_headers Additional header lines, each ending in CRLF (e.g. "Vary: ...\r\n").
      */
-    void sendResponse(const std::string& status, const std::string& content_type,
-                      const std::string& body);
+    void sendResponse(std::string_view status, std::string_view content_type,
+                      std::string_view body, std::string_view extra_headers = {});
+
+    /**
+     * @brief Sends a response with a body the queue takes ownership of.
+     *
+     * For bodies built on the fly, which would not outlive the call otherwise.
+     */
+    void sendResponse(std::string_view status, std::string_view content_type,
+                      std::string&& body);
 
     /**
      * @brief Sends a raw string as a response.
@@ -97,7 +360,122 @@ public:
      * Useful for sending responses without a body or with custom headers.
      * @param raw The raw HTTP response string to send.
      */
-    void sendRaw(const std::string& raw);
+    void sendRaw(std::string_view raw);
+
+    /**
+     * @brief Sends a prebuilt, empty-bodied response for the given status.
+     *
+     * The bytes come from the compile-time table in static-responses.hpp, so this only
+     * queues a pointer, plus the connection headers when keepAlive() asked for them.
+     * @param status The numeric HTTP status (e.g. 404).
+     */
+    void sendStatus(int status);
+
+    /**
+     * @brief Sends an empty-bodied error response and marks the connection for closing.
+     * @param status The numeric HTTP status (e.g. 400).
+     */
+    void sendError(int status);
+
+    /**
+     * @brief Sends a response whose body is a range of an open file.
+     *
+     * Only the headers are built in userspace; the body is streamed with sendfile(2).
+     * @param status The HTTP status string (e.g., "200 OK").
+     * @param content_type The MIME type of the body.
+     * @param file_fd An open file descriptor; ownership passes to the response.
+     * @param length Number of bytes to send, starting at offset 0.
+     */
+    void sendFile(std::string_view status, std::string_view content_type,
+                  int file_fd, size_t length, std::string_view extra_headers = {});
+
+    /**
+     * @brief Sends a whole file as the body, read block by block by 'reader' as it is sent.
+     */
+    void sendFile(std::string_view status, std::string_view content_type,
+                  std::unique_ptr<FileReader> reader, std::string_view extra_headers = {});
+
+    /**
+     * @brief Sends a body gzip-compressed, with 'Content-Encoding: gzip'.
+     *
+     * The body is compressed in one pass with the calling thread's reusable compressor; if
+     * zlib fails, it is sent uncompressed instead.
+     */
+    void sendGzip(std::string_view status, std::string_view content_type, std::string_view body);
+
+    /**
+     * @brief Sends a range of an open file gzip-compressed, as a stream (see sendStream()).
+     *
+     * The file is compressed block by block as the socket accepts data (see GzipFileSource),
+     * so large files are never buffered whole. Requires an HTTP/1.1 or HTTP/2 client.
+     * @param file_fd An open file descriptor; ownership passes to the response.
+     */
+    void sendGzipFile(std::string_view status, std::string_view content_type,
+                      int file_fd, size_t length, std::string_view extra_headers = {});
+
+    /**
+     * @brief Like the above, with the file read by 'reader'.
+     */
+    void sendGzipFile(std::string_view status, std::string_view content_type,
+                      std::unique_ptr<FileReader> reader, std::string_view extra_headers = {});
+
+    /**
+     * @brief Sends a body of unknown length, pulled from 'body' as the socket drains.
+     *
+     * Each piece the source produces is sent as soon as it exists, as an HTTP/1.1 chunk (see
+     * ChunkedSource) or in DATA frames on HTTP/2, so the first bytes leave before the last
+     * are generated. Requires an HTTP/1.1 or HTTP/2 client.
+     */
+    void sendStream(std::string_view status, std::string_view content_type,
+                    std::unique_ptr<StreamSource> body, std::string_view extra_headers = {});
+
+    /**
+     * @brief Sends 304 Not Modified: no body, just the headers a 200 would have had.
+     * @param headers Header lines such as ETag, Last-Modified and Vary.
+     */
+    void sendNotModified(std::string_view headers);
+
+    /**
+     * @brief Sends a 206 response with parts of an open file.
+     *
+     * A single range is the body itself, described by Content-Range; several are sent as
+     * multipart/byteranges. Parts go out with sendfile(2) from their offsets, or are read
+     * by FileReader on event loops.
+     * @param file_fd An open file descriptor; ownership passes to the response.
+     * @param size The whole file's length.
+     */
+    void sendFileRanges(std::string_view content_type, int file_fd, uint64_t size,
+                        const ByteRanges& ranges, std::string_view extra_headers = {});
+
+    /**
+     * @brief Like sendFileRanges(), with the parts queued by reference from a FileCache entry.
+     */
+    void sendCachedRanges(std::shared_ptr<const CachedFile> file, std::string_view content_type,
+                          const ByteRanges& ranges, std::string_view extra_headers = {});
+
+    /**
+     * @brief Like sendFileRanges(), with the parts queued by reference from 'body', which
+     * 'owner' keeps alive.
+     */
+    void sendSharedRanges(std::shared_ptr<const void> owner, std::string_view body,
+                          std::string_view content_type, const ByteRanges& ranges,
+                          std::string_view extra_headers = {});
+
+    /**
+     * @brief Sends a 200 response straight from a FileCache entry.
+     *
+     * The precomputed head and the body are queued by reference; the entry stays alive until
+     * they are written.
+     * @param gzip Send the gzip variant, if the entry has one.
+     */
+    void sendCached(std::shared_ptr<const CachedFile> file, bool gzip);
+
+    /**
+     * @brief Sends a 200 response from a precomputed head (see makeFileHead()) and body, both
+     * queued by reference; 'owner' keeps them alive until they are written.
+     */
+    void sendPrepared(std::shared_ptr<const void> owner, std::string_view head,
+                      std::string_view body);
 };
 
 
@@ -105,21 +483,124 @@ public:
  * @class RequestHandler
  * @brief Contains the application logic for routing and handling requests.
  *
- * This class inspects the HttpRequest and determines the appropriate action,
- * such as returning an echo, serving a file, or creating a new file.
+ * The constructor registers every route in a Router; handle() dispatches through it, such as
+ * returning an echo, serving a file, or creating a new file. One instance is built at startup
+ * and shared, read-only, by every worker thread and event loop.
  */
 class RequestHandler {
 private:
     std::string base_dir;  // The working directory for file operations.
+    size_t gzip_min_bytes; // Bodies shorter than this are never compressed.
+    size_t max_body_bytes; // Longest request body accepted.
+    Timeouts limits;       // How long connections wait on clients.
+    unsigned max_requests; // Requests per connection; 0 for no limit.
+    bool accept_http2;     // Whether connections may switch to HTTP/2.
+    mutable FileCache file_cache;   // Hot /files/ contents; internally synchronized.
+    std::unique_ptr<AssetBundle> bundle;    // Null unless files are served from a bundle.
+    mutable Admission admission_control;    // Which connections to take; internally synchronized.
+    Router router;         // Every route, built once in the constructor.
+    std::unique_ptr<AccessLog> access_log;  // Null when no access log was asked for.
+    std::unique_ptr<TlsContext> tls_context; // Null when serving plain TCP.
+    std::atomic<bool> stopping{false};      // Set by startDraining().
+    int drain_fd;          // An eventfd, readable from startDraining() on.
+
+    // Whether a compressible body of this length should be gzipped for this request.
+    bool wantsGzip(const HttpRequest& request, size_t length) const;
+
+    void serveRoot(HttpResponse& response) const;
+    void serveMetrics(HttpResponse& response) const;
+    void serveEcho(const HttpRequest& request, HttpResponse& response, std::string_view text) const;
+    void serveUserAgent(const HttpRequest& request, HttpResponse& response) const;
+    Task<void> serveFile(const HttpRequest& request, HttpResponse response, std::string_view name) const;
+    void serveBundled(const HttpRequest& request, HttpResponse& response,
+                      const BundledFile& file) const;
+    std::unique_ptr<BodySink> storeFile(std::string_view name) const;
 public:
-    RequestHandler(const std::string& dir);
+    explicit RequestHandler(const ServerConfig& config);
+    ~RequestHandler();
+    RequestHandler(const RequestHandler&) = delete;
+    RequestHandler& operator=(const RequestHandler&) = delete;
 
     /**
      * @brief Handles an incoming request and uses the HttpResponse object to send a reply.
+     *
+     * Handlers that wait for I/O are coroutines (see Task). If one suspends before it has
+     * responded, its Task is returned: the caller must keep it, and must not handle the
+     * connection's next request, until the Task is done. Without an AsyncContext on the
+     * response nothing suspends, so the returned Task is always empty.
      * @param request The parsed HttpRequest object.
      * @param response The HttpResponse object used to send the response.
      */
-    void handle(const HttpRequest& request, HttpResponse& response);
+    [[nodiscard]] Task<void> handle(const HttpRequest& request, HttpResponse& response) const;
+
+    /**
+     * @brief Opens a sink for the body of a request whose route streams it.
+     *
+     * Connection loops call this when a request head has arrived but its body has not, so
+     * uploads go to disk as they arrive instead of being buffered whole.
+     * @return null if the request's body should be buffered and handled by handle().
+     */
+    std::unique_ptr<BodySink> openBody(const HttpRequest& request) const;
+
+    /**
+     * @brief Longest request body to accept; connection parsers answer longer ones with 413.
+     */
+    size_t maxBodyBytes() const { return max_body_bytes; }
+
+    /**
+     * @brief How long connection loops let a connection wait on its client.
+     */
+    const Timeouts& timeouts() const { return limits; }
+
+    /**
+     * @brief Where connection loops log requests (see AccessEntry), or null for nowhere.
+     */
+    AccessLog* accessLog() const { return access_log.get(); }
+
+    /**
+     * @brief Whether connection loops take h2c connections (see Http2Session).
+     */
+    bool http2() const { return accept_http2; }
+
+    /**
+     * @brief What connection loops wrap accepted sockets in, or null to serve plain TCP.
+     */
+    const TlsContext* tls() const { return tls_context.get(); }
+
+    /**
+     * @brief What connection loops ask before accepting, and about each connection accepted.
+     */
+    Admission& admission() const { return admission_control; }
+
+    /**
+     * @brief Whether a connection must close after its 'served'th request, whatever the client
+     * asked: it has reached the per-connection limit, or the server is draining.
+     */
+    bool lastRequest(unsigned served) const {
+        return draining() || (max_requests && served >= max_requests);
+    }
+
+    /**
+     * @brief Tells connection loops to stop accepting and to close every connection once
+     * its client is not waiting on a response.
+     */
+    void startDraining();
+
+    bool draining() const { return stopping.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Becomes readable (and stays so) when draining starts, for loops to poll with
+     * their sockets.
+     */
+    int drainFd() const { return drain_fd; }
+
+    /**
+     * @brief Tells the client how long a connection is kept idle, and how many requests it
+     * takes after its 'served'th, with a 'Keep-Alive' header on response.
+     */
+    void advertiseKeepAlive(HttpResponse& response, unsigned served) const {
+        response.keepAlive(limits.idle, max_requests ? max_requests - served : 0);
+    }
 };
 
 
@@ -129,6 +610,6 @@ public:
  * This function manages the lifecycle of a single client connection. It reads requests,
  * processes them, sends responses, and handles persistent connections (keep-alive).
  * @param client_fd The file descriptor for the connected client's socket.
- * @param base_dir The root directory for file operations.
+ * @param handler The shared route table requests are dispatched through.
  */
-void handleClient(int client_fd, const std::string& base_dir);
\ No newline at end of file
+void handleClient(int client_fd, const RequestHandler& handler);
\ No newline at end of file
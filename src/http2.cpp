@@ -0,0 +1,791 @@
+#include "http2.hpp"
+#include "metrics.hpp"
+#include "request-body.hpp"
+#include "request-parser.hpp"
+#include "simd-scan.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+
+namespace {
+
+constexpr size_t FRAME_HEADER_BYTES = 9;
+
+// Largest frame payload either side sends. Clients may allow more, but larger frames would
+// only make pump()'s turns between streams coarser.
+constexpr size_t MAX_FRAME_BYTES = 16384;
+
+constexpr uint8_t FRAME_DATA = 0x0;
+constexpr uint8_t FRAME_HEADERS = 0x1;
+constexpr uint8_t FRAME_PRIORITY = 0x2;
+constexpr uint8_t FRAME_RST_STREAM = 0x3;
+constexpr uint8_t FRAME_SETTINGS = 0x4;
+constexpr uint8_t FRAME_PUSH_PROMISE = 0x5;
+constexpr uint8_t FRAME_PING = 0x6;
+constexpr uint8_t FRAME_GOAWAY = 0x7;
+constexpr uint8_t FRAME_WINDOW_UPDATE = 0x8;
+constexpr uint8_t FRAME_CONTINUATION = 0x9;
+
+constexpr uint8_t FLAG_END_STREAM = 0x1;
+constexpr uint8_t FLAG_ACK = 0x1;
+constexpr uint8_t FLAG_END_HEADERS = 0x4;
+constexpr uint8_t FLAG_PADDED = 0x8;
+constexpr uint8_t FLAG_PRIORITY = 0x20;
+
+constexpr uint16_t SETTINGS_ENABLE_PUSH = 0x2;
+constexpr uint16_t SETTINGS_MAX_CONCURRENT_STREAMS = 0x3;
+constexpr uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 0x4;
+constexpr uint16_t SETTINGS_MAX_FRAME_SIZE = 0x5;
+constexpr uint16_t SETTINGS_MAX_HEADER_LIST_SIZE = 0x6;
+
+// Error codes (RFC 9113 7).
+constexpr uint32_t NO_ERROR = 0x0;
+constexpr uint32_t PROTOCOL_ERROR = 0x1;
+constexpr uint32_t INTERNAL_ERROR = 0x2;
+constexpr uint32_t FLOW_CONTROL_ERROR = 0x3;
+constexpr uint32_t STREAM_CLOSED = 0x5;
+constexpr uint32_t FRAME_SIZE_ERROR = 0x6;
+constexpr uint32_t REFUSED_STREAM = 0x7;
+constexpr uint32_t COMPRESSION_ERROR = 0x9;
+constexpr uint32_t ENHANCE_YOUR_CALM = 0xb;
+
+// What this side advertises. The stream window holds a whole buffered body, so a client
+// never waits on a WINDOW_UPDATE to finish sending one.
+constexpr uint32_t MAX_STREAMS = 100;
+constexpr int64_t DEFAULT_WINDOW = 65535;
+constexpr int64_t STREAM_WINDOW = RequestParser::MAX_BUFFERED_BODY;
+constexpr int64_t CONNECTION_WINDOW = 16 << 20;
+constexpr int64_t MAX_WINDOW = 0x7fffffff;
+
+uint32_t read32(const char* p) {
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(p);
+    return uint32_t(b[0]) << 24 | uint32_t(b[1]) << 16 | uint32_t(b[2]) << 8 | b[3];
+}
+
+char* put32(char* p, uint32_t value) {
+    p[0] = static_cast<char>(value >> 24);
+    p[1] = static_cast<char>(value >> 16);
+    p[2] = static_cast<char>(value >> 8);
+    p[3] = static_cast<char>(value);
+    return p + 4;
+}
+
+void putFrameHeader(char* p, size_t length, uint8_t type, uint8_t flags, uint32_t stream_id) {
+    p[0] = static_cast<char>(length >> 16);
+    p[1] = static_cast<char>(length >> 8);
+    p[2] = static_cast<char>(length);
+    p[3] = static_cast<char>(type);
+    p[4] = static_cast<char>(flags);
+    put32(p + 5, stream_id);
+}
+
+char* putSetting(char* p, uint16_t id, uint32_t value) {
+    p[0] = static_cast<char>(id >> 8);
+    p[1] = static_cast<char>(id);
+    return put32(p + 2, value);
+}
+
+// Strips the padding of a PADDED frame; false if the padding is longer than the frame.
+bool unpad(uint8_t flags, std::string_view& payload) {
+    if (!(flags & FLAG_PADDED)) return true;
+    if (payload.empty()) return false;
+    size_t padding = static_cast<uint8_t>(payload[0]);
+    if (padding >= payload.size()) return false;
+    payload = payload.substr(1, payload.size() - 1 - padding);
+    return true;
+}
+
+// HTTP2-Settings carries a SETTINGS payload in base64url without padding (RFC 7540 3.2.1).
+bool decodeBase64Url(std::string_view text, std::string& out) {
+    uint32_t bits = 0;
+    int count = 0;
+    for (char c : text) {
+        int value;
+        if (c >= 'A' && c <= 'Z') value = c - 'A';
+        else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') value = c - '0' + 52;
+        else if (c == '-' || c == '+') value = 62;
+        else if (c == '_' || c == '/') value = 63;
+        else if (c == '=') break;
+        else return false;
+        bits = bits << 6 | value;
+        count += 6;
+        if (count >= 8) {
+            count -= 8;
+            out += static_cast<char>(bits >> count);
+        }
+    }
+    return true;
+}
+
+// Headers that only mean something to one HTTP/1.1 connection; HTTP/2 forbids them.
+bool connectionSpecific(std::string_view name) {
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+           name == "transfer-encoding" || name == "upgrade";
+}
+
+// Whether a comma-separated header value lists 'token'.
+bool hasToken(std::string_view list, std::string_view token) {
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+        while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+        if (item == token) return true;
+        if (comma == std::string_view::npos) break;
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+}
+
+
+Http2Stream::Http2Stream(Http2Session& session, uint32_t id, int64_t send_window,
+                         int64_t receive_window)
+    : session(session), id(id), send_window(send_window), receive_window(receive_window),
+      access(session.access) {}
+
+void Http2Stream::respond(int status, std::string_view content_type,
+                          std::optional<size_t> content_length, std::string_view header_lines) {
+    if (responded) return;
+    responded = true;
+
+    std::string& block = session.encoded;
+    block.clear();
+    hpackEncodeStatus(block, status);
+    if (!content_type.empty()) hpackEncode(block, "content-type", content_type);
+    if (content_length) {
+        char digits[20];
+        char* end = std::to_chars(digits, digits + sizeof(digits), *content_length).ptr;
+        hpackEncode(block, "content-length", std::string_view(digits, end - digits));
+    }
+
+    std::string name;
+    while (!header_lines.empty()) {
+        size_t end = header_lines.find("\r\n");
+        std::string_view line = header_lines.substr(0, end);
+        header_lines.remove_prefix(end == std::string_view::npos ? header_lines.size() : end + 2);
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) continue;
+        name.assign(line.substr(0, colon));
+        lowercaseInPlace(name.data(), name.size());
+        if (connectionSpecific(name)) continue;
+        std::string_view value = line.substr(colon + 1);
+        while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+        hpackEncode(block, name, value);
+    }
+
+    bool end_stream = content_length && *content_length == 0;
+    session.writeHeaders(id, block, end_stream);
+    local_closed = end_stream;
+}
+
+
+Http2Session::Http2Session(const RequestHandler& handler, OutputQueue& out,
+                           const AsyncContext* async, std::function<void()> task_done,
+                           const AccessEntry& access)
+    : handler(handler), out(out), async(async), task_done(std::move(task_done)), access(access),
+      metrics(localMetrics()) {
+    // The server's preface: its SETTINGS, then a connection window larger than the default.
+    char settings[18];
+    char* p = putSetting(settings, SETTINGS_MAX_CONCURRENT_STREAMS, MAX_STREAMS);
+    p = putSetting(p, SETTINGS_INITIAL_WINDOW_SIZE, STREAM_WINDOW);
+    p = putSetting(p, SETTINGS_MAX_HEADER_LIST_SIZE, RequestParser::MAX_HEADER_BYTES);
+    writeFrame(FRAME_SETTINGS, 0, 0, std::string_view(settings, p - settings));
+    writeWindowUpdate(0, CONNECTION_WINDOW - DEFAULT_WINDOW);
+}
+
+Http2Session::~Http2Session() = default;
+
+bool Http2Session::startsWithPreface(const char* data, size_t length) {
+    // "PRI" is reserved as a method so that no HTTP/1.1 request starts like this.
+    return length >= 4 && std::memcmp(data, PREFACE.data(), 4) == 0;
+}
+
+bool Http2Session::wantsUpgrade(const HttpRequest& request) {
+    std::optional<std::string_view> upgrade = request.headers.get("upgrade");
+    return upgrade && hasToken(*upgrade, "h2c") && request.headers.get("http2-settings") &&
+           request.version == "HTTP/1.1" && request.body.empty() &&
+           !request.headers.get("transfer-encoding");
+}
+
+void Http2Session::upgrade(const HttpRequest& request) {
+    // The 101 response acknowledges the client's settings; no SETTINGS ACK is sent for them.
+    std::string settings;
+    if (!decodeBase64Url(*request.headers.get("http2-settings"), settings) ||
+        settings.size() % 6 != 0 || !applySettings(settings)) {
+        if (!failed) connectionError(PROTOCOL_ERROR);
+        return;
+    }
+
+    // The request becomes stream 1, half-closed since it has been received in full.
+    last_stream_id = 1;
+    auto fresh = std::make_unique<Http2Stream>(*this, 1, initial_send_window, STREAM_WINDOW);
+    Http2Stream& stream = *fresh;
+    stream.remote_closed = true;
+    auto add = [&stream](std::string_view name, std::string_view value) {
+        uint32_t at = stream.text.size();
+        stream.text += name;
+        stream.text += value;
+        stream.fields.push_back(HpackField{at, static_cast<uint32_t>(name.size()),
+                                           static_cast<uint32_t>(at + name.size()),
+                                           static_cast<uint32_t>(value.size())});
+    };
+    add(":method", request.method);
+    add(":path", request.path);
+    for (const HttpHeader& header : request.headers) {
+        if (connectionSpecific(header.name) || header.name == "http2-settings") continue;
+        add(header.name, header.value);
+    }
+    streams.push_back(std::move(fresh));
+
+    ++served;
+    if (int status = buildRequest(stream)) {
+        stream.access.begin(request.method, request.path, request.version);
+        reject(stream, status);
+        return;
+    }
+    stream.access.begin(stream.request.method, stream.request.path,
+                        stream.request.version);
+    dispatch(stream);
+}
+
+size_t Http2Session::receive(const char* data, size_t length) {
+    size_t consumed = 0;
+    if (!preface_received) {
+        size_t n = std::min(length, PREFACE.size());
+        if (std::string_view(data, n) != PREFACE.substr(0, n)) {
+            connectionError(PROTOCOL_ERROR);
+            return length;
+        }
+        if (n < PREFACE.size()) return 0;
+        preface_received = true;
+        consumed = n;
+    }
+
+    while (!failed && length - consumed >= FRAME_HEADER_BYTES) {
+        const uint8_t* header = reinterpret_cast<const uint8_t*>(data + consumed);
+        size_t frame_length = header[0] << 16 | header[1] << 8 | header[2];
+        if (frame_length > MAX_FRAME_BYTES) {
+            connectionError(FRAME_SIZE_ERROR);
+            break;
+        }
+        if (length - consumed < FRAME_HEADER_BYTES + frame_length) break;
+        uint32_t stream_id = read32(data + consumed + 5) & 0x7fffffff;
+        onFrame(header[3], header[4], stream_id,
+                std::string_view(data + consumed + FRAME_HEADER_BYTES, frame_length));
+        consumed += FRAME_HEADER_BYTES + frame_length;
+    }
+    return failed ? length : consumed;  // After a connection error the rest is never read.
+}
+
+void Http2Session::onFrame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                           std::string_view payload) {
+    // A header block must arrive in one piece: only its CONTINUATION frames may follow HEADERS.
+    if (continuation_id && (type != FRAME_CONTINUATION || stream_id != continuation_id)) {
+        connectionError(PROTOCOL_ERROR);
+        return;
+    }
+
+    switch (type) {
+        case FRAME_DATA:
+            onData(flags, stream_id, payload);
+            break;
+        case FRAME_HEADERS:
+            onHeaders(flags, stream_id, payload);
+            break;
+        case FRAME_PRIORITY:
+            // Priorities are advisory; pump() takes turns regardless.
+            if (stream_id == 0) connectionError(PROTOCOL_ERROR);
+            else if (payload.size() != 5) resetStream(stream_id, FRAME_SIZE_ERROR);
+            break;
+        case FRAME_RST_STREAM:
+            onRstStream(stream_id, payload);
+            break;
+        case FRAME_SETTINGS:
+            if (stream_id != 0) connectionError(PROTOCOL_ERROR);
+            else onSettings(flags, payload);
+            break;
+        case FRAME_PUSH_PROMISE:
+            connectionError(PROTOCOL_ERROR);    // Only servers push.
+            break;
+        case FRAME_PING:
+            if (stream_id != 0) connectionError(PROTOCOL_ERROR);
+            else if (payload.size() != 8) connectionError(FRAME_SIZE_ERROR);
+            else if (!(flags & FLAG_ACK)) writeFrame(FRAME_PING, FLAG_ACK, 0, payload);
+            break;
+        case FRAME_GOAWAY:
+            if (stream_id != 0) connectionError(PROTOCOL_ERROR);
+            else peer_going_away = true;
+            break;
+        case FRAME_WINDOW_UPDATE:
+            onWindowUpdate(stream_id, payload);
+            break;
+        case FRAME_CONTINUATION:
+            if (!continuation_id) {
+                connectionError(PROTOCOL_ERROR);
+                break;
+            }
+            header_block += payload;
+            if (header_block.size() > RequestParser::MAX_HEADER_BYTES) {
+                connectionError(ENHANCE_YOUR_CALM);
+                break;
+            }
+            if (flags & FLAG_END_HEADERS) {
+                uint32_t id = std::exchange(continuation_id, 0);
+                onHeaderBlock(id, continuation_end_stream);
+            }
+            break;
+        default:
+            break;  // Unknown frame types are ignored (RFC 9113 5.5).
+    }
+}
+
+void Http2Session::onData(uint8_t flags, uint32_t stream_id, std::string_view payload) {
+    if (stream_id == 0) {
+        connectionError(PROTOCOL_ERROR);
+        return;
+    }
+    // Padding counts against the windows too.
+    size_t frame_bytes = payload.size();
+    if (unacknowledged + frame_bytes > CONNECTION_WINDOW) {
+        connectionError(FLOW_CONTROL_ERROR);
+        return;
+    }
+    if (!unpad(flags, payload)) {
+        connectionError(PROTOCOL_ERROR);
+        return;
+    }
+
+    Http2Stream* stream = find(stream_id);
+    if (!stream) {
+        // DATA may still be in flight to a stream we finished or reset; an idle one is an error.
+        if (stream_id > last_stream_id) connectionError(PROTOCOL_ERROR);
+        else consumed(nullptr, frame_bytes);
+        return;
+    }
+    if (stream->remote_closed || static_cast<int64_t>(frame_bytes) > stream->receive_window) {
+        consumed(nullptr, frame_bytes);
+        resetStream(stream_id, stream->remote_closed ? STREAM_CLOSED : FLOW_CONTROL_ERROR);
+        erase(stream_id);
+        return;
+    }
+    stream->receive_window -= frame_bytes;
+
+    bool end_stream = flags & FLAG_END_STREAM;
+    if (stream->sink) {
+        stream->sink->write(payload);
+    } else if (!stream->responded) {
+        if (stream->request_body.size() + payload.size() > RequestParser::MAX_BUFFERED_BODY) {
+            reject(*stream, 413);
+        } else {
+            stream->request_body += payload;
+        }
+    }
+    // Once answered, the rest of the body is dropped.
+    consumed(end_stream ? nullptr : stream, frame_bytes);
+
+    if (end_stream) {
+        stream->remote_closed = true;
+        if (!stream->responded) dispatch(*stream);
+    }
+}
+
+void Http2Session::onHeaders(uint8_t flags, uint32_t stream_id, std::string_view payload) {
+    if (stream_id == 0 || !unpad(flags, payload)) {
+        connectionError(PROTOCOL_ERROR);
+        return;
+    }
+    if (flags & FLAG_PRIORITY) {
+        if (payload.size() < 5) {
+            connectionError(FRAME_SIZE_ERROR);
+            return;
+        }
+        payload.remove_prefix(5);
+    }
+    header_block.assign(payload);
+    if (!(flags & FLAG_END_HEADERS)) {
+        continuation_id = stream_id;
+        continuation_end_stream = flags & FLAG_END_STREAM;
+        return;
+    }
+    onHeaderBlock(stream_id, flags & FLAG_END_STREAM);
+}
+
+void Http2Session::onHeaderBlock(uint32_t stream_id, bool end_stream) {
+    if (Http2Stream* stream = find(stream_id)) {
+        // Trailers: decoded to keep the table in step, then dropped. They must end the stream.
+        std::string text;
+        std::vector<HpackField> fields;
+        if (decoder.decode(header_block, text, fields, RequestParser::MAX_HEADER_BYTES) ==
+            HpackDecoder::Result::Error) {
+            connectionError(COMPRESSION_ERROR);
+            return;
+        }
+        if (stream->remote_closed || !end_stream) {
+            resetStream(stream_id, stream->remote_closed ? STREAM_CLOSED : PROTOCOL_ERROR);
+            erase(stream_id);
+            return;
+        }
+        stream->remote_closed = true;
+        if (!stream->responded) dispatch(*stream);
+        return;
+    }
+
+    // Client streams are odd and opened in increasing order; lower ids are closed for good.
+    if (!(stream_id & 1) || stream_id <= last_stream_id) {
+        connectionError(stream_id & 1 ? STREAM_CLOSED : PROTOCOL_ERROR);
+        return;
+    }
+    auto fresh = std::make_unique<Http2Stream>(*this, stream_id, initial_send_window, STREAM_WINDOW);
+    Http2Stream& stream = *fresh;
+    HpackDecoder::Result result = decoder.decode(header_block, stream.text, stream.fields,
+                                                 RequestParser::MAX_HEADER_BYTES);
+    if (result == HpackDecoder::Result::Error) {
+        connectionError(COMPRESSION_ERROR);
+        return;
+    }
+    if (going_away) return;     // Opened after our GOAWAY: ignored, as that promised.
+    last_stream_id = stream_id;
+    if (streams.size() >= MAX_STREAMS) {
+        resetStream(stream_id, REFUSED_STREAM);
+        return;
+    }
+    stream.remote_closed = end_stream;
+    streams.push_back(std::move(fresh));
+
+    ++served;
+    if (handler.lastRequest(served)) shutdown();
+    int status = result == HpackDecoder::Result::TooLarge ? 431 : buildRequest(stream);
+    if (status) {
+        stream.access.begin({}, {});
+        reject(stream, status);
+        return;
+    }
+    stream.access.begin(stream.request.method, stream.request.path,
+                        stream.request.version);
+    if (end_stream) {
+        dispatch(stream);
+        return;
+    }
+
+    // The body is still to come: stream it if the route takes it piecewise.
+    std::optional<std::string_view> declared = stream.request.headers.get("content-length");
+    size_t length = 0;
+    if (declared) std::from_chars(declared->data(), declared->data() + declared->size(), length);
+    if (length > handler.maxBodyBytes()) {
+        reject(stream, 413);
+    } else if (!(stream.sink = handler.openBody(stream.request)) &&
+               length > RequestParser::MAX_BUFFERED_BODY) {
+        reject(stream, 413);
+    }
+}
+
+void Http2Session::onSettings(uint8_t flags, std::string_view payload) {
+    if (flags & FLAG_ACK) {
+        if (!payload.empty()) connectionError(FRAME_SIZE_ERROR);
+        return;
+    }
+    if (payload.size() % 6 != 0) {
+        connectionError(FRAME_SIZE_ERROR);
+        return;
+    }
+    if (applySettings(payload)) writeFrame(FRAME_SETTINGS, FLAG_ACK, 0, {});
+}
+
+bool Http2Session::applySettings(std::string_view payload) {
+    for (size_t i = 0; i + 6 <= payload.size(); i += 6) {
+        uint16_t id = static_cast<uint8_t>(payload[i]) << 8 | static_cast<uint8_t>(payload[i + 1]);
+        uint32_t value = read32(payload.data() + i + 2);
+        switch (id) {
+            case SETTINGS_ENABLE_PUSH:
+                if (value > 1) {
+                    connectionError(PROTOCOL_ERROR);
+                    return false;
+                }
+                break;
+            case SETTINGS_INITIAL_WINDOW_SIZE: {
+                if (value > MAX_WINDOW) {
+                    connectionError(FLOW_CONTROL_ERROR);
+                    return false;
+                }
+                // Applies to open streams too, and may leave them with a negative window.
+                int64_t delta = static_cast<int64_t>(value) - initial_send_window;
+                for (const std::unique_ptr<Http2Stream>& stream : streams) {
+                    stream->send_window += delta;
+                    if (stream->send_window > MAX_WINDOW) {
+                        connectionError(FLOW_CONTROL_ERROR);
+                        return false;
+                    }
+                }
+                initial_send_window = value;
+                break;
+            }
+            case SETTINGS_MAX_FRAME_SIZE:
+                if (value < 16384 || value > 16777215) {
+                    connectionError(PROTOCOL_ERROR);
+                    return false;
+                }
+                break;
+            default:
+                // The encoder never indexes, so any header table size suits it.
+                break;
+        }
+    }
+    return true;
+}
+
+void Http2Session::onWindowUpdate(uint32_t stream_id, std::string_view payload) {
+    if (payload.size() != 4) {
+        connectionError(FRAME_SIZE_ERROR);
+        return;
+    }
+    uint32_t increment = read32(payload.data()) & 0x7fffffff;
+    if (stream_id == 0) {
+        send_window += increment;
+        if (increment == 0) connectionError(PROTOCOL_ERROR);
+        else if (send_window > MAX_WINDOW) connectionError(FLOW_CONTROL_ERROR);
+        return;
+    }
+    Http2Stream* stream = find(stream_id);
+    if (!stream) {
+        if (stream_id > last_stream_id) connectionError(PROTOCOL_ERROR);
+        return;
+    }
+    stream->send_window += increment;
+    if (increment == 0 || stream->send_window > MAX_WINDOW) {
+        resetStream(stream_id, increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+        erase(stream_id);
+    }
+}
+
+void Http2Session::onRstStream(uint32_t stream_id, std::string_view payload) {
+    if (payload.size() != 4) {
+        connectionError(FRAME_SIZE_ERROR);
+        return;
+    }
+    if (stream_id == 0 || stream_id > last_stream_id) {
+        connectionError(PROTOCOL_ERROR);
+        return;
+    }
+    erase(stream_id);   // Drops its handler, too, if it is still running.
+}
+
+Http2Stream* Http2Session::find(uint32_t stream_id) const {
+    for (const std::unique_ptr<Http2Stream>& stream : streams) {
+        if (stream->id == stream_id) return stream.get();
+    }
+    return nullptr;
+}
+
+void Http2Session::erase(uint32_t stream_id) {
+    auto it = std::find_if(streams.begin(), streams.end(),
+                           [stream_id](const auto& stream) { return stream->id == stream_id; });
+    if (it != streams.end()) streams.erase(it);
+}
+
+int Http2Session::buildRequest(Http2Stream& stream) {
+    HttpRequest& request = stream.request;
+    std::string_view text = stream.text;
+    std::string_view authority;
+    bool regular = false;       // Pseudo-headers must all come first.
+    for (const HpackField& field : stream.fields) {
+        std::string_view name = field.nameIn(text);
+        std::string_view value = field.valueIn(text);
+        if (name.empty()) return 400;
+        if (name.front() == ':') {
+            if (regular) return 400;
+            if (name == ":method") request.method = value;
+            else if (name == ":path") request.path = value;
+            else if (name == ":authority") authority = value;
+            else if (name != ":scheme") return 400;
+            continue;
+        }
+        regular = true;
+        // Names must be lowercase, and connection-specific headers are malformed (RFC 9113 8.2).
+        if (std::any_of(name.begin(), name.end(), [](char c) { return c >= 'A' && c <= 'Z'; }) ||
+            connectionSpecific(name)) {
+            return 400;
+        }
+        if (!request.headers.add(name, value)) return 431;
+    }
+    if (request.method.empty() || request.path.empty()) return 400;
+    request.version = "HTTP/2";
+    // Handlers look for 'host', which :authority replaces.
+    if (!authority.empty() && !request.headers.get("host") && !request.headers.add("host", authority)) {
+        return 431;
+    }
+    return 0;
+}
+
+void Http2Session::dispatch(Http2Stream& stream) {
+    HttpResponse response(stream, async, &stream.arena);
+    response.logTo(&stream.access);
+    if (stream.sink) {
+        response.setRoute(stream.sink->route_id);
+        stream.sink->finish(response);
+        stream.sink.reset();
+        return;
+    }
+
+    stream.request.body = stream.request_body;
+    stream.handle_started = std::chrono::steady_clock::now();
+    {
+        Arena::Scope scope(stream.arena);
+        stream.task = handler.handle(stream.request, response);
+    }
+    if (stream.task) {
+        stream.task.onDone(task_done);  // reapTasks() records its time.
+    } else {
+        metrics.handle.record(std::chrono::steady_clock::now() - stream.handle_started);
+        stream.arena.reset();
+    }
+}
+
+void Http2Session::reject(Http2Stream& stream, int status) {
+    HttpResponse response(stream, async);
+    response.logTo(&stream.access);
+    response.sendStatus(status);
+    stream.sink.reset();
+    std::string().swap(stream.request_body);
+}
+
+void Http2Session::reapTasks() {
+    for (const std::unique_ptr<Http2Stream>& stream : streams) {
+        if (!stream->task || !stream->task.done()) continue;
+        metrics.handle.record(std::chrono::steady_clock::now() - stream->handle_started);
+        stream->task = {};
+        stream->arena.reset();
+    }
+}
+
+bool Http2Session::busy() const {
+    return std::any_of(streams.begin(), streams.end(),
+                       [](const auto& stream) { return stream->running(); });
+}
+
+void Http2Session::consumed(Http2Stream* stream, size_t bytes) {
+    unacknowledged += bytes;
+    if (unacknowledged >= CONNECTION_WINDOW / 2) {
+        writeWindowUpdate(0, unacknowledged);
+        unacknowledged = 0;
+    }
+    if (!stream) return;
+    stream->unacknowledged += bytes;
+    if (stream->unacknowledged >= STREAM_WINDOW / 2) {
+        writeWindowUpdate(stream->id, stream->unacknowledged);
+        stream->receive_window += stream->unacknowledged;
+        stream->unacknowledged = 0;
+    }
+}
+
+bool Http2Session::pump() {
+    bool produced = false;
+    bool progress = true;
+    // One frame per stream per round, starting one stream further on each call.
+    while (progress && out.bufferedBytes() < PUMP_BUDGET && send_window > 0) {
+        progress = false;
+        size_t count = streams.size();
+        for (size_t i = 0; i < count && out.bufferedBytes() < PUMP_BUDGET; ++i) {
+            if (pumpStream(*streams[(next_pump + i) % count])) progress = produced = true;
+        }
+        next_pump = count ? (next_pump + 1) % count : 0;
+    }
+    // Bodies that end with a zero-length DATA frame need no window.
+    for (const std::unique_ptr<Http2Stream>& stream : streams) {
+        if (send_window <= 0 && stream->responded && !stream->local_closed && stream->body.empty()) {
+            produced = pumpStream(*stream) || produced;
+        }
+    }
+
+    // Streams whose response is complete are done with; a client still sending a body it
+    // no longer needs to is told to stop.
+    for (size_t i = 0; i < streams.size();) {
+        Http2Stream& stream = *streams[i];
+        if (!stream.local_closed || stream.task) {
+            ++i;
+            continue;
+        }
+        if (!stream.remote_closed) resetStream(stream.id, NO_ERROR);
+        streams.erase(streams.begin() + i);
+    }
+    return produced;
+}
+
+bool Http2Session::pumpStream(Http2Stream& stream) {
+    if (!stream.responded || stream.local_closed) return false;
+    int64_t window = std::min(send_window, stream.send_window);
+    size_t room = window > 0 ? std::min<size_t>(window, MAX_FRAME_BYTES) : 0;
+
+    char* frame = out.prepareHead(FRAME_HEADER_BYTES + room);
+    size_t taken = 0;
+    OutputQueue::FlushResult result = stream.body.take(frame + FRAME_HEADER_BYTES, room, taken);
+    if (result == OutputQueue::FlushResult::Error) {
+        // The body cannot be completed (say, the file shrank); the client must not take what
+        // it got for all of it.
+        resetStream(stream.id, INTERNAL_ERROR);
+        stream.local_closed = stream.remote_closed = true;
+        return true;
+    }
+    bool done = result == OutputQueue::FlushResult::Done;
+    if (taken == 0 && !done) return false;  // Out of window, or waiting for a file read.
+
+    putFrameHeader(frame, taken, FRAME_DATA, done ? FLAG_END_STREAM : 0, stream.id);
+    out.commitHead(FRAME_HEADER_BYTES + taken);
+    send_window -= taken;
+    stream.send_window -= taken;
+    stream.local_closed = done;
+    return true;
+}
+
+void Http2Session::shutdown() {
+    if (!going_away) goAway(NO_ERROR);
+}
+
+void Http2Session::writeFrame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                              std::string_view payload) {
+    char* frame = out.prepareHead(FRAME_HEADER_BYTES + payload.size());
+    putFrameHeader(frame, payload.size(), type, flags, stream_id);
+    if (!payload.empty()) std::memcpy(frame + FRAME_HEADER_BYTES, payload.data(), payload.size());
+    out.commitHead(FRAME_HEADER_BYTES + payload.size());
+}
+
+void Http2Session::writeHeaders(uint32_t stream_id, std::string_view block, bool end_stream) {
+    // Blocks larger than a frame continue in CONTINUATION frames, back to back.
+    uint8_t type = FRAME_HEADERS;
+    uint8_t flags = end_stream ? FLAG_END_STREAM : 0;
+    do {
+        std::string_view piece = block.substr(0, MAX_FRAME_BYTES);
+        block.remove_prefix(piece.size());
+        writeFrame(type, flags | (block.empty() ? FLAG_END_HEADERS : 0), stream_id, piece);
+        type = FRAME_CONTINUATION;
+        flags = 0;
+    } while (!block.empty());
+}
+
+void Http2Session::writeWindowUpdate(uint32_t stream_id, uint32_t increment) {
+    char payload[4];
+    put32(payload, increment);
+    writeFrame(FRAME_WINDOW_UPDATE, 0, stream_id, std::string_view(payload, 4));
+}
+
+void Http2Session::resetStream(uint32_t stream_id, uint32_t error) {
+    char payload[4];
+    put32(payload, error);
+    writeFrame(FRAME_RST_STREAM, 0, stream_id, std::string_view(payload, 4));
+}
+
+void Http2Session::goAway(uint32_t error) {
+    char payload[8];
+    put32(put32(payload, last_stream_id), error);
+    writeFrame(FRAME_GOAWAY, 0, 0, std::string_view(payload, 8));
+    going_away = true;
+}
+
+void Http2Session::connectionError(uint32_t error) {
+    goAway(error);
+    failed = true;
+}
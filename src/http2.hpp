@@ -0,0 +1,244 @@
+#pragma once
+
+#include "access-log.hpp"
+#include "arena.hpp"
+#include "hpack.hpp"
+#include "http-server.hpp"
+#include "output-queue.hpp"
+#include "task.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Http2Session;
+
+
+/**
+ * @class Http2Stream
+ * @brief One request and its response on an HTTP/2 connection.
+ *
+ * The request is decoded into the stream's own storage, so it stays valid for as long as the
+ * stream lives, and the handler answers through an HttpResponse bound to the stream (see
+ * HttpResponse's Http2Stream constructor): the head goes out as a HEADERS frame at once, the
+ * body is queued in 'body' and cut into DATA frames by Http2Session::pump() as the flow-control
+ * windows allow.
+ */
+class Http2Stream {
+public:
+    OutputQueue body;       // The response body, written by HttpResponse; never flushed to a socket.
+
+    Http2Stream(Http2Session& session, uint32_t id, int64_t send_window, int64_t receive_window);
+    Http2Stream(const Http2Stream&) = delete;
+    Http2Stream& operator=(const Http2Stream&) = delete;
+
+    /**
+     * @brief Sends the response head as a HEADERS frame.
+     *
+     * The arguments are those of a response head in HTTP/1.1 terms (see HttpResponse); header
+     * names are lowercased and connection-specific headers dropped on the way. A zero
+     * content_length ends the stream with the head. Only the first call has an effect.
+     * @param header_lines Complete, CRLF-terminated "Name: value" lines.
+     */
+    void respond(int status, std::string_view content_type, std::optional<size_t> content_length,
+                 std::string_view header_lines);
+
+private:
+    friend class Http2Session;
+
+    Http2Session& session;
+    uint32_t id;
+    int64_t send_window;        // Bytes of DATA the peer will take on this stream.
+    int64_t receive_window;     // Bytes of DATA the peer may still send on it.
+    size_t unacknowledged = 0;  // Received bytes not yet returned with a WINDOW_UPDATE.
+    bool remote_closed = false; // The request is complete (END_STREAM received).
+    bool responded = false;     // The head was sent.
+    bool local_closed = false;  // END_STREAM was sent: the response is complete.
+
+    std::string text;           // Decoded header names and values; 'request' points into it.
+    std::vector<HpackField> fields;
+    std::string request_body;   // A body buffered for handle().
+    HttpRequest request;
+    std::unique_ptr<BodySink> sink;     // Where a streamed body goes instead.
+
+    AccessEntry access;
+    std::chrono::steady_clock::time_point handle_started;
+    Arena arena;                // The handler's scratch memory; outlives 'task'.
+    Task<void> task;            // A handler suspended mid-request.
+
+    bool running() const { return task && !task.done(); }
+};
+
+
+/**
+ * @class Http2Session
+ * @brief The HTTP/2 (RFC 9113) side of one cleartext connection, for either connection loop.
+ *
+ * The connection's owner feeds received bytes to receive(), which decodes frames, answers
+ * control frames and dispatches each request to RequestHandler as soon as it is complete, so a
+ * client can have many requests in flight at once and a slow one holds up no other. Output goes
+ * to the connection's OutputQueue, which the owner flushes as usual, calling pump() first to
+ * move more response bodies into DATA frames.
+ *
+ * Response bodies are copied once, into the frames; file bodies are read into them with
+ * pread() or, on event loops, arrive through FileReader as on HTTP/1.1. pump() keeps at most
+ * PUMP_BUDGET bytes queued on the connection and takes turns between streams, so one large
+ * download does not starve the others. Received DATA is handed to the route at once, so the
+ * receive windows are returned to the client as they are used.
+ *
+ * Coroutine handlers suspend per stream; 'task_done' is called when one finishes, and the
+ * owner must then call reapTasks() (not from inside the callback).
+ */
+class Http2Session {
+public:
+    // The client connection preface (RFC 9113 3.4).
+    static constexpr std::string_view PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+    // What an HTTP/1.1 request with 'Upgrade: h2c' is answered with before upgrade().
+    static constexpr std::string_view SWITCHING_PROTOCOLS =
+        "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+
+    // Response bytes pump() keeps queued on the connection before waiting for it to drain.
+    static constexpr size_t PUMP_BUDGET = 64 * 1024;
+
+    /**
+     * @param out The connection's output queue.
+     * @param async How file bodies are read without blocking, or null on blocking threads.
+     * @param access Access log and client address every stream's entry starts from.
+     */
+    Http2Session(const RequestHandler& handler, OutputQueue& out, const AsyncContext* async,
+                 std::function<void()> task_done, const AccessEntry& access);
+    ~Http2Session();
+    Http2Session(const Http2Session&) = delete;
+    Http2Session& operator=(const Http2Session&) = delete;
+
+    /**
+     * @brief Whether a connection's first bytes are the HTTP/2 preface rather than a request.
+     *
+     * Decided by the first four bytes; fewer than that are never taken for the preface.
+     */
+    static bool startsWithPreface(const char* data, size_t length);
+
+    /**
+     * @brief Whether an HTTP/1.1 request asks to switch to h2c with 'Upgrade: h2c'.
+     *
+     * Only requests without a body are upgraded; others are served over HTTP/1.1.
+     */
+    static bool wantsUpgrade(const HttpRequest& request);
+
+    /**
+     * @brief Takes over an upgraded connection, answering 'request' on stream 1.
+     *
+     * The caller has sent the 101 response; the client's preface is still to come.
+     */
+    void upgrade(const HttpRequest& request);
+
+    /**
+     * @brief Processes every complete frame in data.
+     * @return Bytes consumed; the rest is an incomplete frame to pass again with more.
+     */
+    size_t receive(const char* data, size_t length);
+
+    /**
+     * @brief Queues DATA frames of pending response bodies, within the budget and windows.
+     * @return Whether anything was queued; if so, flush and call again once the queue drains.
+     */
+    bool pump();
+
+    /**
+     * @brief Drops the Tasks of finished coroutine handlers; see 'task_done'.
+     */
+    void reapTasks();
+
+    /**
+     * @brief Sends GOAWAY: streams already open are finished, new ones refused.
+     */
+    void shutdown();
+
+    /**
+     * @brief Whether a handler is still running (the server, not the client, is the holdup).
+     */
+    bool busy() const;
+
+    /**
+     * @brief Whether any stream is open, i.e. the client owes a request or its body.
+     */
+    bool hasStreams() const { return !streams.empty(); }
+
+    /**
+     * @brief Whether the connection should close once its output is flushed.
+     */
+    bool finished() const { return failed || ((going_away || peer_going_away) && streams.empty()); }
+
+private:
+    friend class Http2Stream;
+
+    const RequestHandler& handler;
+    OutputQueue& out;
+    const AsyncContext* async;
+    std::function<void()> task_done;
+    AccessEntry access;             // Copied into every stream.
+    WorkerMetrics& metrics;
+
+    HpackDecoder decoder;
+    std::vector<std::unique_ptr<Http2Stream>> streams;  // Open streams, oldest first.
+    size_t next_pump = 0;           // Stream pump() starts with, for turn-taking.
+    uint32_t last_stream_id = 0;    // Highest stream the client opened.
+    uint32_t continuation_id = 0;   // Stream whose header block is incomplete, or 0.
+    bool continuation_end_stream = false;   // Whether that HEADERS frame ended the stream.
+    std::string header_block;       // The header block being reassembled.
+    std::string encoded;            // Reused buffer for response header blocks.
+    unsigned served = 0;            // Requests taken, for the per-connection limit.
+
+    bool preface_received = false;
+    bool going_away = false;        // We sent GOAWAY.
+    bool peer_going_away = false;   // The client sent GOAWAY.
+    bool failed = false;            // A connection error was answered with GOAWAY.
+
+    // The client's settings that apply to what we send.
+    int64_t initial_send_window = 65535;
+    int64_t send_window = 65535;    // Connection-level DATA the client will take.
+    size_t unacknowledged = 0;      // Connection-level bytes received and not yet returned.
+
+    void onFrame(uint8_t type, uint8_t flags, uint32_t stream_id, std::string_view payload);
+    void onData(uint8_t flags, uint32_t stream_id, std::string_view payload);
+    void onHeaders(uint8_t flags, uint32_t stream_id, std::string_view payload);
+    void onHeaderBlock(uint32_t stream_id, bool end_stream);
+    void onSettings(uint8_t flags, std::string_view payload);
+    void onWindowUpdate(uint32_t stream_id, std::string_view payload);
+    void onRstStream(uint32_t stream_id, std::string_view payload);
+
+    // Applies SETTINGS parameters; false after a connection error.
+    bool applySettings(std::string_view payload);
+
+    Http2Stream* find(uint32_t stream_id) const;
+    void erase(uint32_t stream_id);
+
+    // Turns the decoded fields into the stream's HttpRequest; 0 if it is well-formed, else
+    // the status to refuse it with.
+    int buildRequest(Http2Stream& stream);
+
+    // Hands a stream's complete request to the handler.
+    void dispatch(Http2Stream& stream);
+
+    // Answers a request without running its route, e.g. with 413; the rest of its body is refused.
+    void reject(Http2Stream& stream, int status);
+
+    // Counts received DATA and returns window to the client once half of it is used.
+    void consumed(Http2Stream* stream, size_t bytes);
+
+    void writeFrame(uint8_t type, uint8_t flags, uint32_t stream_id, std::string_view payload);
+    void writeHeaders(uint32_t stream_id, std::string_view block, bool end_stream);
+    void writeWindowUpdate(uint32_t stream_id, uint32_t increment);
+    void resetStream(uint32_t stream_id, uint32_t error);
+    void connectionError(uint32_t error);
+    void goAway(uint32_t error);
+
+    // Moves up to one frame of the stream's body into DATA; false if it has nothing to send now.
+    bool pumpStream(Http2Stream& stream);
+};
@@ -0,0 +1,262 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <iterator>
+#include <mutex>
+
+
+namespace {
+
+// Every thread's block, in registration order. Only registration and scrapes take the lock.
+// Like the blocks, which outlive their threads, it is never freed, so it keeps them reachable
+// while the process exits.
+std::mutex registry_mutex;
+std::vector<WorkerMetrics*>& registry = *new std::vector<WorkerMetrics*>;
+
+// Exported histogram buckets: every power of two from about 1 us to about 69 s. They fall on
+// bucket boundaries, so the cumulative counts are exact.
+constexpr int FIRST_EXPORTED_EXPONENT = 10;
+constexpr int LAST_EXPORTED_EXPONENT = 36;
+
+constexpr double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+void appendNumber(std::string& out, uint64_t value) {
+    char digits[20];
+    out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+void appendNumber(std::string& out, double value) {
+    char digits[32];
+    out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+void appendFamily(std::string& out, std::string_view name, std::string_view type,
+                  std::string_view help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+template <typename Field>
+uint64_t total(const std::vector<WorkerMetrics*>& workers, Field field) {
+    uint64_t sum = 0;
+    for (const WorkerMetrics* worker : workers) sum += field(*worker).get();
+    return sum;
+}
+
+void appendSample(std::string& out, std::string_view name, uint64_t value) {
+    out += name;
+    out += ' ';
+    appendNumber(out, value);
+    out += '\n';
+}
+
+struct MergedHistogram {
+    std::array<uint64_t, LatencyHistogram::BUCKETS> buckets{};
+    uint64_t count = 0;
+    uint64_t sum_ns = 0;
+};
+
+MergedHistogram merge(const std::vector<WorkerMetrics*>& workers,
+                      const LatencyHistogram WorkerMetrics::*member) {
+    MergedHistogram merged;
+    for (const WorkerMetrics* worker : workers) {
+        const LatencyHistogram& histogram = worker->*member;
+        for (size_t i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+            uint64_t n = histogram.buckets[i].get();
+            merged.buckets[i] += n;
+            merged.count += n;
+        }
+        merged.sum_ns += histogram.sum_ns.get();
+    }
+    return merged;
+}
+
+// The middle of the bucket holding the q-th quantile, in seconds.
+double quantile(const MergedHistogram& merged, double q) {
+    if (merged.count == 0) return 0;
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * merged.count + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+        seen += merged.buckets[i];
+        if (seen >= rank) {
+            uint64_t low = LatencyHistogram::lowerBound(i);
+            uint64_t high = LatencyHistogram::lowerBound(i + 1);
+            return (low + (high - low) / 2.0) / 1e9;
+        }
+    }
+    return LatencyHistogram::lowerBound(LatencyHistogram::BUCKETS) / 1e9;
+}
+
+}
+
+
+void LatencyHistogram::record(std::chrono::nanoseconds elapsed) {
+    uint64_t ns = elapsed.count() > 0 ? elapsed.count() : 0;
+    buckets[bucketOf(ns)].add();
+    sum_ns.add(ns);
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t ns) {
+    if (ns < SUB_BUCKETS) return ns;
+    int exponent = std::bit_width(ns) - 1;
+    if (exponent >= MAX_EXPONENT) return BUCKETS - 1;
+    return (exponent - SUB_BITS + 1) * SUB_BUCKETS + ((ns >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+uint64_t LatencyHistogram::lowerBound(size_t index) {
+    if (index < SUB_BUCKETS) return index;
+    int exponent = index / SUB_BUCKETS + SUB_BITS - 1;
+    return (SUB_BUCKETS + index % SUB_BUCKETS) << (exponent - SUB_BITS);
+}
+
+
+WorkerMetrics& localMetrics() {
+    thread_local WorkerMetrics* mine = [] {
+        auto* metrics = new WorkerMetrics;
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(metrics);
+        return metrics;
+    }();
+    return *mine;
+}
+
+std::string renderMetrics(const std::vector<RouteLabel>& routes) {
+    std::vector<WorkerMetrics*> workers;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        workers = registry;
+    }
+
+    std::string out;
+    appendFamily(out, "http_responses_total", "counter", "Responses sent, by route and status.");
+    for (size_t route = 0; route < WorkerMetrics::ROUTE_SLOTS; ++route) {
+        bool labelled = route < routes.size() && route != WorkerMetrics::NO_ROUTE;
+        for (size_t status = 0; status < STATUS_COUNT; ++status) {
+            uint64_t count = total(workers, [&](const WorkerMetrics& m) -> const Counter& {
+                return m.responses[route][status];
+            });
+            if (count == 0) continue;
+            out += "http_responses_total{method=\"";
+            out += labelled ? routes[route].method : "";
+            out += "\",route=\"";
+            out += labelled ? std::string_view(routes[route].path) : "";
+            out += "\",status=\"";
+            appendNumber(out, static_cast<uint64_t>(STATUS_TABLE[status].code));
+            out += "\"} ";
+            appendNumber(out, count);
+            out += '\n';
+        }
+    }
+
+    appendFamily(out, "http_received_bytes_total", "counter", "Request bytes received.");
+    appendSample(out, "http_received_bytes_total",
+                 total(workers, [](const WorkerMetrics& m) -> const Counter& { return m.bytes_in; }));
+    appendFamily(out, "http_sent_bytes_total", "counter", "Response bytes sent.");
+    appendSample(out, "http_sent_bytes_total",
+                 total(workers, [](const WorkerMetrics& m) -> const Counter& { return m.bytes_out; }));
+
+    uint64_t opened = total(workers, [](const WorkerMetrics& m) -> const Counter& {
+        return m.connections_opened;
+    });
+    uint64_t closed = total(workers, [](const WorkerMetrics& m) -> const Counter& {
+        return m.connections_closed;
+    });
+    appendFamily(out, "http_connections_total", "counter", "Connections accepted.");
+    appendSample(out, "http_connections_total", opened);
+    appendFamily(out, "http_connections_active", "gauge", "Connections currently open.");
+    // Opened and closed are read at slightly different moments; never report a negative.
+    appendSample(out, "http_connections_active", opened > closed ? opened - closed : 0);
+
+    appendFamily(out, "http_connections_rejected_total", "counter",
+                 "Connections refused with a 503 for exceeding the per-client rate limit.");
+    appendSample(out, "http_connections_rejected_total",
+                 total(workers, [](const WorkerMetrics& m) -> const Counter& {
+                     return m.connections_rejected;
+                 }));
+    appendFamily(out, "http_accept_pauses_total", "counter",
+                 "Times accepting paused because the connection limit was reached.");
+    appendSample(out, "http_accept_pauses_total",
+                 total(workers, [](const WorkerMetrics& m) -> const Counter& {
+                     return m.accept_pauses;
+                 }));
+
+    appendFamily(out, "http_parse_errors_total", "counter", "Malformed requests.");
+    appendSample(out, "http_parse_errors_total",
+                 total(workers, [](const WorkerMetrics& m) -> const Counter& { return m.parse_errors; }));
+    appendFamily(out, "http_access_log_dropped_total", "counter",
+                 "Access log records dropped because the writer fell behind.");
+    appendSample(out, "http_access_log_dropped_total",
+                 total(workers, [](const WorkerMetrics& m) -> const Counter& {
+                     return m.access_log_dropped;
+                 }));
+
+    struct Phase {
+        std::string_view name;
+        const LatencyHistogram WorkerMetrics::*member;
+    };
+    const Phase phases[] = {
+        {"parse", &WorkerMetrics::parse},
+        {"handle", &WorkerMetrics::handle},
+        {"write", &WorkerMetrics::write},
+    };
+    MergedHistogram merged[std::size(phases)];
+    for (size_t i = 0; i < std::size(phases); ++i) merged[i] = merge(workers, phases[i].member);
+
+    appendFamily(out, "http_phase_duration_seconds", "histogram",
+                 "Time spent parsing requests, running handlers and writing responses.");
+    for (size_t i = 0; i < std::size(phases); ++i) {
+        std::string labels = "{phase=\"" + std::string(phases[i].name) + "\"";
+        uint64_t cumulative = 0;
+        size_t bucket = 0;
+        for (int exponent = FIRST_EXPORTED_EXPONENT; exponent <= LAST_EXPORTED_EXPONENT; ++exponent) {
+            size_t end = LatencyHistogram::bucketOf(uint64_t(1) << exponent);
+            for (; bucket < end; ++bucket) cumulative += merged[i].buckets[bucket];
+            out += "http_phase_duration_seconds_bucket";
+            out += labels;
+            out += ",le=\"";
+            appendNumber(out, static_cast<double>(uint64_t(1) << exponent) / 1e9);
+            out += "\"} ";
+            appendNumber(out, cumulative);
+            out += '\n';
+        }
+        out += "http_phase_duration_seconds_bucket";
+        out += labels;
+        out += ",le=\"+Inf\"} ";
+        appendNumber(out, merged[i].count);
+        out += '\n';
+        out += "http_phase_duration_seconds_sum";
+        out += labels;
+        out += "} ";
+        appendNumber(out, merged[i].sum_ns / 1e9);
+        out += '\n';
+        out += "http_phase_duration_seconds_count";
+        out += labels;
+        out += "} ";
+        appendNumber(out, merged[i].count);
+        out += '\n';
+    }
+
+    appendFamily(out, "http_phase_duration_quantile_seconds", "gauge",
+                 "Quantiles of http_phase_duration_seconds at full histogram resolution.");
+    for (size_t i = 0; i < std::size(phases); ++i) {
+        for (double q : QUANTILES) {
+            out += "http_phase_duration_quantile_seconds{phase=\"";
+            out += phases[i].name;
+            out += "\",quantile=\"";
+            appendNumber(out, q);
+            out += "\"} ";
+            appendNumber(out, quantile(merged[i], q));
+            out += '\n';
+        }
+    }
+    return out;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "static-responses.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+/**
+ * @class Counter
+ * @brief A monotonically increasing count with a single writer.
+ *
+ * Only the owning thread adds to it, so an add is a relaxed load and store: no locked
+ * instruction, and no cache line shared with other writers. Any thread may read it.
+ */
+class Counter {
+public:
+    void add(uint64_t n = 1) { value.store(value.load(std::memory_order_relaxed) + n,
+                                           std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value{0};
+};
+
+
+/**
+ * @class LatencyHistogram
+ * @brief Log-linear (HDR-style) histogram of durations in nanoseconds, with a single writer.
+ *
+ * Every power of two is split into SUB_BUCKETS equal buckets, so a recorded value is known to
+ * within 25% from 1 ns to about 18 minutes at a fixed 1.2 KB. Longer values land in the last
+ * bucket. Histograms recorded by different threads are merged by adding their buckets.
+ */
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BITS = 2;
+    static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr int MAX_EXPONENT = 40;     // 2^40 ns is about 18 minutes.
+    static constexpr size_t BUCKETS = (MAX_EXPONENT - SUB_BITS + 1) * SUB_BUCKETS;
+
+    void record(std::chrono::nanoseconds elapsed);
+
+    // Bucket that holds ns.
+    static size_t bucketOf(uint64_t ns);
+
+    // Smallest value of bucket index; lowerBound(index + 1) is one past its largest.
+    static uint64_t lowerBound(size_t index);
+
+    std::array<Counter, BUCKETS> buckets;
+    Counter sum_ns;
+};
+
+
+/**
+ * @struct WorkerMetrics
+ * @brief Everything one thread counts. Each thread that serves connections owns one.
+ *
+ * Blocks are registered once per thread and never freed, so a scrape can read every one
+ * without coordinating with the threads writing them.
+ */
+struct alignas(64) WorkerMetrics {
+    // Routes get consecutive ids from the Router; the last slot counts unrouted responses.
+    static constexpr size_t ROUTE_SLOTS = 16;
+    static constexpr size_t NO_ROUTE = ROUTE_SLOTS - 1;
+
+    std::array<std::array<Counter, STATUS_COUNT>, ROUTE_SLOTS> responses;  // By route, status.
+    Counter bytes_in;               // Request bytes received.
+    Counter bytes_out;              // Response bytes sent.
+    Counter connections_opened;
+    Counter connections_closed;
+    Counter connections_rejected;   // Turned away over the per-client rate limit.
+    Counter accept_pauses;          // Times accepting stopped at the connection limit.
+    Counter parse_errors;           // Malformed requests.
+    Counter access_log_dropped;     // Access log records lost to a full ring.
+    LatencyHistogram parse;         // Each parse() call that finishes a head or a request.
+    LatencyHistogram handle;        // Running a request's handler until it has responded.
+    LatencyHistogram write;         // Each flush of queued output to the socket.
+
+    void response(size_t route, int status) {
+        responses[route < ROUTE_SLOTS ? route : NO_ROUTE][statusIndex(status)].add();
+    }
+};
+
+/**
+ * @brief The calling thread's metrics, registered on first use.
+ */
+WorkerMetrics& localMetrics();
+
+
+/**
+ * @struct RouteLabel
+ * @brief How a route is named in exported metrics.
+ */
+struct RouteLabel {
+    std::string_view method;
+    std::string path;
+};
+
+/**
+ * @brief Sums every thread's metrics into Prometheus text exposition format.
+ * @param routes Indexed by route id; ids without a label are exported as unrouted.
+ */
+std::string renderMetrics(const std::vector<RouteLabel>& routes);
@@ -0,0 +1,343 @@
+#include "output-queue.hpp"
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Largest chunk handed to a single sendfile() call; the kernel caps it near 2 GB anyway.
+constexpr size_t MAX_SENDFILE_CHUNK = 1 << 30;
+
+// Memory segments gathered into one sendmsg() call.
+constexpr size_t MAX_IOVECS = 64;
+
+// First allocation of the header arena; enough for a couple of typical response heads.
+constexpr size_t INITIAL_ARENA_BYTES = 256;
+
+// Segment-list capacity kept across flushes (a head, a body and a spare).
+constexpr size_t RETAINED_SEGMENTS = 4;
+
+
+OutputQueue::~OutputQueue() {
+    clear();
+}
+
+char* OutputQueue::prepareHead(size_t max_length) {
+    if (arena_capacity - arena_used < max_length) {
+        size_t new_capacity = arena_capacity ? arena_capacity : INITIAL_ARENA_BYTES;
+        while (new_capacity - arena_used < max_length) new_capacity *= 2;
+
+        std::unique_ptr<char[]> grown(new char[new_capacity]);
+        if (arena_used) std::memcpy(grown.get(), arena.get(), arena_used);
+        arena = std::move(grown);
+        arena_capacity = new_capacity;
+    }
+    return arena.get() + arena_used;
+}
+
+void OutputQueue::commitHead(size_t length) {
+    if (length == 0) return;
+    Segment seg;
+    seg.kind = Kind::Head;
+    seg.offset = arena_used;
+    seg.length = length;
+    arena_used += length;
+    buffered += length;
+    segments.push_back(std::move(seg));
+}
+
+void OutputQueue::append(std::string data) {
+    if (data.empty()) return;
+    Segment seg;
+    seg.kind = Kind::Owned;
+    seg.length = data.size();
+    seg.owned = std::move(data);
+    buffered += seg.length;
+    segments.push_back(std::move(seg));
+}
+
+void OutputQueue::appendBorrowed(std::string_view data) {
+    if (data.empty()) return;
+    Segment seg;
+    seg.kind = Kind::Borrowed;
+    seg.data = data.data();
+    seg.length = data.size();
+    buffered += seg.length;
+    ++borrowed;
+    segments.push_back(std::move(seg));
+}
+
+void OutputQueue::appendStatic(std::string_view data) {
+    if (data.empty()) return;
+    Segment seg;
+    seg.kind = Kind::Static;
+    seg.data = data.data();
+    seg.length = data.size();
+    buffered += seg.length;
+    segments.push_back(std::move(seg));
+}
+
+void OutputQueue::appendShared(std::shared_ptr<const void> owner, std::string_view data) {
+    if (data.empty()) return;
+    Segment seg;
+    seg.kind = Kind::Shared;
+    seg.data = data.data();
+    seg.length = data.size();
+    seg.keeper = std::move(owner);
+    buffered += seg.length;
+    segments.push_back(std::move(seg));
+}
+
+void OutputQueue::appendFile(int file_fd, off_t offset, size_t length) {
+    if (length == 0) {
+        close(file_fd);
+        return;
+    }
+    Segment seg;
+    seg.kind = Kind::File;
+    seg.file_fd = file_fd;
+    seg.file_offset = offset;
+    seg.file_remaining = length;
+    segments.push_back(std::move(seg));
+}
+
+void OutputQueue::appendStream(std::unique_ptr<StreamSource> source) {
+    Segment seg;
+    seg.kind = Kind::Stream;
+    seg.source = std::move(source);
+    segments.push_back(std::move(seg));
+}
+
+void OutputQueue::retainBorrowed() {
+    if (borrowed == 0) return;
+    for (size_t i = head; i < segments.size(); ++i) {
+        Segment& seg = segments[i];
+        if (seg.kind != Kind::Borrowed) continue;
+        // Keep only what is still unsent; the sent prefix is never looked at again.
+        seg.owned.assign(seg.data + seg.sent, seg.length - seg.sent);
+        seg.length -= seg.sent;
+        seg.sent = 0;
+        seg.data = nullptr;
+        seg.kind = Kind::Owned;
+    }
+    borrowed = 0;
+}
+
+const char* OutputQueue::bytesOf(const Segment& seg) const {
+    switch (seg.kind) {
+        case Kind::Static:   return seg.data;
+        case Kind::Shared:   return seg.data;
+        case Kind::Head:     return arena.get() + seg.offset;
+        case Kind::Owned:    return seg.owned.data();
+        case Kind::Borrowed: return seg.data;
+        case Kind::File:     break;
+        case Kind::Stream:   break;
+    }
+    return nullptr;
+}
+
+OutputQueue::FlushResult OutputQueue::flush(int socket_fd) {
+    // An empty queue is flushed after every request; only time flushes that write something.
+    if (empty()) return flushSegments(socket_fd);
+    auto started = std::chrono::steady_clock::now();
+    FlushResult result = flushSegments(socket_fd);
+    localMetrics().write.record(std::chrono::steady_clock::now() - started);
+    return result;
+}
+
+OutputQueue::FlushResult OutputQueue::flushSegments(int socket_fd) {
+    while (head < segments.size()) {
+        Segment& seg = segments[head];
+
+        if (seg.kind == Kind::File) {
+            while (seg.file_remaining > 0) {
+                // sendfile() advances file_offset itself.
+                ssize_t n = sendfile(socket_fd, seg.file_fd, &seg.file_offset,
+                                     std::min(seg.file_remaining, MAX_SENDFILE_CHUNK));
+                if (n > 0) {
+                    seg.file_remaining -= n;
+                    localMetrics().bytes_out.add(n);
+                    continue;
+                }
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return FlushResult::WouldBlock;
+                // n == 0 means the file shrank under us; the promised Content-Length can't be met.
+                return FlushResult::Error;
+            }
+            close(seg.file_fd);
+            seg.file_fd = -1;
+            ++head;
+        } else if (seg.kind == Kind::Stream) {
+            FlushResult result = flushStream(socket_fd, seg);
+            if (result != FlushResult::Done) return result;
+            ++head;
+        } else if (!flushBytes(socket_fd)) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? FlushResult::WouldBlock : FlushResult::Error;
+        }
+    }
+
+    drained();
+    return FlushResult::Done;
+}
+
+void OutputQueue::drained() {
+    // Rewind the arena for the next batch of responses. A small segment list is kept so a
+    // keep-alive client's next response does not allocate; a large one is freed.
+    if (segments.capacity() > RETAINED_SEGMENTS) {
+        std::vector<Segment>().swap(segments);
+    } else {
+        segments.clear();
+    }
+    head = 0;
+    arena_used = 0;
+}
+
+// Writes the run of memory segments at the head of the queue with a single sendmsg(), so a
+// response's headers and body, and every response queued by a batch of pipelined requests,
+// leave in one system call. Returns false (with errno set) when the socket would block or failed.
+bool OutputQueue::flushBytes(int socket_fd) {
+    while (head < segments.size() && isMemory(segments[head].kind)) {
+        iovec iov[MAX_IOVECS];
+        size_t count = 0;
+        for (size_t i = head; i < segments.size() && count < MAX_IOVECS; ++i) {
+            const Segment& seg = segments[i];
+            if (!isMemory(seg.kind)) break;
+            iov[count].iov_base = const_cast<char*>(bytesOf(seg)) + seg.sent;
+            iov[count].iov_len = seg.length - seg.sent;
+            ++count;
+        }
+
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        // MSG_NOSIGNAL: a client that hung up must not kill the process with SIGPIPE.
+        // MSG_MORE: more output follows (e.g. headers before a sendfile() body), so let the
+        // kernel coalesce them into full segments instead of pushing a tiny one.
+        int flags = MSG_NOSIGNAL | (head + count < segments.size() ? MSG_MORE : 0);
+        ssize_t n = sendmsg(socket_fd, &msg, flags);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        // A short write can end anywhere, including in the middle of a segment.
+        size_t written = n;
+        buffered -= written;
+        localMetrics().bytes_out.add(written);
+        while (written > 0) {
+            Segment& seg = segments[head];
+            size_t left = seg.length - seg.sent;
+            if (written < left) {
+                seg.sent += written;
+                break;
+            }
+            written -= left;
+            seg.sent = seg.length;
+            if (seg.kind == Kind::Borrowed) --borrowed;
+            std::string().swap(seg.owned);  // Free sent bytes early; the rest may wait a while.
+            seg.keeper.reset();
+            ++head;
+        }
+    }
+    return true;
+}
+
+// Writes the current piece of a stream, then asks the source for the next one, until the
+// source is finished. Done means the whole stream has been sent.
+OutputQueue::FlushResult OutputQueue::flushStream(int socket_fd, Segment& seg) {
+    while (true) {
+        while (seg.sent < seg.owned.size()) {
+            bool more = seg.source || head + 1 < segments.size();
+            ssize_t n = send(socket_fd, seg.owned.data() + seg.sent, seg.owned.size() - seg.sent,
+                             MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+            if (n > 0) {
+                seg.sent += n;
+                localMetrics().bytes_out.add(n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return FlushResult::WouldBlock;
+            return FlushResult::Error;
+        }
+        if (!seg.source) break;
+
+        seg.owned.clear();
+        seg.sent = 0;
+        StreamSource::Status status = seg.source->produce(seg.owned);
+        if (status == StreamSource::Status::Error) return FlushResult::Error;
+        if (status == StreamSource::Status::Pending) return FlushResult::WouldBlock;
+        if (status == StreamSource::Status::Done) seg.source.reset();
+    }
+    std::string().swap(seg.owned);
+    return FlushResult::Done;
+}
+
+OutputQueue::FlushResult OutputQueue::take(char* dest, size_t capacity, size_t& taken) {
+    taken = 0;
+    while (head < segments.size() && taken < capacity) {
+        Segment& seg = segments[head];
+        size_t room = capacity - taken;
+
+        if (seg.kind == Kind::File) {
+            ssize_t n = pread(seg.file_fd, dest + taken, std::min(room, seg.file_remaining),
+                              seg.file_offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return FlushResult::Error;     // As in flush(): the file shrank.
+            taken += n;
+            seg.file_offset += n;
+            seg.file_remaining -= n;
+            if (seg.file_remaining == 0) {
+                close(seg.file_fd);
+                seg.file_fd = -1;
+                ++head;
+            }
+        } else if (seg.kind == Kind::Stream) {
+            size_t n = std::min(room, seg.owned.size() - seg.sent);
+            std::memcpy(dest + taken, seg.owned.data() + seg.sent, n);
+            taken += n;
+            seg.sent += n;
+            if (seg.sent < seg.owned.size()) break;     // 'dest' is full.
+            if (!seg.source) {
+                std::string().swap(seg.owned);
+                ++head;
+                continue;
+            }
+            seg.owned.clear();
+            seg.sent = 0;
+            StreamSource::Status status = seg.source->produce(seg.owned);
+            if (status == StreamSource::Status::Error) return FlushResult::Error;
+            if (status == StreamSource::Status::Pending) return FlushResult::WouldBlock;
+            if (status == StreamSource::Status::Done) seg.source.reset();
+        } else {
+            size_t n = std::min(room, seg.length - seg.sent);
+            std::memcpy(dest + taken, bytesOf(seg) + seg.sent, n);
+            taken += n;
+            seg.sent += n;
+            buffered -= n;
+            if (seg.sent < seg.length) break;
+            if (seg.kind == Kind::Borrowed) --borrowed;
+            std::string().swap(seg.owned);
+            seg.keeper.reset();
+            ++head;
+        }
+    }
+    if (head < segments.size()) return FlushResult::WouldBlock;
+    drained();
+    return FlushResult::Done;
+}
+
+void OutputQueue::clear() {
+    for (size_t i = head; i < segments.size(); ++i) {
+        if (segments[i].file_fd >= 0) close(segments[i].file_fd);
+    }
+    segments.clear();
+    head = 0;
+    buffered = 0;
+    borrowed = 0;
+    arena_used = 0;
+}
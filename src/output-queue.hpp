@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+
+/**
+ * @class StreamSource
+ * @brief A response body produced piece by piece while it is being sent.
+ *
+ * Used for bodies whose bytes are generated on the fly (e.g. a file compressed as it is sent),
+ * so they never have to exist in memory all at once. The OutputQueue asks for the next piece
+ * only after the previous one has been written.
+ */
+class StreamSource {
+public:
+    enum class Status {
+        More,       // 'out' holds the next piece (possibly empty); call again for more.
+        Done,       // 'out' holds the last piece.
+        Pending,    // Nothing to send until data being read asynchronously arrives; the
+                    // source arranges for the connection to flush again then.
+        Error       // The body cannot be completed; the connection should close.
+    };
+
+    virtual ~StreamSource() = default;
+
+    /**
+     * @brief Replaces the contents of out with the next bytes to send.
+     */
+    virtual Status produce(std::string& out) = 0;
+};
+
+
+/**
+ * @class OutputQueue
+ * @brief Response bytes and file ranges waiting to be written to one client socket.
+ *
+ * HttpResponse appends to the queue rather than writing itself, and the connection's owner
+ * flushes it: handleClient() on a blocking socket, or the EventLoop whenever the socket is
+ * writable. File bodies are queued as (fd, offset, length) and sent with sendfile(2), so file
+ * contents go straight from the page cache to the socket and never through userspace. Bodies
+ * generated while they are sent are queued as a StreamSource and pulled one piece at a time.
+ * Consecutive in-memory segments (e.g. the headers and body of a response, or the responses
+ * to a batch of pipelined requests) are gathered into a single sendmsg() call.
+ *
+ * Memory segments come in five kinds:
+ *   - static:   bytes with static storage duration (prebuilt responses), never copied;
+ *   - shared:   bytes kept alive by a shared owner (e.g. a FileCache entry), never copied;
+ *   - head:     formatted directly into the queue's reusable header arena;
+ *   - owned:    a std::string the queue took over;
+ *   - borrowed: a view into memory the caller keeps alive (e.g. the read buffer), so a body
+ *               is written without being copied. The caller must call retainBorrowed()
+ *               before that memory changes; only bytes still unsent are copied then.
+ *
+ * An empty queue owns no heap memory besides its (small) header arena, which keeps idle
+ * keep-alive connections cheap.
+ */
+class OutputQueue {
+public:
+    enum class FlushResult {
+        Done,           // Everything queued has been written.
+        WouldBlock,     // The socket's send buffer is full, or a stream is Pending.
+        Error           // The peer went away or a write failed; the connection should close.
+    };
+
+    // Buffered output above which connection loops stop taking on more pipelined requests.
+    static constexpr size_t HIGH_WATER_MARK = 1 << 20;
+
+    OutputQueue() = default;
+    ~OutputQueue();
+    OutputQueue(const OutputQueue&) = delete;
+    OutputQueue& operator=(const OutputQueue&) = delete;
+
+    /**
+     * @brief Returns space for up to max_length bytes of response head in the header arena.
+     *
+     * Format into it, then call commitHead() with the number of bytes actually written. The
+     * pointer is only valid until the next call that modifies the queue.
+     */
+    char* prepareHead(size_t max_length);
+
+    /**
+     * @brief Queues the first 'length' bytes written since the last prepareHead().
+     */
+    void commitHead(size_t length);
+
+    /**
+     * @brief Queues bytes the queue takes ownership of.
+     */
+    void append(std::string data);
+
+    /**
+     * @brief Queues bytes without copying them; see retainBorrowed().
+     */
+    void appendBorrowed(std::string_view data);
+
+    /**
+     * @brief Queues bytes that live for the whole program (e.g. string literals).
+     */
+    void appendStatic(std::string_view data);
+
+    /**
+     * @brief Queues bytes owned by 'owner', which the queue holds on to until they are sent.
+     */
+    void appendShared(std::shared_ptr<const void> owner, std::string_view data);
+
+    /**
+     * @brief Queues a range of an open file to be sent with sendfile(2).
+     *
+     * The queue takes ownership of file_fd and closes it once the range is sent or the queue
+     * is destroyed.
+     */
+    void appendFile(int file_fd, off_t offset, size_t length);
+
+    /**
+     * @brief Queues a body that is generated while it is sent; see StreamSource.
+     */
+    void appendStream(std::unique_ptr<StreamSource> source);
+
+    /**
+     * @brief Copies the unsent part of every borrowed segment into owned storage.
+     *
+     * Call before the memory behind appendBorrowed() views is reused or freed. Cheap when
+     * the preceding flush() already sent everything.
+     */
+    void retainBorrowed();
+
+    bool empty() const { return head == segments.size(); }
+
+    /**
+     * @brief Bytes of queued in-memory output not yet written (file ranges are not counted).
+     *
+     * Connection loops stop handling pipelined requests once this gets large, so a client
+     * that sends requests without reading the responses cannot grow the queue without bound.
+     */
+    size_t bufferedBytes() const { return buffered; }
+
+    /**
+     * @brief Writes queued data until everything is sent or the socket would block.
+     *
+     * On a blocking socket, with streams that never go Pending, this returns only Done or
+     * Error. On a non-blocking one, WouldBlock means the call should be repeated when the
+     * socket becomes writable (or the pending stream asks for it); progress is kept.
+     * Short writes are resumed from wherever they stopped, even mid-segment.
+     */
+    FlushResult flush(int socket_fd);
+
+    /**
+     * @brief Moves up to 'capacity' bytes from the front of the queue into dest.
+     *
+     * For queues that are cut into frames rather than written to a socket, such as the body
+     * of an HTTP/2 response. File ranges are read with pread() and streams are asked for
+     * more as they run dry, as flush() would.
+     * @param taken Set to the number of bytes copied.
+     * @return Done once the queue is empty; WouldBlock if something remains (fewer than
+     *         'capacity' bytes taken then means a stream is Pending); Error if a read failed.
+     */
+    FlushResult take(char* dest, size_t capacity, size_t& taken);
+
+    /**
+     * @brief Drops everything still queued, closing any file descriptors.
+     */
+    void clear();
+
+private:
+    enum class Kind { Static, Shared, Head, Owned, Borrowed, File, Stream };
+
+    // One queued piece of output.
+    struct Segment {
+        Kind kind;
+        const char* data = nullptr; // Static, shared and borrowed bytes.
+        size_t offset = 0;          // Head bytes: position in the arena.
+        size_t length = 0;          // Memory kinds: total bytes.
+        size_t sent = 0;            // Memory kinds: bytes already written.
+        std::string owned;          // Owned bytes; for streams, the current piece.
+        int file_fd = -1;           // File to sendfile() from.
+        off_t file_offset = 0;      // Next file offset to send.
+        size_t file_remaining = 0;
+        std::unique_ptr<StreamSource> source;   // Stream, until it has produced its last piece.
+        std::shared_ptr<const void> keeper;     // Shared: keeps 'data' alive.
+    };
+
+    std::vector<Segment> segments;
+    size_t head = 0;        // Index of the first segment not fully sent.
+    size_t buffered = 0;    // Unsent bytes across all memory segments.
+    size_t borrowed = 0;    // Unsent borrowed segments.
+
+    // Header arena. Segments refer to it by offset, so it may be reallocated as it grows;
+    // it is rewound (not freed) whenever the queue drains.
+    std::unique_ptr<char[]> arena;
+    size_t arena_capacity = 0;
+    size_t arena_used = 0;
+
+    const char* bytesOf(const Segment& seg) const;  // Start of a memory segment's bytes.
+
+    // Segments whose bytes sit in memory and can be gathered into one sendmsg().
+    static bool isMemory(Kind kind) { return kind != Kind::File && kind != Kind::Stream; }
+
+    // flush() without the timing.
+    FlushResult flushSegments(int socket_fd);
+
+    // Sends the memory segments at the head with one sendmsg() per call; false if it can't finish.
+    bool flushBytes(int socket_fd);
+
+    // Sends the stream segment at the head, producing pieces as the previous ones are written.
+    FlushResult flushStream(int socket_fd, Segment& seg);
+
+    // Rewinds the arena and trims the segment list once everything has been sent.
+    void drained();
+};
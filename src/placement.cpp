@@ -0,0 +1,135 @@
+#include "placement.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <dirent.h>
+#include <iostream>
+#include <linux/filter.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <sys/socket.h>
+
+// Returned by the steering program for a CPU without a worker: past the end of any group,
+// so the kernel falls back to picking a socket by hash.
+constexpr uint32_t NO_WORKER = 0xffffffff;
+
+
+// Parses a CPU or node number, all of the text; cpu_set_t can't hold any larger.
+static bool parseIndex(std::string_view text, int& index) {
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), index);
+    return error == std::errc() && end == text.data() + text.size() && index >= 0 &&
+           index < CPU_SETSIZE;
+}
+
+bool parseCpuList(std::string_view text, std::vector<int>& cpus) {
+    cpus.clear();
+    while (!text.empty()) {
+        size_t comma = text.find(',');
+        std::string_view range = text.substr(0, comma);
+        text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+
+        size_t dash = range.find('-');
+        int first, last;
+        if (!parseIndex(range.substr(0, dash), first)) return false;
+        last = first;
+        if (dash != std::string_view::npos &&
+            (!parseIndex(range.substr(dash + 1), last) || last < first)) {
+            return false;
+        }
+        for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return !cpus.empty();
+}
+
+static cpu_set_t toSet(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) CPU_SET(cpu, &set);
+    return set;
+}
+
+void restrictToCpus(const std::vector<int>& cpus) {
+    cpu_set_t set = toSet(cpus);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        std::cerr << "Cannot run on the CPUs given to --cpus: " << strerror(errno) << "\n";
+        exit(1);
+    }
+}
+
+std::vector<int> allowedCpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// The NUMA node of a CPU: its sysfs directory has a "node<N>" link to it.
+static int nodeOf(int cpu) {
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR* dir = opendir(path.c_str());
+    if (!dir) return 0;
+    int node = 0;
+    while (dirent* entry = readdir(dir)) {
+        std::string_view name = entry->d_name;
+        if (name.starts_with("node") && parseIndex(name.substr(4), node)) break;
+    }
+    closedir(dir);
+    return node;
+}
+
+std::vector<std::vector<int>> cpusByNode(const std::vector<int>& cpus) {
+    std::vector<int> nodes;
+    std::vector<std::vector<int>> groups;
+    for (int cpu : cpus) {
+        int node = nodeOf(cpu);
+        size_t group = std::find(nodes.begin(), nodes.end(), node) - nodes.begin();
+        if (group == nodes.size()) {
+            nodes.push_back(node);
+            groups.emplace_back();
+        }
+        groups[group].push_back(cpu);
+    }
+    return groups;
+}
+
+void pinThread(const std::vector<int>& cpus) {
+    cpu_set_t set = toSet(cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+bool steerByCpu(int listen_fd, const std::vector<int>& socket_cpus) {
+    // A = the CPU handling the packet; then one compare-and-return per socket.
+    std::vector<sock_filter> code;
+    constexpr uint32_t LOAD_CPU = static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU);
+    code.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, LOAD_CPU));
+    for (size_t i = 0; i < socket_cpus.size(); ++i) {
+        code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint32_t>(socket_cpus[i]),
+                                0, 1));
+        code.push_back(BPF_STMT(BPF_RET | BPF_K, static_cast<uint32_t>(i)));
+    }
+    code.push_back(BPF_STMT(BPF_RET | BPF_K, NO_WORKER));
+
+    sock_fprog program{static_cast<unsigned short>(code.size()), code.data()};
+    if (setsockopt(listen_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program,
+                   sizeof(program)) != 0) {
+        std::cerr << "Cannot steer connections by CPU (SO_ATTACH_REUSEPORT_CBPF): "
+                  << strerror(errno) << "\n";
+        return false;
+    }
+    return true;
+}
+
+void stopSteering(int listen_fd) {
+    // Fails harmlessly with ENOENT when there is no program.
+    int unused = 0;
+    setsockopt(listen_fd, SOL_SOCKET, SO_DETACH_REUSEPORT_BPF, &unused, sizeof(unused));
+}
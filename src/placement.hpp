@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+
+/**
+ * Where worker threads run, and so where their memory lives.
+ *
+ * Linux places a page on the NUMA node of the CPU that first touches it. Workers are pinned
+ * before they build anything (an EventLoop, a pool thread's buffers), so connection state,
+ * read buffers and arenas come from the worker's own node without an allocator of our own;
+ * what is shared by every worker, like the file cache, stays wherever it was first written.
+ *
+ * Topology is read from sysfs, so nothing beyond the kernel is needed: on a machine with a
+ * single node, or without the information, every CPU counts as node 0.
+ */
+
+/**
+ * @brief Parses a CPU list in the kernel's format (see cpuset(7)), e.g. "0-7,16-23".
+ * @return false if the text is malformed or names no CPU.
+ */
+bool parseCpuList(std::string_view text, std::vector<int>& cpus);
+
+/**
+ * @brief Confines the process to 'cpus'; exits with a message if the kernel refuses.
+ *
+ * Call before starting any thread: threads inherit the calling thread's affinity.
+ */
+void restrictToCpus(const std::vector<int>& cpus);
+
+/**
+ * @brief The CPUs the calling thread may run on, in ascending order.
+ */
+std::vector<int> allowedCpus();
+
+/**
+ * @brief Groups CPUs by NUMA node, keeping their order within each; nodes in the order their
+ * first CPU appears.
+ */
+std::vector<std::vector<int>> cpusByNode(const std::vector<int>& cpus);
+
+/**
+ * @brief Pins the calling thread to the given CPUs.
+ */
+void pinThread(const std::vector<int>& cpus);
+
+/**
+ * @brief Makes a SO_REUSEPORT group hand each connection to the socket of the worker running
+ * on the CPU that received it, with a classic BPF program (SO_ATTACH_REUSEPORT_CBPF).
+ *
+ * With receive queues (RSS) or RPS spread over the workers' CPUs, a connection is then
+ * served on the core whose cache and node its packets are already on. Connections arriving
+ * on a CPU without a worker are spread by the kernel's hash, as without the program.
+ * @param listen_fd Any socket of the group; the program applies to the whole group.
+ * @param socket_cpus socket_cpus[i] is the CPU of the worker accepting from the group's i-th
+ *                    socket, in the order the sockets joined it.
+ * @return false (with a message) if the kernel refused the program.
+ */
+bool steerByCpu(int listen_fd, const std::vector<int>& socket_cpus);
+
+/**
+ * @brief Removes a steering program a previous process attached to the group, if there is one.
+ */
+void stopSteering(int listen_fd);
@@ -0,0 +1,62 @@
+#include "read-buffer.hpp"
+
+#include <cstring>
+
+ReadBuffer::~ReadBuffer() {
+    clear();
+}
+
+bool ReadBuffer::reserve(size_t min_free) {
+    if (freeSpace() >= min_free) return true;
+
+    size_t used = size();
+    if (start > 0 && capacity - used >= min_free) {
+        // Enough room once the consumed prefix is reclaimed.
+        std::memmove(storage, storage + start, used);
+    } else {
+        size_t new_capacity = capacity ? capacity : INITIAL_CAPACITY;
+        while (new_capacity - used < min_free) new_capacity *= 2;
+
+        char* grown = pool ? pool->acquire(new_capacity) : new char[new_capacity];
+        if (!grown) return false;
+        if (used) std::memcpy(grown, storage + start, used);
+        clear();
+        storage = grown;
+        capacity = new_capacity;
+    }
+    start = 0;
+    end = used;
+    return true;
+}
+
+bool ReadBuffer::append(const char* bytes, size_t n) {
+    if (!reserve(n)) return false;
+    std::memcpy(tail(), bytes, n);
+    commit(n);
+    return true;
+}
+
+void ReadBuffer::consume(size_t n) {
+    start += n;
+    if (start >= end) {
+        // Nothing left: rewind so the next read starts at the front.
+        start = end = 0;
+    }
+}
+
+void ReadBuffer::release() {
+    if (!empty()) return;
+    clear();
+}
+
+void ReadBuffer::clear() {
+    if (storage) {
+        if (pool) {
+            pool->release(storage, capacity);
+        } else {
+            delete[] storage;
+        }
+    }
+    storage = nullptr;
+    capacity = start = end = 0;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "buffer-pool.hpp"
+
+#include <cstddef>
+
+
+/**
+ * @class ReadBuffer
+ * @brief A growable, connection-owned buffer of received bytes.
+ *
+ * Bytes are appended at the tail by recv() and consumed from the head once a request in
+ * them has been handled. Unconsumed bytes (an incomplete or pipelined request) are kept, and
+ * the buffer compacts or doubles when more room is needed, so a request is never limited to
+ * the size of a single read. The parser's string_views point into this storage.
+ *
+ * Storage comes from a BufferPool when one is given, so it is recycled between connections
+ * and counted against the pool's limit; growing may then fail.
+ */
+class ReadBuffer {
+public:
+    static constexpr size_t INITIAL_CAPACITY = BufferPool::BLOCK_BYTES;
+    // Least free room worth a recv(); reserving a whole INITIAL_CAPACITY would double the
+    // storage of every buffer holding a few bytes already.
+    static constexpr size_t MIN_READ = 1024;
+
+    explicit ReadBuffer(BufferPool* pool = nullptr) : pool(pool) {}
+    ~ReadBuffer();
+    ReadBuffer(const ReadBuffer&) = delete;
+    ReadBuffer& operator=(const ReadBuffer&) = delete;
+
+    char* data() { return storage + start; }     // First unconsumed byte.
+    size_t size() const { return end - start; }        // Number of unconsumed bytes.
+    bool empty() const { return start == end; }
+
+    /**
+     * @brief Makes room for at least min_free more bytes at the tail.
+     *
+     * Moves the unconsumed bytes to the front of the storage, growing it if that is not
+     * enough. Any views into the old contents are invalidated.
+     * @return false if the pool's limit does not allow the larger storage; nothing changes.
+     */
+    [[nodiscard]] bool reserve(size_t min_free);
+
+    char* tail() { return storage + end; }                // Where the next recv() should write.
+    size_t freeSpace() const { return capacity - end; }         // Room left at the tail.
+    void commit(size_t n) { end += n; }                         // Marks n received bytes as valid.
+
+    /**
+     * @brief Appends a copy of the given bytes.
+     * @return false, appending nothing, if there is no room for them (see reserve()).
+     */
+    [[nodiscard]] bool append(const char* bytes, size_t n);
+
+    /**
+     * @brief Discards n bytes from the head. The storage is kept for reuse.
+     */
+    void consume(size_t n);
+
+    /**
+     * @brief Frees the storage. Only valid when the buffer is empty.
+     *
+     * The event loop calls this for idle connections so they hold no heap memory.
+     */
+    void release();
+
+    /**
+     * @brief Drops any unconsumed bytes and frees the storage.
+     */
+    void clear();
+
+private:
+    BufferPool* pool;           // Where storage comes from, or null for the heap.
+    char* storage = nullptr;
+    size_t capacity = 0;
+    size_t start = 0;   // Offset of the first unconsumed byte.
+    size_t end = 0;     // Offset one past the last received byte.
+};
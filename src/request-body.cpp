@@ -0,0 +1,149 @@
+#include "request-body.hpp"
+#include "http-server.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+// Bytes moved per splice() or recv(); the default pipe capacity.
+constexpr size_t BODY_CHUNK_BYTES = 64 * 1024;
+
+
+// The calling thread's pipe for splice(). It is always drained before a call returns, so
+// one pipe serves every connection on the thread.
+struct SplicePipe {
+    int read_fd = -1;
+    int write_fd = -1;
+
+    SplicePipe() {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) == 0) {
+            read_fd = fds[0];
+            write_fd = fds[1];
+        }
+    }
+    ~SplicePipe() {
+        if (read_fd >= 0) close(read_fd);
+        if (write_fd >= 0) close(write_fd);
+    }
+};
+
+static SplicePipe& splicePipe() {
+    static thread_local SplicePipe pipe;
+    return pipe;
+}
+
+
+void BodyStream::start(std::unique_ptr<BodySink> new_sink, size_t length, bool close_after) {
+    sink = std::move(new_sink);
+    remaining = length;
+    chunked = false;
+    should_close = close_after;
+    splice_ok = true;
+    error_status = 0;
+}
+
+void BodyStream::startChunked(std::unique_ptr<BodySink> new_sink, uint64_t max_bytes,
+                              bool close_after) {
+    start(std::move(new_sink), 0, close_after);
+    chunked = true;
+    chunks = ChunkedDecoder(max_bytes);
+}
+
+size_t BodyStream::feed(const char* data, size_t length) {
+    if (!chunked) {
+        size_t take = std::min(length, remaining);
+        if (take > 0) sink->write(std::string_view(data, take));
+        remaining -= take;
+        return take;
+    }
+
+    std::string_view input(data, length);
+    while (!complete()) {
+        std::string_view piece;
+        ChunkedDecoder::Result result = chunks.next(input, piece);
+        if (result == ChunkedDecoder::Result::Data) {
+            sink->write(piece);
+        } else if (result == ChunkedDecoder::Result::Malformed) {
+            error_status = 400;
+        } else if (result == ChunkedDecoder::Result::TooLarge) {
+            error_status = 413;
+        } else {
+            break;  // Incomplete, or Done.
+        }
+    }
+    return length - input.size();
+}
+
+void BodyStream::consumeData(size_t length) {
+    if (chunked) {
+        chunks.skip(length);
+    } else {
+        remaining -= length;
+    }
+}
+
+bool BodyStream::canSplice() const {
+    return splice_ok && sink && sink->spliceFd() >= 0 && splicePipe().read_fd >= 0;
+}
+
+ssize_t BodyStream::spliceFrom(int socket_fd) {
+    if (!canSplice()) return readInto(socket_fd);
+
+    SplicePipe& pipe = splicePipe();
+    int file_fd = sink->spliceFd();
+    ssize_t n = splice(socket_fd, nullptr, pipe.write_fd, nullptr,
+                       std::min<uint64_t>(dataAhead(), BODY_CHUNK_BYTES), SPLICE_F_MOVE);
+    if (n < 0) {
+        if (errno != EINVAL) return -1;
+        splice_ok = false;      // This socket can't be spliced from.
+        return readInto(socket_fd);
+    }
+    if (n == 0) return 0;
+
+    // Empty the pipe into the file before returning, whatever happens.
+    size_t left = n;
+    while (left > 0) {
+        ssize_t moved = splice(pipe.read_fd, nullptr, file_fd, nullptr, left, SPLICE_F_MOVE);
+        if (moved > 0) {
+            left -= moved;
+            continue;
+        }
+        if (moved < 0 && errno == EINTR) continue;
+
+        // The file can't take spliced data (or the write failed). Hand the rest to the
+        // sink's write(), which notices a real failure itself; stop splicing this body.
+        splice_ok = false;
+        char chunk[16 * 1024];
+        while (left > 0) {
+            ssize_t got = read(pipe.read_fd, chunk, std::min(left, sizeof(chunk)));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) break;
+            sink->write(std::string_view(chunk, got));
+            left -= got;
+        }
+        break;
+    }
+    consumeData(n);
+    return n;
+}
+
+ssize_t BodyStream::readInto(int socket_fd) {
+    static thread_local std::vector<char> buffer(BODY_CHUNK_BYTES);
+    ssize_t n = recv(socket_fd, buffer.data(), std::min<uint64_t>(dataAhead(), buffer.size()), 0);
+    if (n > 0) feed(buffer.data(), n);
+    return n;
+}
+
+void BodyStream::finish(HttpResponse& response) {
+    response.setRoute(sink->route_id);
+    if (error_status) {
+        response.sendError(error_status);   // The sink discards what it got when destroyed.
+    } else {
+        sink->finish(response);
+    }
+    sink.reset();
+}
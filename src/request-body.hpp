@@ -0,0 +1,128 @@
+#pragma once
+
+#include "chunked.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <sys/types.h>
+
+class HttpResponse;
+
+
+/**
+ * @class BodySink
+ * @brief Receives a request body piece by piece as it arrives.
+ *
+ * Routes registered with Router::prefixBody() return a sink instead of handling a fully
+ * buffered request, so an upload of any size needs no more memory than one read. A sink
+ * that fails part-way (disk full, say) must keep accepting, and discarding, the rest of the
+ * body so the connection stays in sync, and report the failure from finish().
+ */
+class BodySink {
+public:
+    virtual ~BodySink() = default;
+
+    /**
+     * @brief Consumes the next piece of the body.
+     */
+    virtual void write(std::string_view chunk) = 0;
+
+    /**
+     * @brief A file descriptor body bytes may be spliced into directly, or -1.
+     *
+     * When this is a file, the body moves socket -> pipe -> file with splice(2) and never
+     * enters userspace; write() is then only used for bytes that were already buffered.
+     */
+    virtual int spliceFd() const { return -1; }
+
+    /**
+     * @brief Called after the last byte of the body, to send the response.
+     */
+    virtual void finish(HttpResponse& response) = 0;
+
+    size_t route_id = SIZE_MAX;     // Set by the Router, so the response counts under its route.
+};
+
+
+/**
+ * @class BodyStream
+ * @brief The streamed body of the request a connection is currently receiving.
+ *
+ * Connection loops hand every received byte to feed() while a body is active, or, when the
+ * sink allows it and nothing is buffered, call spliceFrom() to move the body straight from
+ * the socket into the sink's file.
+ *
+ * A chunked body is decoded on the way: feed() strips the framing, and spliceFrom() only
+ * moves the data of the chunk in progress, so it never reads past the end of the body. A
+ * malformed or oversized one ends the stream early; finish() then answers with an error in
+ * place of the sink, and the connection is closed.
+ */
+class BodyStream {
+public:
+    /**
+     * @brief Starts streaming a body of 'length' bytes into sink.
+     * @param should_close Whether to close the connection after the response.
+     */
+    void start(std::unique_ptr<BodySink> sink, size_t length, bool should_close);
+
+    /**
+     * @brief Starts streaming a chunked body, which may decode to at most max_bytes.
+     */
+    void startChunked(std::unique_ptr<BodySink> sink, uint64_t max_bytes, bool should_close);
+
+    bool active() const { return sink != nullptr; }
+    bool complete() const {
+        return error_status != 0 || (chunked ? chunks.done() : remaining == 0);
+    }
+    bool shouldClose() const { return should_close || error_status != 0; }
+
+    /**
+     * @brief Whether the next bytes on the socket are known to be body data, not framing.
+     *
+     * Only then may spliceFrom() be used; otherwise the caller reads into its own buffer and
+     * feed()s it, keeping whatever follows the body.
+     */
+    bool expectsData() const { return dataAhead() > 0; }
+
+    /**
+     * @brief Passes up to the rest of the body from data to the sink.
+     * @return The number of bytes taken; anything after them belongs to the next request.
+     */
+    size_t feed(const char* data, size_t length);
+
+    /**
+     * @brief Whether spliceFrom() can be used for the rest of the body.
+     */
+    bool canSplice() const;
+
+    /**
+     * @brief Moves body bytes from the socket into the sink's file without copying them.
+     *
+     * Falls back to recv() and write() if the kernel cannot splice between the two.
+     * @return Bytes moved (> 0), 0 if the peer closed, or -1 with errno set (e.g. EAGAIN).
+     */
+    ssize_t spliceFrom(int socket_fd);
+
+    /**
+     * @brief Lets the sink respond once the body is complete, then forgets it.
+     *
+     * After a malformed (400) or oversized (413) chunked body the error is sent instead.
+     */
+    void finish(HttpResponse& response);
+
+private:
+    std::unique_ptr<BodySink> sink;
+    size_t remaining = 0;       // Body bytes not yet received, unless chunked.
+    bool chunked = false;
+    ChunkedDecoder chunks;
+    bool should_close = false;
+    bool splice_ok = true;      // Cleared once splicing turned out to be unsupported.
+    int error_status = 0;       // Set when a chunked body turned out to be unacceptable.
+
+    // Bytes that can be read from the socket without going past the current data run.
+    uint64_t dataAhead() const { return chunked ? chunks.dataAhead() : remaining; }
+    void consumeData(size_t length);    // Accounts for data moved past feed().
+    ssize_t readInto(int socket_fd);    // recv() fallback for spliceFrom().
+};
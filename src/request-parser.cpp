@@ -0,0 +1,250 @@
+#include "request-parser.hpp"
+#include "simd-scan.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+// Returns the next line (without its "\r\n") and advances p past it. Only called on a header
+// block whose end has already been found, so every line is CRLF-terminated.
+static std::string_view nextLine(char*& p, char* end) {
+    char* start = p;
+    char* lf = static_cast<char*>(std::memchr(p, '\n', end - p));
+    if (!lf) lf = end;
+    p = lf + 1;
+    char* line_end = (lf > start && lf[-1] == '\r') ? lf - 1 : lf;
+    return std::string_view(start, line_end - start);
+}
+
+static std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+// Only header names are lowercased, so codings in values are compared case-blind.
+static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](char x, char y) {
+        return (x | 0x20) == (y | 0x20);
+    });
+}
+
+
+void RequestParser::reset() {
+    state = State::Head;
+    scanned = 0;
+    head_length = 0;
+    body_length = 0;
+    chunked_body = false;
+    encoded_length = 0;
+    error_status = 0;
+}
+
+RequestParser::Result RequestParser::fail(int status) {
+    error_status = status;
+    return Result::Error;
+}
+
+RequestParser::Result RequestParser::parse(char* data, size_t length, HttpRequest& request) {
+    if (state == State::Head) {
+        // Back up three bytes in case the terminator straddles the previous read.
+        size_t from = scanned >= 3 ? scanned - 3 : 0;
+        size_t end = findHeaderEnd(data, from, length);
+        if (end == std::string_view::npos) {
+            scanned = length;
+            if (length > MAX_HEADER_BYTES) return fail(431);
+            return Result::Incomplete;
+        }
+        head_length = end;
+        if (head_length > MAX_HEADER_BYTES) return fail(431);
+        if (!parseHead(data, request) || !parseFraming(request)) return Result::Error;
+
+        state = State::Body;
+        if (chunked_body) {
+            // Look before decoding: a caller that streams the body wants it as it was sent.
+            Result ahead = decodeChunked(data, length, false);
+            if (ahead == Result::Incomplete) return Result::Headers;
+            if (ahead == Result::Error) return ahead;
+            decodeChunked(data, length, true);
+        } else if (length < head_length + body_length) {
+            return Result::Headers;
+        }
+    } else {
+        if (chunked_body) {
+            Result decoded = decodeChunked(data, length, true);
+            if (decoded != Result::Complete) return decoded;
+        } else if (length < head_length + body_length) {
+            return Result::Incomplete;
+        }
+        // The bytes may have moved since the head was parsed, so rebuild the views. The head
+        // was already validated (and lowercased), so this cannot fail.
+        parseHead(data, request);
+    }
+
+    request.body = std::string_view(data + head_length, body_length);
+    return Result::Complete;
+}
+
+RequestParser::Result RequestParser::decodeChunked(char* data, size_t length, bool commit) {
+    ChunkedDecoder decoder = chunks;
+    char* body = data + head_length;
+    size_t decoded = body_length;
+    std::string_view input(body + encoded_length, length - head_length - encoded_length);
+    std::string_view piece;
+    ChunkedDecoder::Result result;
+    while ((result = decoder.next(input, piece)) == ChunkedDecoder::Result::Data) {
+        // Data only ever moves towards the head, so bytes not yet decoded are never touched.
+        if (commit) std::memmove(body + decoded, piece.data(), piece.size());
+        decoded += piece.size();
+    }
+    if (result == ChunkedDecoder::Result::Malformed) return fail(400);
+    if (result == ChunkedDecoder::Result::TooLarge) return fail(413);
+
+    size_t encoded = input.data() - body;
+    if (commit) {
+        chunks = decoder;
+        body_length = decoded;
+        encoded_length = encoded;
+        // Framing can outweigh the data by far (one-byte chunks), so bound both.
+        if (result == ChunkedDecoder::Result::Incomplete &&
+            (decoded > MAX_BUFFERED_BODY || encoded > 2 * MAX_BUFFERED_BODY)) {
+            return fail(413);
+        }
+    }
+    return result == ChunkedDecoder::Result::Done ? Result::Complete : Result::Incomplete;
+}
+
+bool RequestParser::parseHead(char* data, HttpRequest& request) {
+    request.reset();
+
+    char* p = data;
+    char* end = data + head_length - 2;     // Drop the final blank line's CRLF.
+
+    // Tolerate stray blank lines before the request line (e.g. after a previous body).
+    while (p < end && (*p == '\r' || *p == '\n')) ++p;
+
+    // Request line: METHOD SP TARGET SP VERSION
+    std::string_view line = nextLine(p, end);
+    size_t sp1 = line.find(' ');
+    size_t sp2 = sp1 == std::string_view::npos ? sp1 : line.find(' ', sp1 + 1);
+    if (sp1 == 0 || sp2 == std::string_view::npos || sp2 == sp1 + 1) {
+        error_status = 400;
+        return false;
+    }
+    request.method = line.substr(0, sp1);
+    request.path = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    request.version = line.substr(sp2 + 1);
+    if (!request.version.starts_with("HTTP/1.")) {
+        error_status = 400;
+        return false;
+    }
+
+    // Header lines: NAME ":" OWS VALUE OWS
+    while (p < end) {
+        char* name = p;
+        // One scan finds the colon, or the end of a line that has none.
+        char* colon = const_cast<char*>(findEither(p, end, ':', '\n'));
+        // No name, no colon, whitespace before the colon, or obsolete line folding.
+        if (colon == name || colon == end || *colon == '\n' ||
+            colon[-1] == ' ' || colon[-1] == '\t' || *name == ' ' || *name == '\t') {
+            error_status = 400;
+            return false;
+        }
+        char* lf = const_cast<char*>(findEither(colon + 1, end, '\n', '\n'));
+        p = lf < end ? lf + 1 : end;
+        char* value_end = lf > colon + 1 && lf[-1] == '\r' ? lf - 1 : lf;
+
+        // Normalize header keys to lowercase for case-insensitive matching.
+        lowercaseInPlace(name, colon - name);
+        if (!request.headers.add(std::string_view(name, colon - name),
+                                 trim(std::string_view(colon + 1, value_end - (colon + 1))))) {
+            error_status = 431;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Calls visit(member) for every member of the comma-separated lists in all 'name' headers,
+// in order: repeated header lines form one list (RFC 9110 5.3). Returns false as soon as
+// visit() does, true otherwise.
+template <typename Visit>
+static bool forEachMember(const HttpHeaders& headers, std::string_view name, Visit visit) {
+    for (const HttpHeader& header : headers) {
+        if (header.name != name) continue;
+        std::string_view values = header.value;
+        while (true) {
+            size_t comma = values.find(',');
+            if (!visit(trim(values.substr(0, comma)))) return false;
+            if (comma == std::string_view::npos) break;
+            values.remove_prefix(comma + 1);
+        }
+    }
+    return true;
+}
+
+bool RequestParser::parseFraming(const HttpRequest& request) {
+    body_length = 0;
+    // Repeated lengths, in several headers or as a list in one, must all agree (RFC 9112
+    // 6.3): otherwise this server and a proxy in front of it could frame the body apart.
+    std::optional<std::string_view> length;
+    bool lengths_agree = forEachMember(request.headers, "content-length",
+                                       [&](std::string_view value) {
+        if (length && *length != value) return false;
+        length = value;
+        return true;
+    });
+    if (!lengths_agree) {
+        error_status = 400;
+        return false;
+    }
+
+    // Every Transfer-Encoding line counts, as a proxy joining them would see it: a second
+    // line making "chunked, gzip" leaves the body's end to the connection closing.
+    bool has_coding = false;
+    size_t codings = 0;
+    bool chunked_before_last = false;
+    std::string_view last_coding;
+    forEachMember(request.headers, "transfer-encoding", [&](std::string_view coding) {
+        has_coding = true;
+        if (coding.empty()) return true;    // Empty list elements are allowed and ignored.
+        if (codings > 0 && equalsIgnoreCase(last_coding, "chunked")) chunked_before_last = true;
+        last_coding = coding;
+        ++codings;
+        return true;
+    });
+    if (has_coding) {
+        // With both, which one frames the body is exactly what request smuggling exploits
+        // (RFC 9112 6.1); and HTTP/1.0 has no transfer codings at all. Without chunked as
+        // the final coding, applied once, the length can't be determined either (6.3).
+        if (length || request.version == "HTTP/1.0" || !equalsIgnoreCase(last_coding, "chunked") ||
+            chunked_before_last) {
+            error_status = 400;
+            return false;
+        }
+        // No coding but chunked is implemented.
+        if (codings > 1) {
+            error_status = 501;
+            return false;
+        }
+        chunked_body = true;
+        chunks = ChunkedDecoder(max_body_bytes);
+        return true;
+    }
+
+    // Otherwise the length of the body comes from the 'Content-Length' header.
+    if (length) {
+        auto [ptr, ec] = std::from_chars(length->data(), length->data() + length->size(), body_length);
+        if (ec != std::errc() || ptr != length->data() + length->size()) {
+            error_status = 400;
+            return false;
+        }
+        // Refuse before reading any of it.
+        if (body_length > max_body_bytes) {
+            error_status = 413;
+            return false;
+        }
+    }
+    return true;
+}
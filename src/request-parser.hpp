@@ -0,0 +1,114 @@
+#pragma once
+
+#include "chunked.hpp"
+#include "http-server.hpp"
+
+#include <cstdint>
+
+
+/**
+ * @class RequestParser
+ * @brief A resumable, allocation-free HTTP/1.1 request parser.
+ *
+ * The parser is fed the bytes of a connection's read buffer, starting at the first byte of the
+ * current request, every time more data arrives. It remembers how far it has already searched
+ * for the end of the header block, so a request split across many recv() calls is scanned
+ * once rather than from the start on each call. When a request is complete, HttpRequest is
+ * filled with string_views into the buffer and header names are lowercased in place; nothing
+ * is copied and nothing is allocated.
+ *
+ * The caller may move the buffer's contents between calls (e.g. compact or grow it) as long
+ * as the request still starts at data[0]: only offsets are carried between calls.
+ *
+ * Bodies are framed by Content-Length or by the chunked transfer coding. A chunked body that
+ * is buffered is decoded in place as it arrives: the data of each chunk is moved down over
+ * the framing before it, so request.body is still one view into the buffer.
+ */
+class RequestParser {
+public:
+    enum class Result {
+        Incomplete,     // Need more bytes; call parse() again once they arrive.
+        Headers,        // The head is parsed, the body is still arriving; see below.
+        Complete,       // 'request' is filled in; consumed() bytes belong to it.
+        Error           // Malformed or oversized; errorStatus() says how to reply.
+    };
+
+    static constexpr size_t MAX_HEADER_BYTES = 64 * 1024;  // Request line plus headers.
+
+    // Largest body a connection loop buffers whole; bigger ones must be streamed to a BodySink.
+    static constexpr size_t MAX_BUFFERED_BODY = 1 << 20;
+
+    /**
+     * @param max_body_bytes Requests declaring a longer Content-Length, or whose chunks add
+     *                       up to more, fail with 413.
+     */
+    explicit RequestParser(size_t max_body_bytes = SIZE_MAX) : max_body_bytes(max_body_bytes) {}
+
+    /**
+     * @brief Parses as much of the request as the bytes allow.
+     * @param data The buffered bytes, beginning with the current request. The header block is
+     *             modified in place (header names are lowercased).
+     * @param length Number of bytes available at data.
+     * @param request Filled in when the result is Headers or Complete.
+     *
+     * Headers is returned once per request, when the head has been parsed but the body has
+     * not fully arrived. 'request' (except its body) is valid until the buffer changes. The
+     * caller may then stream the body itself: it starts at headLength() and takes
+     * bodyLength() bytes, or is chunked() to its end, and the parser must be reset().
+     * Otherwise, calling parse() again keeps buffering until the result is Complete; a
+     * chunked body buffered this way may decode to at most MAX_BUFFERED_BODY bytes.
+     */
+    Result parse(char* data, size_t length, HttpRequest& request);
+
+    /**
+     * @brief Number of bytes taken by the completed request (headers and body).
+     */
+    size_t consumed() const {
+        return head_length + (chunked_body ? encoded_length : body_length);
+    }
+
+    size_t headLength() const { return head_length; }
+
+    /**
+     * @brief The body's length: from Content-Length, or, when chunked(), as decoded so far.
+     */
+    size_t bodyLength() const { return body_length; }
+
+    /**
+     * @brief Whether the body uses the chunked transfer coding, so its length is not known.
+     */
+    bool chunked() const { return chunked_body; }
+
+    /**
+     * @brief The HTTP status to answer with after an Error (400, 413, 431 or 501).
+     */
+    int errorStatus() const { return error_status; }
+
+    /**
+     * @brief Prepares the parser for the next request on the connection.
+     */
+    void reset();
+
+private:
+    enum class State { Head, Body };
+
+    size_t max_body_bytes;
+    State state = State::Head;
+    size_t scanned = 0;         // Bytes already searched for the blank line ending the headers.
+    size_t head_length = 0;     // Request line, headers and the blank line.
+    size_t body_length = 0;     // From Content-Length, or decoded so far.
+    bool chunked_body = false;
+    ChunkedDecoder chunks;      // State of a buffered chunked body.
+    size_t encoded_length = 0;  // Bytes of the chunked body decoded so far, framing included.
+    int error_status = 0;
+
+    // Splits the header block into the request line and headers; false on a malformed head.
+    bool parseHead(char* data, HttpRequest& request);
+    // Works out how the body is framed from the parsed headers; false if it can't be read.
+    bool parseFraming(const HttpRequest& request);
+    // Decodes the chunked body that has arrived in place. Without 'commit', only checks
+    // whether all of it is there and leaves the bytes untouched.
+    Result decodeChunked(char* data, size_t length, bool commit);
+    Result fail(int status);
+};
+
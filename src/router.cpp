@@ -0,0 +1,175 @@
+#include "router.hpp"
+#include "http-server.hpp"
+#include "request-body.hpp"
+
+#include <algorithm>
+
+
+HttpMethod parseMethod(std::string_view method) {
+    switch (method.size()) {
+        case 3:
+            if (method == "GET") return HttpMethod::Get;
+            if (method == "PUT") return HttpMethod::Put;
+            break;
+        case 4:
+            if (method == "POST") return HttpMethod::Post;
+            if (method == "HEAD") return HttpMethod::Head;
+            break;
+        case 5:
+            if (method == "PATCH") return HttpMethod::Patch;
+            break;
+        case 6:
+            if (method == "DELETE") return HttpMethod::Delete;
+            break;
+        case 7:
+            if (method == "OPTIONS") return HttpMethod::Options;
+            break;
+    }
+    return HttpMethod::Other;
+}
+
+std::string_view methodName(HttpMethod method) {
+    switch (method) {
+        case HttpMethod::Get: return "GET";
+        case HttpMethod::Head: return "HEAD";
+        case HttpMethod::Post: return "POST";
+        case HttpMethod::Put: return "PUT";
+        case HttpMethod::Delete: return "DELETE";
+        case HttpMethod::Options: return "OPTIONS";
+        case HttpMethod::Patch: return "PATCH";
+        case HttpMethod::Other: break;
+    }
+    return {};
+}
+
+
+Router::Router() = default;
+Router::~Router() = default;
+
+Router::Node* Router::Node::child(char first) const {
+    for (const auto& [key, node] : children) {
+        if (key == first) return node.get();
+    }
+    return nullptr;
+}
+
+Router::Node& Router::insert(std::string_view path) {
+    Node* node = &root;
+    while (!path.empty()) {
+        Node* next = node->child(path.front());
+        if (!next) {
+            auto leaf = std::make_unique<Node>();
+            leaf->label = path;
+            Node* raw = leaf.get();
+            node->children.emplace_back(path.front(), std::move(leaf));
+            return *raw;
+        }
+
+        // Length of the common prefix of the edge label and the remaining path.
+        size_t common = std::mismatch(next->label.begin(), next->label.end(),
+                                      path.begin(), path.end()).first - next->label.begin();
+        if (common < next->label.size()) {
+            // Split the edge: 'next' keeps the tail of its label below a new middle node.
+            auto middle = std::make_unique<Node>();
+            middle->label = next->label.substr(0, common);
+            for (auto& [key, owned] : node->children) {
+                if (owned.get() != next) continue;
+                next->label.erase(0, common);
+                middle->children.emplace_back(next->label.front(), std::move(owned));
+                owned = std::move(middle);
+                next = owned.get();
+                break;
+            }
+        }
+        node = next;
+        path.remove_prefix(common);
+    }
+    return *node;
+}
+
+void Router::add(bool is_prefix, HttpMethod method, std::string_view path, Route route) {
+    Node& node = insert(path);
+    std::unique_ptr<MethodTable>& table = is_prefix ? node.prefix : node.exact;
+    if (!table) table = std::make_unique<MethodTable>();
+    route.id = route_labels.size();
+    route_labels.push_back(RouteLabel{methodName(method), std::string(path)});
+    (*table)[static_cast<size_t>(method)] = std::move(route);
+}
+
+void Router::exact(HttpMethod method, std::string_view path, Handler handler) {
+    add(false, method, path, Route{std::move(handler), nullptr, nullptr});
+}
+
+void Router::prefix(HttpMethod method, std::string_view prefix, Handler handler) {
+    add(true, method, prefix, Route{std::move(handler), nullptr, nullptr});
+}
+
+void Router::prefixTask(HttpMethod method, std::string_view prefix, TaskHandler handler) {
+    add(true, method, prefix, Route{nullptr, std::move(handler), nullptr});
+}
+
+void Router::prefixBody(HttpMethod method, std::string_view prefix, BodyHandler handler) {
+    add(true, method, prefix, Route{nullptr, nullptr, std::move(handler)});
+}
+
+const Router::Route* Router::find(const HttpRequest& request, std::string_view& tail) const {
+    size_t method = static_cast<size_t>(parseMethod(request.method));
+    std::string_view path = request.path;
+
+    // The longest prefix route seen so far on the way down, and where its tail starts.
+    const Route* best = nullptr;
+    size_t best_end = 0;
+
+    const Node* node = &root;
+    size_t matched = 0;
+    while (true) {
+        if (node->prefix && (*node->prefix)[method]) {
+            best = &(*node->prefix)[method];
+            best_end = matched;
+        }
+        if (matched == path.size()) {
+            if (node->exact && (*node->exact)[method]) {
+                tail = {};
+                return &(*node->exact)[method];
+            }
+            break;
+        }
+        const Node* next = node->child(path[matched]);
+        if (!next || path.substr(matched, next->label.size()) != next->label) break;
+        matched += next->label.size();
+        node = next;
+    }
+
+    if (best) tail = path.substr(best_end);
+    return best;
+}
+
+bool Router::dispatch(const HttpRequest& request, HttpResponse& response,
+                      Task<void>& suspended) const {
+    std::string_view tail;
+    const Route* route = find(request, tail);
+    if (!route) return false;
+
+    response.setRoute(route->id);
+    if (route->handler) {
+        route->handler(request, response, tail);
+    } else if (route->task) {
+        Task<void> task = route->task(request, response, tail);
+        task.start();
+        if (!task.done()) suspended = std::move(task);
+    } else {
+        std::unique_ptr<BodySink> sink = route->body(request, tail);
+        sink->write(request.body);
+        sink->finish(response);
+    }
+    return true;
+}
+
+std::unique_ptr<BodySink> Router::openBody(const HttpRequest& request) const {
+    std::string_view tail;
+    const Route* route = find(request, tail);
+    if (!route || !route->body) return nullptr;
+    std::unique_ptr<BodySink> sink = route->body(request, tail);
+    if (sink) sink->route_id = route->id;
+    return sink;
+}
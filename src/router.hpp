@@ -0,0 +1,161 @@
+#pragma once
+
+#include "metrics.hpp"
+#include "task.hpp"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class BodySink;
+class HttpRequest;
+class HttpResponse;
+
+
+/**
+ * @brief The request methods routes can be registered for.
+ */
+enum class HttpMethod : uint8_t { Get, Head, Post, Put, Delete, Options, Patch, Other };
+
+constexpr size_t HTTP_METHOD_COUNT = static_cast<size_t>(HttpMethod::Other) + 1;
+
+/**
+ * @brief Maps a request-line method token to HttpMethod (case-sensitive, as RFC 9110 requires).
+ */
+HttpMethod parseMethod(std::string_view method);
+
+/**
+ * @brief The request-line token for a method; empty for HttpMethod::Other.
+ */
+std::string_view methodName(HttpMethod method);
+
+
+/**
+ * @class Router
+ * @brief A table of routes, looked up with a radix tree over the request path.
+ *
+ * Every route pairs a method with either an exact path ("/user-agent") or a path prefix
+ * ("/files/"). A route either handles a fully buffered request, runs a coroutine that may
+ * wait for I/O while handling it, or, for uploads, opens a BodySink that the body is
+ * streamed into. The table is built once at startup and is
+ * read-only afterwards, so one Router serves every worker thread without locking.
+ *
+ * Lookup walks the path through the tree once, comparing each byte at most once, so dispatch
+ * costs O(path length) however many routes are registered. An exact match beats a prefix
+ * match, and among prefixes the longest one wins.
+ */
+class Router {
+public:
+    /**
+     * @brief Runs a matched route.
+     *
+     * 'tail' is the part of the path after the route's prefix (empty for exact routes).
+     */
+    using Handler = std::function<void(const HttpRequest& request, HttpResponse& response,
+                                       std::string_view tail)>;
+
+    /**
+     * @brief Runs a matched route as a coroutine that may suspend before it has responded.
+     *
+     * The response is passed by value so it lives in the coroutine frame. The request and
+     * 'tail' point into the connection's buffers and are only valid until the first
+     * suspension; copy what is needed after it.
+     */
+    using TaskHandler = std::function<Task<void>(const HttpRequest& request, HttpResponse response,
+                                                 std::string_view tail)>;
+
+    /**
+     * @brief Opens the sink a matched request's body is streamed into.
+     *
+     * Called with the request head only; the sink must copy anything it needs from it.
+     */
+    using BodyHandler = std::function<std::unique_ptr<BodySink>(const HttpRequest& request,
+                                                                std::string_view tail)>;
+
+    Router();
+    ~Router();
+    Router(const Router&) = delete;
+    Router& operator=(const Router&) = delete;
+
+    /**
+     * @brief Registers a handler for one method and exactly one path.
+     */
+    void exact(HttpMethod method, std::string_view path, Handler handler);
+
+    /**
+     * @brief Registers a handler for one method and every path starting with prefix.
+     */
+    void prefix(HttpMethod method, std::string_view prefix, Handler handler);
+
+    /**
+     * @brief Registers a coroutine handler for one method and a path prefix.
+     */
+    void prefixTask(HttpMethod method, std::string_view prefix, TaskHandler handler);
+
+    /**
+     * @brief Registers a streaming-body handler for one method and a path prefix.
+     */
+    void prefixBody(HttpMethod method, std::string_view prefix, BodyHandler handler);
+
+    /**
+     * @brief If the request's route streams its body, opens the sink for it.
+     * @return null when no route matched or the route wants the body buffered.
+     */
+    std::unique_ptr<BodySink> openBody(const HttpRequest& request) const;
+
+    /**
+     * @brief Finds the route for a request and runs it.
+     *
+     * A streaming route is given the already buffered body in one piece. A coroutine route
+     * runs until it finishes or first suspends; in the latter case its Task is moved to
+     * 'suspended' and the caller keeps it until it is done.
+     * @return false if no route matched; nothing was sent then.
+     */
+    bool dispatch(const HttpRequest& request, HttpResponse& response, Task<void>& suspended) const;
+
+    /**
+     * @brief Names of the registered routes, indexed by the id each got in registration order.
+     *
+     * Responses are tagged with their route's id (HttpResponse::setRoute()) for metrics.
+     */
+    const std::vector<RouteLabel>& labels() const { return route_labels; }
+
+private:
+    // What a route runs; exactly one of the three is set.
+    struct Route {
+        Handler handler;
+        TaskHandler task;
+        BodyHandler body;
+        size_t id = 0;      // Index into route_labels.
+
+        explicit operator bool() const { return handler || task || body; }
+    };
+
+    // Per-method routes, indexed by HttpMethod; empty slots have no handler set.
+    using MethodTable = std::array<Route, HTTP_METHOD_COUNT>;
+
+    // A tree node. The edge leading to it is labelled with 'label'; its children are keyed by
+    // the first byte of their labels, so at most one child can continue a given path.
+    struct Node {
+        std::string label;
+        std::vector<std::pair<char, std::unique_ptr<Node>>> children;
+        std::unique_ptr<MethodTable> exact;     // Routes ending exactly at this node.
+        std::unique_ptr<MethodTable> prefix;    // Routes matching this node's path and beyond.
+
+        Node* child(char first) const;
+    };
+
+    Node root;
+    std::vector<RouteLabel> route_labels;
+
+    // Finds or creates the node for path, splitting edges as needed.
+    Node& insert(std::string_view path);
+    void add(bool is_prefix, HttpMethod method, std::string_view path, Route route);
+
+    // The best route for a request, or null; 'tail' is set to the path after its prefix.
+    const Route* find(const HttpRequest& request, std::string_view& tail) const;
+};
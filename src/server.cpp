@@ -1,19 +1,233 @@
 #include "http-server.hpp"
 
+#include <csignal>
+
+// Parses a strictly positive integer option value, exiting with a message if it is malformed.
+static int parsePositive(const std::string& flag, const std::string& value) {
+    try {
+        int n = std::stoi(value);
+        if (n > 0) return n;
+    } catch (const std::exception&) {}
+    std::cerr << flag << " expects a positive integer, got '" << value << "'\n";
+    exit(1);
+}
+
+// Like parsePositive(), but also accepts 0 (e.g. to turn a feature off).
+static int parseCount(const std::string& flag, const std::string& value) {
+    return value == "0" ? 0 : parsePositive(flag, value);
+}
+
+// Parses an 'on' or 'off' option value, exiting with a message otherwise.
+static bool parseSwitch(const std::string& flag, const std::string& value) {
+    if (value == "on") return true;
+    if (value == "off") return false;
+    std::cerr << "Unknown " << flag << " value '" << value << "' (expected 'on' or 'off')\n";
+    exit(1);
+}
+
+// Sets the option 'flag' (e.g. "--backlog") to 'value'; false if there is no such option.
+// Exits with a message if the value is not one the option takes.
+static bool applyOption(ServerConfig& config, const std::string& flag, const std::string& value) {
+    if (flag == "--directory") {
+        config.base_dir = value;
+    }
+    else if (flag == "--bundle") {
+        config.bundle_path = value;
+    }
+    else if (flag == "--mode") {
+        if (value == "reactor") {
+            config.mode = ServerMode::Reactor;
+        } else if (value == "threads") {
+            config.mode = ServerMode::Threads;
+        } else {
+            std::cerr << "Unknown mode '" << value << "' (expected 'threads' or 'reactor')\n";
+            exit(1);
+        }
+    }
+    else if (flag == "--workers") {
+        // Running several workers only makes sense with event loops.
+        config.workers = parsePositive(flag, value);
+        config.mode = ServerMode::Reactor;
+    }
+    else if (flag == "--backlog") {
+        config.backlog = parsePositive(flag, value);
+    }
+    else if (flag == "--threads") {
+        config.pool_threads = parsePositive(flag, value);
+    }
+    else if (flag == "--queue") {
+        config.max_queued = parsePositive(flag, value);
+    }
+    else if (flag == "--gzip-min") {
+        config.gzip_min_bytes = parsePositive(flag, value);
+    }
+    else if (flag == "--max-body-mb") {
+        config.max_body_bytes = static_cast<size_t>(parsePositive(flag, value)) << 20;
+    }
+    else if (flag == "--buffer-memory-mb") {
+        config.buffer_memory_bytes = static_cast<size_t>(parseCount(flag, value)) << 20;
+    }
+    else if (flag == "--idle-timeout") {
+        config.timeouts.idle = parseCount(flag, value);
+    }
+    else if (flag == "--header-timeout") {
+        config.timeouts.header = parseCount(flag, value);
+    }
+    else if (flag == "--body-timeout") {
+        config.timeouts.body = parseCount(flag, value);
+    }
+    else if (flag == "--drain-timeout") {
+        config.drain_timeout = parseCount(flag, value);
+    }
+    else if (flag == "--max-connections") {
+        config.admission.max_connections = parseCount(flag, value);
+    }
+    else if (flag == "--rate-limit") {
+        config.admission.rate = parseCount(flag, value);
+    }
+    else if (flag == "--rate-burst") {
+        config.admission.burst = parsePositive(flag, value);
+        if (config.admission.burst > RateLimiter::MAX_BURST) {
+            std::cerr << flag << " is at most " << RateLimiter::MAX_BURST << "\n";
+            exit(1);
+        }
+    }
+    else if (flag == "--keepalive-requests") {
+        config.keepalive_requests = parseCount(flag, value);
+    }
+    else if (flag == "--file-io") {
+        if (value == "uring") {
+            config.io_uring = true;
+        } else if (value == "threads") {
+            config.io_uring = false;
+        } else {
+            std::cerr << "Unknown file I/O backend '" << value << "' (expected 'uring' or 'threads')\n";
+            exit(1);
+        }
+    }
+    else if (flag == "--http2") {
+        config.http2 = parseSwitch(flag, value);
+    }
+    else if (flag == "--cache-mb") {
+        config.file_cache_bytes = static_cast<size_t>(parseCount(flag, value)) << 20;
+    }
+    else if (flag == "--access-log") {
+        config.access_log.path = value;
+    }
+    else if (flag == "--access-log-max-mb") {
+        config.access_log.max_bytes = static_cast<size_t>(parseCount(flag, value)) << 20;
+    }
+    else if (flag == "--access-log-sample") {
+        config.access_log.sample = parsePositive(flag, value);
+    }
+    else if (flag == "--tls-cert") {
+        config.tls.cert_path = value;
+    }
+    else if (flag == "--tls-key") {
+        config.tls.key_path = value;
+    }
+    else if (flag == "--tcp-nodelay") {
+        config.sockets.no_delay = parseSwitch(flag, value);
+    }
+    else if (flag == "--defer-accept") {
+        config.sockets.defer_accept = parseCount(flag, value);
+    }
+    else if (flag == "--fast-open") {
+        config.sockets.fast_open = parseCount(flag, value);
+    }
+    else if (flag == "--send-buffer-kb") {
+        config.sockets.send_buffer = parseCount(flag, value) * 1024;
+    }
+    else if (flag == "--receive-buffer-kb") {
+        config.sockets.receive_buffer = parseCount(flag, value) * 1024;
+    }
+    else if (flag == "--busy-poll") {
+        config.sockets.busy_poll = parseCount(flag, value);
+    }
+    else if (flag == "--accept-batch") {
+        config.sockets.accept_batch = parsePositive(flag, value);
+    }
+    else if (flag == "--cpus") {
+        if (!parseCpuList(value, config.cpus)) {
+            std::cerr << flag << " expects a CPU list such as '0-3,8', got '" << value << "'\n";
+            exit(1);
+        }
+    }
+    else if (flag == "--steer-connections") {
+        config.steer_connections = parseSwitch(flag, value);
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+// Applies a config file: one option per line, its name without the leading "--", then
+// whitespace and the value, which runs to the end of the line. Blank lines and lines
+// starting with '#' are skipped. Exits with a message on a line it can't apply.
+static void applyConfigFile(ServerConfig& config, const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Cannot read config file '" << path << "'\n";
+        exit(1);
+    }
+    constexpr std::string_view SPACE = " \t\r";
+    std::string line;
+    for (unsigned number = 1; std::getline(file, line); ++number) {
+        size_t start = line.find_first_not_of(SPACE);
+        if (start == std::string::npos || line[start] == '#') continue;
+        size_t name_end = std::min(line.find_first_of(SPACE, start), line.size());
+        size_t value_start = line.find_first_not_of(SPACE, name_end);
+        std::string name = line.substr(start, name_end - start);
+        if (value_start == std::string::npos) {
+            std::cerr << path << ":" << number << ": '" << name << "' has no value\n";
+            exit(1);
+        }
+        size_t value_end = line.find_last_not_of(SPACE) + 1;
+        std::string value = line.substr(value_start, value_end - value_start);
+        if (!applyOption(config, "--" + name, value)) {
+            std::cerr << path << ":" << number << ": unknown option '" << name << "'\n";
+            exit(1);
+        }
+    }
+}
+
 int main(int argc, char **argv){
 
     // Flush after every std::cout / std::cerr
     std::cout << std::unitbuf;
     std::cerr << std::unitbuf;
 
-    std::string base_dir = ".";
-    if (argc == 3 && std::string(argv[1]) == "--directory") {
-    base_dir = argv[2];
+    // sendfile() has no MSG_NOSIGNAL; a client that disconnects mid-download must surface as
+    // EPIPE on the write, not terminate the server.
+    signal(SIGPIPE, SIG_IGN);
+
+    // Options apply in order, so those after '--config' override the file's. As in a config
+    // file, one that is misspelt or lacks its value stops the server rather than being
+    // dropped.
+    ServerConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (!arg.starts_with("--")) {
+            std::cerr << "Unknown option '" << arg << "'\n";
+            exit(1);
+        }
+        if (i + 1 == argc) {
+            std::cerr << "Option '" << arg << "' has no value\n";
+            exit(1);
+        }
+        std::string value = argv[++i];
+        if (arg == "--config") {
+            applyConfigFile(config, value);
+        } else if (!applyOption(config, arg, value)) {
+            std::cerr << "Unknown option '" << arg << "'\n";
+            exit(1);
+        }
     }
 
-    HttpServer server(base_dir);
+    HttpServer server(config);
     server.start();
 
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,233 @@
+#include "simd-scan.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+
+namespace {
+
+// One implementation of every scan.
+struct Kernels {
+    size_t (*header_end)(const char* data, size_t from, size_t length);
+    const char* (*find_either)(const char* p, const char* end, char a, char b);
+    void (*lowercase)(char* data, size_t length);
+};
+
+
+size_t headerEndScalar(const char* data, size_t from, size_t length) {
+    const char* p = data + from;
+    const char* end = data + length;
+    while (end - p >= 4) {
+        // Jump to the next '\r' rather than testing every position.
+        p = static_cast<const char*>(std::memchr(p, '\r', (end - p) - 3));
+        if (!p) break;
+        if (p[1] == '\n' && p[2] == '\r' && p[3] == '\n') return (p - data) + 4;
+        ++p;
+    }
+    return std::string_view::npos;
+}
+
+const char* findEitherScalar(const char* p, const char* end, char a, char b) {
+    for (; p < end; ++p) {
+        if (*p == a || *p == b) return p;
+    }
+    return end;
+}
+
+void lowercaseScalar(char* data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        char c = data[i];
+        if (c >= 'A' && c <= 'Z') data[i] = c | 0x20;
+    }
+}
+
+constexpr Kernels SCALAR = {headerEndScalar, findEitherScalar, lowercaseScalar};
+
+
+#ifdef HAVE_X86_KERNELS
+
+// The vector loops stop where a full step would read past the end; the scalar code finishes.
+
+// Bit i of 'candidates' says p[i] == '\r' and p[i + 3] == '\n'; the middle two bytes are
+// checked only for those, since a head has one CR per line and most lines are longer than a step.
+inline size_t confirmHeaderEnd(const char* data, const char* p, uint32_t candidates) {
+    for (; candidates; candidates &= candidates - 1) {
+        const char* at = p + __builtin_ctz(candidates);
+        if (at[1] == '\n' && at[2] == '\r') return (at - data) + 4;
+    }
+    return std::string_view::npos;
+}
+
+__attribute__((target("sse4.2")))
+size_t headerEndSse42(const char* data, size_t from, size_t length) {
+    const char* p = data + from;
+    const char* end = data + length;
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    for (; end - p >= 16 + 3; p += 16) {
+        __m128i match = _mm_and_si128(
+            _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), cr),
+            _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 3)), lf));
+        uint32_t candidates = _mm_movemask_epi8(match);
+        if (candidates) {
+            size_t found = confirmHeaderEnd(data, p, candidates);
+            if (found != std::string_view::npos) return found;
+        }
+    }
+    return headerEndScalar(data, p - data, length);
+}
+
+__attribute__((target("sse4.2")))
+const char* findEitherSse42(const char* p, const char* end, char a, char b) {
+    // PCMPESTRI compares against every byte of a set at once; the set here is {a, b}.
+    const __m128i set = _mm_setr_epi8(a, b, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    constexpr int MODE = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT;
+    for (; end - p >= 16; p += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int index = _mm_cmpestri(set, 2, chunk, 16, MODE);
+        if (index < 16) return p + index;
+    }
+    return findEitherScalar(p, end, a, b);
+}
+
+__attribute__((target("sse4.2")))
+void lowercaseSse42(char* data, size_t length) {
+    // Signed compares: bytes of 0x80 and up are negative, so they are never taken for letters.
+    const __m128i before_a = _mm_set1_epi8('A' - 1);
+    const __m128i after_z = _mm_set1_epi8('Z' + 1);
+    const __m128i bit = _mm_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i* at = reinterpret_cast<__m128i*>(data + i);
+        __m128i v = _mm_loadu_si128(at);
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, before_a), _mm_cmpgt_epi8(after_z, v));
+        _mm_storeu_si128(at, _mm_or_si128(v, _mm_and_si128(upper, bit)));
+    }
+    lowercaseScalar(data + i, length - i);
+}
+
+constexpr Kernels SSE42 = {headerEndSse42, findEitherSse42, lowercaseSse42};
+
+
+__attribute__((target("avx2")))
+size_t headerEndAvx2(const char* data, size_t from, size_t length) {
+    const char* p = data + from;
+    const char* end = data + length;
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    for (; end - p >= 32 + 3; p += 32) {
+        __m256i match = _mm256_and_si256(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), cr),
+            _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 3)), lf));
+        uint32_t candidates = _mm256_movemask_epi8(match);
+        if (candidates) {
+            size_t found = confirmHeaderEnd(data, p, candidates);
+            if (found != std::string_view::npos) return found;
+        }
+    }
+    return headerEndSse42(data, p - data, length);
+}
+
+__attribute__((target("avx2")))
+const char* findEitherAvx2(const char* p, const char* end, char a, char b) {
+    const __m256i first = _mm256_set1_epi8(a);
+    const __m256i second = _mm256_set1_epi8(b);
+    for (; end - p >= 32; p += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, first),
+                                                             _mm256_cmpeq_epi8(chunk, second)));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return findEitherSse42(p, end, a, b);
+}
+
+__attribute__((target("avx2")))
+void lowercaseAvx2(char* data, size_t length) {
+    const __m256i before_a = _mm256_set1_epi8('A' - 1);
+    const __m256i after_z = _mm256_set1_epi8('Z' + 1);
+    const __m256i bit = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i* at = reinterpret_cast<__m256i*>(data + i);
+        __m256i v = _mm256_loadu_si256(at);
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, before_a), _mm256_cmpgt_epi8(after_z, v));
+        _mm256_storeu_si256(at, _mm256_or_si256(v, _mm256_and_si256(upper, bit)));
+    }
+    lowercaseSse42(data + i, length - i);
+}
+
+constexpr Kernels AVX2 = {headerEndAvx2, findEitherAvx2, lowercaseAvx2};
+
+#endif
+
+
+bool supported(ScanKernel kernel) {
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();   // We may run from a static initializer, before libgcc's own.
+    switch (kernel) {
+        case ScanKernel::Scalar: return true;
+        case ScanKernel::Sse42:  return __builtin_cpu_supports("sse4.2");
+        case ScanKernel::Avx2:   return __builtin_cpu_supports("avx2");
+    }
+    return false;
+#else
+    return kernel == ScanKernel::Scalar;
+#endif
+}
+
+const Kernels& kernelsFor(ScanKernel kernel) {
+#ifdef HAVE_X86_KERNELS
+    if (kernel == ScanKernel::Avx2) return AVX2;
+    if (kernel == ScanKernel::Sse42) return SSE42;
+#endif
+    return SCALAR;
+}
+
+ScanKernel active_kernel = bestScanKernel();
+const Kernels* active = &kernelsFor(active_kernel);
+
+}
+
+
+ScanKernel bestScanKernel() {
+    if (supported(ScanKernel::Avx2)) return ScanKernel::Avx2;
+    if (supported(ScanKernel::Sse42)) return ScanKernel::Sse42;
+    return ScanKernel::Scalar;
+}
+
+ScanKernel activeScanKernel() {
+    return active_kernel;
+}
+
+bool selectScanKernel(ScanKernel kernel) {
+    if (!supported(kernel)) return false;
+    active_kernel = kernel;
+    active = &kernelsFor(kernel);
+    return true;
+}
+
+std::string_view scanKernelName(ScanKernel kernel) {
+    switch (kernel) {
+        case ScanKernel::Scalar: return "scalar";
+        case ScanKernel::Sse42:  return "sse4.2";
+        case ScanKernel::Avx2:   return "avx2";
+    }
+    return {};
+}
+
+size_t findHeaderEnd(const char* data, size_t from, size_t length) {
+    return active->header_end(data, from, length);
+}
+
+const char* findEither(const char* p, const char* end, char a, char b) {
+    return active->find_either(p, end, a, b);
+}
+
+void lowercaseInPlace(char* data, size_t length) {
+    active->lowercase(data, length);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+
+/**
+ * Byte-scanning kernels behind the request parser, in the widest variant the CPU supports.
+ *
+ * Scalar - portable loops; the fallback on any CPU.
+ * Sse42  - 16 bytes per step, with PCMPESTRI to match a set of delimiters.
+ * Avx2   - 32 bytes per step.
+ *
+ * The best variant is picked once at startup with CPUID; selectScanKernel() overrides it,
+ * which the microbenchmarks use to compare them. Every variant gives the same results.
+ */
+enum class ScanKernel { Scalar, Sse42, Avx2 };
+
+/**
+ * @brief The widest kernel this CPU can run.
+ */
+ScanKernel bestScanKernel();
+
+/**
+ * @brief The kernel in use.
+ */
+ScanKernel activeScanKernel();
+
+/**
+ * @brief Switches every scan to 'kernel'; false (and no change) if the CPU lacks it.
+ *
+ * Not synchronized: call it before any thread starts parsing.
+ */
+bool selectScanKernel(ScanKernel kernel);
+
+std::string_view scanKernelName(ScanKernel kernel);
+
+/**
+ * @brief Offset just past the first "\r\n\r\n" at or after 'from' in data[0, length), or npos.
+ */
+size_t findHeaderEnd(const char* data, size_t from, size_t length);
+
+/**
+ * @brief The first byte in [p, end) equal to a or to b, or end if there is none.
+ */
+const char* findEither(const char* p, const char* end, char a, char b);
+
+/**
+ * @brief Lowercases ASCII letters in place; other bytes are left untouched.
+ */
+void lowercaseInPlace(char* data, size_t length);
@@ -0,0 +1,48 @@
+#include "socket-options.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+static void setOption(int fd, int level, int name, int value, const char* label) {
+    if (setsockopt(fd, level, name, &value, sizeof(value)) != 0) {
+        std::cerr << "setsockopt(" << label << ", " << value << ") failed: " << strerror(errno)
+                  << "\n";
+        exit(1);
+    }
+}
+
+void applySocketOptions(int listen_fd, const SocketOptions& options) {
+    // Responses leave in as few writes as the OutputQueue can manage, each but the last of a
+    // flush marked MSG_MORE. What is left to send at the end of a flush is wanted now: with
+    // Nagle, it would wait for the client to ACK the previous segment, which it may delay by
+    // up to 40ms.
+    setOption(listen_fd, IPPROTO_TCP, TCP_NODELAY, options.no_delay, "TCP_NODELAY");
+
+    // Clients send first, so a connection is no use until its request arrives. Deferred,
+    // accept() skips connections that have sent nothing yet, or are never going to.
+    setOption(listen_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, static_cast<int>(options.defer_accept),
+              "TCP_DEFER_ACCEPT");
+
+    // A returning client can put its request in the SYN, saving a round trip.
+    setOption(listen_fd, IPPROTO_TCP, TCP_FASTOPEN, static_cast<int>(options.fast_open),
+              "TCP_FASTOPEN");
+
+    // The kernel caps these at net.core.wmem_max and rmem_max, and doubles them for its
+    // bookkeeping; a receive buffer set before listen() also sizes the window scaling.
+    if (options.send_buffer) {
+        setOption(listen_fd, SOL_SOCKET, SO_SNDBUF, options.send_buffer, "SO_SNDBUF");
+    }
+    if (options.receive_buffer) {
+        setOption(listen_fd, SOL_SOCKET, SO_RCVBUF, options.receive_buffer, "SO_RCVBUF");
+    }
+
+    // Spinning on the device queue trades CPU for wake-up latency on blocking reads (threads
+    // mode), and for epoll_wait() where net.core.busy_poll is set. More than
+    // net.core.busy_read needs CAP_NET_ADMIN.
+    setOption(listen_fd, SOL_SOCKET, SO_BUSY_POLL, static_cast<int>(options.busy_poll),
+              "SO_BUSY_POLL");
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+
+/**
+ * @struct SocketOptions
+ * @brief TCP tuning for the listening sockets, filled in from the command line or a config
+ * file.
+ *
+ * Everything here is set on the listeners, before or while they listen; Linux copies a
+ * listener's options to each socket accept() returns, so tuning costs no system call per
+ * connection.
+ */
+struct SocketOptions {
+    bool no_delay = true;           // TCP_NODELAY: output is already coalesced with MSG_MORE.
+    unsigned defer_accept = 0;      // TCP_DEFER_ACCEPT, seconds: wake accept() on data (0: off).
+    unsigned fast_open = 0;         // TCP_FASTOPEN queue length: data in the SYN (0: off).
+    int send_buffer = 0;            // SO_SNDBUF, bytes (0: kernel autotuning).
+    int receive_buffer = 0;         // SO_RCVBUF, bytes (0: kernel autotuning).
+    unsigned busy_poll = 0;         // SO_BUSY_POLL, microseconds spun before sleeping (0: off).
+    unsigned accept_batch = 64;     // Connections accepted per wakeup before serving others.
+};
+
+/**
+ * @brief Applies the options to a listening socket, for the connections accepted from it.
+ *
+ * Options left at their defaults are set too, so a listener inherited from a previous
+ * process (see receiveListeners()) loses tuning the new configuration dropped; buffer sizes
+ * are the exception, since there is no way back to autotuning once one is set. Exits with a
+ * message if the kernel refuses an option.
+ */
+void applySocketOptions(int listen_fd, const SocketOptions& options);
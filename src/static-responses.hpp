@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+
+
+/**
+ * Every status code the server produces, as X(code, reason phrase).
+ *
+ * Add a status here and it gets a status line and prebuilt empty-bodied responses below.
+ */
+#define HTTP_STATUSES(X)                            \
+    X(200, "OK")                                    \
+    X(201, "Created")                               \
+    X(206, "Partial Content")                       \
+    X(304, "Not Modified")                          \
+    X(400, "Bad Request")                           \
+    X(404, "Not Found")                             \
+    X(408, "Request Timeout")                       \
+    X(413, "Content Too Large")                     \
+    X(416, "Range Not Satisfiable")                 \
+    X(431, "Request Header Fields Too Large")       \
+    X(500, "Internal Server Error")                 \
+    X(501, "Not Implemented")                       \
+    X(503, "Service Unavailable")
+
+
+/**
+ * @struct StatusEntry
+ * @brief The compile-time text of one status: its status line and complete bodiless responses.
+ *
+ * The responses are string literals in read-only memory, so sending one is just handing a
+ * pointer to the OutputQueue: nothing is formatted, copied or allocated.
+ */
+struct StatusEntry {
+    int code;
+    std::string_view text;          // "404 Not Found", for building heads with a body.
+    std::string_view head;          // Status line and Content-Length, for adding connection headers.
+    std::string_view keep_alive;    // Full response with 'Connection: keep-alive'.
+    std::string_view close;         // Full response with 'Connection: close'.
+};
+
+#define HTTP_STATUS_ENTRY(code, reason)                                                     \
+    StatusEntry{code, #code " " reason,                                                     \
+                "HTTP/1.1 " #code " " reason "\r\nContent-Length: 0\r\n",                   \
+                "HTTP/1.1 " #code " " reason "\r\nContent-Length: 0\r\nConnection: keep-alive\r\n\r\n", \
+                "HTTP/1.1 " #code " " reason "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"},
+
+inline constexpr StatusEntry STATUS_TABLE[] = { HTTP_STATUSES(HTTP_STATUS_ENTRY) };
+inline constexpr size_t STATUS_COUNT = std::size(STATUS_TABLE);
+
+#undef HTTP_STATUS_ENTRY
+
+
+/**
+ * @brief Looks up a status; unknown codes map to 500.
+ *
+ * constexpr, so with a constant argument the lookup folds away at compile time.
+ */
+constexpr const StatusEntry& statusEntry(int code) {
+    for (const StatusEntry& entry : STATUS_TABLE) {
+        if (entry.code == code) return entry;
+    }
+    return statusEntry(500);
+}
+
+/**
+ * @brief Position of a status in STATUS_TABLE, e.g. to index per-status counters.
+ */
+constexpr size_t statusIndex(int code) {
+    return &statusEntry(code) - STATUS_TABLE;
+}
+
+static_assert(statusEntry(404).keep_alive ==
+              "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: keep-alive\r\n\r\n");
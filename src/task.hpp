@@ -0,0 +1,139 @@
+#pragma once
+
+#include "arena.hpp"
+
+#include <cstddef>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <utility>
+
+
+// Holds what a Task's coroutine co_returns.
+template <typename T>
+struct TaskResult {
+    std::optional<T> value;
+
+    void return_value(T result) { value.emplace(std::move(result)); }
+    T take() { return std::move(*value); }
+};
+
+template <>
+struct TaskResult<void> {
+    void return_void() {}
+    void take() {}
+};
+
+
+/**
+ * @class Task
+ * @brief A lazily started coroutine, used for request handlers that wait for I/O.
+ *
+ * A handler written as a coroutine reads top to bottom, 'co_await'ing file reads (see
+ * ReadFile) where a plain handler would block. On an event loop an await suspends the
+ * handler and the loop serves other connections until the read completes; on a blocking
+ * thread the awaitables complete inline, so the same code simply runs to the end.
+ *
+ * A Task owns its coroutine frame and destroys it with itself, also while suspended: a
+ * connection that closes mid-request just drops its Task. Tasks can await each other; the
+ * awaiting one is resumed when the awaited one finishes. The outermost Task is started with
+ * start() and reports its end through onDone(). Exceptions are not used in this code base,
+ * so one escaping a coroutine terminates the process.
+ *
+ * A Task created while an Arena is current (see Arena::Scope) keeps its frame in that arena,
+ * which must then outlive the Task.
+ */
+template <typename T = void>
+class Task {
+public:
+    struct promise_type : TaskResult<T> {
+        std::coroutine_handle<> continuation;   // A Task awaiting this one.
+        std::function<void()> on_done;          // For the outermost Task; see onDone().
+
+        Task get_return_object() { return Task(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> self) noexcept {
+                promise_type& promise = self.promise();
+                if (promise.continuation) return promise.continuation;
+                if (promise.on_done) promise.on_done();
+                return std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void unhandled_exception() noexcept { std::terminate(); }
+
+        // Frames go into the current request's arena when there is one. A header in front of
+        // the frame records which, since the arena releases memory only on reset.
+        static constexpr size_t FRAME_HEADER = alignof(std::max_align_t);
+
+        static void* operator new(size_t size) {
+            Arena* arena = Arena::current();
+            void* memory = arena ? arena->allocate(FRAME_HEADER + size, alignof(std::max_align_t))
+                                 : ::operator new(FRAME_HEADER + size);
+            *static_cast<Arena**>(memory) = arena;
+            return static_cast<char*>(memory) + FRAME_HEADER;
+        }
+        static void operator delete(void* frame) {
+            void* memory = static_cast<char*>(frame) - FRAME_HEADER;
+            if (!*static_cast<Arena**>(memory)) ::operator delete(memory);
+        }
+    };
+
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Task() = default;
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle) handle.destroy();
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    ~Task() {
+        if (handle) handle.destroy();
+    }
+
+    // An empty Task stands for work that already finished.
+    explicit operator bool() const { return static_cast<bool>(handle); }
+    bool done() const { return !handle || handle.done(); }
+
+    /**
+     * @brief Runs the coroutine until it first suspends or finishes.
+     */
+    void start() { handle.resume(); }
+
+    /**
+     * @brief Sets what to call when a started, suspended Task finishes.
+     *
+     * It runs inside the coroutine's final suspension, so it must not destroy the Task;
+     * it should only note that the Task can be dropped now.
+     */
+    void onDone(std::function<void()> done) { handle.promise().on_done = std::move(done); }
+
+    // Awaiting a Task starts it and resumes the awaiting coroutine when it is finished.
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            Handle handle;
+
+            bool await_ready() noexcept { return handle.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> waiter) noexcept {
+                handle.promise().continuation = waiter;
+                return handle;
+            }
+            T await_resume() { return handle.promise().take(); }
+        };
+        return Awaiter{handle};
+    }
+
+private:
+    Handle handle;
+
+    explicit Task(Handle handle) : handle(handle) {}
+};
@@ -0,0 +1,81 @@
+#include "thread-pool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads, size_t max_queued, std::function<void(size_t)> on_start)
+    : free_slots(static_cast<std::ptrdiff_t>(std::max<size_t>(1, max_queued))) {
+    threads = std::max<size_t>(1, threads);
+    for (size_t i = 0; i < threads; ++i) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([this, i, on_start] {
+            if (on_start) on_start(i);
+            workerLoop(i);
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    stopping = true;
+    // Wake every worker; each one drains what is left and then sees 'stopping'.
+    ready.release(static_cast<std::ptrdiff_t>(workers.size()));
+    for (auto& t : workers) {
+        t.join();
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    free_slots.acquire();   // Blocks the submitter (the accept loop) while the pool is saturated.
+    push(std::move(task));
+}
+
+void ThreadPool::push(Task task) {
+    size_t index = next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    ready.release();
+}
+
+// Pops from the front of our own deque, otherwise steals from the back of the others'.
+bool ThreadPool::take(size_t self, Task& task) {
+    {
+        WorkQueue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); ++i) {
+        WorkQueue& victim = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t self) {
+    while (true) {
+        ready.acquire();
+
+        // Every acquired 'ready' is backed by a queued task, but another worker may have stolen
+        // from a deque we already scanned, so keep looking until we find ours.
+        Task task;
+        bool found = false;
+        while (!(found = take(self, task)) && !stopping) {
+            std::this_thread::yield();
+        }
+        if (!found) return;     // Woken only to shut down, and nothing is left.
+
+        free_slots.release();
+        task();
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <thread>
+#include <vector>
+
+
+/**
+ * @class ThreadPool
+ * @brief A fixed-size pool of worker threads with per-worker deques and work stealing.
+ *
+ * Tasks are spread round-robin over the workers' deques. A worker takes from the front of its
+ * own deque and, when that is empty, steals from the back of another worker's, so one slow task
+ * (say, a large /files/ read) never strands the tasks queued behind it.
+ *
+ * The number of waiting tasks is bounded: submit() blocks once the limit is reached. Used by the
+ * accept loop, this turns a connection spike into back-pressure on the listen backlog instead of
+ * an ever-growing number of threads.
+ */
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    /**
+     * @brief Starts the worker threads.
+     * @param threads Number of workers (at least one).
+     * @param max_queued Maximum number of tasks waiting for a worker before submit() blocks.
+     * @param on_start Run by each worker, with its index, before it takes any task (e.g. to
+     *                 set its affinity).
+     */
+    ThreadPool(size_t threads, size_t max_queued, std::function<void(size_t)> on_start = {});
+
+    /**
+     * @brief Lets the workers finish the tasks already queued, then joins them.
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Queues a task, blocking while the queue is full.
+     */
+    void submit(Task task);
+
+    size_t size() const { return workers.size(); }
+
+private:
+    // One worker's deque. Each has its own lock so submitters and thieves rarely collide.
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;     // queues[i] belongs to workers[i].
+    std::vector<std::thread> workers;
+    std::counting_semaphore<> free_slots;   // Room left in the bounded queue.
+    std::counting_semaphore<> ready{0};     // Tasks pushed but not yet claimed by a worker.
+    std::atomic<size_t> next_queue{0};      // Round-robin cursor for submit().
+    std::atomic<bool> stopping{false};
+
+    void push(Task task);                       // Places a task after a slot was reserved.
+    bool take(size_t self, Task& task);         // Own queue first, then steal.
+    void workerLoop(size_t self);
+};
@@ -0,0 +1,91 @@
+#include "timer-wheel.hpp"
+
+#include <algorithm>
+#include <bit>
+
+
+TimerWheel::TimerWheel() : start(Clock::now()) {}
+
+uint64_t TimerWheel::tickAt(Clock::time_point when) const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(when - start) / TICK;
+}
+
+void TimerWheel::schedule(Timer& timer, std::chrono::milliseconds delay) {
+    cancel(timer);
+    // Round up, plus one for the part of the current tick that has already passed, so a timer
+    // never fires early. That also keeps it out of a slot advance() may be running.
+    uint64_t ticks = (delay + TICK - std::chrono::milliseconds(1)) / TICK + 1;
+    // Count from the real time, not 'current': the loop may not have advanced for a while.
+    timer.expires = std::max(tickAt(Clock::now()), current) + ticks;
+    link(timer);
+    ++count;
+}
+
+void TimerWheel::cancel(Timer& timer) {
+    if (timer.armed()) unlink(timer);
+}
+
+void TimerWheel::link(Timer& timer) {
+    uint64_t delta = timer.expires > current ? timer.expires - current : 0;
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (uint64_t(1) << (SLOT_BITS * (level + 1)))) {
+        ++level;
+    }
+    uint64_t expires = std::min(timer.expires, current + (uint64_t(1) << (SLOT_BITS * LEVELS)) - 1);
+    int slot = (expires >> (SLOT_BITS * level)) & (SLOTS - 1);
+
+    timer.level = level;
+    timer.slot = slot;
+    timer.prev = nullptr;
+    timer.next = slots[level][slot];
+    if (timer.next) timer.next->prev = &timer;
+    slots[level][slot] = &timer;
+    occupied[level] |= uint64_t(1) << slot;
+}
+
+void TimerWheel::unlink(Timer& timer) {
+    if (timer.prev) {
+        timer.prev->next = timer.next;
+    } else {
+        slots[timer.level][timer.slot] = timer.next;
+        if (!timer.next) occupied[timer.level] &= ~(uint64_t(1) << timer.slot);
+    }
+    if (timer.next) timer.next->prev = timer.prev;
+    timer.prev = timer.next = nullptr;
+    timer.level = -1;
+    --count;
+}
+
+void TimerWheel::cascade() {
+    for (int level = 1; level < LEVELS; ++level) {
+        // Level 'level' only turns over when every level below it has wrapped.
+        if (current & ((uint64_t(1) << (SLOT_BITS * level)) - 1)) return;
+        int slot = (current >> (SLOT_BITS * level)) & (SLOTS - 1);
+        Timer* timer = slots[level][slot];
+        slots[level][slot] = nullptr;
+        occupied[level] &= ~(uint64_t(1) << slot);
+        while (timer) {
+            Timer* next = timer->next;
+            link(*timer);   // Lands on a lower level now that it is closer.
+            timer = next;
+        }
+    }
+}
+
+int TimerWheel::nextTimeoutMs() const {
+    if (count == 0) return -1;
+
+    uint64_t ticks;
+    int index = current & (SLOTS - 1);
+    // Level 0 slots after the current one, wrapping round; the current slot was already run.
+    uint64_t ahead = std::rotr(occupied[0], index + 1);
+    if (ahead) {
+        ticks = std::countr_zero(ahead) + 1;
+    } else {
+        ticks = SLOTS - index;  // Nothing on level 0: wake for the next cascade.
+    }
+
+    auto due = start + TICK * (current + ticks);
+    auto wait = std::chrono::ceil<std::chrono::milliseconds>(due - Clock::now()).count();
+    return static_cast<int>(std::max<decltype(wait)>(0, wait));
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+
+/**
+ * @class TimerWheel
+ * @brief Hierarchical timing wheel for per-connection timeouts on an event loop.
+ *
+ * Time advances in fixed ticks. Each of the LEVELS wheels has SLOTS slots; level 0 holds the
+ * timers due within SLOTS ticks, one slot per tick, and every higher level covers SLOTS times
+ * the span of the one below. When level 0 wraps around, the next slot of level 1 is cascaded
+ * down into it (and so on upwards), so each timer moves at most LEVELS - 1 times.
+ *
+ * Timers are intrusive doubly linked list nodes owned by the caller (one per connection), so
+ * schedule() and cancel() are O(1) and never allocate. They fire up to one tick late, never
+ * early. A wheel belongs to one thread.
+ */
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::milliseconds TICK{100};
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int SLOTS = 1 << SLOT_BITS;
+    static constexpr int LEVELS = 4;    // Reaches 2^24 ticks ahead, about 19 days.
+
+    /**
+     * @struct Timer
+     * @brief One schedulable timeout. Must be cancelled (or fire) before it is destroyed.
+     */
+    struct Timer {
+        uint64_t id = 0;            // For the owner: tells the expiry callback whose timer it is.
+
+        bool armed() const { return level >= 0; }
+
+    private:
+        friend class TimerWheel;
+        Timer* prev = nullptr;
+        Timer* next = nullptr;
+        uint64_t expires = 0;       // Tick at which it fires.
+        int level = -1;             // Wheel it is linked into; -1 when not scheduled.
+        int slot = 0;
+    };
+
+    TimerWheel();
+
+    /**
+     * @brief (Re)schedules timer to fire after delay, replacing any earlier schedule.
+     */
+    void schedule(Timer& timer, std::chrono::milliseconds delay);
+
+    /**
+     * @brief Unschedules timer; does nothing if it is not armed.
+     */
+    void cancel(Timer& timer);
+
+    /**
+     * @brief Fires every timer due by now, in expiry order, calling expired(timer) for each.
+     *
+     * A timer is disarmed before its callback runs, which may schedule or cancel any timer.
+     */
+    template <typename Callback>
+    void advance(Callback&& expired) {
+        uint64_t target = tickAt(Clock::now());
+        if (count == 0) {
+            current = target;
+            return;
+        }
+        while (current < target && count > 0) {
+            ++current;
+            cascade();
+            int index = current & (SLOTS - 1);
+            while (Timer* timer = slots[0][index]) {
+                unlink(*timer);
+                expired(*timer);
+            }
+        }
+        if (count == 0) current = target;
+    }
+
+    /**
+     * @brief Milliseconds until advance() may have work, for epoll_wait(); -1 if none is armed.
+     *
+     * May be early when the nearest timers are still on an upper level: the wait then ends at
+     * the next cascade, which costs one spurious wake-up.
+     */
+    int nextTimeoutMs() const;
+
+private:
+    Clock::time_point start;
+    uint64_t current = 0;       // Last tick processed.
+    size_t count = 0;           // Armed timers.
+    std::array<std::array<Timer*, SLOTS>, LEVELS> slots{};
+    std::array<uint64_t, LEVELS> occupied{};    // Bit i set when slots[level][i] is non-empty.
+
+    uint64_t tickAt(Clock::time_point when) const;
+    void link(Timer& timer);    // Files an unlinked timer by its expiry.
+    void unlink(Timer& timer);
+    void cascade();             // Moves timers down when the lower levels wrap at 'current'.
+};
@@ -0,0 +1,169 @@
+#include "tls.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/err.h>
+
+// Tells the sessions cached for this server apart from any other's (RFC 5246 7.4.1.2).
+constexpr unsigned char SESSION_ID_CONTEXT[] = "http-server";
+
+// ALPN protocol lists in wire format: length-prefixed names, most preferred first.
+constexpr unsigned char ALPN_HTTP2[] = "\x02h2\x08http/1.1";
+constexpr unsigned char ALPN_HTTP1[] = "\x08http/1.1";
+
+
+// Picks our most preferred protocol the client also offers. Clients offering none of them
+// still get a connection, just without ALPN, as if they had not asked.
+static int selectProtocol(SSL*, const unsigned char** out, unsigned char* out_length,
+                          const unsigned char* offered, unsigned int offered_length, void* arg) {
+    bool http2 = arg != nullptr;
+    const unsigned char* ours = http2 ? ALPN_HTTP2 : ALPN_HTTP1;
+    unsigned int ours_length = (http2 ? sizeof(ALPN_HTTP2) : sizeof(ALPN_HTTP1)) - 1;
+    unsigned char* selected;
+    if (SSL_select_next_proto(&selected, out_length, ours, ours_length, offered, offered_length) !=
+        OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+static void failStartup(const std::string& message) {
+    std::cerr << message;
+    if (unsigned long error = ERR_get_error()) {
+        char text[256];
+        ERR_error_string_n(error, text, sizeof(text));
+        std::cerr << ": " << text;
+    }
+    std::cerr << "\n";
+    exit(1);
+}
+
+
+TlsContext::TlsContext(const TlsOptions& options, bool offer_http2) {
+    ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) failStartup("Failed to create the TLS context");
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+
+    const std::string& key_path = options.key_path.empty() ? options.cert_path : options.key_path;
+    if (SSL_CTX_use_certificate_chain_file(ctx, options.cert_path.c_str()) != 1) {
+        failStartup("Failed to load TLS certificate '" + options.cert_path + "'");
+    }
+    if (SSL_CTX_use_PrivateKey_file(ctx, key_path.c_str(), SSL_FILETYPE_PEM) != 1) {
+        failStartup("Failed to load TLS private key '" + key_path + "'");
+    }
+    if (SSL_CTX_check_private_key(ctx) != 1) {
+        failStartup("TLS private key '" + key_path + "' does not match the certificate");
+    }
+
+    // kTLS where the kernel has it; renegotiation, which kTLS can't follow, is refused.
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION |
+                             SSL_OP_CIPHER_SERVER_PREFERENCE);
+    // flush() offers SSL_write() partial pieces, and retries them from the same buffer.
+    // Idle keep-alive connections give their record buffers back.
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                          SSL_MODE_RELEASE_BUFFERS);
+
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_session_id_context(ctx, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+
+    SSL_CTX_set_alpn_select_cb(ctx, selectProtocol, offer_http2 ? this : nullptr);
+}
+
+TlsContext::~TlsContext() {
+    SSL_CTX_free(ctx);
+}
+
+
+TlsSession::TlsSession(const TlsContext& context, int fd) : ssl(SSL_new(context.get())), fd(fd) {
+    // A socket BIO: kTLS is only set up on the socket OpenSSL itself reads and writes.
+    if (!ssl) return;
+    SSL_set_fd(ssl, fd);
+    SSL_set_accept_state(ssl);
+    // Output is already coalesced into records, each written on its own; with Nagle, the
+    // last of a flush would wait for the client to ACK the others (often delayed by 40ms).
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+TlsSession::~TlsSession() {
+    SSL_free(ssl);
+}
+
+TlsSession::Handshake TlsSession::handshake() {
+    if (!ssl) return Handshake::Failed;
+    int rc = SSL_do_handshake(ssl);
+    if (rc == 1) {
+        is_established = true;
+        kernel_send = BIO_get_ktls_send(SSL_get_wbio(ssl));
+        return Handshake::Done;
+    }
+    int error = SSL_get_error(ssl, rc);
+    ERR_clear_error();
+    if (error == SSL_ERROR_WANT_READ) return Handshake::WantRead;
+    if (error == SSL_ERROR_WANT_WRITE) return Handshake::WantWrite;
+    return Handshake::Failed;
+}
+
+ssize_t TlsSession::receive(char* data, size_t length) {
+    size_t n = 0;
+    if (SSL_read_ex(ssl, data, length, &n) == 1) return static_cast<ssize_t>(n);
+    int error = SSL_get_error(ssl, 0);
+    ERR_clear_error();
+    switch (error) {
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            errno = EAGAIN;
+            return -1;
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;   // close_notify.
+        case SSL_ERROR_SYSCALL:
+            // Plenty of clients just close the socket; treat that like a TCP close.
+            if (errno == 0) return 0;
+            return -1;
+        default:
+            errno = EPROTO;
+            return -1;
+    }
+}
+
+OutputQueue::FlushResult TlsSession::flush(OutputQueue& out) {
+    if (kernel_send) return out.flush(fd);
+
+    while (true) {
+        if (unsent_length == 0) {
+            if (!unsent) unsent = std::make_unique<char[]>(RECORD_BYTES);
+            size_t taken = 0;
+            OutputQueue::FlushResult result = out.take(unsent.get(), RECORD_BYTES, taken);
+            if (result == OutputQueue::FlushResult::Error) return result;
+            if (taken == 0) {
+                if (result == OutputQueue::FlushResult::Done) unsent.reset();
+                return result;  // Drained, or a stream is waiting for a file read.
+            }
+            unsent_offset = 0;
+            unsent_length = taken;
+        }
+
+        size_t written = 0;
+        if (SSL_write_ex(ssl, unsent.get() + unsent_offset, unsent_length, &written) == 1) {
+            unsent_offset += written;
+            unsent_length -= written;
+            continue;
+        }
+        int error = SSL_get_error(ssl, 0);
+        ERR_clear_error();
+        if (error == SSL_ERROR_WANT_WRITE || error == SSL_ERROR_WANT_READ) {
+            return OutputQueue::FlushResult::WouldBlock;
+        }
+        return OutputQueue::FlushResult::Error;
+    }
+}
+
+void TlsSession::shutdown() {
+    if (!is_established) return;
+    SSL_shutdown(ssl);
+    ERR_clear_error();
+}
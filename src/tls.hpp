@@ -0,0 +1,149 @@
+#pragma once
+
+#include "output-queue.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <openssl/ssl.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+
+/**
+ * @struct TlsOptions
+ * @brief Where the server's certificate and key are; TLS is off unless a certificate is given.
+ */
+struct TlsOptions {
+    std::string cert_path;  // PEM certificate chain, leaf first.
+    std::string key_path;   // PEM private key; empty if it is in cert_path as well.
+};
+
+
+/**
+ * @class TlsContext
+ * @brief The server's TLS configuration, shared by every connection and worker thread.
+ *
+ * Wraps an SSL_CTX holding the certificate, TLS 1.2 as the minimum version, ALPN ("h2" when
+ * HTTP/2 is on, otherwise "http/1.1") and session resumption: a server-side session cache for
+ * TLS 1.2 and session tickets, whose keys the context keeps, for both versions. Kernel TLS is
+ * requested, so after each handshake OpenSSL hands the traffic keys to the socket where the
+ * kernel and cipher allow it (see TlsSession::kernelSend()).
+ */
+class TlsContext {
+private:
+    SSL_CTX* ctx;
+
+public:
+    /**
+     * @brief Loads the certificate and key; exits with a message if either is unusable.
+     * @param offer_http2 Whether ALPN may select "h2".
+     */
+    TlsContext(const TlsOptions& options, bool offer_http2);
+    ~TlsContext();
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    SSL_CTX* get() const { return ctx; }
+};
+
+
+/**
+ * @class TlsSession
+ * @brief The TLS layer of one client connection.
+ *
+ * Works on blocking and non-blocking sockets alike: on the latter, every call that would wait
+ * returns early and is repeated when the socket is ready, as it would be for plain TCP.
+ *
+ * Output is where kernel TLS pays off. When the session's send direction is offloaded, the
+ * kernel encrypts whatever is written to the socket, so flush() hands the OutputQueue the
+ * socket itself: in-memory segments still go out in one sendmsg() and file ranges with
+ * sendfile(2), never entering userspace. Otherwise the queue is drained through SSL_write(),
+ * one record-sized piece at a time.
+ */
+class TlsSession {
+public:
+    enum class Handshake {
+        Done,       // Established; requests can be read.
+        WantRead,   // Call again once the socket is readable.
+        WantWrite,  // Call again once the socket is writable.
+        Failed      // The client is not speaking (acceptable) TLS; close the connection.
+    };
+
+    TlsSession(const TlsContext& context, int fd);
+    ~TlsSession();
+    TlsSession(const TlsSession&) = delete;
+    TlsSession& operator=(const TlsSession&) = delete;
+
+    /**
+     * @brief Advances the server side of the handshake.
+     */
+    Handshake handshake();
+
+    bool established() const { return is_established; }
+
+    /**
+     * @brief Reads decrypted bytes, with recv()'s conventions.
+     * @return Bytes read (> 0), 0 if the peer closed, or -1 with errno set (EAGAIN when it
+     *         would block).
+     */
+    ssize_t receive(char* data, size_t length);
+
+    /**
+     * @brief Whether decrypted bytes are waiting inside OpenSSL, so that the socket may never
+     * become readable for them.
+     */
+    bool hasBuffered() const { return SSL_pending(ssl) > 0; }
+
+    /**
+     * @brief Writes queued output, with OutputQueue::flush()'s conventions.
+     */
+    OutputQueue::FlushResult flush(OutputQueue& out);
+
+    /**
+     * @brief Whether bytes taken from the queue still wait for SSL_write() to accept them.
+     */
+    bool hasUnsent() const { return unsent_length > 0; }
+
+    /**
+     * @brief Whether the kernel encrypts this connection's output (kTLS), so the socket can
+     * be written to directly.
+     */
+    bool kernelSend() const { return kernel_send; }
+
+    /**
+     * @brief Sends close_notify, without waiting for the peer's; for just before close().
+     */
+    void shutdown();
+
+private:
+    // One TLS record's worth of plaintext.
+    static constexpr size_t RECORD_BYTES = 16 * 1024;
+
+    SSL* ssl;
+    int fd;
+    bool is_established = false;
+    bool kernel_send = false;
+
+    // Plaintext taken from the queue that SSL_write() has not accepted yet. It must be
+    // offered again unchanged, so it lives here rather than in the queue; allocated while
+    // there is some.
+    std::unique_ptr<char[]> unsent;
+    size_t unsent_offset = 0;
+    size_t unsent_length = 0;
+};
+
+
+/**
+ * @brief recv() from a client socket, decrypted through 'tls' when there is one.
+ */
+inline ssize_t receiveFrom(int fd, TlsSession* tls, char* data, size_t length) {
+    return tls ? tls->receive(data, length) : recv(fd, data, length, 0);
+}
+
+/**
+ * @brief Flushes a client's output to its socket, through 'tls' when there is one.
+ */
+inline OutputQueue::FlushResult flushTo(int fd, TlsSession* tls, OutputQueue& out) {
+    return tls ? tls->flush(out) : out.flush(fd);
+}
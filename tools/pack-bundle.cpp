@@ -0,0 +1,87 @@
+// Packs a directory into a bundle for the server's --bundle option (see src/bundle.hpp).
+// Built with the server; run ./build/pack-bundle --help for options.
+
+#include "bundle.hpp"
+
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <vector>
+
+
+static void usage() {
+    std::cout << "Usage: pack-bundle [--gzip-min <bytes>] <directory> <bundle>\n"
+                 "\n"
+                 "Packs every regular file below <directory> into <bundle>, named by its path\n"
+                 "relative to the directory. Files of at least --gzip-min bytes (default 1024)\n"
+                 "also get a gzip variant when it is smaller. An existing bundle is replaced\n"
+                 "atomically.\n";
+}
+
+// Reads all 'size' bytes of the file at 'path'.
+static bool readFile(const std::filesystem::path& path, size_t size, std::string& contents) {
+    std::ifstream in(path, std::ios::binary);
+    contents.resize(size);
+    in.read(contents.data(), static_cast<std::streamsize>(size));
+    return in && static_cast<size_t>(in.gcount()) == size;
+}
+
+int main(int argc, char** argv) {
+    size_t gzip_min_bytes = 1024;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            usage();
+            return 0;
+        }
+        if (arg == "--gzip-min") {
+            std::string_view value = i + 1 < argc ? argv[++i] : "";
+            auto [end, error] = std::from_chars(value.data(), value.data() + value.size(),
+                                                gzip_min_bytes);
+            if (error != std::errc() || end != value.data() + value.size() || value.empty()) {
+                std::cerr << "--gzip-min expects a number of bytes, got '" << value << "'\n";
+                return 1;
+            }
+        } else {
+            paths.emplace_back(arg);
+        }
+    }
+    if (paths.size() != 2) {
+        usage();
+        return 1;
+    }
+
+    std::filesystem::path root = paths[0];
+    std::error_code error;
+    std::vector<BundleInput> files;
+    std::filesystem::recursive_directory_iterator it(root, error), end;
+    for (; !error && it != end; it.increment(error)) {
+        // Symbolic links are followed to files, not into directories, so every file has
+        // one name and a link can't loop.
+        if (!it->is_regular_file(error)) continue;
+        BundleInput file;
+        file.name = it->path().lexically_relative(root).generic_string();
+        struct stat st{};
+        if (stat(it->path().c_str(), &st) != 0 ||
+            !readFile(it->path(), st.st_size, file.contents)) {
+            std::cerr << "Cannot read '" << it->path().string() << "'\n";
+            return 1;
+        }
+        file.modified = st.st_mtime;
+        files.push_back(std::move(file));
+    }
+    if (error) {
+        std::cerr << "Cannot list '" << root.string() << "': " << error.message() << "\n";
+        return 1;
+    }
+
+    size_t count = files.size();
+    if (!writeBundle(std::move(files), paths[1], gzip_min_bytes)) return 1;
+    std::cout << "Packed " << count << " files into " << paths[1] << "\n";
+    return 0;
+}